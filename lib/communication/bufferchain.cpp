@@ -0,0 +1,132 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+
+#include "hbk/communication/bufferchain.h"
+
+namespace hbk {
+	namespace communication {
+		BufferChain::BufferChain()
+			: m_slices()
+			, m_size(0)
+		{
+		}
+
+		void BufferChain::append(const BufferSlice& slice)
+		{
+			if (slice.size==0) {
+				return;
+			}
+			m_slices.push_back(slice);
+			m_size += slice.size;
+		}
+
+		void BufferChain::append(BufferChain&& other)
+		{
+			for (auto &iter: other.m_slices) {
+				m_slices.push_back(std::move(iter));
+			}
+			m_size += other.m_size;
+			other.clear();
+		}
+
+		void BufferChain::consume(size_t length)
+		{
+			while ((length>0) && (!m_slices.empty())) {
+				BufferSlice& front = m_slices.front();
+				if (length>=front.size) {
+					length -= front.size;
+					m_size -= front.size;
+					m_slices.pop_front();
+				} else {
+					front.pData += length;
+					front.size -= length;
+					m_size -= length;
+					length = 0;
+				}
+			}
+		}
+
+		BufferChain BufferChain::split(size_t length)
+		{
+			BufferChain result;
+			while ((length>0) && (!m_slices.empty())) {
+				BufferSlice& front = m_slices.front();
+				if (length>=front.size) {
+					length -= front.size;
+					m_size -= front.size;
+					result.append(front);
+					m_slices.pop_front();
+				} else {
+					result.append(front.subSlice(0, length));
+					front.pData += length;
+					front.size -= length;
+					m_size -= length;
+					length = 0;
+				}
+			}
+			return result;
+		}
+
+		size_t BufferChain::copyOut(size_t offset, void* pDestination, size_t length) const
+		{
+			uint8_t* pPos = reinterpret_cast < uint8_t* > (pDestination);
+			size_t copied = 0;
+			for (const auto &iter: m_slices) {
+				if (copied==length) {
+					break;
+				}
+				if (offset>=iter.size) {
+					offset -= iter.size;
+					continue;
+				}
+				size_t available = iter.size - offset;
+				size_t chunk = length - copied;
+				if (chunk>available) {
+					chunk = available;
+				}
+				memcpy(pPos+copied, iter.pData+offset, chunk);
+				copied += chunk;
+				offset = 0;
+			}
+			return copied;
+		}
+
+		uint8_t BufferChain::at(size_t offset) const
+		{
+			for (const auto &iter: m_slices) {
+				if (offset<iter.size) {
+					return iter.pData[offset];
+				}
+				offset -= iter.size;
+			}
+			return 0;
+		}
+
+		void BufferChain::clear()
+		{
+			m_slices.clear();
+			m_size = 0;
+		}
+	}
+}
@@ -0,0 +1,185 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "hbk/communication/bufferpool.h"
+
+/// slabs are multiples of the typical huge page size
+static const size_t HUGE_PAGE_SIZE = 2*1024*1024;
+
+namespace hbk {
+	namespace communication {
+		BufferPool::Storage::~Storage()
+		{
+			for (auto &iter: freeList) {
+				if (!isFromSlab(iter)) {
+					delete [] iter;
+				}
+			}
+#ifndef _WIN32
+			for (auto &iter: slabs) {
+				munmap(iter.pMemory, iter.size);
+			}
+#endif
+		}
+
+		bool BufferPool::Storage::isFromSlab(const uint8_t* pBuffer) const
+		{
+			for (const auto &iter: slabs) {
+				const uint8_t* pStart = reinterpret_cast < const uint8_t* > (iter.pMemory);
+				if ((pBuffer>=pStart) && (pBuffer<pStart+iter.size)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool BufferPool::Storage::mapSlab(Slab& slab) const
+		{
+#ifdef _WIN32
+			(void) slab;
+			return false;
+#else
+			size_t slabSize = ((bufferSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+			void* pMemory = mmap(nullptr, slabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (pMemory==MAP_FAILED) {
+				// no huge pages reserved. Try to get transparent huge pages instead.
+				pMemory = mmap(nullptr, slabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (pMemory==MAP_FAILED) {
+					return false;
+				}
+				madvise(pMemory, slabSize, MADV_HUGEPAGE);
+			}
+			slab.pMemory = pMemory;
+			slab.size = slabSize;
+			return true;
+#endif
+		}
+
+		void BufferPool::Storage::addSlab(const Slab& slab)
+		{
+			slabs.push_back(slab);
+			uint8_t* pPos = reinterpret_cast < uint8_t* > (slab.pMemory);
+			for (size_t offset = 0; offset+bufferSize<=slab.size; offset += bufferSize) {
+				freeList.push_back(pPos+offset);
+			}
+		}
+
+		uint8_t* BufferPool::Storage::acquire()
+		{
+			{
+				std::lock_guard < std::mutex > lock(mtx);
+				if (!freeList.empty()) {
+					uint8_t* pBuffer = freeList.back();
+					freeList.pop_back();
+					return pBuffer;
+				}
+			}
+			if (useSlabs) {
+				// the system calls happen outside of the lock, other threads are not held up meanwhile
+				Slab slab;
+				if (mapSlab(slab)) {
+					std::lock_guard < std::mutex > lock(mtx);
+					addSlab(slab);
+					uint8_t* pBuffer = freeList.back();
+					freeList.pop_back();
+					return pBuffer;
+				}
+				// on failure we fall back to the heap
+			}
+			return new uint8_t[bufferSize];
+		}
+
+		void BufferPool::Storage::release(uint8_t* pBuffer)
+		{
+			if (pBuffer==nullptr) {
+				return;
+			}
+			{
+				std::lock_guard < std::mutex > lock(mtx);
+				if ((useSlabs) || (freeList.size()<maxCachedBuffers)) {
+					// blocks carved from slabs always return to the free list
+					freeList.push_back(pBuffer);
+					return;
+				}
+			}
+			delete [] pBuffer;
+		}
+
+		BufferPool::BufferPool(size_t bufferSize, size_t maxCachedBuffers, bool useHugePages)
+			: m_storage(std::make_shared < Storage > ())
+		{
+			m_storage->bufferSize = bufferSize;
+			m_storage->maxCachedBuffers = maxCachedBuffers;
+#ifdef _WIN32
+			m_storage->useSlabs = false;
+#else
+			m_storage->useSlabs = useHugePages;
+#endif
+		}
+
+		BufferPool::~BufferPool()
+		{
+		}
+
+		BufferPool::Buffer_t BufferPool::get()
+		{
+			std::shared_ptr < Storage > storage = m_storage;
+			return Buffer_t(storage->acquire(), [storage](uint8_t* pBuffer) { storage->release(pBuffer); });
+		}
+
+		uint8_t* BufferPool::acquire()
+		{
+			return m_storage->acquire();
+		}
+
+		void BufferPool::release(uint8_t* pBuffer)
+		{
+			m_storage->release(pBuffer);
+		}
+
+		size_t BufferPool::getBufferSize() const
+		{
+			return m_storage->bufferSize;
+		}
+
+		size_t BufferPool::getCachedCount() const
+		{
+			std::lock_guard < std::mutex > lock(m_storage->mtx);
+			return m_storage->freeList.size();
+		}
+
+		bool BufferPool::usesSlabs() const
+		{
+			return m_storage->useSlabs;
+		}
+
+		BufferPool& BufferPool::defaultPool()
+		{
+			static BufferPool pool;
+			return pool;
+		}
+	}
+}
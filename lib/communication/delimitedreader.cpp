@@ -0,0 +1,231 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "hbk/communication/delimitedreader.h"
+#include "hbk/communication/socketnonblocking.h"
+
+#include "receiveloop.h"
+#include "simd.h"
+
+using Find_t = const uint8_t* (*)(const uint8_t* pPos, const uint8_t* pEnd, uint8_t value);
+
+static const uint8_t* findScalar(const uint8_t* pPos, const uint8_t* pEnd, uint8_t value)
+{
+	for (; pPos<pEnd; ++pPos) {
+		if (*pPos==value) {
+			break;
+		}
+	}
+	return pPos;
+}
+
+#ifdef HBK_SIMD_SSE2
+static const uint8_t* findSse2(const uint8_t* pPos, const uint8_t* pEnd, uint8_t value)
+{
+	const __m128i needle = _mm_set1_epi8(static_cast < char > (value));
+	while (pEnd-pPos>=16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast < const __m128i* > (pPos));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+		if (mask) {
+			return pPos + hbk::communication::simd::countTrailingZeros(static_cast < uint64_t > (mask));
+		}
+		pPos += 16;
+	}
+	return findScalar(pPos, pEnd, value);
+}
+#endif
+
+#ifdef HBK_SIMD_AVX2
+__attribute__((target("avx2")))
+static const uint8_t* findAvx2(const uint8_t* pPos, const uint8_t* pEnd, uint8_t value)
+{
+	const __m256i needle = _mm256_set1_epi8(static_cast < char > (value));
+	while (pEnd-pPos>=32) {
+		__m256i chunk = _mm256_loadu_si256(reinterpret_cast < const __m256i* > (pPos));
+		unsigned mask = static_cast < unsigned > (_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+		if (mask) {
+			return pPos + hbk::communication::simd::countTrailingZeros(mask);
+		}
+		pPos += 32;
+	}
+	return findSse2(pPos, pEnd, value);
+}
+#endif
+
+#ifdef HBK_SIMD_NEON
+static const uint8_t* findNeon(const uint8_t* pPos, const uint8_t* pEnd, uint8_t value)
+{
+	const uint8x16_t needle = vdupq_n_u8(value);
+	while (pEnd-pPos>=16) {
+		uint8x16_t equal = vceqq_u8(vld1q_u8(pPos), needle);
+		// narrow each byte of the comparison result to 4 bits
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+		if (mask) {
+			return pPos + (hbk::communication::simd::countTrailingZeros(mask) >> 2);
+		}
+		pPos += 16;
+	}
+	return findScalar(pPos, pEnd, value);
+}
+#endif
+
+static const hbk::communication::simd::Dispatch < Find_t >& getFind()
+{
+	static const hbk::communication::simd::Dispatch < Find_t > find(findScalar, HBK_SIMD_SSE2_FUNCTION(findSse2), HBK_SIMD_AVX2_FUNCTION(findAvx2), HBK_SIMD_NEON_FUNCTION(findNeon));
+	return find;
+}
+
+namespace hbk {
+	namespace communication {
+		DelimitedReader::DelimitedReader(const std::string& delimiter, RecordCb_t recordCb, size_t maxRecordSize, BufferPool& pool)
+			: m_delimiter(delimiter)
+			, m_recordCb(recordCb)
+			, m_maxRecordSize(maxRecordSize)
+			, m_pool(pool)
+			, m_pending()
+			, m_scanned(0)
+		{
+			if (m_delimiter.empty()) {
+				throw std::invalid_argument("empty delimiter");
+			}
+		}
+
+		size_t DelimitedReader::find(const uint8_t* pData, size_t size, uint8_t value)
+		{
+			return static_cast < size_t > (getFind().get()(pData, pData+size, value) - pData);
+		}
+
+		const char* DelimitedReader::getScannerName()
+		{
+			return getFind().getName();
+		}
+
+		ssize_t DelimitedReader::receive(SocketNonblocking& socket)
+		{
+			bool processFailed;
+			ssize_t result = receiveLoop(socket, m_pool, [this](BufferChain&& data) {
+				return process(std::move(data));
+			}, processFailed);
+			if (processFailed) {
+				errno = EMSGSIZE;
+				return -1;
+			}
+			return result;
+		}
+
+		size_t DelimitedReader::findInPending(size_t offset) const
+		{
+			uint8_t value = static_cast < uint8_t > (m_delimiter.back());
+			Find_t find = getFind().get();
+			size_t sliceStart = 0;
+			for (const auto &iter: m_pending.getSlices()) {
+				if (offset<sliceStart+iter.size) {
+					const uint8_t* pEnd = iter.pData+iter.size;
+					const uint8_t* pMatch = find(iter.pData+(offset-sliceStart), pEnd, value);
+					if (pMatch!=pEnd) {
+						return sliceStart + static_cast < size_t > (pMatch-iter.pData);
+					}
+					offset = sliceStart+iter.size;
+				}
+				sliceStart += iter.size;
+			}
+			return std::string::npos;
+		}
+
+		int DelimitedReader::process(BufferChain&& data)
+		{
+			m_pending.append(std::move(data));
+
+			int recordCount = 0;
+			size_t delimiterSize = m_delimiter.size();
+			while (m_scanned<m_pending.size()) {
+				size_t position = findInPending(m_scanned);
+				if (position==std::string::npos) {
+					m_scanned = m_pending.size();
+					break;
+				}
+				m_scanned = position+1;
+
+				if (delimiterSize>1) {
+					// the last byte matched. Check the preceding ones.
+					if (position+1<delimiterSize) {
+						continue;
+					}
+					bool match = true;
+					size_t delimiterStart = position+1-delimiterSize;
+					for (size_t index = 0; index<delimiterSize-1; ++index) {
+						if (m_pending.at(delimiterStart+index)!=static_cast < uint8_t > (m_delimiter[index])) {
+							match = false;
+							break;
+						}
+					}
+					if (!match) {
+						continue;
+					}
+				}
+
+				size_t recordSize = position+1-delimiterSize;
+				if (recordSize>m_maxRecordSize) {
+					return -1;
+				}
+				const BufferSlice& front = m_pending.getSlices().front();
+				if (front.size>=recordSize) {
+					// contiguous, no need to copy
+					BufferSlice record = front.subSlice(0, recordSize);
+					m_pending.consume(position+1);
+					m_scanned = 0;
+					m_recordCb(record);
+				} else {
+					// spread over several blocks
+					std::shared_ptr < uint8_t > buffer;
+					if (recordSize<=m_pool.getBufferSize()) {
+						buffer = m_pool.get();
+					} else {
+						buffer = std::shared_ptr < uint8_t > (new uint8_t[recordSize], std::default_delete < uint8_t[] > ());
+					}
+					m_pending.copyOut(0, buffer.get(), recordSize);
+					m_pending.consume(position+1);
+					m_scanned = 0;
+					m_recordCb(BufferSlice(buffer, buffer.get(), recordSize));
+				}
+				++recordCount;
+			}
+
+			if (m_pending.size()>m_maxRecordSize+delimiterSize-1) {
+				// even the delimiter arriving next would not make it a valid record
+				return -1;
+			}
+			return recordCount;
+		}
+
+		void DelimitedReader::reset()
+		{
+			m_pending.clear();
+			m_scanned = 0;
+		}
+	}
+}
@@ -0,0 +1,136 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+
+#include "hbk/communication/framedreader.h"
+#include "hbk/communication/socketnonblocking.h"
+
+#include "receiveloop.h"
+
+namespace hbk {
+	namespace communication {
+		FramedReader::Format::Format()
+			: lengthOffset(0)
+			, lengthSize(4)
+			, bigEndian(true)
+			, headerSize(4)
+			, lengthIncludesHeader(false)
+			, maxFrameSize(16*1024*1024)
+		{
+		}
+
+		FramedReader::FramedReader(const Format& format, FrameCb_t frameCb, BufferPool& pool)
+			: m_format(format)
+			, m_frameCb(frameCb)
+			, m_pool(pool)
+			, m_pending()
+		{
+			switch (m_format.lengthSize) {
+			case 1:
+			case 2:
+			case 4:
+			case 8:
+				break;
+			default:
+				throw std::invalid_argument("length field size has to be 1, 2, 4 or 8 bytes");
+			}
+			if (m_format.headerSize < m_format.lengthOffset+m_format.lengthSize) {
+				throw std::invalid_argument("length field exceeds header");
+			}
+		}
+
+		ssize_t FramedReader::receive(SocketNonblocking& socket)
+		{
+			bool processFailed;
+			ssize_t result = receiveLoop(socket, m_pool, [this](BufferChain&& data) {
+				return process(std::move(data));
+			}, processFailed);
+			if (processFailed) {
+				errno = EMSGSIZE;
+				return -1;
+			}
+			return result;
+		}
+
+		uint64_t FramedReader::readLength() const
+		{
+			uint8_t field[8];
+			m_pending.copyOut(m_format.lengthOffset, field, m_format.lengthSize);
+			uint64_t length = 0;
+			for (size_t index = 0; index<m_format.lengthSize; ++index) {
+				size_t position = m_format.bigEndian ? index : m_format.lengthSize-1-index;
+				length = (length << 8) | field[position];
+			}
+			return length;
+		}
+
+		int FramedReader::process(BufferChain&& data)
+		{
+			m_pending.append(std::move(data));
+
+			int frameCount = 0;
+			while (m_pending.size()>=m_format.headerSize) {
+				uint64_t length = readLength();
+				if (!m_format.lengthIncludesHeader) {
+					length += m_format.headerSize;
+				}
+				if ((length<m_format.headerSize) || (length>m_format.maxFrameSize)) {
+					return -1;
+				}
+				size_t frameSize = static_cast < size_t > (length);
+				if (m_pending.size()<frameSize) {
+					// wait for the rest
+					break;
+				}
+
+				const BufferSlice& front = m_pending.getSlices().front();
+				if (front.size>=frameSize) {
+					// contiguous, no need to copy
+					BufferSlice frame = front.subSlice(0, frameSize);
+					m_pending.consume(frameSize);
+					m_frameCb(frame);
+				} else {
+					// spread over several blocks
+					std::shared_ptr < uint8_t > buffer;
+					if (frameSize<=m_pool.getBufferSize()) {
+						buffer = m_pool.get();
+					} else {
+						buffer = std::shared_ptr < uint8_t > (new uint8_t[frameSize], std::default_delete < uint8_t[] > ());
+					}
+					m_pending.copyOut(0, buffer.get(), frameSize);
+					m_pending.consume(frameSize);
+					m_frameCb(BufferSlice(buffer, buffer.get(), frameSize));
+				}
+				++frameCount;
+			}
+			return frameCount;
+		}
+
+		void FramedReader::reset()
+		{
+			m_pending.clear();
+		}
+	}
+}
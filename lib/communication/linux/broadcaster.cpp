@@ -0,0 +1,159 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "hbk/communication/broadcaster.h"
+
+namespace hbk {
+	namespace communication {
+		Broadcaster::Broadcaster(slowPolicy_t policy, size_t maxQueuedBytes, DropCb_t dropCb)
+			: m_mtx()
+			, m_subscribers()
+			, m_removeCount(0)
+			, m_policy(policy)
+			, m_maxQueuedBytes(maxQueuedBytes)
+			, m_dropCb(dropCb)
+			, m_skippedCount(0)
+			, m_droppedCount(0)
+		{
+		}
+
+		int Broadcaster::add(SocketNonblocking& socket)
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_mtx);
+			if (isSubscribed(&socket)) {
+				return -1;
+			}
+			m_subscribers.push_back(&socket);
+			return 0;
+		}
+
+		int Broadcaster::remove(SocketNonblocking& socket)
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_mtx);
+			auto iter = std::find(m_subscribers.begin(), m_subscribers.end(), &socket);
+			if (iter==m_subscribers.end()) {
+				return -1;
+			}
+			m_subscribers.erase(iter);
+			++m_removeCount;
+			return 0;
+		}
+
+		ssize_t Broadcaster::broadcast(const BufferSlice& slice)
+		{
+			if (!slice.buffer) {
+				return -1;
+			}
+
+			std::vector < SocketNonblocking* > dropped;
+			ssize_t enqueuedCount = 0;
+			{
+				std::lock_guard < std::recursive_mutex > lock(m_mtx);
+				// watermark callbacks might remove subscribers
+				std::vector < SocketNonblocking* > subscribers(m_subscribers);
+				uint64_t removeCount = m_removeCount;
+				for (auto &iter: subscribers) {
+					if ((m_removeCount!=removeCount) && (!isSubscribed(iter))) {
+						continue;
+					}
+					if (isSlow(*iter)) {
+						if (m_policy==DROP) {
+							dropped.push_back(iter);
+						} else {
+							++m_skippedCount;
+						}
+						continue;
+					}
+					// all queues reference the same memory block
+					if (iter->sendAsync(slice)==0) {
+						++enqueuedCount;
+					} else {
+						++m_skippedCount;
+					}
+				}
+
+				for (auto iter = dropped.begin(); iter!=dropped.end();) {
+					auto subscriberIter = std::find(m_subscribers.begin(), m_subscribers.end(), *iter);
+					if (subscriberIter==m_subscribers.end()) {
+						// removed by a watermark callback meanwhile
+						iter = dropped.erase(iter);
+						continue;
+					}
+					m_subscribers.erase(subscriberIter);
+					++m_removeCount;
+					++m_droppedCount;
+					++iter;
+				}
+			}
+
+			if (m_dropCb) {
+				for (auto &iter: dropped) {
+					m_dropCb(*iter);
+				}
+			}
+			return enqueuedCount;
+		}
+
+		ssize_t Broadcaster::broadcast(const void* pData, size_t size)
+		{
+			std::shared_ptr < uint8_t > buffer(new uint8_t[size], std::default_delete < uint8_t[] > ());
+			memcpy(buffer.get(), pData, size);
+			return broadcast(BufferSlice(buffer, buffer.get(), size));
+		}
+
+		size_t Broadcaster::getSubscriberCount() const
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_mtx);
+			return m_subscribers.size();
+		}
+
+		uint64_t Broadcaster::getSkippedCount() const
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_mtx);
+			return m_skippedCount;
+		}
+
+		uint64_t Broadcaster::getDroppedCount() const
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_mtx);
+			return m_droppedCount;
+		}
+
+		bool Broadcaster::isSlow(const SocketNonblocking& socket) const
+		{
+			if (socket.isAboveHighWatermark()) {
+				return true;
+			}
+			return (m_maxQueuedBytes>0) && (socket.getQueuedBytes()>=m_maxQueuedBytes);
+		}
+
+		bool Broadcaster::isSubscribed(const SocketNonblocking* pSocket) const
+		{
+			return std::find(m_subscribers.begin(), m_subscribers.end(), pSocket)!=m_subscribers.end();
+		}
+	}
+}
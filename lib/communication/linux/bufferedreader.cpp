@@ -20,23 +20,112 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <climits>
 #include <cstring>
 #include <stdint.h>
+#include <vector>
 
 #include <sys/socket.h>
 #include <sys/uio.h>
 
 
 #include "hbk/communication/bufferedreader.h"
+#include "hbk/communication/socketnonblocking.h"
 
 namespace hbk {
 	namespace communication {
-		BufferedReader::BufferedReader()
-			: m_fillLevel(0)
+		BufferedReader::BufferedReader(BufferPool& pool)
+			: m_pPool(&pool)
+			, m_pBufferOwner(nullptr)
+			, m_pBuffer(nullptr)
+			, m_bufferSize(0)
+			, m_fillLevel(0)
 			, m_alreadyRead(0)
+			, m_chainBuffer()
+			, m_chainBufferSize(0)
+			, m_chainBufferOffset(0)
 		{
 		}
 
+		BufferedReader::BufferedReader(BufferedReader&& op)
+			: m_pPool(op.m_pPool)
+			, m_pBufferOwner(op.m_pBufferOwner)
+			, m_pBuffer(op.m_pBuffer)
+			, m_bufferSize(op.m_bufferSize)
+			, m_fillLevel(op.m_fillLevel)
+			, m_alreadyRead(op.m_alreadyRead)
+			, m_chainBuffer(std::move(op.m_chainBuffer))
+			, m_chainBufferSize(op.m_chainBufferSize)
+			, m_chainBufferOffset(op.m_chainBufferOffset)
+		{
+			op.m_pBufferOwner = nullptr;
+			op.m_pBuffer = nullptr;
+			op.m_fillLevel = 0;
+			op.m_alreadyRead = 0;
+		}
+
+		BufferedReader& BufferedReader::operator=(BufferedReader&& op)
+		{
+			if (this==&op) {
+				return *this;
+			}
+			if (m_pBuffer) {
+				m_pBufferOwner->release(m_pBuffer);
+			}
+			m_pPool = op.m_pPool;
+			m_pBufferOwner = op.m_pBufferOwner;
+			m_pBuffer = op.m_pBuffer;
+			m_bufferSize = op.m_bufferSize;
+			m_fillLevel = op.m_fillLevel;
+			m_alreadyRead = op.m_alreadyRead;
+			m_chainBuffer = std::move(op.m_chainBuffer);
+			m_chainBufferSize = op.m_chainBufferSize;
+			m_chainBufferOffset = op.m_chainBufferOffset;
+
+			op.m_pBufferOwner = nullptr;
+			op.m_pBuffer = nullptr;
+			op.m_fillLevel = 0;
+			op.m_alreadyRead = 0;
+			return *this;
+		}
+
+		BufferedReader::~BufferedReader()
+		{
+			if (m_pBuffer) {
+				m_pBufferOwner->release(m_pBuffer);
+			}
+		}
+
+		void BufferedReader::setBufferPool(BufferPool& pool)
+		{
+			m_pPool = &pool;
+			// the current chain block stays with the slices referencing it. The next one comes from the new pool.
+			m_chainBuffer.reset();
+			m_chainBufferSize = 0;
+			m_chainBufferOffset = 0;
+		}
+
+		void BufferedReader::acquireBuffer()
+		{
+			if (m_pBuffer==nullptr) {
+				m_pBuffer = m_pPool->acquire();
+				m_bufferSize = m_pPool->getBufferSize();
+				m_pBufferOwner = m_pPool;
+			}
+		}
+
+		void BufferedReader::releaseBufferIfDrained()
+		{
+			if ((m_pBuffer) && (m_alreadyRead==m_fillLevel)) {
+				m_pBufferOwner->release(m_pBuffer);
+				m_pBuffer = nullptr;
+				m_pBufferOwner = nullptr;
+				m_bufferSize = 0;
+				m_fillLevel = 0;
+				m_alreadyRead = 0;
+			}
+		}
+
 		ssize_t BufferedReader::recv(hbk::sys::event& sockfd, void *buf, size_t desiredLen)
 		{
 			// check whether there is something left
@@ -44,32 +133,181 @@ namespace hbk {
 
 			if(bytesLeft>=desiredLen) {
 				// there is more than or as much as desired
-				memcpy(buf, m_buffer.data() + m_alreadyRead, desiredLen);
+				memcpy(buf, m_pBuffer + m_alreadyRead, desiredLen);
 				m_alreadyRead += desiredLen;
+				// the buffer is kept for the next read of this receive burst
 				return static_cast < ssize_t > (desiredLen);
 			} else if(bytesLeft>0) {
 				// use what reamins from the last read which is less than desired and read the reamining amount of data
-				memcpy(buf, m_buffer.data() + m_alreadyRead, bytesLeft);
+				memcpy(buf, m_pBuffer + m_alreadyRead, bytesLeft);
 			}
 
 			// try to read as much as possible into the provided buffer. In addition we fill our internal buffer if there is already more to read.
 			// readv saves us from reading into the internal buffer first and copying into the provided buffer afterwards.
+			acquireBuffer();
 			struct iovec iov[2];
 			iov[0].iov_base = reinterpret_cast<uint8_t*>(buf) + bytesLeft;
 			iov[0].iov_len = desiredLen - bytesLeft;
-			iov[1].iov_base = m_buffer.data();
-			iov[1].iov_len = m_buffer.size();
+			iov[1].iov_base = m_pBuffer;
+			iov[1].iov_len = m_bufferSize;
 
 			ssize_t retVal = ::readv(sockfd, iov, 2);
 			m_alreadyRead = 0;
+			m_fillLevel = 0;
 
-			if (retVal>static_cast < ssize_t > (desiredLen)) {
+			if (retVal>static_cast < ssize_t > (iov[0].iov_len)) {
 				// readv returns the total number of bytes read
-				m_fillLevel = static_cast < size_t > (retVal)-desiredLen;
+				m_fillLevel = static_cast < size_t > (retVal)-iov[0].iov_len;
 				return static_cast < ssize_t > (desiredLen);
 			}
+			if (retVal<=0) {
+				// nothing more to read, the receive burst is over
+				releaseBufferIfDrained();
+				if (bytesLeft>0) {
+					// deliver what remained. Error or closed connection is to be reported by the next call.
+					return static_cast < ssize_t > (bytesLeft);
+				}
+				return retVal;
+			}
+			return static_cast < ssize_t > (bytesLeft) + retVal;
+		}
+
+		ssize_t BufferedReader::recv(hbk::sys::event& sockfd, const dataBlock_t* blocks, size_t blockCount)
+		{
+			size_t blockIndex = 0;
+			size_t blockOffset = 0;
+			size_t delivered = 0;
+
+			// deliver what remained first
+			while ((blockIndex<blockCount) && (m_alreadyRead<m_fillLevel)) {
+				size_t chunk = blocks[blockIndex].size - blockOffset;
+				size_t bytesLeft = m_fillLevel - m_alreadyRead;
+				if (chunk>bytesLeft) {
+					chunk = bytesLeft;
+				}
+				memcpy(reinterpret_cast < uint8_t* > (const_cast < void* > (blocks[blockIndex].pData)) + blockOffset, m_pBuffer + m_alreadyRead, chunk);
+				m_alreadyRead += chunk;
+				delivered += chunk;
+				blockOffset += chunk;
+				if (blockOffset==blocks[blockIndex].size) {
+					++blockIndex;
+					blockOffset = 0;
+				}
+			}
+			if (blockIndex==blockCount) {
+				return static_cast < ssize_t > (delivered);
+			}
+
+			// read the rest directly into the blocks. In addition we fill our internal buffer if there is already more to read.
+			size_t iovCount = blockCount-blockIndex;
+			if (iovCount>IOV_MAX-1) {
+				// results in a short read
+				iovCount = IOV_MAX-1;
+			}
+			std::vector < struct iovec > iov(iovCount+1);
+			size_t desiredLen = 0;
+			for (size_t index = 0; index<iovCount; ++index) {
+				const dataBlock_t& block = blocks[blockIndex+index];
+				iov[index].iov_base = reinterpret_cast < uint8_t* > (const_cast < void* > (block.pData)) + blockOffset;
+				iov[index].iov_len = block.size - blockOffset;
+				desiredLen += iov[index].iov_len;
+				blockOffset = 0;
+			}
+			if (desiredLen==0) {
+				return static_cast < ssize_t > (delivered);
+			}
+			acquireBuffer();
+			iov[iovCount].iov_base = m_pBuffer;
+			iov[iovCount].iov_len = m_bufferSize;
+
+			ssize_t retVal = ::readv(sockfd, iov.data(), static_cast < int > (iov.size()));
+			m_alreadyRead = 0;
 			m_fillLevel = 0;
+			if (retVal>static_cast < ssize_t > (desiredLen)) {
+				m_fillLevel = static_cast < size_t > (retVal)-desiredLen;
+				return static_cast < ssize_t > (delivered+desiredLen);
+			}
+			if (retVal<=0) {
+				releaseBufferIfDrained();
+				if (delivered>0) {
+					// deliver what remained. Error or closed connection is to be reported by the next call.
+					return static_cast < ssize_t > (delivered);
+				}
+				return retVal;
+			}
+			return static_cast < ssize_t > (delivered) + retVal;
+		}
+
+		ssize_t BufferedReader::recv(hbk::sys::event& sockfd, BufferChain& chain)
+		{
+			size_t bytesLeft = m_fillLevel - m_alreadyRead;
+			if (bytesLeft>0) {
+				// deliver what remained from recv(ev, buf, len) first
+				size_t bytesDelivered = 0;
+				while (bytesLeft>0) {
+					BufferPool::Buffer_t buffer = m_pPool->get();
+					size_t chunk = m_pPool->getBufferSize();
+					if (chunk>bytesLeft) {
+						chunk = bytesLeft;
+					}
+					memcpy(buffer.get(), m_pBuffer + m_alreadyRead, chunk);
+					chain.append(BufferSlice(buffer, buffer.get(), chunk));
+					m_alreadyRead += chunk;
+					bytesLeft -= chunk;
+					bytesDelivered += chunk;
+				}
+				return static_cast < ssize_t > (bytesDelivered);
+			}
+
+			if ((m_chainBuffer) && (m_chainBuffer.use_count()==1)) {
+				// all slices referencing this block are gone. We may start from the beginning.
+				m_chainBufferOffset = 0;
+			}
+
+			// the remaining space of the current block is used as long as it is at least 1/8 of the block size
+			if ((!m_chainBuffer) || ((m_chainBufferSize - m_chainBufferOffset) < (m_chainBufferSize/8)) || (m_chainBufferSize==m_chainBufferOffset)) {
+				m_chainBuffer = m_pPool->get();
+				m_chainBufferSize = m_pPool->getBufferSize();
+				m_chainBufferOffset = 0;
+			}
+
+			uint8_t* pPos = m_chainBuffer.get() + m_chainBufferOffset;
+			ssize_t retVal = ::recv(sockfd, pPos, m_chainBufferSize - m_chainBufferOffset, 0);
+			if (retVal>0) {
+				chain.append(BufferSlice(m_chainBuffer, pPos, static_cast < size_t > (retVal)));
+				m_chainBufferOffset += static_cast < size_t > (retVal);
+			} else {
+				// drained by recv(ev, buf, len) before
+				releaseBufferIfDrained();
+				if (m_chainBuffer.use_count()==1) {
+					// no slice references the block anymore. Idle sockets do not occupy a block.
+					m_chainBuffer.reset();
+					m_chainBufferSize = 0;
+					m_chainBufferOffset = 0;
+				}
+			}
 			return retVal;
 		}
+
+		int BufferedReader::preload(const void* pData, size_t size)
+		{
+			if (size==0) {
+				return 0;
+			}
+			acquireBuffer();
+			if (m_alreadyRead>0) {
+				// make room at the end
+				memmove(m_pBuffer, m_pBuffer + m_alreadyRead, m_fillLevel - m_alreadyRead);
+				m_fillLevel -= m_alreadyRead;
+				m_alreadyRead = 0;
+			}
+			if (m_fillLevel+size>m_bufferSize) {
+				releaseBufferIfDrained();
+				return -1;
+			}
+			memcpy(m_pBuffer + m_fillLevel, pData, size);
+			m_fillLevel += size;
+			return 0;
+		}
 	}
 }
@@ -0,0 +1,225 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+
+#include <sys/socket.h>
+
+#include "hbk/communication/connectionpool.h"
+
+namespace hbk {
+	namespace communication {
+		ConnectionPool::ConnectionPool(sys::EventLoop& eventLoop, size_t maxPerEndpoint, std::chrono::milliseconds idleTimeout, const SocketOptions& options)
+			: m_eventLoop(eventLoop)
+			, m_maxPerEndpoint(maxPerEndpoint)
+			, m_idleTimeout(idleTimeout)
+			, m_options(options)
+			, m_mtx()
+			, m_endpoints()
+			, m_checkedOut()
+			, m_connectCount(0)
+			, m_reuseCount(0)
+			, m_evictedCount(0)
+			, m_evictionTimer(eventLoop)
+		{
+			// idle connections live between idleTimeout and 1.5 times idleTimeout
+			std::chrono::milliseconds period = idleTimeout/2;
+			if (period.count()==0) {
+				period = std::chrono::milliseconds(1);
+			}
+			m_evictionTimer.set(period, true, [this](bool fired) {
+				if (fired) {
+					evictIdle();
+				}
+			});
+		}
+
+		ConnectionPool::~ConnectionPool()
+		{
+			m_evictionTimer.cancel();
+			clear();
+		}
+
+		clientSocket_t ConnectionPool::checkout(const std::string& address, const std::string& port)
+		{
+			return checkout(address + ":" + port, [address, port](SocketNonblocking& socket) {
+				return socket.connect(address, port);
+			});
+		}
+
+		clientSocket_t ConnectionPool::checkout(const std::string& path, bool useAbstractNamespace)
+		{
+			std::string key = useAbstractNamespace ? "unix:@" + path : "unix:" + path;
+			return checkout(key, [path, useAbstractNamespace](SocketNonblocking& socket) {
+				return socket.connect(path, useAbstractNamespace);
+			});
+		}
+
+		clientSocket_t ConnectionPool::checkout(const std::string& key, ConnectCb_t connectCb)
+		{
+			std::vector < clientSocket_t > dead;
+			{
+				std::lock_guard < std::mutex > lock(m_mtx);
+				Endpoint& endpoint = m_endpoints[key];
+				while (!endpoint.idle.empty()) {
+					clientSocket_t socket = std::move(endpoint.idle.back().socket);
+					endpoint.idle.pop_back();
+					if (isAlive(*socket)) {
+						++endpoint.checkedOutCount;
+						++m_reuseCount;
+						m_checkedOut[socket.get()] = key;
+						return socket;
+					}
+					++m_evictedCount;
+					// closed outside of the lock
+					dead.push_back(std::move(socket));
+				}
+				if (endpoint.checkedOutCount>=m_maxPerEndpoint) {
+					errno = EBUSY;
+					return clientSocket_t();
+				}
+				// reserve the slot while connecting without the lock
+				++endpoint.checkedOutCount;
+			}
+			dead.clear();
+
+			clientSocket_t socket(new SocketNonblocking(m_eventLoop, m_options));
+			int result = connectCb(*socket);
+
+			std::lock_guard < std::mutex > lock(m_mtx);
+			if (result<0) {
+				--m_endpoints[key].checkedOutCount;
+				return clientSocket_t();
+			}
+			++m_connectCount;
+			m_checkedOut[socket.get()] = key;
+			return socket;
+		}
+
+		int ConnectionPool::checkin(clientSocket_t socket, bool reusable)
+		{
+			if (!socket) {
+				return -1;
+			}
+			std::lock_guard < std::mutex > lock(m_mtx);
+			auto iter = m_checkedOut.find(socket.get());
+			if (iter==m_checkedOut.end()) {
+				// not ours
+				return -1;
+			}
+			Endpoint& endpoint = m_endpoints[iter->second];
+			m_checkedOut.erase(iter);
+			--endpoint.checkedOutCount;
+
+			socket->clearDataCb();
+			socket->clearOutDataCb();
+			socket->flush();
+			if ((!reusable) || (socket->getEvent()==-1) || (socket->getQueuedBytes()>0)) {
+				return -1;
+			}
+			IdleConnection connection;
+			connection.socket = std::move(socket);
+			connection.lastUsed = std::chrono::steady_clock::now();
+			endpoint.idle.push_back(std::move(connection));
+			return 0;
+		}
+
+		void ConnectionPool::clear()
+		{
+			std::vector < clientSocket_t > closed;
+			{
+				std::lock_guard < std::mutex > lock(m_mtx);
+				for (auto &iter: m_endpoints) {
+					for (auto &idleIter: iter.second.idle) {
+						closed.push_back(std::move(idleIter.socket));
+					}
+					iter.second.idle.clear();
+				}
+			}
+		}
+
+		size_t ConnectionPool::getIdleCount() const
+		{
+			std::lock_guard < std::mutex > lock(m_mtx);
+			size_t count = 0;
+			for (const auto &iter: m_endpoints) {
+				count += iter.second.idle.size();
+			}
+			return count;
+		}
+
+		uint64_t ConnectionPool::getConnectCount() const
+		{
+			std::lock_guard < std::mutex > lock(m_mtx);
+			return m_connectCount;
+		}
+
+		uint64_t ConnectionPool::getReuseCount() const
+		{
+			std::lock_guard < std::mutex > lock(m_mtx);
+			return m_reuseCount;
+		}
+
+		uint64_t ConnectionPool::getEvictedCount() const
+		{
+			std::lock_guard < std::mutex > lock(m_mtx);
+			return m_evictedCount;
+		}
+
+		bool ConnectionPool::isAlive(const SocketNonblocking& socket)
+		{
+			char value;
+			ssize_t result = ::recv(socket.getEvent(), &value, sizeof(value), MSG_PEEK | MSG_DONTWAIT);
+			if (result==-1) {
+				return (errno==EAGAIN) || (errno==EWOULDBLOCK);
+			}
+			// 0: closed by the peer; >0: a late response or a goodbye message from the peer
+			return false;
+		}
+
+		void ConnectionPool::evictIdle()
+		{
+			std::vector < clientSocket_t > closed;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			{
+				std::lock_guard < std::mutex > lock(m_mtx);
+				for (auto iter = m_endpoints.begin(); iter!=m_endpoints.end(); ) {
+					std::vector < IdleConnection >& idle = iter->second.idle;
+					for (auto idleIter = idle.begin(); idleIter!=idle.end(); ) {
+						if ((now-idleIter->lastUsed>=m_idleTimeout) || (!isAlive(*idleIter->socket))) {
+							closed.push_back(std::move(idleIter->socket));
+							idleIter = idle.erase(idleIter);
+							++m_evictedCount;
+						} else {
+							++idleIter;
+						}
+					}
+					if ((idle.empty()) && (iter->second.checkedOutCount==0)) {
+						iter = m_endpoints.erase(iter);
+					} else {
+						++iter;
+					}
+				}
+			}
+		}
+	}
+}
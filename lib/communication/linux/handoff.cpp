@@ -0,0 +1,397 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "hbk/communication/handoff.h"
+
+/// "HBKH"
+static const uint32_t MAGIC = 0x484b4248;
+
+enum itemType_t {
+	ITEM_SERVER = 1,
+	ITEM_CONNECTION = 2,
+	ITEM_END = 3
+};
+
+/// precedes each item. The file descriptor travels with it.
+struct ItemHeader {
+	uint32_t magic;
+	uint32_t type;
+	uint32_t tag;
+	uint32_t unreadSize;
+	uint64_t unsentSize;
+};
+
+/// Upper limit for the unread and unsent data of one item. Anything larger is rejected instead of being allocated.
+static const uint64_t MAX_ITEM_DATA_SIZE = 64*1024*1024;
+
+/// \param events POLLIN or POLLOUT
+/// \param msTimeout -1 for infinite
+/// \return 0 timeout; >0 ready; -1 error
+static int waitFor(int fd, short events, int msTimeout = -1)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = events;
+	int result;
+	do {
+		result = poll(&pfd, 1, msTimeout);
+	} while ((result==-1) && (errno==EINTR));
+	if (result==0) {
+		errno = ETIMEDOUT;
+	}
+	return result;
+}
+
+/// works for blocking and non-blocking sockets
+static int sendAll(int fd, const void* pData, size_t size)
+{
+	const uint8_t* pPos = reinterpret_cast < const uint8_t* > (pData);
+	while (size>0) {
+		ssize_t result = ::send(fd, pPos, size, MSG_NOSIGNAL);
+		if (result<0) {
+			if ((errno==EAGAIN) || (errno==EWOULDBLOCK)) {
+				waitFor(fd, POLLOUT);
+				continue;
+			} else if (errno==EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		pPos += result;
+		size -= static_cast < size_t > (result);
+	}
+	return 0;
+}
+
+/// works for blocking and non-blocking sockets
+/// \param msTimeout Maximum time to wait for more data. -1 for infinite
+static int receiveAll(int fd, void* pData, size_t size, int msTimeout)
+{
+	uint8_t* pPos = reinterpret_cast < uint8_t* > (pData);
+	while (size>0) {
+		// wait first, a blocking socket would not return before data arrives
+		if (waitFor(fd, POLLIN, msTimeout)<=0) {
+			return -1;
+		}
+		ssize_t result = ::recv(fd, pPos, size, 0);
+		if (result<0) {
+			if ((errno==EAGAIN) || (errno==EWOULDBLOCK) || (errno==EINTR)) {
+				continue;
+			}
+			return -1;
+		} else if (result==0) {
+			// closed before the item was complete
+			return -1;
+		}
+		pPos += result;
+		size -= static_cast < size_t > (result);
+	}
+	return 0;
+}
+
+/// Consume data that is not needed
+/// \param msTimeout Maximum time to wait for more data. -1 for infinite
+static int discardAll(int fd, uint64_t size, int msTimeout)
+{
+	uint8_t buffer[4096];
+	while (size>0) {
+		size_t chunk = sizeof(buffer);
+		if (chunk>size) {
+			chunk = static_cast < size_t > (size);
+		}
+		if (receiveAll(fd, buffer, chunk, msTimeout)<0) {
+			return -1;
+		}
+		size -= chunk;
+	}
+	return 0;
+}
+
+/// Receive the header of the next item together with the file descriptor
+/// \param receivedFd -1 if the item has no file descriptor
+/// \param msTimeout Maximum time to wait for data. -1 for infinite
+static int receiveHeader(int fd, ItemHeader& header, int& receivedFd, int msTimeout)
+{
+	receivedFd = -1;
+	union {
+		char buffer[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+
+	struct iovec iov;
+	iov.iov_base = &header;
+	iov.iov_len = sizeof(header);
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+
+	ssize_t result;
+	do {
+		// wait first, a blocking socket would not return before data arrives
+		if (waitFor(fd, POLLIN, msTimeout)<=0) {
+			return -1;
+		}
+		result = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	} while ((result<0) && ((errno==EINTR) || (errno==EAGAIN) || (errno==EWOULDBLOCK)));
+	if (result<=0) {
+		return -1;
+	}
+
+	// the file descriptor arrives with the first byte of the item
+	for (struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg); pCmsg!=nullptr; pCmsg = CMSG_NXTHDR(&msg, pCmsg)) {
+		if ((pCmsg->cmsg_level==SOL_SOCKET) && (pCmsg->cmsg_type==SCM_RIGHTS)) {
+			memcpy(&receivedFd, CMSG_DATA(pCmsg), sizeof(receivedFd));
+		}
+	}
+
+	if (static_cast < size_t > (result)<sizeof(header)) {
+		// stream socket: the rest of the header follows
+		if (receiveAll(fd, reinterpret_cast < uint8_t* > (&header) + result, sizeof(header) - static_cast < size_t > (result), msTimeout)<0) {
+			if (receivedFd!=-1) {
+				::close(receivedFd);
+				receivedFd = -1;
+			}
+			return -1;
+		}
+	}
+	if (header.magic!=MAGIC) {
+		if (receivedFd!=-1) {
+			::close(receivedFd);
+			receivedFd = -1;
+		}
+		return -1;
+	}
+	if ((header.unreadSize>MAX_ITEM_DATA_SIZE) || (header.unsentSize>MAX_ITEM_DATA_SIZE)) {
+		syslog(LOG_ERR, "handoff: Item data too large (unread %u, unsent %llu)", header.unreadSize, static_cast < unsigned long long > (header.unsentSize));
+		if (receivedFd!=-1) {
+			::close(receivedFd);
+			receivedFd = -1;
+		}
+		return -1;
+	}
+	return 0;
+}
+
+namespace hbk {
+	namespace communication {
+		Handoff::Handoff(int fd)
+			: m_fd(fd)
+		{
+		}
+
+		int Handoff::sendServer(TcpServer& server, uint32_t tag)
+		{
+			int fd = server.release();
+			if (fd==-1) {
+				return -1;
+			}
+			int result = sendItem(ITEM_SERVER, tag, fd, std::vector < uint8_t > (), BufferChain());
+			// the other process has its own reference now
+			::close(fd);
+			return result;
+		}
+
+		int Handoff::sendConnection(SocketNonblocking& socket, uint32_t tag)
+		{
+			std::vector < uint8_t > unreadData;
+			BufferChain unsentData;
+			int fd = socket.release(unreadData, unsentData);
+			if (fd==-1) {
+				return -1;
+			}
+			int result = sendItem(ITEM_CONNECTION, tag, fd, unreadData, unsentData);
+			::close(fd);
+			return result;
+		}
+
+		int Handoff::sendEnd()
+		{
+			return sendItem(ITEM_END, 0, -1, std::vector < uint8_t > (), BufferChain());
+		}
+
+		int Handoff::sendItem(uint32_t type, uint32_t tag, int fd, const std::vector < uint8_t >& unreadData, const BufferChain& unsentData)
+		{
+			if ((unreadData.size()>MAX_ITEM_DATA_SIZE) || (unsentData.size()>MAX_ITEM_DATA_SIZE)) {
+				syslog(LOG_ERR, "handoff: Item data too large to be handed over");
+				return -1;
+			}
+			ItemHeader header;
+			header.magic = MAGIC;
+			header.type = type;
+			header.tag = tag;
+			header.unreadSize = static_cast < uint32_t > (unreadData.size());
+			header.unsentSize = unsentData.size();
+
+			union {
+				char buffer[CMSG_SPACE(sizeof(int))];
+				struct cmsghdr align;
+			} control;
+			memset(&control, 0, sizeof(control));
+
+			struct iovec iov;
+			iov.iov_base = &header;
+			iov.iov_len = sizeof(header);
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			if (fd!=-1) {
+				msg.msg_control = control.buffer;
+				msg.msg_controllen = sizeof(control.buffer);
+				struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+				pCmsg->cmsg_level = SOL_SOCKET;
+				pCmsg->cmsg_type = SCM_RIGHTS;
+				pCmsg->cmsg_len = CMSG_LEN(sizeof(int));
+				memcpy(CMSG_DATA(pCmsg), &fd, sizeof(fd));
+			}
+
+			ssize_t result;
+			do {
+				result = ::sendmsg(m_fd, &msg, MSG_NOSIGNAL);
+				if ((result<0) && ((errno==EAGAIN) || (errno==EWOULDBLOCK))) {
+					waitFor(m_fd, POLLOUT);
+					errno = EINTR;
+				}
+			} while ((result<0) && (errno==EINTR));
+			if (result<0) {
+				syslog(LOG_ERR, "handoff: Sending item failed '%s'", strerror(errno));
+				return -1;
+			}
+			// the file descriptor went with the first byte
+			if (sendAll(m_fd, reinterpret_cast < uint8_t* > (&header) + result, sizeof(header) - static_cast < size_t > (result))<0) {
+				return -1;
+			}
+			if (sendAll(m_fd, unreadData.data(), unreadData.size())<0) {
+				return -1;
+			}
+			for (const auto &iter: unsentData.getSlices()) {
+				if (sendAll(m_fd, iter.pData, iter.size)<0) {
+					return -1;
+				}
+			}
+			return 0;
+		}
+
+		int Handoff::receive(sys::EventLoop& eventLoop, ServerCb_t serverCb, ConnectionCb_t connectionCb, const SocketOptions& options, int msTimeout)
+		{
+			int count = 0;
+			do {
+				ItemHeader header;
+				int fd;
+				if (receiveHeader(m_fd, header, fd, msTimeout)<0) {
+					syslog(LOG_ERR, "handoff: Receiving item failed");
+					return -1;
+				}
+				std::vector < uint8_t > unreadData;
+				std::vector < uint8_t > unsentData;
+				int result;
+				try {
+					unreadData.resize(header.unreadSize);
+					unsentData.resize(header.unsentSize);
+					result = receiveAll(m_fd, unreadData.data(), unreadData.size(), msTimeout);
+					if (result==0) {
+						result = receiveAll(m_fd, unsentData.data(), unsentData.size(), msTimeout);
+					}
+				} catch (const std::bad_alloc&) {
+					// skip this item only. The data has to be consumed in order to get to the next one.
+					syslog(LOG_ERR, "handoff: Not enough memory for the data of an item");
+					unreadData.clear();
+					unsentData.clear();
+					result = discardAll(m_fd, header.unreadSize+header.unsentSize, msTimeout);
+					if (result==0) {
+						if (fd!=-1) {
+							::close(fd);
+						}
+						continue;
+					}
+				}
+				if (result<0) {
+					if (fd!=-1) {
+						::close(fd);
+					}
+					return -1;
+				}
+
+				if (header.type==ITEM_END) {
+					if (fd!=-1) {
+						::close(fd);
+					}
+					return count;
+				}
+				if (fd==-1) {
+					syslog(LOG_ERR, "handoff: Item without file descriptor");
+					continue;
+				}
+
+				// a bad item is skipped, the following ones are still taken over
+				if (header.type==ITEM_SERVER) {
+					if (serverCb) {
+						serverCb(fd, header.tag);
+					} else {
+						::close(fd);
+					}
+				} else if (header.type==ITEM_CONNECTION) {
+					clientSocket_t socket;
+					try {
+						socket.reset(new SocketNonblocking(fd, eventLoop, options));
+					} catch (const std::runtime_error& e) {
+						syslog(LOG_ERR, "handoff: Could not take over connection '%s'", e.what());
+						::close(fd);
+						continue;
+					}
+					// on error, the socket closes the connection when being destructed
+					if (socket->preload(unreadData.data(), unreadData.size())<0) {
+						syslog(LOG_ERR, "handoff: Unread data does not fit into receive buffer");
+						continue;
+					}
+					if ((!unsentData.empty()) && (socket->sendAsync(unsentData.data(), unsentData.size())<0)) {
+						syslog(LOG_ERR, "handoff: Could not send the unsent data '%s'", strerror(errno));
+						continue;
+					}
+					if (connectionCb) {
+						connectionCb(std::move(socket), header.tag);
+					}
+				} else {
+					::close(fd);
+					syslog(LOG_ERR, "handoff: Unknown item type %u", header.type);
+					continue;
+				}
+				++count;
+			} while (true);
+		}
+	}
+}
@@ -0,0 +1,353 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/relay.h"
+
+/// splice() into a socket raises SIGPIPE if the peer is gone and there is no MSG_NOSIGNAL for splice().
+/// SIGPIPE is blocked once for each thread that pumps data instead of around each pump.
+static void blockSigPipe()
+{
+	static thread_local bool blocked = false;
+	if (blocked) {
+		return;
+	}
+	sigset_t pipeSet;
+	sigemptyset(&pipeSet);
+	sigaddset(&pipeSet, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeSet, nullptr);
+	blocked = true;
+}
+
+/// Consume the SIGPIPE raised by a failed splice(). It would stay pending otherwise.
+static void consumeSigPipe()
+{
+	int error = errno;
+	sigset_t pipeSet;
+	sigemptyset(&pipeSet);
+	sigaddset(&pipeSet, SIGPIPE);
+	struct timespec timeout = { 0, 0 };
+	sigtimedwait(&pipeSet, nullptr, &timeout);
+	errno = error;
+}
+
+static const unsigned int SPLICE_FLAGS = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+namespace hbk {
+	namespace communication {
+		Relay::Relay(sys::EventLoop& eventLoop, size_t pipeSize)
+			: m_eventLoop(eventLoop)
+			, m_pipeSize(pipeSize)
+			, m_headerSize(0)
+			, m_inspectCb()
+			, m_closeCb()
+			, m_running(false)
+		{
+			for (unsigned int index = 0; index<2; ++index) {
+				Stream& stream = m_streams[index];
+				stream.source = -1;
+				stream.destination = -1;
+				stream.fill = 0;
+				stream.unsentCount = 0;
+				stream.inspected = true;
+				stream.sourceEnded = false;
+				stream.finished = false;
+				stream.relayedCount = 0;
+				if (pipe2(stream.pipe, O_NONBLOCK | O_CLOEXEC)==-1) {
+					if (index==1) {
+						::close(m_streams[0].pipe[0]);
+						::close(m_streams[0].pipe[1]);
+					}
+					throw std::runtime_error(std::string("could not create pipe: ") + strerror(errno));
+				}
+				fcntl(stream.pipe[1], F_SETPIPE_SZ, static_cast < int > (pipeSize));
+			}
+			// the kernel rounds up and is limited by /proc/sys/fs/pipe-max-size
+			int size = fcntl(m_streams[0].pipe[1], F_GETPIPE_SZ);
+			if (size>0) {
+				m_pipeSize = std::min(static_cast < size_t > (size), static_cast < size_t > (fcntl(m_streams[1].pipe[1], F_GETPIPE_SZ)));
+			}
+		}
+
+		Relay::~Relay()
+		{
+			stop();
+			for (auto &iter: m_streams) {
+				::close(iter.pipe[0]);
+				::close(iter.pipe[1]);
+			}
+		}
+
+		void Relay::setInspectCb(size_t headerSize, InspectCb_t inspectCb)
+		{
+			m_headerSize = headerSize;
+			m_inspectCb = inspectCb;
+		}
+
+		void Relay::setCloseCb(CloseCb_t closeCb)
+		{
+			m_closeCb = closeCb;
+		}
+
+		int Relay::start(SocketNonblocking& first, SocketNonblocking& second)
+		{
+			if ((m_running) || (first.getEvent()==-1) || (second.getEvent()==-1)) {
+				return -1;
+			}
+
+			std::vector < uint8_t > unreadData[2];
+			BufferChain unsentData[2];
+			int firstFd = first.release(unreadData[FIRST_TO_SECOND], unsentData[SECOND_TO_FIRST]);
+			int secondFd = second.release(unreadData[SECOND_TO_FIRST], unsentData[FIRST_TO_SECOND]);
+
+			m_streams[FIRST_TO_SECOND].source = firstFd;
+			m_streams[FIRST_TO_SECOND].destination = secondFd;
+			m_streams[SECOND_TO_FIRST].source = secondFd;
+			m_streams[SECOND_TO_FIRST].destination = firstFd;
+			for (unsigned int index = 0; index<2; ++index) {
+				Stream& stream = m_streams[index];
+				// drop whatever was left in the pipe by a previous run
+				char discard[4096];
+				while (::read(stream.pipe[0], discard, sizeof(discard))>0) {
+				}
+				stream.fill = 0;
+				// unsent data of the destination goes first, it is not part of the stream
+				stream.backlog.resize(unsentData[index].size());
+				unsentData[index].copyOut(0, stream.backlog.data(), stream.backlog.size());
+				stream.unsentCount = stream.backlog.size();
+				stream.backlog.insert(stream.backlog.end(), unreadData[index].begin(), unreadData[index].end());
+				stream.inspected = (m_headerSize==0) || (!m_inspectCb);
+				stream.sourceEnded = false;
+				stream.finished = false;
+				stream.relayedCount = 0;
+			}
+			m_running = true;
+
+			// registering executes the callbacks once, hence anything received already is forwarded
+			m_eventLoop.addEvent(firstFd, std::bind(&Relay::pump, this, FIRST_TO_SECOND));
+			if (m_running) {
+				m_eventLoop.addEvent(secondFd, std::bind(&Relay::pump, this, SECOND_TO_FIRST));
+			}
+			if (m_running) {
+				m_eventLoop.addOutEvent(firstFd, std::bind(&Relay::pump, this, SECOND_TO_FIRST));
+			}
+			if (m_running) {
+				m_eventLoop.addOutEvent(secondFd, std::bind(&Relay::pump, this, FIRST_TO_SECOND));
+			}
+			return 0;
+		}
+
+		void Relay::stop()
+		{
+			if (!m_running) {
+				return;
+			}
+			m_running = false;
+			// both streams share the same two sockets
+			int fds[2] = { m_streams[FIRST_TO_SECOND].source, m_streams[SECOND_TO_FIRST].source };
+			for (auto &iter: fds) {
+				m_eventLoop.eraseEvent(iter);
+				m_eventLoop.eraseOutEvent(iter);
+				::close(iter);
+			}
+			for (auto &iter: m_streams) {
+				iter.source = -1;
+				iter.destination = -1;
+				iter.backlog.clear();
+			}
+		}
+
+		int Relay::pump(Direction direction)
+		{
+			if (!m_running) {
+				return -1;
+			}
+			Stream& stream = m_streams[direction];
+			if (!stream.inspected) {
+				int result = inspect(direction);
+				if (result<=0) {
+					// closed or waiting for the rest of the header
+					return result;
+				}
+			}
+
+			blockSigPipe();
+			for (;;) {
+				int filled = fill(stream);
+				if (filled<0) {
+					return close(errno);
+				}
+				int drained = drain(stream);
+				if (drained<0) {
+					return close(errno);
+				}
+				if ((stream.sourceEnded) && (stream.backlog.empty()) && (stream.fill==0) && (!stream.finished)) {
+					// forward the end of the stream
+					stream.finished = true;
+					::shutdown(stream.destination, SHUT_WR);
+					if ((m_streams[FIRST_TO_SECOND].finished) && (m_streams[SECOND_TO_FIRST].finished)) {
+						return close(0);
+					}
+				}
+				if ((drained==0) || (filled==1)) {
+					// destination is full or there is nothing more to read
+					return 0;
+				}
+				// pipe was full and got drained, continue reading
+			}
+		}
+
+		int Relay::fill(Stream& stream)
+		{
+			while (stream.fill<m_pipeSize) {
+				size_t space = m_pipeSize - stream.fill;
+				ssize_t result;
+				if (!stream.backlog.empty()) {
+					result = ::write(stream.pipe[1], stream.backlog.data(), std::min(space, stream.backlog.size()));
+					if (result<0) {
+						if ((errno==EAGAIN) || (errno==EWOULDBLOCK)) {
+							return 0;
+						}
+						return -1;
+					}
+					size_t written = static_cast < size_t > (result);
+					stream.unsentCount -= std::min(stream.unsentCount, written);
+					stream.backlog.erase(stream.backlog.begin(), stream.backlog.begin()+result);
+					stream.fill += written;
+					continue;
+				}
+				if (stream.sourceEnded) {
+					return 1;
+				}
+
+				result = splice(stream.source, nullptr, stream.pipe[1], nullptr, space, SPLICE_FLAGS);
+				if (result>0) {
+					stream.fill += static_cast < size_t > (result);
+				} else if (result==0) {
+					stream.sourceEnded = true;
+					return 1;
+				} else if ((errno==EAGAIN) || (errno==EWOULDBLOCK)) {
+					if (stream.fill>0) {
+						// pipe capacity is counted in pages, not bytes. Might be full, drain before trying again.
+						return 0;
+					}
+					return 1;
+				} else {
+					return -1;
+				}
+			}
+			return 0;
+		}
+
+		int Relay::drain(Stream& stream)
+		{
+			while (stream.fill>0) {
+				unsigned int flags = SPLICE_FLAGS;
+				if ((!stream.sourceEnded) || (!stream.backlog.empty())) {
+					flags |= SPLICE_F_MORE;
+				}
+				ssize_t result = splice(stream.pipe[0], nullptr, stream.destination, nullptr, stream.fill, flags);
+				if (result>0) {
+					stream.fill -= static_cast < size_t > (result);
+					stream.relayedCount += static_cast < uint64_t > (result);
+				} else if ((result<0) && ((errno==EAGAIN) || (errno==EWOULDBLOCK))) {
+					// continued by the output event of the destination
+					return 0;
+				} else {
+					if (result==0) {
+						errno = EPIPE;
+					} else if (errno==EPIPE) {
+						consumeSigPipe();
+					}
+					return -1;
+				}
+			}
+			return 1;
+		}
+
+		int Relay::inspect(Direction direction)
+		{
+			Stream& stream = m_streams[direction];
+			// unread data of the released socket is the start of the stream
+			size_t fromBacklog = std::min(m_headerSize, stream.backlog.size()-stream.unsentCount);
+			std::vector < uint8_t > header(stream.backlog.begin()+stream.unsentCount, stream.backlog.begin()+stream.unsentCount+fromBacklog);
+			if (header.size()<m_headerSize) {
+				// look without consuming, nothing is forwarded before the header was accepted
+				size_t offset = header.size();
+				header.resize(m_headerSize);
+				ssize_t result = ::recv(stream.source, &header[offset], m_headerSize-offset, MSG_PEEK | MSG_DONTWAIT);
+				if (result<0) {
+					if ((errno!=EAGAIN) && (errno!=EWOULDBLOCK)) {
+						return close(errno);
+					}
+					result = 0;
+				}
+				header.resize(offset + static_cast < size_t > (result));
+				if (header.size()<m_headerSize) {
+					// incomplete, unless the peer is done sending
+					struct pollfd pollFd;
+					pollFd.fd = stream.source;
+					pollFd.events = POLLRDHUP;
+					pollFd.revents = 0;
+					if ((::poll(&pollFd, 1, 0)<=0) || ((pollFd.revents & (POLLRDHUP | POLLHUP | POLLERR))==0)) {
+						return 0;
+					}
+				}
+			}
+
+			stream.inspected = true;
+			bool accepted = m_inspectCb(*this, direction, header.data(), header.size());
+			if (!m_running) {
+				// stopped from within the callback
+				return -1;
+			}
+			if (!accepted) {
+				return close(ECONNABORTED);
+			}
+			return 1;
+		}
+
+		int Relay::close(int error)
+		{
+			stop();
+			// the callback might replace itself
+			CloseCb_t closeCb = m_closeCb;
+			if (closeCb) {
+				closeCb(*this, error);
+			}
+			return -1;
+		}
+	}
+}
@@ -0,0 +1,135 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "hbk/communication/seqpacketserver.h"
+
+namespace hbk {
+	namespace communication {
+		SeqPacketServer::SeqPacketServer(sys::EventLoop& eventLoop)
+			: m_listeningEvent(-1)
+			, m_eventLoop(eventLoop)
+			, m_acceptCb()
+			, m_unixDomainSocketPath()
+		{
+		}
+
+		SeqPacketServer::~SeqPacketServer()
+		{
+			stop();
+		}
+
+		int SeqPacketServer::start(const std::string& path, bool useAbstractNamespace, int backlog, Cb_t acceptCb)
+		{
+			if ((m_listeningEvent!=-1) || (!acceptCb)) {
+				return -1;
+			}
+			sockaddr_un address;
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+
+			size_t serveraddrLen;
+			if(useAbstractNamespace) {
+				serveraddrLen = 1+strlen(path.c_str())+sizeof(address.sun_family);
+				strncpy(&address.sun_path[1], path.c_str(), sizeof(address.sun_path)-2);
+			} else {
+				serveraddrLen = strlen(path.c_str())+sizeof(address.sun_family);
+				strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+				::unlink(path.c_str());
+			}
+
+			m_listeningEvent = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (m_listeningEvent==-1) {
+				::syslog(LOG_ERR, "seqpacket server: Socket initialization failed '%s'", strerror(errno));
+				return -1;
+			}
+
+			if (::bind(m_listeningEvent, reinterpret_cast<sockaddr*>(&address), static_cast < socklen_t > (serveraddrLen)) == -1) {
+				::syslog(LOG_ERR, "seqpacket server: Binding socket to unix domain socket %s failed '%s'", path.c_str(), strerror(errno));
+				::close(m_listeningEvent);
+				m_listeningEvent = -1;
+				return -1;
+			}
+
+			if(!useAbstractNamespace) {
+				chmod(path.c_str(), 0666); // everyone should have access
+				m_unixDomainSocketPath = path;
+			}
+			if (listen(m_listeningEvent, backlog)==-1) {
+				stop();
+				return -1;
+			}
+
+			m_acceptCb = acceptCb;
+			return m_eventLoop.addEvent(m_listeningEvent, std::bind(&SeqPacketServer::process, this));
+		}
+
+		void SeqPacketServer::stop()
+		{
+			if (m_listeningEvent==-1) {
+				return;
+			}
+			m_eventLoop.eraseEvent(m_listeningEvent);
+			::close(m_listeningEvent);
+			m_listeningEvent = -1;
+			if (!m_unixDomainSocketPath.empty()) {
+				// unlink non-abstract unix domain socket
+				if(::unlink(m_unixDomainSocketPath.c_str())) {
+					::syslog(LOG_ERR, "seqpacket server: unlinking %s failed '%s'", m_unixDomainSocketPath.c_str(), strerror(errno));
+				}
+				m_unixDomainSocketPath.clear();
+			}
+			m_acceptCb = Cb_t();
+		}
+
+		int SeqPacketServer::process()
+		{
+			int clientFd = ::accept4(m_listeningEvent, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (clientFd==-1) {
+				if ((errno!=EWOULDBLOCK) && (errno!=EAGAIN) && (errno!=EINTR) ) {
+					::syslog(LOG_ERR, "seqpacket server: error accepting connection '%s'", strerror(errno));
+				}
+				return -1;
+			}
+			seqPacketSocket_t worker;
+			try {
+				worker.reset(new SeqPacketSocket(clientFd, m_eventLoop));
+			} catch (const std::runtime_error& e) {
+				::syslog(LOG_ERR, "seqpacket server: %s", e.what());
+				::close(clientFd);
+				return 1;
+			}
+			m_acceptCb(std::move(worker));
+			// we are working edge triggered. Returning > 0 tells the eventloop to call process again to try whether there is more in the queue.
+			return 1;
+		}
+	}
+}
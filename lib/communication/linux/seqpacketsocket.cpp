@@ -0,0 +1,280 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "hbk/communication/seqpacketsocket.h"
+
+/// time to wait for the server to accept
+static const int TIMEOUT_CONNECT_MS = 5000;
+
+static int waitFor(int fd, short events, int timeoutMilliSeconds)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = events;
+	int retVal;
+	do {
+		retVal = poll(&pfd, 1, timeoutMilliSeconds);
+	} while ((retVal==-1) && (errno==EINTR));
+	return retVal;
+}
+
+namespace hbk {
+	namespace communication {
+		SeqPacketSocket::SeqPacketSocket(sys::EventLoop& eventLoop)
+			: m_eventLoop(eventLoop)
+			, m_event(-1)
+			, m_inDataHandler()
+			, m_outDataHandler()
+		{
+		}
+
+		SeqPacketSocket::SeqPacketSocket(int fd, sys::EventLoop& eventLoop)
+			: m_eventLoop(eventLoop)
+			, m_event(fd)
+			, m_inDataHandler()
+			, m_outDataHandler()
+		{
+			int type;
+			socklen_t len = sizeof(type);
+			if ((getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len)==-1) || (type!=SOCK_SEQPACKET)) {
+				throw std::runtime_error("not a SOCK_SEQPACKET socket");
+			}
+			int flags = fcntl(fd, F_GETFL);
+			if ((flags==-1) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK)==-1)) {
+				throw std::runtime_error("error setting socket to non-blocking");
+			}
+		}
+
+		SeqPacketSocket::~SeqPacketSocket()
+		{
+			disconnect();
+		}
+
+		int SeqPacketSocket::connect(const std::string& path, bool useAbstractNamespace)
+		{
+			if (m_event!=-1) {
+				return -1;
+			}
+			struct sockaddr_un sockaddr;
+			memset(&sockaddr, 0, sizeof(sockaddr));
+			sockaddr.sun_family = AF_UNIX;
+
+			socklen_t serveraddrLen;
+			if (useAbstractNamespace) {
+				serveraddrLen = static_cast < socklen_t > (1+path.length()+sizeof(sockaddr.sun_family));
+				strncpy(&sockaddr.sun_path[1], path.c_str(), sizeof(sockaddr.sun_path)-2);
+			} else {
+				serveraddrLen = static_cast < socklen_t > (path.length()+sizeof(sockaddr.sun_family));
+				strncpy(sockaddr.sun_path, path.c_str(), sizeof(sockaddr.sun_path)-1);
+			}
+
+			m_event = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (m_event==-1) {
+				return -1;
+			}
+
+			int err = ::connect(m_event, reinterpret_cast < struct sockaddr* > (&sockaddr), serveraddrLen);
+			if ((err==-1) && (errno==EAGAIN)) {
+				// backlog of the server is full
+				if (waitFor(m_event, POLLOUT, TIMEOUT_CONNECT_MS)==1) {
+					err = ::connect(m_event, reinterpret_cast < struct sockaddr* > (&sockaddr), serveraddrLen);
+				}
+			}
+			if (err==-1) {
+				syslog(LOG_ERR, "could not connect to unix domain socket '%s': '%s'", path.c_str(), strerror(errno));
+				::close(m_event);
+				m_event = -1;
+				return -1;
+			}
+
+			// callback functions might have already been set before fd was created.
+			if (m_inDataHandler) {
+				m_eventLoop.addEvent(m_event, std::bind(m_inDataHandler, std::ref(*this)));
+			}
+			if (m_outDataHandler) {
+				m_eventLoop.addOutEvent(m_event, std::bind(m_outDataHandler, std::ref(*this)));
+			}
+			return 0;
+		}
+
+		void SeqPacketSocket::disconnect()
+		{
+			if (m_event==-1) {
+				return;
+			}
+			m_eventLoop.eraseEvent(m_event);
+			m_eventLoop.eraseOutEvent(m_event);
+			::close(m_event);
+			m_event = -1;
+		}
+
+		void SeqPacketSocket::setDataCb(DataCb_t dataCb)
+		{
+			m_inDataHandler = dataCb;
+			if (m_event!=-1) {
+				m_eventLoop.addEvent(m_event, std::bind(m_inDataHandler, std::ref(*this)));
+			}
+		}
+
+		void SeqPacketSocket::setOutDataCb(DataCb_t dataCb)
+		{
+			m_outDataHandler = dataCb;
+			if (m_event!=-1) {
+				m_eventLoop.addOutEvent(m_event, std::bind(m_outDataHandler, std::ref(*this)));
+			}
+		}
+
+		void SeqPacketSocket::clearDataCb()
+		{
+			if (m_event!=-1) {
+				m_eventLoop.eraseEvent(m_event);
+			}
+			m_inDataHandler = DataCb_t();
+		}
+
+		void SeqPacketSocket::clearOutDataCb()
+		{
+			if (m_event!=-1) {
+				m_eventLoop.eraseOutEvent(m_event);
+			}
+			m_outDataHandler = DataCb_t();
+		}
+
+		ssize_t SeqPacketSocket::send(const void* pData, size_t size)
+		{
+			dataBlock_t block(pData, size);
+			return sendBlocks(&block, 1);
+		}
+
+		ssize_t SeqPacketSocket::sendBlocks(const dataBlock_t* blocks, size_t blockCount)
+		{
+			struct iovec iovs[MAX_BATCH];
+			if (blockCount>MAX_BATCH) {
+				errno = EINVAL;
+				return -1;
+			}
+			for (size_t i = 0; i<blockCount; ++i) {
+				iovs[i].iov_base = const_cast < void* > (blocks[i].pData);
+				iovs[i].iov_len = blocks[i].size;
+			}
+			struct msghdr msgHdr;
+			memset(&msgHdr, 0, sizeof(msgHdr));
+			msgHdr.msg_iov = iovs;
+			msgHdr.msg_iovlen = blockCount;
+
+			ssize_t retVal;
+			do {
+				retVal = sendmsg(m_event, &msgHdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+			} while ((retVal==-1) && (errno==EINTR));
+			return retVal;
+		}
+
+		ssize_t SeqPacketSocket::sendBlock(const void* pData, size_t size)
+		{
+			while (true) {
+				ssize_t retVal = send(pData, size);
+				if ((retVal!=-1) || ((errno!=EAGAIN) && (errno!=EWOULDBLOCK))) {
+					return retVal;
+				}
+				if (waitFor(m_event, POLLOUT, -1)!=1) {
+					return -1;
+				}
+			}
+		}
+
+		ssize_t SeqPacketSocket::receive(void* pData, size_t size)
+		{
+			struct iovec iov;
+			iov.iov_base = pData;
+			iov.iov_len = size;
+			struct msghdr msgHdr;
+			memset(&msgHdr, 0, sizeof(msgHdr));
+			msgHdr.msg_iov = &iov;
+			msgHdr.msg_iovlen = 1;
+
+			ssize_t retVal;
+			do {
+				retVal = recvmsg(m_event, &msgHdr, MSG_DONTWAIT);
+			} while ((retVal==-1) && (errno==EINTR));
+			if ((retVal>0) && (msgHdr.msg_flags & MSG_TRUNC)) {
+				errno = EMSGSIZE;
+				return -1;
+			}
+			return retVal;
+		}
+
+		int SeqPacketSocket::receiveMessages(Message* pMessages, unsigned int messageCount)
+		{
+			if (messageCount>MAX_BATCH) {
+				messageCount = MAX_BATCH;
+			}
+			struct iovec iovs[MAX_BATCH];
+			struct mmsghdr msgHdrs[MAX_BATCH];
+			memset(msgHdrs, 0, sizeof(struct mmsghdr)*messageCount);
+			for (unsigned int i = 0; i<messageCount; ++i) {
+				iovs[i].iov_base = pMessages[i].pData;
+				iovs[i].iov_len = pMessages[i].capacity;
+				msgHdrs[i].msg_hdr.msg_iov = &iovs[i];
+				msgHdrs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			int count;
+			do {
+				count = recvmmsg(m_event, msgHdrs, messageCount, MSG_DONTWAIT, nullptr);
+			} while ((count==-1) && (errno==EINTR));
+			for (int i = 0; i<count; ++i) {
+				if (msgHdrs[i].msg_len==0) {
+					// end of connection. Messages before are delivered, the end is reported by the next call.
+					return i;
+				}
+				pMessages[i].size = msgHdrs[i].msg_len;
+				pMessages[i].truncated = (msgHdrs[i].msg_hdr.msg_flags & MSG_TRUNC)!=0;
+			}
+			return count;
+		}
+
+		ssize_t SeqPacketSocket::receiveComplete(void* pData, size_t size, int msTimeout)
+		{
+			while (true) {
+				ssize_t retVal = receive(pData, size);
+				if ((retVal!=-1) || ((errno!=EAGAIN) && (errno!=EWOULDBLOCK))) {
+					return retVal;
+				}
+				if (waitFor(m_event, POLLIN, msTimeout)!=1) {
+					return -1;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,610 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "hbk/communication/sharedmemorysocket.h"
+
+/// "HBKS"
+static const uint32_t MAGIC = 0x534b4248;
+static const size_t MIN_RING_SIZE = 4096;
+/// memfd, 2 eventfds per direction
+static const unsigned int OFFER_FD_COUNT = 5;
+/// producer and consumer cache line in front of the data of each ring
+static const size_t RING_CONTROL_SIZE = 128;
+/// the memfd can not be resized by the peer, which would make accessing the mapping raise SIGBUS
+static const int REQUIRED_SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+/// sent by the client together with the file descriptors
+struct Offer {
+	uint32_t magic;
+	uint32_t reserved;
+	uint64_t ringSize;
+};
+
+namespace hbk {
+	namespace communication {
+		/// Positions count the bytes ever written and read. They are reduced to the ring size when accessing the data.
+		/// Producer and consumer positions live in different cache lines.
+		struct SharedMemorySocket::Ring {
+			alignas(64) std::atomic < uint64_t > writePosition;
+			/// the consumer waits for data
+			std::atomic < uint32_t > readerWaiting;
+			/// the producer closed its side
+			std::atomic < uint32_t > writerClosed;
+
+			alignas(64) std::atomic < uint64_t > readPosition;
+			/// the producer waits for space
+			std::atomic < uint32_t > writerWaiting;
+
+			alignas(64) uint8_t data[1];
+		};
+
+		static void signal(int eventFd)
+		{
+			uint64_t value = 1;
+			if (::write(eventFd, &value, sizeof(value))<0) {
+				syslog(LOG_ERR, "shared memory: Could not wake up peer '%s'", strerror(errno));
+			}
+		}
+
+		static void closeFd(int& fd)
+		{
+			if (fd!=-1) {
+				::close(fd);
+				fd = -1;
+			}
+		}
+
+		SharedMemorySocket::SharedMemorySocket(sys::EventLoop& eventLoop)
+			: m_eventLoop(eventLoop)
+			, m_pMemory(nullptr)
+			, m_memorySize(0)
+			, m_ringSize(0)
+			, m_pTx(nullptr)
+			, m_pRx(nullptr)
+			, m_ownDataEventFd(-1)
+			, m_ownSpaceEventFd(-1)
+			, m_peerDataEventFd(-1)
+			, m_peerSpaceEventFd(-1)
+			, m_controlFd(-1)
+			, m_peerGone(false)
+			, m_inDataHandler()
+			, m_outDataHandler()
+		{
+		}
+
+		SharedMemorySocket::~SharedMemorySocket()
+		{
+			disconnect();
+		}
+
+		int SharedMemorySocket::connect(const SocketNonblocking& unixSocket, size_t ringSize)
+		{
+			if ((isConnected()) || (unixSocket.getEvent()==-1)) {
+				return -1;
+			}
+			size_t size = MIN_RING_SIZE;
+			while (size<ringSize) {
+				size <<= 1;
+			}
+
+			int memFd = memfd_create("hbk-shared-memory-socket", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+			if (memFd==-1) {
+				syslog(LOG_ERR, "shared memory: memfd_create failed '%s'", strerror(errno));
+				return -1;
+			}
+			if (ftruncate(memFd, static_cast < off_t > (2*(RING_CONTROL_SIZE+size)))==-1) {
+				syslog(LOG_ERR, "shared memory: Could not size memfd '%s'", strerror(errno));
+				::close(memFd);
+				return -1;
+			}
+			if (fcntl(memFd, F_ADD_SEALS, REQUIRED_SEALS)==-1) {
+				syslog(LOG_ERR, "shared memory: Could not seal memfd '%s'", strerror(errno));
+				::close(memFd);
+				return -1;
+			}
+
+			// client to server data and space, server to client data and space
+			int eventFds[4];
+			for (unsigned int i = 0; i<4; ++i) {
+				eventFds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				if (eventFds[i]==-1) {
+					syslog(LOG_ERR, "shared memory: Could not create eventfd '%s'", strerror(errno));
+					::close(memFd);
+					for (unsigned int j = 0; j<i; ++j) {
+						::close(eventFds[j]);
+					}
+					return -1;
+				}
+			}
+
+			Offer offer;
+			memset(&offer, 0, sizeof(offer));
+			offer.magic = MAGIC;
+			offer.ringSize = size;
+
+			int fds[OFFER_FD_COUNT] = { memFd, eventFds[0], eventFds[1], eventFds[2], eventFds[3] };
+			union {
+				char buffer[CMSG_SPACE(sizeof(fds))];
+				struct cmsghdr align;
+			} control;
+			memset(&control, 0, sizeof(control));
+			struct iovec iov;
+			iov.iov_base = &offer;
+			iov.iov_len = sizeof(offer);
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control.buffer;
+			msg.msg_controllen = sizeof(control.buffer);
+			struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+			pCmsg->cmsg_level = SOL_SOCKET;
+			pCmsg->cmsg_type = SCM_RIGHTS;
+			pCmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+			memcpy(CMSG_DATA(pCmsg), fds, sizeof(fds));
+
+			ssize_t result;
+			do {
+				result = ::sendmsg(unixSocket.getEvent(), &msg, MSG_NOSIGNAL);
+			} while ((result==-1) && (errno==EINTR));
+			if (result!=static_cast < ssize_t > (sizeof(offer))) {
+				syslog(LOG_ERR, "shared memory: Could not send offer '%s'", strerror(errno));
+				::close(memFd);
+				for (auto &iter: eventFds) {
+					::close(iter);
+				}
+				return -1;
+			}
+			// the peer does not have to be there yet. Data written meanwhile waits in the ring.
+			return setup(memFd, true, eventFds[2], eventFds[1], eventFds[0], eventFds[3], unixSocket.getEvent());
+		}
+
+		int SharedMemorySocket::accept(const SocketNonblocking& unixSocket, int msTimeout)
+		{
+			if ((isConnected()) || (unixSocket.getEvent()==-1)) {
+				return -1;
+			}
+			struct pollfd pfd;
+			pfd.fd = unixSocket.getEvent();
+			pfd.events = POLLIN;
+			int pollResult;
+			do {
+				pollResult = poll(&pfd, 1, msTimeout);
+			} while ((pollResult==-1) && (errno==EINTR));
+			if (pollResult<=0) {
+				syslog(LOG_ERR, "shared memory: No offer from client");
+				return -1;
+			}
+
+			Offer offer;
+			int fds[OFFER_FD_COUNT];
+			union {
+				char buffer[CMSG_SPACE(sizeof(fds))];
+				struct cmsghdr align;
+			} control;
+			memset(&control, 0, sizeof(control));
+			struct iovec iov;
+			iov.iov_base = &offer;
+			iov.iov_len = sizeof(offer);
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control.buffer;
+			msg.msg_controllen = sizeof(control.buffer);
+			ssize_t result;
+			do {
+				result = ::recvmsg(unixSocket.getEvent(), &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+			} while ((result==-1) && (errno==EINTR));
+
+			unsigned int fdCount = 0;
+			for (struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg); pCmsg!=nullptr; pCmsg = CMSG_NXTHDR(&msg, pCmsg)) {
+				if ((pCmsg->cmsg_level==SOL_SOCKET) && (pCmsg->cmsg_type==SCM_RIGHTS)) {
+					fdCount = static_cast < unsigned int > ((pCmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+					memcpy(fds, CMSG_DATA(pCmsg), fdCount*sizeof(int));
+				}
+			}
+			if ((result!=static_cast < ssize_t > (sizeof(offer))) || (offer.magic!=MAGIC) || (fdCount!=OFFER_FD_COUNT) || (offer.ringSize<MIN_RING_SIZE) || ((offer.ringSize & (offer.ringSize-1))!=0)) {
+				syslog(LOG_ERR, "shared memory: Invalid offer from client");
+				for (unsigned int i = 0; i<fdCount; ++i) {
+					::close(fds[i]);
+				}
+				return -1;
+			}
+
+			// the size checked here is final only if the client can not change it anymore
+			int seals = fcntl(fds[0], F_GET_SEALS);
+			if ((seals==-1) || ((seals & REQUIRED_SEALS)!=REQUIRED_SEALS)) {
+				syslog(LOG_ERR, "shared memory: memfd offered by the client is not sealed");
+				for (auto &iter: fds) {
+					::close(iter);
+				}
+				return -1;
+			}
+			struct stat memStat;
+			if ((fstat(fds[0], &memStat)==-1) || (static_cast < uint64_t > (memStat.st_size)!=2*(RING_CONTROL_SIZE+offer.ringSize))) {
+				syslog(LOG_ERR, "shared memory: Size of memfd does not match the offer");
+				for (auto &iter: fds) {
+					::close(iter);
+				}
+				return -1;
+			}
+			return setup(fds[0], false, fds[1], fds[4], fds[3], fds[2], unixSocket.getEvent());
+		}
+
+		int SharedMemorySocket::setup(int memFd, bool isClient, int ownDataEventFd, int ownSpaceEventFd, int peerDataEventFd, int peerSpaceEventFd, int unixSocketFd)
+		{
+			static_assert(offsetof(Ring, data)==RING_CONTROL_SIZE, "unexpected layout of the ring control block");
+
+			m_ownDataEventFd = ownDataEventFd;
+			m_ownSpaceEventFd = ownSpaceEventFd;
+			m_peerDataEventFd = peerDataEventFd;
+			m_peerSpaceEventFd = peerSpaceEventFd;
+
+			struct stat memStat;
+			if (fstat(memFd, &memStat)==-1) {
+				::close(memFd);
+				disconnect();
+				return -1;
+			}
+			m_memorySize = static_cast < size_t > (memStat.st_size);
+			m_ringSize = m_memorySize/2 - RING_CONTROL_SIZE;
+			m_pMemory = mmap(nullptr, m_memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+			// the mapping keeps the memory
+			::close(memFd);
+			if (m_pMemory==MAP_FAILED) {
+				syslog(LOG_ERR, "shared memory: Could not map memfd '%s'", strerror(errno));
+				m_pMemory = nullptr;
+				disconnect();
+				return -1;
+			}
+
+			uint8_t* pClientToServer = reinterpret_cast < uint8_t* > (m_pMemory);
+			uint8_t* pServerToClient = pClientToServer + RING_CONTROL_SIZE + m_ringSize;
+			if (isClient) {
+				// the memory is zeroed, nothing written and nothing read so far
+				m_pTx = new (pClientToServer) Ring;
+				m_pRx = new (pServerToClient) Ring;
+			} else {
+				m_pTx = reinterpret_cast < Ring* > (pServerToClient);
+				m_pRx = reinterpret_cast < Ring* > (pClientToServer);
+			}
+
+			m_controlFd = fcntl(unixSocketFd, F_DUPFD_CLOEXEC, 0);
+			if (m_controlFd==-1) {
+				disconnect();
+				return -1;
+			}
+			m_peerGone = false;
+			m_eventLoop.addEvent(m_controlFd, std::bind(&SharedMemorySocket::controlEvent, this));
+			if (m_inDataHandler) {
+				m_eventLoop.addEvent(m_ownDataEventFd, std::bind(&SharedMemorySocket::dataEvent, this));
+			}
+			if (m_outDataHandler) {
+				m_eventLoop.addEvent(m_ownSpaceEventFd, std::bind(&SharedMemorySocket::spaceEvent, this));
+			}
+			return 0;
+		}
+
+		void SharedMemorySocket::disconnect()
+		{
+			if (m_pTx) {
+				m_pTx->writerClosed.store(1);
+				signal(m_peerDataEventFd);
+			}
+			if (m_controlFd!=-1) {
+				m_eventLoop.eraseEvent(m_controlFd);
+				closeFd(m_controlFd);
+			}
+			if (m_ownDataEventFd!=-1) {
+				m_eventLoop.eraseEvent(m_ownDataEventFd);
+			}
+			if (m_ownSpaceEventFd!=-1) {
+				m_eventLoop.eraseEvent(m_ownSpaceEventFd);
+			}
+			closeFd(m_ownDataEventFd);
+			closeFd(m_ownSpaceEventFd);
+			closeFd(m_peerDataEventFd);
+			closeFd(m_peerSpaceEventFd);
+			if (m_pMemory) {
+				munmap(m_pMemory, m_memorySize);
+				m_pMemory = nullptr;
+			}
+			m_pTx = nullptr;
+			m_pRx = nullptr;
+			m_memorySize = 0;
+			m_ringSize = 0;
+		}
+
+		void SharedMemorySocket::setDataCb(DataCb_t dataCb)
+		{
+			m_inDataHandler = dataCb;
+			if (m_ownDataEventFd!=-1) {
+				m_eventLoop.addEvent(m_ownDataEventFd, std::bind(&SharedMemorySocket::dataEvent, this));
+			}
+		}
+
+		void SharedMemorySocket::clearDataCb()
+		{
+			m_inDataHandler = DataCb_t();
+			if (m_ownDataEventFd!=-1) {
+				m_eventLoop.eraseEvent(m_ownDataEventFd);
+			}
+		}
+
+		void SharedMemorySocket::setOutDataCb(DataCb_t dataCb)
+		{
+			m_outDataHandler = dataCb;
+			if (m_ownSpaceEventFd!=-1) {
+				m_eventLoop.addEvent(m_ownSpaceEventFd, std::bind(&SharedMemorySocket::spaceEvent, this));
+			}
+		}
+
+		void SharedMemorySocket::clearOutDataCb()
+		{
+			m_outDataHandler = DataCb_t();
+			if (m_ownSpaceEventFd!=-1) {
+				m_eventLoop.eraseEvent(m_ownSpaceEventFd);
+			}
+		}
+
+		ssize_t SharedMemorySocket::send(const void* pBlock, size_t len)
+		{
+			if ((m_pTx==nullptr) || (isPeerClosed())) {
+				errno = EPIPE;
+				return -1;
+			}
+			uint64_t writePosition = m_pTx->writePosition.load(std::memory_order_relaxed);
+			uint64_t readPosition = m_pTx->readPosition.load(std::memory_order_acquire);
+			if (writePosition-readPosition>m_ringSize) {
+				return protocolError();
+			}
+			size_t space = m_ringSize - static_cast < size_t > (writePosition-readPosition);
+			if (space==0) {
+				// the peer signals when it made space
+				m_pTx->writerWaiting.store(1);
+				readPosition = m_pTx->readPosition.load();
+				if (writePosition-readPosition>m_ringSize) {
+					return protocolError();
+				}
+				space = m_ringSize - static_cast < size_t > (writePosition-readPosition);
+				if (space==0) {
+					errno = EAGAIN;
+					return -1;
+				}
+			}
+			if (len>space) {
+				len = space;
+			}
+
+			size_t offset = static_cast < size_t > (writePosition & (m_ringSize-1));
+			size_t firstChunk = m_ringSize-offset;
+			if (firstChunk>len) {
+				firstChunk = len;
+			}
+			const uint8_t* pData = reinterpret_cast < const uint8_t* > (pBlock);
+			memcpy(m_pTx->data+offset, pData, firstChunk);
+			memcpy(m_pTx->data, pData+firstChunk, len-firstChunk);
+			m_pTx->writePosition.store(writePosition+len, std::memory_order_release);
+
+			// pairs with the consumer setting readerWaiting before checking the write position again
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if ((m_pTx->readerWaiting.load(std::memory_order_relaxed)) && (m_pTx->readerWaiting.exchange(0))) {
+				signal(m_peerDataEventFd);
+			}
+			return static_cast < ssize_t > (len);
+		}
+
+		ssize_t SharedMemorySocket::sendBlock(const void* pBlock, size_t len)
+		{
+			const uint8_t* pData = reinterpret_cast < const uint8_t* > (pBlock);
+			size_t sent = 0;
+			while (sent<len) {
+				ssize_t result = send(pData+sent, len-sent);
+				if (result>0) {
+					sent += static_cast < size_t > (result);
+				} else if (errno==EAGAIN) {
+					if (waitFor(m_ownSpaceEventFd, -1)<0) {
+						return -1;
+					}
+				} else {
+					return -1;
+				}
+			}
+			return static_cast < ssize_t > (sent);
+		}
+
+		ssize_t SharedMemorySocket::sendBlocks(const dataBlocks_t& blocks)
+		{
+			size_t sent = 0;
+			for (const auto &iter: blocks) {
+				ssize_t result = sendBlock(iter.pData, iter.size);
+				if (result<0) {
+					return -1;
+				}
+				sent += static_cast < size_t > (result);
+			}
+			return static_cast < ssize_t > (sent);
+		}
+
+		ssize_t SharedMemorySocket::receive(void* pBlock, size_t len)
+		{
+			if (m_pRx==nullptr) {
+				errno = ENOTCONN;
+				return -1;
+			}
+			uint64_t readPosition = m_pRx->readPosition.load(std::memory_order_relaxed);
+			uint64_t writePosition = m_pRx->writePosition.load(std::memory_order_acquire);
+			if (writePosition==readPosition) {
+				// the peer signals when there is new data
+				m_pRx->readerWaiting.store(1);
+				writePosition = m_pRx->writePosition.load();
+				if (writePosition==readPosition) {
+					if (isPeerClosed()) {
+						return 0;
+					}
+					errno = EAGAIN;
+					return -1;
+				}
+			}
+			if (writePosition-readPosition>m_ringSize) {
+				return protocolError();
+			}
+			size_t available = static_cast < size_t > (writePosition-readPosition);
+			if (len>available) {
+				len = available;
+			}
+
+			size_t offset = static_cast < size_t > (readPosition & (m_ringSize-1));
+			size_t firstChunk = m_ringSize-offset;
+			if (firstChunk>len) {
+				firstChunk = len;
+			}
+			uint8_t* pData = reinterpret_cast < uint8_t* > (pBlock);
+			memcpy(pData, m_pRx->data+offset, firstChunk);
+			memcpy(pData+firstChunk, m_pRx->data, len-firstChunk);
+			m_pRx->readPosition.store(readPosition+len, std::memory_order_release);
+
+			// pairs with the producer setting writerWaiting before checking the read position again
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if ((m_pRx->writerWaiting.load(std::memory_order_relaxed)) && (m_pRx->writerWaiting.exchange(0))) {
+				signal(m_peerSpaceEventFd);
+			}
+			return static_cast < ssize_t > (len);
+		}
+
+		ssize_t SharedMemorySocket::receiveComplete(void* pBlock, size_t len, int msTimeout)
+		{
+			uint8_t* pData = reinterpret_cast < uint8_t* > (pBlock);
+			size_t received = 0;
+			while (received<len) {
+				ssize_t result = receive(pData+received, len-received);
+				if (result>0) {
+					received += static_cast < size_t > (result);
+				} else if (result==0) {
+					break;
+				} else if (errno==EAGAIN) {
+					if (waitFor(m_ownDataEventFd, msTimeout)<=0) {
+						return -1;
+					}
+				} else {
+					return -1;
+				}
+			}
+			return static_cast < ssize_t > (received);
+		}
+
+		ssize_t SharedMemorySocket::protocolError()
+		{
+			syslog(LOG_ERR, "shared memory: Peer corrupted the ring positions, disconnecting");
+			disconnect();
+			errno = EPROTO;
+			return -1;
+		}
+
+		bool SharedMemorySocket::isPeerClosed() const
+		{
+			if (m_peerGone) {
+				return true;
+			}
+			return m_pRx->writerClosed.load()!=0;
+		}
+
+		int SharedMemorySocket::waitFor(int eventFd, int msTimeout)
+		{
+			struct pollfd pfds[2];
+			pfds[0].fd = eventFd;
+			pfds[0].events = POLLIN;
+			pfds[1].fd = m_controlFd;
+			pfds[1].events = POLLIN;
+			int result;
+			do {
+				result = poll(pfds, 2, msTimeout);
+			} while ((result==-1) && (errno==EINTR));
+			if (result<=0) {
+				return result;
+			}
+			if (pfds[0].revents & POLLIN) {
+				// reset, poll would report it forever otherwise
+				uint64_t value;
+				if (::read(eventFd, &value, sizeof(value))<0) {
+					return -1;
+				}
+			}
+			if (pfds[1].revents) {
+				controlEvent();
+			}
+			return 1;
+		}
+
+		int SharedMemorySocket::dataEvent()
+		{
+			// The eventfd is not being reset. Edge triggered epoll signals each write.
+			if (m_inDataHandler) {
+				return static_cast < int > (m_inDataHandler(*this));
+			}
+			return 0;
+		}
+
+		int SharedMemorySocket::spaceEvent()
+		{
+			if (m_outDataHandler) {
+				return static_cast < int > (m_outDataHandler(*this));
+			}
+			return 0;
+		}
+
+		int SharedMemorySocket::controlEvent()
+		{
+			char value;
+			ssize_t result = ::recv(m_controlFd, &value, sizeof(value), MSG_PEEK | MSG_DONTWAIT);
+			if ((result==0) || ((result<0) && (errno!=EAGAIN) && (errno!=EWOULDBLOCK))) {
+				// the peer terminated without disconnecting
+				if (!m_peerGone) {
+					m_peerGone = true;
+					m_eventLoop.eraseEvent(m_controlFd);
+					if (m_inDataHandler) {
+						m_inDataHandler(*this);
+					}
+				}
+			}
+			return 0;
+		}
+	}
+}
@@ -21,6 +21,7 @@
 // THE SOFTWARE.
 
 #include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <cstdint>
 #include <sys/ioctl.h>
@@ -42,10 +43,15 @@
 #include <syslog.h>
 #include <poll.h>
 
+#include "hbk/communication/resolver.h"
 #include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/uring.h"
+#include "hbk/exception/exception.hpp"
 
 /// Maximum time to wait for connecting
 constexpr time_t TIMEOUT_CONNECT_S = 5;
+/// Maximum time disconnect() waits for the peer to take the data that is still queued
+constexpr int TIMEOUT_DISCONNECT_MS = 1000;
 
 
 //#define WRITEV_TEST
@@ -97,112 +103,845 @@ static int waitForWritable(int fd, int timeoutMilliSeconds)
 	return err;
 }
 
-hbk::communication::SocketNonblocking::SocketNonblocking(sys::EventLoop &eventLoop)
+static void setOptionalSocketOption(int fd, int level, int name, int value, const char* pName)
+{
+	if (setsockopt(fd, level, name, &value, sizeof(value))==-1) {
+		syslog(LOG_WARNING, "could not set socket option %s to %d '%s'", pName, value, strerror(errno));
+	}
+}
+
+/// \param bytesPerSecond 0 removes the limit
+static int setMaxPacingRate(int fd, uint64_t bytesPerSecond)
+{
+	if (bytesPerSecond==0) {
+		unsigned int unlimited = ~0U;
+		return setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &unlimited, sizeof(unlimited));
+	} else if (bytesPerSecond<~0U) {
+		unsigned int rate = static_cast < unsigned int > (bytesPerSecond);
+		return setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+	}
+	// 64 bit rates are supported by newer kernels only
+	return setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &bytesPerSecond, sizeof(bytesPerSecond));
+}
+
+/// \param family of the socket, decides which options are relevant
+static int applySocketOptions(int fd, int family, const hbk::communication::SocketOptions& options)
+{
+	int opt = 1;
+
+	if ((family == AF_INET) || (family == AF_INET6)) {
+		// those are relevant for ip sockets only:
+
+		// turn off Nagle algorithm
+		opt = options.noDelay ? 1 : 0;
+		if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
+			syslog(LOG_ERR, "error turning off nagle algorithm %s", strerror(errno));
+			return -1;
+		}
+
+		if (options.keepAlive) {
+			opt = static_cast < int > (options.keepAliveIdle.count());
+			// the interval between the last data packet sent (simple ACKs are not considered data) and the first keepalive probe;
+			// after the connection is marked to need keepalive, this counter is not used any further
+			if (setsockopt(fd, SOL_TCP, TCP_KEEPIDLE, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
+				syslog(LOG_ERR, "error setting socket option TCP_KEEPIDLE");
+				return -1;
+			}
+
+
+			opt = static_cast < int > (options.keepAliveInterval.count());
+			// the interval between subsequential keepalive probes, regardless of what the connection has exchanged in the meantime
+			if (setsockopt(fd, SOL_TCP, TCP_KEEPINTVL, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
+				syslog(LOG_ERR, "error setting socket option TCP_KEEPINTVL");
+				return -1;
+			}
+
+
+			opt = options.keepAliveProbes;
+			// the number of unacknowledged probes to send before considering the connection dead and notifying the application layer
+			if (setsockopt(fd, SOL_TCP, TCP_KEEPCNT, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
+				syslog(LOG_ERR, "error setting socket option TCP_KEEPCNT");
+				return -1;
+			}
+		}
+
+		// tuning options are applied on best effort basis
+		if (options.quickAck) {
+			opt = 1;
+			setOptionalSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, opt, "TCP_QUICKACK");
+		}
+		if (options.notSentLowWatermark>0) {
+			setOptionalSocketOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.notSentLowWatermark, "TCP_NOTSENT_LOWAT");
+		}
+		if (options.dscp>=0) {
+			// DSCP are the upper 6 bits of the traffic class
+			opt = (options.dscp & 0x3f) << 2;
+			if (family == AF_INET6) {
+				setOptionalSocketOption(fd, IPPROTO_IPV6, IPV6_TCLASS, opt, "IPV6_TCLASS");
+			} else {
+				setOptionalSocketOption(fd, IPPROTO_IP, IP_TOS, opt, "IP_TOS");
+			}
+		}
+		if (options.userTimeout.count()>0) {
+			opt = static_cast < int > (options.userTimeout.count());
+			setOptionalSocketOption(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, opt, "TCP_USER_TIMEOUT");
+		}
+		if (!options.congestionControl.empty()) {
+			if (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, options.congestionControl.c_str(), static_cast < socklen_t > (options.congestionControl.length()))==-1) {
+				syslog(LOG_WARNING, "congestion control '%s' not available '%s'", options.congestionControl.c_str(), strerror(errno));
+			}
+		}
+	}
+
+	if (options.sendBufferSize>0) {
+		setOptionalSocketOption(fd, SOL_SOCKET, SO_SNDBUF, options.sendBufferSize, "SO_SNDBUF");
+	}
+	if (options.receiveBufferSize>0) {
+		setOptionalSocketOption(fd, SOL_SOCKET, SO_RCVBUF, options.receiveBufferSize, "SO_RCVBUF");
+	}
+	if (options.priority>=0) {
+		setOptionalSocketOption(fd, SOL_SOCKET, SO_PRIORITY, options.priority, "SO_PRIORITY");
+	}
+	if (options.busyPoll.count()>0) {
+		opt = static_cast < int > (options.busyPoll.count());
+		setOptionalSocketOption(fd, SOL_SOCKET, SO_BUSY_POLL, opt, "SO_BUSY_POLL");
+	}
+
+	opt = options.keepAlive ? 1 : 0;
+	if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
+		syslog(LOG_ERR, "error setting socket option SO_KEEPALIVE");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int getSocketFamily(int fd)
+{
+	struct sockaddr_storage sockAddr;
+	socklen_t sockAddrSize = sizeof(sockAddr);
+	if (getsockname(fd, reinterpret_cast< struct sockaddr * > (&sockAddr), &sockAddrSize) < 0) {
+		syslog(LOG_ERR, "could not determine socket domain %s", strerror(errno));
+		return -1;
+	}
+	return sockAddr.ss_family;
+}
+
+int hbk::communication::SocketNonblocking::waitForWritableCounted()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int retVal = waitForWritable(m_event, -1);
+	m_transportCounters.blockedTime += static_cast < uint64_t > (std::chrono::duration_cast < std::chrono::microseconds > (std::chrono::steady_clock::now()-start).count());
+	return retVal;
+}
+
+hbk::communication::SocketNonblocking::SocketNonblocking(sys::EventLoop &eventLoop, const SocketOptions& options)
 	: m_event(-1)
-	, m_bufferedReader()
-	, m_eventLoop(eventLoop)
+	, m_options(options)
+	, m_pEventLoop(&eventLoop)
 {
 }
 
-hbk::communication::SocketNonblocking::SocketNonblocking(int fd, sys::EventLoop &eventLoop)
-	: m_event(fd)
-	, m_bufferedReader()
-	, m_eventLoop(eventLoop)
+hbk::communication::SocketNonblocking::SocketNonblocking(int fd, sys::EventLoop &eventLoop, const SocketOptions& options)
+	: SocketNonblocking(fd, eventLoop, options, nullptr, 0)
 {
-	if (m_event==-1) {
+}
+
+hbk::communication::SocketNonblocking::SocketNonblocking(int fd, sys::EventLoop &eventLoop, const SocketOptions& options, const struct sockaddr* pPeerAddress, socklen_t peerAddressLength, bool inheritedOptions)
+	: SocketNonblocking(eventLoop, options)
+{
+	if (fd==-1) {
 		throw std::runtime_error("not a valid socket");
 	}
+	m_event = fd;
+	if ((pPeerAddress) && (peerAddressLength>0) && (peerAddressLength<=sizeof(m_peerAddress))) {
+		memcpy(&m_peerAddress, pPeerAddress, peerAddressLength);
+		m_peerAddressLength = peerAddressLength;
+	}
+	captureAddresses();
+	if (inheritedOptions) {
+		// non-blocking and all options but priority and quick ack were taken over from the listening socket
+		if (m_options.priority>=0) {
+			setOptionalSocketOption(m_event, SOL_SOCKET, SO_PRIORITY, m_options.priority, "SO_PRIORITY");
+		}
+		rearmQuickAck();
+		return;
+	}
 	if (fcntl(m_event, F_SETFL, O_NONBLOCK)==-1) {
+		// the destructor runs after the delegated constructor. The caller keeps the file descriptor.
+		m_event = -1;
 		throw std::runtime_error("error setting socket to non-blocking");
 	}
 	if (setSocketOptions()<0) {
+		m_event = -1;
 		throw std::runtime_error("error setting socket options");
 	}
 }
 
+hbk::communication::SocketNonblocking::SocketNonblocking(SocketNonblocking&& op)
+	: SocketNonblocking(*op.m_pEventLoop)
+{
+	takeOver(op);
+}
+
+hbk::communication::SocketNonblocking& hbk::communication::SocketNonblocking::operator= (SocketNonblocking&& op)
+{
+	if (this!=&op) {
+		disconnect();
+		m_inDataHandler = DataCb_t();
+		m_outDataHandler = DataCb_t();
+		m_sliceDataHandler = SliceDataCb_t();
+		m_pEventLoop = op.m_pEventLoop;
+		takeOver(op);
+	}
+	return *this;
+}
+
 hbk::communication::SocketNonblocking::~SocketNonblocking()
 {
 	disconnect();
 }
 
+void hbk::communication::SocketNonblocking::takeOver(SocketNonblocking& op)
+{
+	// collected data goes to the queue. Event loop, timer and notifier refer to op.
+	op.flush();
+	op.m_pEventLoop->eraseIterationEndHandler(&op);
+	if (op.m_pPacingTimer) {
+		op.m_pPacingTimer->cancel();
+	}
+	if (op.m_pConnectTimer) {
+		op.m_pConnectTimer->cancel();
+	}
+	bool connecting = op.m_connecting.exchange(false);
+	if (op.m_event!=-1) {
+		op.m_pEventLoop->eraseEvent(op.m_event);
+		op.m_pEventLoop->eraseOutEvent(op.m_event);
+	}
+
+	m_event = op.m_event;
+	op.m_event = -1;
+	m_bufferedReader = std::move(op.m_bufferedReader);
+	m_transportCounters.bytesReceived = op.m_transportCounters.bytesReceived.load();
+	m_transportCounters.bytesSent = op.m_transportCounters.bytesSent.load();
+	m_transportCounters.partialWrites = op.m_transportCounters.partialWrites.load();
+	m_transportCounters.coalescedWrites = op.m_transportCounters.coalescedWrites.load();
+	m_transportCounters.blockedTime = op.m_transportCounters.blockedTime.load();
+	m_peerAddress = op.m_peerAddress;
+	m_peerAddressLength = op.m_peerAddressLength;
+	op.m_peerAddressLength = 0;
+	memset(&op.m_peerAddress, 0, sizeof(op.m_peerAddress));
+	m_localAddress = op.m_localAddress;
+	m_localAddressLength = op.m_localAddressLength;
+	op.m_localAddressLength = 0;
+	memset(&op.m_localAddress, 0, sizeof(op.m_localAddress));
+	m_connectAddresses = std::move(op.m_connectAddresses);
+	op.m_connectAddresses.clear();
+	m_connectAddressIndex = op.m_connectAddressIndex;
+	m_connectName = std::move(op.m_connectName);
+	op.m_connectName.clear();
+	m_connectCb = std::move(op.m_connectCb);
+	op.m_connectCb = ConnectCb_t();
+	m_options = op.m_options;
+	m_coalesceThreshold = op.m_coalesceThreshold;
+	m_inDataHandler = op.m_inDataHandler;
+	op.m_inDataHandler = DataCb_t();
+	m_outDataHandler = op.m_outDataHandler;
+	op.m_outDataHandler = DataCb_t();
+	m_sliceDataHandler = op.m_sliceDataHandler;
+	op.m_sliceDataHandler = SliceDataCb_t();
+	m_pUring = op.m_pUring;
+	// the operation stays armed, completions not yet processed are delivered to this object
+	m_uringOperation = op.m_uringOperation;
+	op.m_uringOperation = 0;
+	if (m_uringOperation) {
+		m_pUring->setCompletionCb(m_uringOperation, std::bind(&SocketNonblocking::uringReceived, this, std::placeholders::_1, std::placeholders::_2));
+	}
+
+	bool outEventRegistered;
+	bool userSpacePacing;
+	uint64_t pacingRate;
+	size_t pacingBurst;
+	{
+		std::lock_guard < std::mutex > lock(op.m_sendQueueMtx);
+		m_sendQueue.clear();
+		m_sendQueue.append(std::move(op.m_sendQueue));
+		outEventRegistered = op.m_outEventRegistered;
+		op.m_outEventRegistered = false;
+		m_lowWatermark = op.m_lowWatermark;
+		m_highWatermark = op.m_highWatermark;
+		m_aboveHighWatermark = op.m_aboveHighWatermark;
+		op.m_aboveHighWatermark = false;
+		m_watermarkCb = op.m_watermarkCb;
+		m_sendError = op.m_sendError;
+		op.m_sendError = 0;
+		m_sendErrorCb = op.m_sendErrorCb;
+		userSpacePacing = op.m_userSpacePacing;
+		op.m_userSpacePacing = false;
+		pacingRate = op.m_pacingRate;
+		op.m_pacingRate = 0;
+		pacingBurst = op.m_pacingBurst;
+	}
+
+	// register with this object. The in event is registered when connecting is finished.
+	if ((m_inDataHandler) && (!connecting)) {
+		m_pEventLoop->addEvent(m_event, std::bind(m_inDataHandler, std::ref(*this)));
+	}
+	if ((m_outDataHandler) || (outEventRegistered) || (connecting)) {
+		{
+			std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+			m_outEventRegistered = outEventRegistered;
+		}
+		if (connecting) {
+			waitForConnect();
+		} else {
+			m_pEventLoop->addOutEvent(m_event, std::bind(&SocketNonblocking::outEvent, this));
+		}
+	}
+	if (userSpacePacing) {
+		setPacingRate(pacingRate, pacingBurst, false);
+	} else {
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		m_pacingRate = pacingRate;
+	}
+}
+
 void hbk::communication::SocketNonblocking::setDataCb(DataCb_t dataCb)
 {
+	cancelUringReceive();
 	m_inDataHandler = dataCb;
-	m_eventLoop.addEvent(m_event, std::bind(dataCb, std::ref(*this)));
+	m_pEventLoop->addEvent(m_event, std::bind(dataCb, std::ref(*this)));
+}
+
+int hbk::communication::SocketNonblocking::setDataCb(Uring& uring, SliceDataCb_t dataCb)
+{
+	if ((m_event==-1) || (!dataCb)) {
+		return -1;
+	}
+	clearDataCb();
+	m_pUring = &uring;
+	m_sliceDataHandler = dataCb;
+
+	if (m_bufferedReader.getBufferedCount()>0) {
+		// received before. Goes first.
+		BufferChain chain;
+		if (receive(chain)>0) {
+			for (const auto &iter: chain.getSlices()) {
+				dataCb(*this, iter);
+			}
+		}
+	}
+
+	m_uringOperation = uring.receiveMultishot(m_event, std::bind(&SocketNonblocking::uringReceived, this, std::placeholders::_1, std::placeholders::_2));
+	if (m_uringOperation==0) {
+		m_sliceDataHandler = SliceDataCb_t();
+		return -1;
+	}
+	return 0;
+}
+
+void hbk::communication::SocketNonblocking::uringReceived(int result, const BufferSlice& data)
+{
+	// callback might destroy this object
+	SliceDataCb_t dataCb = m_sliceDataHandler;
+	if (result>0) {
+		m_transportCounters.bytesReceived += static_cast < uint64_t > (result);
+		rearmQuickAck();
+	} else {
+		// the operation ended
+		m_uringOperation = 0;
+		errno = -result;
+	}
+	if (dataCb) {
+		dataCb(*this, data);
+	}
+}
+
+void hbk::communication::SocketNonblocking::cancelUringReceive()
+{
+	if (m_uringOperation) {
+		m_pUring->cancel(m_uringOperation);
+		m_uringOperation = 0;
+	}
+	m_sliceDataHandler = SliceDataCb_t();
 }
 
 void hbk::communication::SocketNonblocking::clearDataCb()
 {
+	cancelUringReceive();
 	m_inDataHandler = DataCb_t();
-	m_eventLoop.eraseEvent(m_event);
+	m_pEventLoop->eraseEvent(m_event);
 }
 
 void hbk::communication::SocketNonblocking::setOutDataCb(DataCb_t dataCb)
 {
 	m_outDataHandler = dataCb;
-	m_eventLoop.addOutEvent(m_event, std::bind(dataCb, std::ref(*this)));
+	m_pEventLoop->addOutEvent(m_event, std::bind(&SocketNonblocking::outEvent, this));
 }
 
 void hbk::communication::SocketNonblocking::clearOutDataCb()
 {
-	m_inDataHandler = DataCb_t();
-	m_eventLoop.eraseOutEvent(m_event);
+	m_outDataHandler = DataCb_t();
+	bool outEventRegistered;
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		outEventRegistered = m_outEventRegistered;
+	}
+	if (!outEventRegistered) {
+		// still needed for sending queued data otherwise
+		m_pEventLoop->eraseOutEvent(m_event);
+	}
 }
 
-int hbk::communication::SocketNonblocking::setSocketOptions()
+void hbk::communication::SocketNonblocking::registerOutEvent()
 {
-	int opt = 1;
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		if (!m_outEventRegistered) {
+			// disconnected or taken over meanwhile
+			return;
+		}
+	}
+	if (m_event==-1) {
+		return;
+	}
+	// outEvent() sends the queued data when the socket becomes writable
+	m_pEventLoop->addOutEvent(m_event, std::bind(&SocketNonblocking::outEvent, this));
+}
 
-	struct sockaddr_storage sockAddr;
-	socklen_t sockAddrSize = sizeof(sockAddr);
-	if (getsockname(m_event, reinterpret_cast< struct sockaddr * > (&sockAddr), &sockAddrSize) < 0) {
-		syslog(LOG_ERR, "could not determine socket domain %s", strerror(errno));
-		return -1;
+int hbk::communication::SocketNonblocking::outEvent()
+{
+	if (m_connecting) {
+		return connectEvent();
 	}
-	if ((sockAddr.ss_family == AF_INET) || (sockAddr.ss_family == AF_INET6)) {
-		// those are relevant for ip sockets only:
+	if (sendQueued()) {
+		// queued data goes first
+		return 0;
+	}
+	if (m_outDataHandler) {
+		return static_cast < int > (m_outDataHandler(*this));
+	}
+	return 0;
+}
 
-		// turn off Nagle algorithm
-		if (setsockopt(m_event, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
-			syslog(LOG_ERR, "error turning off nagle algorithm %s", strerror(errno));
-			return -1;
+bool hbk::communication::SocketNonblocking::sendQueued()
+{
+	bool pending = false;
+	bool reachedLowWatermark = false;
+	WatermarkCb_t watermarkCb;
+	int sendError = 0;
+	SendErrorCb_t sendErrorCb;
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		if ((!m_sendQueue.empty()) && (m_sendError==0)) {
+			int result = drainSendQueue();
+			if (result<0) {
+				// reported once, the data stays queued
+				sendError = m_sendError;
+				sendErrorCb = m_sendErrorCb;
+			} else {
+				pending = (result!=0);
+			}
+			if ((m_aboveHighWatermark) && (m_sendQueue.size()<=m_lowWatermark)) {
+				m_aboveHighWatermark = false;
+				reachedLowWatermark = true;
+				watermarkCb = m_watermarkCb;
+			}
 		}
+	}
+	if ((reachedLowWatermark) && (watermarkCb)) {
+		watermarkCb(*this, false);
+	}
+	if ((sendError!=0) && (sendErrorCb)) {
+		sendErrorCb(*this, sendError);
+	}
+	return pending;
+}
 
-		opt = 12;
-		// the interval between the last data packet sent (simple ACKs are not considered data) and the first keepalive probe;
-		// after the connection is marked to need keepalive, this counter is not used any further
-		if (setsockopt(m_event, SOL_TCP, TCP_KEEPIDLE, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
-			syslog(LOG_ERR, "error setting socket option TCP_KEEPIDLE");
+void hbk::communication::SocketNonblocking::refillPacingTokens()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	uint64_t elapsed = static_cast < uint64_t > (std::chrono::duration_cast < std::chrono::microseconds > (now-m_pacingRefillTime).count());
+	uint64_t tokens;
+	if (elapsed>=1000000) {
+		// avoid overflow, the bucket is full anyway
+		tokens = m_pacingBurst;
+	} else {
+		tokens = m_pacingRate*elapsed/1000000;
+		if (tokens==0) {
+			// keep the fraction for the next refill
+			return;
+		}
+	}
+	m_pacingRefillTime = now;
+	m_pacingTokens += tokens;
+	if (m_pacingTokens>m_pacingBurst) {
+		m_pacingTokens = m_pacingBurst;
+	}
+}
+
+int hbk::communication::SocketNonblocking::drainSendQueue()
+{
+	static const size_t maxIovecCount = 64;
+	iovec iovecs[maxIovecCount];
+	msghdr msgHdr;
+
+	while (!m_sendQueue.empty()) {
+		size_t limit = m_sendQueue.size();
+		if (m_userSpacePacing) {
+			refillPacingTokens();
+			// do not send tiny pieces
+			size_t wanted = m_pacingBurst/4;
+			if (wanted>limit) {
+				wanted = limit;
+			}
+			if (m_pacingTokens<wanted) {
+				if (!m_pacingTimerArmed) {
+					uint64_t delay = ((wanted-m_pacingTokens)*1000+m_pacingRate-1)/m_pacingRate;
+					m_pacingTimerArmed = true;
+					m_pPacingTimer->set(std::chrono::milliseconds(delay), false, [this](bool fired)
+					{
+						{
+							std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+							m_pacingTimerArmed = false;
+						}
+						if (fired) {
+							sendQueued();
+						}
+					});
+				}
+				return 1;
+			}
+			if (m_pacingTokens<limit) {
+				limit = static_cast < size_t > (m_pacingTokens);
+			}
+		}
+
+		size_t iovecCount = 0;
+		size_t iovecTotal = 0;
+		for (const auto &iter: m_sendQueue.getSlices()) {
+			if ((iovecCount==maxIovecCount) || (iovecTotal==limit)) {
+				break;
+			}
+			size_t size = iter.size;
+			if (size>limit-iovecTotal) {
+				size = limit-iovecTotal;
+			}
+			iovecs[iovecCount].iov_base = const_cast < uint8_t* > (iter.pData);
+			iovecs[iovecCount].iov_len = size;
+			iovecTotal += size;
+			++iovecCount;
+		}
+		memset(&msgHdr, 0, sizeof(msgHdr));
+		msgHdr.msg_iov = iovecs;
+		msgHdr.msg_iovlen = iovecCount;
+		ssize_t result = sendmsg(m_event, &msgHdr, MSG_NOSIGNAL);
+		if (result>0) {
+			m_transportCounters.bytesSent += static_cast < uint64_t > (result);
+			m_sendQueue.consume(static_cast < size_t > (result));
+			if (m_userSpacePacing) {
+				m_pacingTokens -= static_cast < uint64_t > (result);
+			}
+		} else if ((result==-1) && ((errno==EWOULDBLOCK) || (errno==EAGAIN))) {
+			++m_transportCounters.partialWrites;
+			return 1;
+		} else if ((result==-1) && (errno==EINTR)) {
+			continue;
+		} else {
+			syslog(LOG_ERR, "sending queued data failed: '%s'", strerror(errno));
+			// kept for release() and getQueuedBytes()
+			m_sendError = errno;
 			return -1;
+		}
 	}
+	return 0;
+}
 
+void hbk::communication::SocketNonblocking::appendToSendQueue(const BufferSlice& slice)
+{
+	if (slice.buffer) {
+		m_sendQueue.append(slice);
+		return;
+	}
 
-		opt = 3;
-		// the interval between subsequential keepalive probes, regardless of what the connection has exchanged in the meantime
-		if (setsockopt(m_event, SOL_TCP, TCP_KEEPINTVL, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
-			syslog(LOG_ERR, "error setting socket option TCP_KEEPINTVL");
+	BufferPool& pool = m_bufferedReader.getBufferPool();
+	size_t offset = 0;
+	while (offset<slice.size) {
+		size_t chunkSize = slice.size - offset;
+		if (chunkSize>pool.getBufferSize()) {
+			chunkSize = pool.getBufferSize();
+		}
+		BufferPool::Buffer_t buffer = pool.get();
+		memcpy(buffer.get(), slice.pData+offset, chunkSize);
+		m_sendQueue.append(BufferSlice(buffer, buffer.get(), chunkSize));
+		offset += chunkSize;
+	}
+}
+
+bool hbk::communication::SocketNonblocking::reachedHighWatermark()
+{
+	if ((m_highWatermark==0) || (m_aboveHighWatermark)) {
+		return false;
+	}
+	if (m_sendQueue.size()<m_highWatermark) {
+		return false;
+	}
+	m_aboveHighWatermark = true;
+	return true;
+}
+
+int hbk::communication::SocketNonblocking::queueIfPending(const dataBlock_t* blocks, size_t blockCount)
+{
+	bool paced;
+	WatermarkCb_t watermarkCb;
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		if (m_sendError!=0) {
+			errno = m_sendError;
 			return -1;
 		}
+		paced = m_userSpacePacing;
+		if ((m_sendQueue.empty()) && (!paced)) {
+			return 0;
+		}
+		for (size_t blockIndex = 0; blockIndex<blockCount; ++blockIndex) {
+			appendToSendQueue(BufferSlice(std::shared_ptr < const uint8_t > (), reinterpret_cast < const uint8_t* > (blocks[blockIndex].pData), blocks[blockIndex].size));
+		}
+		if (reachedHighWatermark()) {
+			watermarkCb = m_watermarkCb;
+		}
+	}
+	if (paced) {
+		m_pPacingNotifier->notify();
+	}
+	if (watermarkCb) {
+		watermarkCb(*this, true);
+	}
+	return 1;
+}
+
+int hbk::communication::SocketNonblocking::sendAsync(const void* pBlock, size_t len)
+{
+	return sendAsync(BufferSlice(std::shared_ptr < const uint8_t > (), reinterpret_cast < const uint8_t* > (pBlock), len));
+}
 
+int hbk::communication::SocketNonblocking::sendAsync(const BufferSlice& slice)
+{
+	bool registerOutEvent = false;
+	bool paced;
+	WatermarkCb_t watermarkCb;
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		if (m_sendError!=0) {
+			errno = m_sendError;
+			return -1;
+		}
+		paced = m_userSpacePacing;
+		size_t offset = 0;
+		if ((m_sendQueue.empty()) && (!paced)) {
+			// nothing queued, try to send immediately
+			ssize_t result = ::send(m_event, slice.pData, slice.size, MSG_NOSIGNAL);
+			if (result>=0) {
+				m_transportCounters.bytesSent += static_cast < uint64_t > (result);
+				offset = static_cast < size_t > (result);
+			} else if ((errno!=EWOULDBLOCK) && (errno!=EAGAIN) && (errno!=EINTR)) {
+				return -1;
+			}
+			if (offset==slice.size) {
+				return 0;
+			}
+			++m_transportCounters.partialWrites;
+		}
+		appendToSendQueue(slice.subSlice(offset, slice.size-offset));
+		if (!m_outEventRegistered) {
+			m_outEventRegistered = true;
+			registerOutEvent = true;
+		}
+		if (reachedHighWatermark()) {
+			watermarkCb = m_watermarkCb;
+		}
+	}
 
-		opt = 2;
-		// the number of unacknowledged probes to send before considering the connection dead and notifying the application layer
-		if (setsockopt(m_event, SOL_TCP, TCP_KEEPCNT, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
-			syslog(LOG_ERR, "error setting socket option TCP_KEEPCNT");
+	if (registerOutEvent) {
+		// addOutEvent() sends right away. Let the event loop do it, the calling thread might be another one.
+		// Only the thread that set m_outEventRegistered gets here. Not created while holding m_sendQueueMtx
+		// because the event loop holds its own lock when calling outEvent().
+		try {
+			if (!m_pOutEventNotifier) {
+				m_pOutEventNotifier.reset(new sys::Notifier(*m_pEventLoop));
+				m_pOutEventNotifier->set(std::bind(&SocketNonblocking::registerOutEvent, this));
+			}
+		} catch (const hbk::exception::exception& e) {
+			syslog(LOG_ERR, "could not create notifier for sending queued data: '%s'", e.what());
+			std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+			// the next call tries again, queued data stays queued
+			m_outEventRegistered = false;
 			return -1;
 		}
+		m_pOutEventNotifier->notify();
+	}
+	if (paced) {
+		// the token bucket is drained by the event loop
+		m_pPacingNotifier->notify();
+	}
+	if (watermarkCb) {
+		watermarkCb(*this, true);
 	}
+	return 0;
+}
 
+void hbk::communication::SocketNonblocking::setSendErrorCb(SendErrorCb_t sendErrorCb)
+{
+	std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+	m_sendErrorCb = sendErrorCb;
+}
 
-	opt = 1;
-	if (setsockopt(m_event, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<char*>(&opt), sizeof(opt))==-1) {
-		syslog(LOG_ERR, "error setting socket option SO_KEEPALIVE");
+size_t hbk::communication::SocketNonblocking::getQueuedBytes() const
+{
+	std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+	return m_sendQueue.size();
+}
+
+int hbk::communication::SocketNonblocking::setWatermarks(size_t lowWatermark, size_t highWatermark, WatermarkCb_t watermarkCb, bool useNotSentLowWatermark)
+{
+	if ((highWatermark>0) && (lowWatermark>=highWatermark)) {
 		return -1;
 	}
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		m_lowWatermark = lowWatermark;
+		m_highWatermark = highWatermark;
+		m_watermarkCb = watermarkCb;
+		m_aboveHighWatermark = false;
+	}
+	if (useNotSentLowWatermark) {
+		m_options.notSentLowWatermark = static_cast < int > (lowWatermark);
+		if (m_event!=-1) {
+			setOptionalSocketOption(m_event, IPPROTO_TCP, TCP_NOTSENT_LOWAT, m_options.notSentLowWatermark, "TCP_NOTSENT_LOWAT");
+		}
+	}
+	return 0;
+}
+
+bool hbk::communication::SocketNonblocking::isAboveHighWatermark() const
+{
+	std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+	return m_aboveHighWatermark;
+}
 
+int hbk::communication::SocketNonblocking::setPacingRate(uint64_t bytesPerSecond, size_t burstSize, bool useKernel)
+{
+	/// token bucket: at least one full sized segment at once
+	static const size_t minBurstSize = 1500;
+
+	if (m_event==-1) {
+		return -1;
+	}
+
+	bool kernelPacing = false;
+	if ((useKernel) && (bytesPerSecond>0)) {
+		int protocol = 0;
+		socklen_t len = sizeof(protocol);
+		if ((getsockopt(m_event, SOL_SOCKET, SO_PROTOCOL, &protocol, &len)==0) && (protocol==IPPROTO_TCP)) {
+			kernelPacing = (setMaxPacingRate(m_event, bytesPerSecond)==0);
+		}
+	}
+	if (!kernelPacing) {
+		// remove a limit set before
+		setMaxPacingRate(m_event, 0);
+	}
+
+	bool userSpacePacing = (bytesPerSecond>0) && (!kernelPacing);
+	if (userSpacePacing) {
+		if (!m_pPacingTimer) {
+			m_pPacingTimer.reset(new sys::Timer(*m_pEventLoop));
+		}
+		if (!m_pPacingNotifier) {
+			m_pPacingNotifier.reset(new sys::Notifier(*m_pEventLoop));
+			m_pPacingNotifier->set(std::bind(&SocketNonblocking::sendQueued, this));
+		}
+	} else if (m_pPacingTimer) {
+		m_pPacingTimer->cancel();
+	}
+
+	bool registerOutEvent = false;
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		m_pacingRate = bytesPerSecond;
+		m_userSpacePacing = userSpacePacing;
+		if (userSpacePacing) {
+			if (burstSize==0) {
+				burstSize = static_cast < size_t > (bytesPerSecond/100);
+			}
+			if (burstSize<minBurstSize) {
+				burstSize = minBurstSize;
+			}
+			m_pacingBurst = burstSize;
+			m_pacingTokens = burstSize;
+			m_pacingRefillTime = std::chrono::steady_clock::now();
+			if (!m_outEventRegistered) {
+				m_outEventRegistered = true;
+				registerOutEvent = true;
+			}
+		}
+	}
+	if (registerOutEvent) {
+		m_pEventLoop->addOutEvent(m_event, std::bind(&SocketNonblocking::outEvent, this));
+	}
+	if (m_pPacingNotifier) {
+		// queued data is to be sent with the new rate
+		m_pPacingNotifier->notify();
+	}
+
+	if (userSpacePacing) {
+		return 1;
+	}
 	return 0;
 }
 
+uint64_t hbk::communication::SocketNonblocking::getPacingRate() const
+{
+	std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+	return m_pacingRate;
+}
+
+int hbk::communication::SocketNonblocking::setSocketOptions()
+{
+	int family = m_localAddress.ss_family;
+	if (m_localAddressLength==0) {
+		family = getSocketFamily(m_event);
+		if (family==-1) {
+			return -1;
+		}
+	}
+	return applySocketOptions(m_event, family, m_options);
+}
+
+int hbk::communication::SocketNonblocking::applyListenerOptions(int listeningFd, const SocketOptions& options)
+{
+	int family = getSocketFamily(listeningFd);
+	if ((family != AF_INET) && (family != AF_INET6)) {
+		// unix domain sockets do not inherit anything relevant
+		return -1;
+	}
+	return applySocketOptions(listeningFd, family, options);
+}
+
+int hbk::communication::SocketNonblocking::setOptions(const SocketOptions& options)
+{
+	m_options = options;
+	if (m_event==-1) {
+		// applied when connecting
+		return 0;
+	}
+	return setSocketOptions();
+}
+
+const hbk::communication::SocketOptions& hbk::communication::SocketNonblocking::getOptions() const
+{
+	return m_options;
+}
+
 
 int hbk::communication::SocketNonblocking::connect(const std::string &address, const std::string& port)
 {
@@ -228,6 +967,174 @@ int hbk::communication::SocketNonblocking::connect(const std::string &address, c
 	return retVal;
 }
 
+int hbk::communication::SocketNonblocking::connect(const std::string &address, const std::string& port, const SocketOptions& options)
+{
+	m_options = options;
+	return connect(address, port);
+}
+
+int hbk::communication::SocketNonblocking::connect(Resolver& resolver, const std::string& address, const std::string& port, ConnectCb_t connectCb)
+{
+	if (!connectCb) {
+		return -1;
+	}
+
+	std::weak_ptr < int > lifeToken = m_lifeToken;
+	auto resultCb = [this, lifeToken, connectCb, address, port](int error, const ResolvedAddresses& addresses)
+	{
+		if (lifeToken.expired()) {
+			// this object is gone
+			return;
+		}
+		if (error!=0) {
+			syslog(LOG_ERR, "could not get address information from '%s:%s': '%s'", address.c_str(), port.c_str(), gai_strerror(error));
+			connectCb(-1);
+			return;
+		}
+
+		m_connectAddresses = addresses;
+		m_connectAddressIndex = 0;
+		m_connectName = address + ":" + port;
+		m_connectCb = connectCb;
+		connectNext();
+	};
+	int result = resolver.resolve(address, port, resultCb);
+	if ((result==0) && (m_connecting)) {
+		// finished by the event loop
+		return 1;
+	}
+	return result;
+}
+
+void hbk::communication::SocketNonblocking::connectNext()
+{
+	while (m_connectAddressIndex<m_connectAddresses.size()) {
+		const ResolvedAddress& resolved = m_connectAddresses[m_connectAddressIndex++];
+		m_event = ::socket(resolved.family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if (m_event==-1) {
+			continue;
+		}
+		if (setSocketOptions()<0) {
+			closeConnectAttempt();
+			continue;
+		}
+		if (::connect(m_event, reinterpret_cast < const struct sockaddr* > (&resolved.address), resolved.addressLength)==0) {
+			connected();
+			return;
+		}
+		if (errno==EINPROGRESS) {
+			waitForConnect();
+			return;
+		}
+		syslog(LOG_ERR, "failed to connect socket (errno=%d '%s')", errno, strerror(errno));
+		closeConnectAttempt();
+	}
+	syslog(LOG_ERR, "could not connect to tcp socket '%s'", m_connectName.c_str());
+	finishConnect(-1);
+}
+
+void hbk::communication::SocketNonblocking::waitForConnect()
+{
+	if (!m_pConnectTimer) {
+		m_pConnectTimer.reset(new sys::Timer(*m_pEventLoop));
+	}
+	m_pConnectTimer->set(std::chrono::seconds(TIMEOUT_CONNECT_S), false, [this](bool fired)
+	{
+		bool connecting = true;
+		if ((!fired) || (!m_connecting.compare_exchange_strong(connecting, false))) {
+			return;
+		}
+		syslog(LOG_ERR, "connecting to '%s' timed out", m_connectName.c_str());
+		closeConnectAttempt();
+		connectNext();
+	});
+	m_connecting = true;
+	// outEvent() forwards to connectEvent() while connecting
+	m_pEventLoop->addOutEvent(m_event, std::bind(&SocketNonblocking::outEvent, this));
+}
+
+int hbk::communication::SocketNonblocking::connectEvent()
+{
+	if (waitForWritable(m_event, 0)!=1) {
+		// still in progress, addOutEvent() executes right away
+		return 0;
+	}
+	bool connecting = true;
+	if (!m_connecting.compare_exchange_strong(connecting, false)) {
+		// finished by another thread or timed out
+		return 0;
+	}
+
+	int value = 0;
+	socklen_t len = sizeof(value);
+	getsockopt(m_event, SOL_SOCKET, SO_ERROR, &value, &len);
+	if (value!=0) {
+		syslog(LOG_ERR, "failed to connect socket (errno=%d '%s')", value, strerror(value));
+		closeConnectAttempt();
+		connectNext();
+		return 0;
+	}
+	connected();
+	return 0;
+}
+
+void hbk::communication::SocketNonblocking::connected()
+{
+	captureAddresses();
+	if (m_inDataHandler) {
+		m_pEventLoop->addEvent(m_event, std::bind(m_inDataHandler, std::ref(*this)));
+	}
+	if (!finishConnect(0)) {
+		return;
+	}
+	if (m_event==-1) {
+		// disconnected by the callback
+		return;
+	}
+
+	bool outEventRegistered;
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		outEventRegistered = m_outEventRegistered;
+	}
+	if ((m_outDataHandler) || (outEventRegistered)) {
+		// the writable edge is consumed. Send what was queued meanwhile and tell the out data handler.
+		m_pEventLoop->addOutEvent(m_event, std::bind(&SocketNonblocking::outEvent, this));
+	} else {
+		m_pEventLoop->eraseOutEvent(m_event);
+	}
+}
+
+void hbk::communication::SocketNonblocking::closeConnectAttempt()
+{
+	if (m_pConnectTimer) {
+		m_pConnectTimer->cancel();
+	}
+	m_pEventLoop->eraseEvent(m_event);
+	m_pEventLoop->eraseOutEvent(m_event);
+	if (::close(m_event)) {
+		syslog(LOG_ERR, "closing socket %d failed '%s'", m_event, strerror(errno));
+	}
+	m_event = -1;
+}
+
+bool hbk::communication::SocketNonblocking::finishConnect(int result)
+{
+	if (m_pConnectTimer) {
+		m_pConnectTimer->cancel();
+	}
+	ConnectCb_t connectCb;
+	std::swap(connectCb, m_connectCb);
+	m_connectAddresses.clear();
+	m_connectName.clear();
+	// callback might destroy this object
+	std::weak_ptr < int > lifeToken = m_lifeToken;
+	if (connectCb) {
+		connectCb(result);
+	}
+	return !lifeToken.expired();
+}
+
 int hbk::communication::SocketNonblocking::connect(const std::string &path, bool useAbstractNamespace)
 {
 	struct sockaddr_un sockaddr;
@@ -263,11 +1170,12 @@ int hbk::communication::SocketNonblocking::connect(int domain, const struct sock
 
 	// callback functions might have already been set before fd was created.
 	if (m_inDataHandler) {
-		m_eventLoop.addEvent(m_event, std::bind(m_inDataHandler, std::ref(*this)));
+		m_pEventLoop->addEvent(m_event, std::bind(m_inDataHandler, std::ref(*this)));
 	}
 
 	if (m_outDataHandler) {
-		m_eventLoop.addOutEvent(m_event, std::bind(m_outDataHandler, std::ref(*this)));
+		// like setOutDataCb(): queued data goes first
+		m_pEventLoop->addOutEvent(m_event, std::bind(&SocketNonblocking::outEvent, this));
 	}
 
 	if (setSocketOptions()<0) {
@@ -293,12 +1201,114 @@ int hbk::communication::SocketNonblocking::connect(int domain, const struct sock
 			return -1;
 		}
 	}
+	captureAddresses();
 	return 0;
 }
 
+void hbk::communication::SocketNonblocking::captureAddresses()
+{
+	if (m_peerAddressLength==0) {
+		m_peerAddressLength = sizeof(m_peerAddress);
+		if (getpeername(m_event, reinterpret_cast < struct sockaddr* > (&m_peerAddress), &m_peerAddressLength)!=0) {
+			m_peerAddressLength = 0;
+		}
+	}
+	m_localAddressLength = sizeof(m_localAddress);
+	if (getsockname(m_event, reinterpret_cast < struct sockaddr* > (&m_localAddress), &m_localAddressLength)!=0) {
+		m_localAddressLength = 0;
+	}
+}
+
+void hbk::communication::SocketNonblocking::rearmQuickAck()
+{
+	if (m_options.quickAck) {
+		// the kernel falls back to delayed acknowledges from time to time
+		int opt = 1;
+		setsockopt(m_event, IPPROTO_TCP, TCP_QUICKACK, &opt, sizeof(opt));
+	}
+}
+
 ssize_t hbk::communication::SocketNonblocking::receive(void* pBlock, size_t size)
 {
-	return m_bufferedReader.recv(m_event, pBlock, size);
+	ssize_t retVal = m_bufferedReader.recv(m_event, pBlock, size);
+	if (retVal>0) {
+		m_transportCounters.bytesReceived += static_cast < uint64_t > (retVal);
+		rearmQuickAck();
+	}
+	return retVal;
+}
+
+ssize_t hbk::communication::SocketNonblocking::receive(BufferChain& chain)
+{
+	ssize_t retVal = m_bufferedReader.recv(m_event, chain);
+	if (retVal>0) {
+		m_transportCounters.bytesReceived += static_cast < uint64_t > (retVal);
+		rearmQuickAck();
+	}
+	return retVal;
+}
+
+ssize_t hbk::communication::SocketNonblocking::receiveBlocks(const dataBlock_t* blocks, size_t blockCount)
+{
+	ssize_t retVal = m_bufferedReader.recv(m_event, blocks, blockCount);
+	if (retVal>0) {
+		m_transportCounters.bytesReceived += static_cast < uint64_t > (retVal);
+		rearmQuickAck();
+	}
+	return retVal;
+}
+
+ssize_t hbk::communication::SocketNonblocking::receiveBlocksComplete(const dataBlock_t* blocks, size_t blockCount, int msTimeout)
+{
+	// keep the blocks of the caller untouched
+	std::vector < dataBlock_t > remaining(blocks, blocks+blockCount);
+	size_t totalLength = 0;
+	for (const auto &iter: remaining) {
+		totalLength += iter.size;
+	}
+
+	size_t received = 0;
+	size_t blockIndex = 0;
+	while (received<totalLength) {
+		ssize_t retVal = receiveBlocks(remaining.data()+blockIndex, remaining.size()-blockIndex);
+		if (retVal>0) {
+			received += static_cast < size_t > (retVal);
+			size_t offset = static_cast < size_t > (retVal);
+			while ((blockIndex<remaining.size()) && (offset>=remaining[blockIndex].size)) {
+				offset -= remaining[blockIndex].size;
+				++blockIndex;
+			}
+			if (offset>0) {
+				remaining[blockIndex].pData = reinterpret_cast < const uint8_t* > (remaining[blockIndex].pData) + offset;
+				remaining[blockIndex].size -= offset;
+			}
+		} else if (retVal==0) {
+			return static_cast < ssize_t > (received);
+		} else {
+			if(errno==EWOULDBLOCK || errno==EAGAIN) {
+				// wait for socket to become readable.
+				struct pollfd pfd;
+				pfd.fd = m_event;
+				pfd.events = POLLIN;
+				int nfds;
+				do {
+					nfds = poll(&pfd, 1, msTimeout);
+				} while((nfds==-1) && (errno==EINTR));
+				if(nfds!=1) {
+					return -1;
+				}
+			} else {
+				syslog(LOG_ERR, "%s: recv failed '%s'", __FUNCTION__, strerror(errno));
+				return -1;
+			}
+		}
+	}
+	return static_cast < ssize_t > (totalLength);
+}
+
+void hbk::communication::SocketNonblocking::setBufferPool(BufferPool& pool)
+{
+	m_bufferedReader.setBufferPool(pool);
 }
 
 ssize_t hbk::communication::SocketNonblocking::receiveComplete(void* pBlock, size_t size, int msTimeout)
@@ -309,6 +1319,7 @@ ssize_t hbk::communication::SocketNonblocking::receiveComplete(void* pBlock, siz
 	while (sizeLeft) {
 		retVal = m_bufferedReader.recv(m_event, pPos, sizeLeft);
 		if (retVal>0) {
+			m_transportCounters.bytesReceived += static_cast < uint64_t > (retVal);
 			sizeLeft -= static_cast < size_t > (retVal);
 			pPos += retVal;
 		} else if (retVal==0) {
@@ -338,19 +1349,32 @@ ssize_t hbk::communication::SocketNonblocking::receiveComplete(void* pBlock, siz
 
 ssize_t hbk::communication::SocketNonblocking::sendBlocks(dataBlock_t *blocks, size_t blockCount, bool more)
 {
+	size_t totalLength = 0;
+	for(size_t blockIndex = 0; blockIndex<blockCount; ++blockIndex) {
+		totalLength += blocks[blockIndex].size;
+	}
+
+	if (m_coalesceThreshold>0) {
+		int result = coalesce(blocks, blockCount);
+		if (result<0) {
+			return -1;
+		} else if (result>0) {
+			return static_cast < ssize_t > (totalLength);
+		}
+	}
+	if (queueIfPending(blocks, blockCount)>0) {
+		return static_cast < ssize_t > (totalLength);
+	}
+
 	msghdr msgHdr;
 	memset(&msgHdr, 0, sizeof(msgHdr));
 
-	size_t totalLength = 0;
 	size_t totalBytesRemaining;
 
 	int flags = MSG_NOSIGNAL;
 	if (more) {
 		flags = MSG_MORE;
 	}
-	for(size_t blockIndex = 0; blockIndex<blockCount; ++blockIndex) {
-		totalLength += blocks[blockIndex].size;
-	}
 	totalBytesRemaining = totalLength;
 	
 	dataBlock_t *pBlockPos = blocks;
@@ -378,11 +1402,13 @@ ssize_t hbk::communication::SocketNonblocking::sendBlocks(dataBlock_t *blocks, s
 			bytesWritten = static_cast < size_t >(retVal);
 		}
 		
+		m_transportCounters.bytesSent += bytesWritten;
 		totalBytesRemaining -= bytesWritten;
 		if (totalBytesRemaining==0) {
 			// we are done!
 			return static_cast < ssize_t > (totalLength);
 		}
+		++m_transportCounters.partialWrites;
 		// in this case we might have written nothing at all or only a part
 		// reorganize buffer and write again...
 		size_t remainingOffset = bytesWritten;
@@ -399,7 +1425,7 @@ ssize_t hbk::communication::SocketNonblocking::sendBlocks(dataBlock_t *blocks, s
 		} while (true);
 		
 		//syslog(LOG_INFO, "%zu bytes in %zu blocks left", totalBytesRemaining, blockCount);
-		retVal = waitForWritable(m_event, -1);
+		retVal = waitForWritableCounted();
 		if (retVal!=1) {
 			return -1;
 		}
@@ -421,6 +1447,19 @@ ssize_t hbk::communication::SocketNonblocking::sendBlocks(const dataBlocks_t &bl
 
 ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, size_t size, bool more)
 {
+	dataBlock_t block(pBlock, size);
+	if (m_coalesceThreshold>0) {
+		int result = coalesce(&block, 1);
+		if (result<0) {
+			return -1;
+		} else if (result>0) {
+			return static_cast < ssize_t > (size);
+		}
+	}
+	if (queueIfPending(&block, 1)>0) {
+		return static_cast < ssize_t > (size);
+	}
+
 	const uint8_t* pDat = reinterpret_cast<const uint8_t*>(pBlock);
 	size_t BytesLeft = size;
 	ssize_t numBytes;
@@ -435,6 +1474,10 @@ ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, siz
 	while (BytesLeft > 0) {
 		numBytes = ::send(m_event, pDat, BytesLeft, flags);
 		if (numBytes>0) {
+			m_transportCounters.bytesSent += static_cast < uint64_t > (numBytes);
+			if (static_cast < size_t > (numBytes)<BytesLeft) {
+				++m_transportCounters.partialWrites;
+			}
 			pDat += numBytes;
 			BytesLeft -= static_cast < size_t > (numBytes);
 		} else if(numBytes==0) {
@@ -444,8 +1487,9 @@ ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, siz
 		} else {
 			// <0
 			if(errno==EWOULDBLOCK || errno==EAGAIN) {
+				++m_transportCounters.partialWrites;
 				// wait for socket to become writable.
-				err = waitForWritable(m_event, -1);
+				err = waitForWritableCounted();
 				if (err!=1) {
 					BytesLeft = 0;
 					retVal = -1;
@@ -463,57 +1507,139 @@ ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, siz
 
 ssize_t hbk::communication::SocketNonblocking::send(const void* pBlock, size_t len, bool more)
 {
+	dataBlock_t block(pBlock, len);
+	if (m_coalesceThreshold>0) {
+		int result = coalesce(&block, 1);
+		if (result<0) {
+			return -1;
+		} else if (result>0) {
+			return static_cast < ssize_t > (len);
+		}
+	}
+	if (queueIfPending(&block, 1)>0) {
+		return static_cast < ssize_t > (len);
+	}
+
 	int flags = MSG_NOSIGNAL;
 	if(more) {
 		flags |= MSG_MORE;
 	}
-	return ::send(m_event, pBlock, len, flags);
+	ssize_t retVal = ::send(m_event, pBlock, len, flags);
+	if (retVal>=0) {
+		m_transportCounters.bytesSent += static_cast < uint64_t > (retVal);
+		if (static_cast < size_t > (retVal)<len) {
+			++m_transportCounters.partialWrites;
+		}
+	} else if ((errno==EWOULDBLOCK) || (errno==EAGAIN)) {
+		++m_transportCounters.partialWrites;
+	}
+	return retVal;
 }
 
 
-bool hbk::communication::SocketNonblocking::checkSockAddr(const struct ::sockaddr* pCheckSockAddr, socklen_t checkSockAddrLen) const
+void hbk::communication::SocketNonblocking::sendQueuedBeforeClosing()
 {
-	struct sockaddr sockAddr;
-	socklen_t addrLen = sizeof(sockaddr_in);
-
-	char checkHost[256] = "";
-	char ckeckService[8] = "";
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()+std::chrono::milliseconds(TIMEOUT_DISCONNECT_MS);
+	do {
+		{
+			std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+			if (m_sendError!=0) {
+				return;
+			}
+			// the rest goes at once
+			m_userSpacePacing = false;
+			if (drainSendQueue()!=1) {
+				// sent or error
+				return;
+			}
+		}
+		int remaining = static_cast < int > (std::chrono::duration_cast < std::chrono::milliseconds > (deadline-std::chrono::steady_clock::now()).count());
+		if (remaining<=0) {
+			break;
+		}
+		if (waitForWritable(m_event, remaining)<=0) {
+			break;
+		}
+	} while (true);
+	syslog(LOG_WARNING, "peer did not take the queued data in time, %zu bytes are discarded", getQueuedBytes());
+}
 
-	char host[256] = "";
-	char service[8] = "";
-	int err = getnameinfo(pCheckSockAddr, checkSockAddrLen, checkHost, sizeof(checkHost), ckeckService, sizeof(ckeckService), NI_NUMERICHOST | NI_NUMERICSERV);
-	if (err != 0) {
-		syslog(LOG_ERR, "%s: error from getnameinfo", __FUNCTION__);
-		return false;
+void hbk::communication::SocketNonblocking::disconnect()
+{
+	// a pending asynchronous connect is abandoned
+	m_connecting = false;
+	if (m_pConnectTimer) {
+		m_pConnectTimer->cancel();
 	}
-
-	if (getpeername(m_event, &sockAddr, &addrLen)!=0) {
-		return false;
+	m_connectCb = ConnectCb_t();
+	m_connectAddresses.clear();
+	// collected data goes to the queue
+	flush();
+	m_coalesceBuffer.clear();
+	m_pEventLoop->eraseIterationEndHandler(this);
+	if (m_pPacingTimer) {
+		m_pPacingTimer->cancel();
 	}
-
-	if (getnameinfo(&sockAddr, addrLen, host, sizeof(host), service, sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV)!=0) {
-		return false;
+	cancelUringReceive();
+	if (m_event!=-1) {
+		sendQueuedBeforeClosing();
 	}
-
-	if ((strcmp(host, checkHost)==0) && (strcmp(service, ckeckService)==0)
-		)
 	{
-		return true;
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		m_sendQueue.clear();
+		m_sendError = 0;
+		m_outEventRegistered = false;
+		m_aboveHighWatermark = false;
+		m_pacingRate = 0;
+		m_userSpacePacing = false;
 	}
-	return false;
-}
-
-void hbk::communication::SocketNonblocking::disconnect()
-{
 	if (m_event!=-1) {
 		if (::close(m_event)) {
 			syslog(LOG_ERR, "closing socket %d failed '%s'", m_event, strerror(errno));
 		}
-		m_eventLoop.eraseEvent(m_event);
-		m_eventLoop.eraseOutEvent(m_event);
+		m_pEventLoop->eraseEvent(m_event);
+		m_pEventLoop->eraseOutEvent(m_event);
+	}
+
+	m_event = -1;
+	memset(&m_peerAddress, 0, sizeof(m_peerAddress));
+	m_peerAddressLength = 0;
+	memset(&m_localAddress, 0, sizeof(m_localAddress));
+	m_localAddressLength = 0;
+}
+
+int hbk::communication::SocketNonblocking::release(std::vector < uint8_t >& unreadData, BufferChain& unsentData)
+{
+	if (m_event==-1) {
+		return -1;
+	}
+	// collected data goes to the queue
+	flush();
+	// the operation must not consume data anymore
+	cancelUringReceive();
+
+	unreadData.resize(m_bufferedReader.getBufferedCount());
+	if (!unreadData.empty()) {
+		// delivers buffered data only
+		m_bufferedReader.recv(m_event, unreadData.data(), unreadData.size());
+	}
+	{
+		std::lock_guard < std::mutex > lock(m_sendQueueMtx);
+		unsentData.append(std::move(m_sendQueue));
 	}
 
+	m_pEventLoop->eraseEvent(m_event);
+	m_pEventLoop->eraseOutEvent(m_event);
+	int fd = m_event;
 	m_event = -1;
+	// cleans up everything else without closing
+	disconnect();
+	return fd;
+}
+
+int hbk::communication::SocketNonblocking::preload(const void* pData, size_t size)
+{
+	return m_bufferedReader.preload(pData, size);
 }
 
 bool hbk::communication::SocketNonblocking::isFirewire() const
@@ -22,7 +22,12 @@
 
 #include <memory>
 #include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
 #include <sys/stat.h>
 #include <sys/un.h>
@@ -33,15 +38,94 @@
 
 #include "hbk/communication/socketnonblocking.h"
 #include "hbk/communication/tcpserver.h"
+#include "hbk/communication/uring.h"
 #include "hbk/sys/eventloop.h"
 
 
+/// connections accepted in one go before the other events of the event loop get their turn
+static const unsigned int MAX_ACCEPTS_PER_WAKEUP = 64;
+
+/// \return empty if the worker could not be created. clientFd is closed then.
+static hbk::communication::clientSocket_t createWorker(int clientFd, hbk::sys::EventLoop& eventLoop, const hbk::communication::SocketOptions& options,
+	const struct sockaddr* pPeerAddress, socklen_t peerAddressLength, bool optionsInherited, hbk::communication::BufferPool& bufferPool)
+{
+	hbk::communication::clientSocket_t worker;
+	try {
+		worker.reset(new hbk::communication::SocketNonblocking(clientFd, eventLoop, options, pPeerAddress, peerAddressLength, optionsInherited));
+	} catch (const std::exception& e) {
+		::syslog(LOG_ERR, "server: Could not create worker socket '%s'", e.what());
+		::close(clientFd);
+		return worker;
+	}
+	worker->setBufferPool(bufferPool);
+	return worker;
+}
+
 namespace hbk {
 	namespace communication {
+		TcpServer::AcceptStats::AcceptStats()
+			: wakeups(0)
+			, accepted(0)
+			, maxAcceptedPerWakeup(0)
+			, fileLimitCount(0)
+		{
+		}
+
+		TcpServer::CpuTarget::CpuTarget(sys::EventLoop& eventLoop)
+			: eventLoop(eventLoop)
+			, mtx()
+			, clients()
+			, acceptCb()
+			, options()
+			, optionsInherited(false)
+			, pBufferPool(nullptr)
+			, notifier(eventLoop)
+		{
+			notifier.set(std::bind(&CpuTarget::addWorkers, this));
+		}
+
+		void TcpServer::CpuTarget::addWorkers()
+		{
+			std::vector < PendingClient > pendingClients;
+			Cb_t cb;
+			SocketOptions socketOptions;
+			bool inherited;
+			BufferPool* pPool;
+			{
+				std::lock_guard < std::mutex > lock(mtx);
+				pendingClients.swap(clients);
+				cb = acceptCb;
+				socketOptions = options;
+				inherited = optionsInherited;
+				pPool = pBufferPool;
+			}
+			for (auto &iter: pendingClients) {
+				if (!cb) {
+					// stopped meanwhile
+					::close(iter.fd);
+					continue;
+				}
+				const struct sockaddr* pPeerAddress = reinterpret_cast < const struct sockaddr* > (&iter.peerAddress);
+				clientSocket_t worker = createWorker(iter.fd, eventLoop, socketOptions, pPeerAddress, iter.peerAddressLength, inherited, *pPool);
+				if (worker) {
+					cb(std::move(worker));
+				}
+			}
+		}
+
 		TcpServer::TcpServer(sys::EventLoop &eventLoop)
 			: m_listeningEvent(-1)
 			, m_eventLoop(eventLoop)
 			, m_acceptCb()
+			, m_pBufferPool(&BufferPool::defaultPool())
+			, m_options()
+			, m_pUring(nullptr)
+			, m_uringOperation(0)
+			, m_cpuTargets()
+			, m_redirectedCount(0)
+			, m_optionsInherited(false)
+			, m_acceptStats()
+			, m_reserveFd(-1)
 		{
 		}
 
@@ -50,7 +134,7 @@ namespace hbk {
 			stop();
 		}
 
-		int TcpServer::start(uint16_t port, int backlog, Cb_t acceptCb)
+		int TcpServer::start(uint16_t port, int backlog, Cb_t acceptCb, const SocketOptions& options)
 		{
 			if (!acceptCb) {
 				return -1;
@@ -80,15 +164,15 @@ namespace hbk {
 				::syslog(LOG_ERR, "server: Binding socket to port %u failed '%s'", port, strerror(errno));
 				return -1;
 			}
+			setListenerOptions(options);
 			if (listen(m_listeningEvent, backlog)==-1) {
 				return -1;
 			}
-			m_acceptCb = acceptCb;
-			m_eventLoop.addEvent(m_listeningEvent, std::bind(&TcpServer::process, this));
+			startAccepting(acceptCb);
 			return 0;
 		}
 
-		int TcpServer::start(const std::string& path, bool useAbstractNamespace, int backlog, Cb_t acceptCb)
+		int TcpServer::start(const std::string& path, bool useAbstractNamespace, int backlog, Cb_t acceptCb, const SocketOptions& options)
 		{
 			sockaddr_un address;
 			memset(&address, 0, sizeof(address));
@@ -126,40 +210,313 @@ namespace hbk {
 				chmod(path.c_str(), 0666); // everyone should have access
 				m_unixDomainSocketPath = path;
 			}
+			setListenerOptions(options);
 			if (listen(m_listeningEvent, backlog)==-1) {
 				return -1;
 			}
 
+			startAccepting(acceptCb);
+			return 0;
+		}
+
+		int TcpServer::start(int listeningFd, Cb_t acceptCb, const SocketOptions& options)
+		{
+			if ((listeningFd==-1) || (!acceptCb)) {
+				return -1;
+			}
+			int flags = fcntl(listeningFd, F_GETFL, 0);
+			if ((flags==-1) || (fcntl(listeningFd, F_SETFL, flags | O_NONBLOCK)==-1)) {
+				::syslog(LOG_ERR, "server: Could not set listening socket to non-blocking '%s'", strerror(errno));
+				return -1;
+			}
+			m_listeningEvent = listeningFd;
+
+			sockaddr_un address;
+			socklen_t addressLen = sizeof(address);
+			memset(&address, 0, sizeof(address));
+			if (getsockname(m_listeningEvent, reinterpret_cast < sockaddr* > (&address), &addressLen)==0) {
+				if ((address.sun_family==AF_UNIX) && (address.sun_path[0]!='\0')) {
+					// to be unlinked on stop
+					m_unixDomainSocketPath = address.sun_path;
+				}
+			}
+			setListenerOptions(options);
+			startAccepting(acceptCb);
+			return 0;
+		}
+
+		int TcpServer::release()
+		{
+			if (m_listeningEvent==-1) {
+				return -1;
+			}
+			if (m_uringOperation) {
+				m_pUring->cancel(m_uringOperation);
+				m_uringOperation = 0;
+			}
+			m_eventLoop.eraseEvent(m_listeningEvent);
+			int fd = m_listeningEvent;
+			m_listeningEvent = -1;
+			if (m_reserveFd!=-1) {
+				::close(m_reserveFd);
+				m_reserveFd = -1;
+			}
+			m_unixDomainSocketPath.clear();
+			m_acceptCb = Cb_t();
+			return fd;
+		}
+
+		void TcpServer::setListenerOptions(const SocketOptions& options)
+		{
+			m_options = options;
+			// accepted sockets inherit the options, which saves several system calls per connection
+			m_optionsInherited = (SocketNonblocking::applyListenerOptions(m_listeningEvent, options)==0);
+			if (m_optionsInherited) {
+				return;
+			}
+			if (!options.congestionControl.empty()) {
+				// check availability once here instead of failing silently for each worker
+				if (setsockopt(m_listeningEvent, IPPROTO_TCP, TCP_CONGESTION, options.congestionControl.c_str(), static_cast < socklen_t > (options.congestionControl.length()))==-1) {
+					::syslog(LOG_WARNING, "server: congestion control '%s' not available '%s'", options.congestionControl.c_str(), strerror(errno));
+				}
+			}
+			if (options.receiveBufferSize>0) {
+				// the window scale is negotiated during handshake, hence the receive buffer size has to be known before accepting
+				if (setsockopt(m_listeningEvent, SOL_SOCKET, SO_RCVBUF, &options.receiveBufferSize, sizeof(options.receiveBufferSize))==-1) {
+					::syslog(LOG_WARNING, "server: could not set receive buffer size '%s'", strerror(errno));
+				}
+			}
+		}
+
+		void TcpServer::startAccepting(Cb_t acceptCb)
+		{
 			m_acceptCb = acceptCb;
+			if (m_reserveFd==-1) {
+				m_reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+			}
+			updateCpuTargets();
+			if (m_pUring) {
+				m_uringOperation = m_pUring->acceptMultishot(m_listeningEvent, [this](int result, const BufferSlice&) {
+					if (result>=0) {
+						++m_acceptStats.accepted;
+						addWorker(result);
+						return;
+					}
+					if ((result==-EMFILE) || (result==-ENFILE)) {
+						++m_acceptStats.fileLimitCount;
+					}
+					// the operation ended
+					m_uringOperation = 0;
+					::syslog(LOG_ERR, "server: multishot accept ended '%s', continuing with event loop", strerror(-result));
+					m_eventLoop.addEvent(m_listeningEvent, std::bind(&TcpServer::process, this));
+				});
+				if (m_uringOperation!=0) {
+					return;
+				}
+				::syslog(LOG_WARNING, "server: Could not start multishot accept, continuing with event loop");
+			}
 			m_eventLoop.addEvent(m_listeningEvent, std::bind(&TcpServer::process, this));
-			return 0;
+		}
+
+		void TcpServer::setCpuEventLoops(const std::vector < sys::EventLoop* >& eventLoops)
+		{
+			clearCpuTargets();
+			m_cpuTargets.clear();
+			for (size_t cpu = 0; cpu<eventLoops.size(); ++cpu) {
+				std::shared_ptr < CpuTarget > target;
+				sys::EventLoop* pEventLoop = eventLoops[cpu];
+				if ((pEventLoop) && (pEventLoop!=&m_eventLoop)) {
+					for (const auto &iter: m_cpuTargets) {
+						if ((iter) && (&iter->eventLoop==pEventLoop)) {
+							target = iter;
+							break;
+						}
+					}
+					if (!target) {
+						target = std::make_shared < CpuTarget > (*pEventLoop);
+					}
+				}
+				m_cpuTargets.push_back(target);
+			}
+			updateCpuTargets();
+		}
+
+		void TcpServer::updateCpuTargets()
+		{
+			for (auto &iter: m_cpuTargets) {
+				if (iter) {
+					std::lock_guard < std::mutex > lock(iter->mtx);
+					iter->acceptCb = m_acceptCb;
+					iter->options = m_options;
+					iter->optionsInherited = m_optionsInherited;
+					iter->pBufferPool = m_pBufferPool;
+				}
+			}
+		}
+
+		void TcpServer::clearCpuTargets()
+		{
+			for (auto &iter: m_cpuTargets) {
+				if (iter) {
+					std::lock_guard < std::mutex > lock(iter->mtx);
+					for (auto &clientIter: iter->clients) {
+						::close(clientIter.fd);
+					}
+					iter->clients.clear();
+					iter->acceptCb = Cb_t();
+				}
+			}
+		}
+
+		void TcpServer::addWorker(int clientFd, const struct sockaddr* pPeerAddress, socklen_t peerAddressLength)
+		{
+			if (!m_cpuTargets.empty()) {
+				int cpu = -1;
+				socklen_t len = sizeof(cpu);
+				if ((getsockopt(clientFd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len)==0) && (cpu>=0) && (static_cast < size_t > (cpu)<m_cpuTargets.size())) {
+					CpuTarget* pTarget = m_cpuTargets[static_cast < size_t > (cpu)].get();
+					if (pTarget) {
+						PendingClient client;
+						client.fd = clientFd;
+						client.peerAddressLength = 0;
+						if ((pPeerAddress) && (peerAddressLength<=sizeof(client.peerAddress))) {
+							memcpy(&client.peerAddress, pPeerAddress, peerAddressLength);
+							client.peerAddressLength = peerAddressLength;
+						}
+						{
+							std::lock_guard < std::mutex > lock(pTarget->mtx);
+							pTarget->clients.push_back(client);
+						}
+						++m_redirectedCount;
+						pTarget->notifier.notify();
+						return;
+					}
+				}
+			}
+			clientSocket_t worker = createWorker(clientFd, m_eventLoop, m_options, pPeerAddress, peerAddressLength, m_optionsInherited, *m_pBufferPool);
+			if (worker) {
+				// a copy, the callback might stop the server which clears m_acceptCb
+				Cb_t acceptCb = m_acceptCb;
+				acceptCb(std::move(worker));
+			}
 		}
 
 		void TcpServer::stop()
 		{
+			if (m_uringOperation) {
+				m_pUring->cancel(m_uringOperation);
+				m_uringOperation = 0;
+			}
 			m_eventLoop.eraseEvent(m_listeningEvent);
-			::close(m_listeningEvent);
+			if (m_listeningEvent!=-1) {
+				::close(m_listeningEvent);
+				m_listeningEvent = -1;
+			}
+			if (m_reserveFd!=-1) {
+				::close(m_reserveFd);
+				m_reserveFd = -1;
+			}
 			if (!m_unixDomainSocketPath.empty()) {
 				// unlink non-abstract unix domain socket
 				if(::unlink(m_unixDomainSocketPath.c_str())) {
 					::syslog(LOG_ERR, "server: unlinking %s failed '%s'", m_unixDomainSocketPath.c_str(), strerror(errno));
 				}
+				m_unixDomainSocketPath.clear();
 			}
+			clearCpuTargets();
 			m_acceptCb = Cb_t();
 		}
 
-		int TcpServer::process()
+		int TcpServer::shedConnection()
 		{
-			int clientFd = ::accept(m_listeningEvent, nullptr, nullptr);
+			if (m_reserveFd==-1) {
+				return -1;
+			}
+			::close(m_reserveFd);
+			int clientFd = ::accept4(m_listeningEvent, nullptr, nullptr, SOCK_CLOEXEC);
+			if (clientFd!=-1) {
+				::close(clientFd);
+			}
+			m_reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
 			if (clientFd==-1) {
-				if ((errno!=EWOULDBLOCK) && (errno!=EAGAIN) && (errno!=EINTR) ) {
-					::syslog(LOG_ERR, "server: error accepting connection '%s'", strerror(errno));
-				}
 				return -1;
 			}
-			m_acceptCb(clientSocket_t(new SocketNonblocking(clientFd, m_eventLoop)));
-			// we are working edge triggered. Returning > 0 tells the eventloop to call process again to try whether there is more in the queue.
-			return 1;
+			return 0;
+		}
+
+		int TcpServer::process()
+		{
+			int result = -1;
+			unsigned int acceptedCount = 0;
+			unsigned int attemptCount = 0;
+			while (attemptCount<MAX_ACCEPTS_PER_WAKEUP) {
+				++attemptCount;
+				struct sockaddr_storage peerAddress;
+				socklen_t peerAddressLength = sizeof(peerAddress);
+				// non-blocking right away, saves the fcntl() per connection
+				int clientFd = ::accept4(m_listeningEvent, reinterpret_cast < struct sockaddr* > (&peerAddress), &peerAddressLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (clientFd==-1) {
+					if (errno==EINTR) {
+						continue;
+					}
+					if ((errno==EMFILE) || (errno==ENFILE)) {
+						++m_acceptStats.fileLimitCount;
+						if (shedConnection()==0) {
+							// the client gets told instead of waiting for a connection that is never served
+							continue;
+						}
+						::syslog(LOG_ERR, "server: error accepting connection '%s', no reserve file descriptor left", strerror(errno));
+						break;
+					}
+					if ((errno!=EWOULDBLOCK) && (errno!=EAGAIN)) {
+						::syslog(LOG_ERR, "server: error accepting connection '%s'", strerror(errno));
+					}
+					break;
+				}
+				addWorker(clientFd, reinterpret_cast < struct sockaddr* > (&peerAddress), peerAddressLength);
+				++acceptedCount;
+				if (m_listeningEvent==-1) {
+					// the accept callback stopped the server
+					break;
+				}
+			}
+			if ((attemptCount==MAX_ACCEPTS_PER_WAKEUP) && (m_listeningEvent!=-1)) {
+				// we are working edge triggered. Returning > 0 tells the eventloop to call process again after the other events got their turn.
+				result = 1;
+			}
+
+			++m_acceptStats.wakeups;
+			m_acceptStats.accepted += acceptedCount;
+			if (acceptedCount>m_acceptStats.maxAcceptedPerWakeup) {
+				m_acceptStats.maxAcceptedPerWakeup = acceptedCount;
+			}
+			return result;
+		}
+
+		int64_t TcpServer::getListenOverflowCount()
+		{
+			// pairs of lines: names, then values
+			std::ifstream file("/proc/net/netstat");
+			std::string names;
+			std::string values;
+			while ((std::getline(file, names)) && (std::getline(file, values))) {
+				if (names.compare(0, 7, "TcpExt:")!=0) {
+					continue;
+				}
+				std::istringstream nameStream(names);
+				std::istringstream valueStream(values);
+				std::string name;
+				int64_t value;
+				// skip the prefix
+				nameStream >> name;
+				valueStream >> name;
+				while ((nameStream >> name) && (valueStream >> value)) {
+					if (name=="ListenOverflows") {
+						return value;
+					}
+				}
+			}
+			return -1;
 		}
 	}
 }
@@ -0,0 +1,164 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "hbk/communication/tcpservergroup.h"
+
+namespace hbk {
+	namespace communication {
+		TcpServerGroup::TcpServerGroup(const std::vector < sys::EventLoop* >& eventLoops)
+			: m_servers()
+			, m_listeningFds()
+			, m_port(0)
+		{
+			if (eventLoops.empty()) {
+				throw std::invalid_argument("no event loop");
+			}
+			for (auto &iter: eventLoops) {
+				if (iter==nullptr) {
+					throw std::invalid_argument("event loop is nullptr");
+				}
+				m_servers.push_back(std::unique_ptr < TcpServer > (new TcpServer(*iter)));
+			}
+		}
+
+		TcpServerGroup::~TcpServerGroup()
+		{
+			stop();
+		}
+
+		int TcpServerGroup::createListener(uint16_t port, int backlog)
+		{
+			//ipv6 does work for ipv4 too!
+			sockaddr_in6 address;
+			memset(&address, 0, sizeof(address));
+			address.sin6_family = AF_INET6;
+			address.sin6_addr = in6addr_any;
+			address.sin6_port = htons(port);
+
+			int fd = ::socket(address.sin6_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (fd==-1) {
+				::syslog(LOG_ERR, "server group: Socket initialization failed '%s'", strerror(errno));
+				return -1;
+			}
+
+			int yes = 1;
+			if ((setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes))==-1) ||
+				(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes))==-1)) {
+				::syslog(LOG_ERR, "server group: Could not set SO_REUSEADDR/SO_REUSEPORT '%s'", strerror(errno));
+				::close(fd);
+				return -1;
+			}
+			if (::bind(fd, reinterpret_cast < sockaddr* > (&address), sizeof(address))==-1) {
+				::syslog(LOG_ERR, "server group: Binding socket to port %u failed '%s'", port, strerror(errno));
+				::close(fd);
+				return -1;
+			}
+			if (listen(fd, backlog)==-1) {
+				::syslog(LOG_ERR, "server group: listen failed '%s'", strerror(errno));
+				::close(fd);
+				return -1;
+			}
+			return fd;
+		}
+
+		int TcpServerGroup::start(uint16_t port, int backlog, TcpServer::Cb_t acceptCb, const SocketOptions& options)
+		{
+			if ((!m_listeningFds.empty()) || (!acceptCb)) {
+				return -1;
+			}
+
+			for (auto &iter: m_servers) {
+				int fd = createListener(port, backlog);
+				if (fd==-1) {
+					stop();
+					return -1;
+				}
+				if (port==0) {
+					// the others join the port chosen for the first one
+					sockaddr_in6 address;
+					socklen_t addressLength = sizeof(address);
+					if (getsockname(fd, reinterpret_cast < sockaddr* > (&address), &addressLength)==-1) {
+						::close(fd);
+						stop();
+						return -1;
+					}
+					port = ntohs(address.sin6_port);
+				}
+				if (iter->start(fd, acceptCb, options)==-1) {
+					::close(fd);
+					stop();
+					return -1;
+				}
+				// joined the reuseport group when listening. The index inside the group is the one steering programs return.
+				m_listeningFds.push_back(fd);
+			}
+			m_port = port;
+			return 0;
+		}
+
+		int TcpServerGroup::setCpuSteering()
+		{
+			struct sock_filter program[] = {
+				// A = number of the CPU processing the packet
+				{ BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast < uint32_t > (SKF_AD_OFF + SKF_AD_CPU) },
+				// return A
+				{ BPF_RET | BPF_A, 0, 0, 0 }
+			};
+			return setSteeringProgram(std::vector < struct sock_filter > (program, program+sizeof(program)/sizeof(program[0])));
+		}
+
+		int TcpServerGroup::setSteeringProgram(const std::vector < struct sock_filter >& program)
+		{
+			if ((m_listeningFds.empty()) || (program.empty())) {
+				return -1;
+			}
+			struct sock_fprog filter;
+			filter.len = static_cast < unsigned short > (program.size());
+			filter.filter = const_cast < struct sock_filter* > (program.data());
+			// attached to one socket, it applies to the whole group
+			if (setsockopt(m_listeningFds.front(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &filter, sizeof(filter))==-1) {
+				::syslog(LOG_ERR, "server group: Could not attach steering program '%s'", strerror(errno));
+				return -1;
+			}
+			return 0;
+		}
+
+		void TcpServerGroup::stop()
+		{
+			for (auto &iter: m_servers) {
+				iter->stop();
+			}
+			m_listeningFds.clear();
+			m_port = 0;
+		}
+	}
+}
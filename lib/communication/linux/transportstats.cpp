@@ -0,0 +1,85 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstddef>
+#include <cstring>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+// netinet/tcp.h of the C library lacks the newer fields of struct tcp_info
+#include <linux/tcp.h>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/transportstats.h"
+
+/// \return true if the kernel filled the field
+#define TCP_INFO_HAS(info, field, length) (offsetof(struct tcp_info, field)+sizeof((info).field) <= (length))
+
+hbk::communication::TransportStats hbk::communication::SocketNonblocking::transportStats() const
+{
+	TransportStats stats;
+	stats.bytesReceived = m_transportCounters.bytesReceived;
+	stats.bytesSent = m_transportCounters.bytesSent;
+	stats.partialWrites = m_transportCounters.partialWrites;
+	stats.coalescedWrites = m_transportCounters.coalescedWrites;
+	stats.blockedTime = std::chrono::microseconds(m_transportCounters.blockedTime.load());
+	stats.time = std::chrono::steady_clock::now();
+
+	int queueSize;
+	if (ioctl(m_event, TIOCOUTQ, &queueSize)==0) {
+		stats.sendQueueSize = static_cast < uint32_t > (queueSize);
+	}
+	if (ioctl(m_event, FIONREAD, &queueSize)==0) {
+		stats.receiveQueueSize = static_cast < uint32_t > (queueSize);
+	}
+
+	struct tcp_info info;
+	memset(&info, 0, sizeof(info));
+	socklen_t length = sizeof(info);
+	if (getsockopt(m_event, IPPROTO_TCP, TCP_INFO, &info, &length)!=0) {
+		// i.e. unix domain socket
+		return stats;
+	}
+	stats.tcpInfoValid = true;
+	stats.rtt = std::chrono::microseconds(info.tcpi_rtt);
+	stats.rttVariance = std::chrono::microseconds(info.tcpi_rttvar);
+	stats.retransmits = info.tcpi_total_retrans;
+	stats.lost = info.tcpi_lost;
+	stats.congestionWindow = info.tcpi_snd_cwnd;
+	stats.sendMss = info.tcpi_snd_mss;
+	if (TCP_INFO_HAS(info, tcpi_pacing_rate, length)) {
+		stats.pacingRate = info.tcpi_pacing_rate;
+	}
+	if (TCP_INFO_HAS(info, tcpi_notsent_bytes, length)) {
+		stats.notSentBytes = info.tcpi_notsent_bytes;
+	}
+	if (TCP_INFO_HAS(info, tcpi_delivery_rate, length)) {
+		stats.deliveryRate = info.tcpi_delivery_rate;
+	}
+	if (TCP_INFO_HAS(info, tcpi_sndbuf_limited, length)) {
+		stats.busyTime = std::chrono::microseconds(info.tcpi_busy_time);
+		stats.receiveWindowLimitedTime = std::chrono::microseconds(info.tcpi_rwnd_limited);
+		stats.sendBufferLimitedTime = std::chrono::microseconds(info.tcpi_sndbuf_limited);
+	}
+	return stats;
+}
@@ -0,0 +1,261 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "hbk/communication/udpsocket.h"
+
+namespace hbk {
+	namespace communication {
+		UdpSocket::UdpSocket(sys::EventLoop& eventLoop, unsigned int batchSize, size_t maxDatagramSize)
+			: m_eventLoop(eventLoop)
+			, m_event(-1)
+			, m_batchSize(batchSize)
+			, m_maxDatagramSize(maxDatagramSize)
+			, m_dataHandler()
+			, m_receiveBuffer(batchSize*maxDatagramSize)
+			, m_sourceAddresses(batchSize)
+			, m_receiveIovs(batchSize)
+			, m_receiveMessages(batchSize)
+			, m_datagrams(batchSize)
+			, m_sendIovs(batchSize)
+			, m_sendMessages(batchSize)
+			, m_queuedCount(0)
+		{
+			if ((batchSize==0) || (maxDatagramSize==0)) {
+				throw std::runtime_error("batch size and datagram size must not be 0");
+			}
+
+			// the receive headers never change, only the lengths are reset before each receive
+			for (unsigned int i = 0; i<batchSize; ++i) {
+				m_receiveIovs[i].iov_base = &m_receiveBuffer[i*maxDatagramSize];
+				m_receiveIovs[i].iov_len = maxDatagramSize;
+				memset(&m_receiveMessages[i], 0, sizeof(m_receiveMessages[i]));
+				m_receiveMessages[i].msg_hdr.msg_iov = &m_receiveIovs[i];
+				m_receiveMessages[i].msg_hdr.msg_iovlen = 1;
+				m_receiveMessages[i].msg_hdr.msg_name = &m_sourceAddresses[i];
+
+				memset(&m_sendMessages[i], 0, sizeof(m_sendMessages[i]));
+				m_sendMessages[i].msg_hdr.msg_iov = &m_sendIovs[i];
+				m_sendMessages[i].msg_hdr.msg_iovlen = 1;
+			}
+		}
+
+		UdpSocket::~UdpSocket()
+		{
+			close();
+		}
+
+		int UdpSocket::makeAddress(const std::string& address, unsigned int port, struct sockaddr_storage& socketAddress, socklen_t& addressLength)
+		{
+			memset(&socketAddress, 0, sizeof(socketAddress));
+			struct sockaddr_in* pV4 = reinterpret_cast < struct sockaddr_in* > (&socketAddress);
+			struct sockaddr_in6* pV6 = reinterpret_cast < struct sockaddr_in6* > (&socketAddress);
+			if (address.empty()) {
+				pV4->sin_family = AF_INET;
+				pV4->sin_addr.s_addr = htonl(INADDR_ANY);
+				pV4->sin_port = htons(static_cast < uint16_t > (port));
+				addressLength = sizeof(struct sockaddr_in);
+			} else if (inet_pton(AF_INET, address.c_str(), &pV4->sin_addr)==1) {
+				pV4->sin_family = AF_INET;
+				pV4->sin_port = htons(static_cast < uint16_t > (port));
+				addressLength = sizeof(struct sockaddr_in);
+			} else if (inet_pton(AF_INET6, address.c_str(), &pV6->sin6_addr)==1) {
+				pV6->sin6_family = AF_INET6;
+				pV6->sin6_port = htons(static_cast < uint16_t > (port));
+				addressLength = sizeof(struct sockaddr_in6);
+			} else {
+				return -1;
+			}
+			return 0;
+		}
+
+		int UdpSocket::bind(const std::string& address, unsigned int port)
+		{
+			if (m_event!=-1) {
+				return -1;
+			}
+			struct sockaddr_storage localAddress;
+			socklen_t addressLength;
+			if (makeAddress(address, port, localAddress, addressLength)<0) {
+				::syslog(LOG_ERR, "udp socket: '%s' is not a valid IP address", address.c_str());
+				return -1;
+			}
+			m_event = ::socket(localAddress.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (m_event==-1) {
+				::syslog(LOG_ERR, "udp socket: Could not create socket '%s'", strerror(errno));
+				return -1;
+			}
+			if (::bind(m_event, reinterpret_cast < struct sockaddr* > (&localAddress), addressLength)<0) {
+				::syslog(LOG_ERR, "udp socket: Could not bind to %s:%u '%s'", address.c_str(), port, strerror(errno));
+				::close(m_event);
+				m_event = -1;
+				return -1;
+			}
+			if (m_dataHandler) {
+				m_eventLoop.addEvent(m_event, std::bind(&UdpSocket::process, this));
+			}
+			return 0;
+		}
+
+		void UdpSocket::close()
+		{
+			if (m_event==-1) {
+				return;
+			}
+			m_eventLoop.eraseEvent(m_event);
+			::close(m_event);
+			m_event = -1;
+			m_queuedCount = 0;
+		}
+
+		unsigned int UdpSocket::getPort() const
+		{
+			struct sockaddr_storage localAddress;
+			socklen_t addressLength = sizeof(localAddress);
+			if ((m_event==-1) || (getsockname(m_event, reinterpret_cast < struct sockaddr* > (&localAddress), &addressLength)<0)) {
+				return 0;
+			}
+			if (localAddress.ss_family==AF_INET6) {
+				return ntohs(reinterpret_cast < struct sockaddr_in6* > (&localAddress)->sin6_port);
+			}
+			return ntohs(reinterpret_cast < struct sockaddr_in* > (&localAddress)->sin_port);
+		}
+
+		void UdpSocket::setDataCb(DataCb_t dataCb)
+		{
+			m_dataHandler = dataCb;
+			if (m_event!=-1) {
+				m_eventLoop.addEvent(m_event, std::bind(&UdpSocket::process, this));
+			}
+		}
+
+		void UdpSocket::clearDataCb()
+		{
+			if (m_event!=-1) {
+				m_eventLoop.eraseEvent(m_event);
+			}
+			m_dataHandler = DataCb_t();
+		}
+
+		int UdpSocket::process()
+		{
+			if (m_dataHandler) {
+				return static_cast < int > (m_dataHandler(*this));
+			}
+			return 0;
+		}
+
+		int UdpSocket::receive()
+		{
+			for (unsigned int i = 0; i<m_batchSize; ++i) {
+				// value/result arguments changed by the previous receive
+				m_receiveMessages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+				m_receiveMessages[i].msg_hdr.msg_flags = 0;
+			}
+			int count;
+			do {
+				count = recvmmsg(m_event, m_receiveMessages.data(), m_batchSize, MSG_DONTWAIT, nullptr);
+			} while ((count==-1) && (errno==EINTR));
+			for (int i = 0; i<count; ++i) {
+				const struct msghdr& header = m_receiveMessages[i].msg_hdr;
+				Datagram& datagram = m_datagrams[i];
+				datagram.pData = reinterpret_cast < const uint8_t* > (m_receiveIovs[i].iov_base);
+				datagram.size = m_receiveMessages[i].msg_len;
+				datagram.truncated = (header.msg_flags & MSG_TRUNC)!=0;
+				datagram.pAddress = reinterpret_cast < const struct sockaddr* > (&m_sourceAddresses[i]);
+				datagram.addressLength = header.msg_namelen;
+			}
+			return count;
+		}
+
+		int UdpSocket::queue(const void* pData, size_t size, const struct sockaddr* pAddress, socklen_t addressLength)
+		{
+			if (m_queuedCount==m_batchSize) {
+				return -1;
+			}
+			m_sendIovs[m_queuedCount].iov_base = const_cast < void* > (pData);
+			m_sendIovs[m_queuedCount].iov_len = size;
+			m_sendMessages[m_queuedCount].msg_hdr.msg_name = const_cast < struct sockaddr* > (pAddress);
+			m_sendMessages[m_queuedCount].msg_hdr.msg_namelen = addressLength;
+			++m_queuedCount;
+			return static_cast < int > (m_queuedCount);
+		}
+
+		int UdpSocket::flush()
+		{
+			unsigned int sentCount = 0;
+			// sent or dropped
+			unsigned int doneCount = 0;
+			int error = 0;
+			while (doneCount<m_queuedCount) {
+				int result = sendmmsg(m_event, &m_sendMessages[doneCount], m_queuedCount-doneCount, MSG_DONTWAIT | MSG_NOSIGNAL);
+				if (result>0) {
+					sentCount += static_cast < unsigned int > (result);
+					doneCount += static_cast < unsigned int > (result);
+				} else if (errno==EINTR) {
+					continue;
+				} else if ((errno==EAGAIN) || (errno==EWOULDBLOCK)) {
+					error = errno;
+					break;
+				} else {
+					// this datagram can not be sent at all (i.e. too large). Drop it in order not to block the following ones.
+					error = errno;
+					::syslog(LOG_ERR, "udp socket: Dropping datagram '%s'", strerror(errno));
+					++doneCount;
+				}
+			}
+
+			// keep what was not sent at the front of the batch
+			unsigned int remaining = m_queuedCount-doneCount;
+			for (unsigned int i = 0; i<remaining; ++i) {
+				m_sendIovs[i] = m_sendIovs[doneCount+i];
+				m_sendMessages[i].msg_hdr.msg_name = m_sendMessages[doneCount+i].msg_hdr.msg_name;
+				m_sendMessages[i].msg_hdr.msg_namelen = m_sendMessages[doneCount+i].msg_hdr.msg_namelen;
+			}
+			m_queuedCount = remaining;
+
+			if ((sentCount==0) && (error!=0)) {
+				errno = error;
+				return -1;
+			}
+			return static_cast < int > (sentCount);
+		}
+
+		ssize_t UdpSocket::sendTo(const void* pData, size_t size, const struct sockaddr* pAddress, socklen_t addressLength)
+		{
+			ssize_t result;
+			do {
+				result = ::sendto(m_event, pData, size, MSG_DONTWAIT | MSG_NOSIGNAL, pAddress, addressLength);
+			} while ((result==-1) && (errno==EINTR));
+			return result;
+		}
+	}
+}
@@ -0,0 +1,650 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#ifdef HBK_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "hbk/communication/uring.h"
+#include "hbk/exception/exception.hpp"
+
+#ifdef HBK_HAVE_IO_URING
+/// all receive buffers belong to this group
+static const uint16_t BUFFER_GROUP = 0;
+/// user data of operations whose completion is of no interest. Ids of operations start at 1.
+static const uint64_t IGNORED_ID = 0;
+
+static int uringSetup(unsigned int entries, io_uring_params* pParams)
+{
+	return static_cast < int > (syscall(__NR_io_uring_setup, entries, pParams));
+}
+
+static int uringEnter(int ringFd, unsigned int toSubmit)
+{
+	return static_cast < int > (syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, 0, nullptr, 0));
+}
+
+static int uringRegister(int ringFd, unsigned int opcode, void* pArg, unsigned int argCount)
+{
+	return static_cast < int > (syscall(__NR_io_uring_register, ringFd, opcode, pArg, argCount));
+}
+
+static unsigned int roundUpToPowerOf2(unsigned int value)
+{
+	unsigned int result = 1;
+	while (result<value) {
+		result <<= 1;
+	}
+	return result;
+}
+#endif
+
+namespace hbk {
+	namespace communication {
+#ifdef HBK_HAVE_IO_URING
+		struct Uring::BufferRing {
+			BufferRing()
+				: pRing(nullptr)
+				, ringSize(0)
+				, entries(0)
+				, tail(0)
+				, pMemory(nullptr)
+				, memorySize(0)
+				, bufferSize(0)
+				, mtx()
+				, provided(0)
+				, starved(false)
+				, eventFd(-1)
+			{
+			}
+
+			~BufferRing()
+			{
+				if (pRing) {
+					munmap(pRing, ringSize);
+				}
+				if (pMemory) {
+					munmap(pMemory, memorySize);
+				}
+			}
+
+			/// give a buffer to the kernel
+			void provide(uint16_t bufferId)
+			{
+				std::lock_guard < std::mutex > lock(mtx);
+				// The descriptors start at the beginning of the ring, the tail overlays the reserved field of the first one.
+				// Do not use pRing->bufs: In C++ it is a flexible array inside a union, which puts it 8 bytes too far.
+				io_uring_buf* pBuffer = reinterpret_cast < io_uring_buf* > (pRing) + (tail & (entries-1));
+				pBuffer->addr = reinterpret_cast < uint64_t > (pMemory + bufferId*bufferSize);
+				pBuffer->len = static_cast < uint32_t > (bufferSize);
+				pBuffer->bid = bufferId;
+				++tail;
+				__atomic_store_n(&pRing->tail, tail, __ATOMIC_RELEASE);
+				++provided;
+			}
+
+			/// called when the last slice referencing the buffer is gone
+			void recycle(uint16_t bufferId)
+			{
+				provide(bufferId);
+				if (starved.exchange(false)) {
+					// wake up the event loop in order to restart starved operations
+					std::lock_guard < std::mutex > lock(mtx);
+					if (eventFd!=-1) {
+						uint64_t value = 1;
+						if (::write(eventFd, &value, sizeof(value))<0) {
+							syslog(LOG_ERR, "uring: Could not signal returned buffer '%s'", strerror(errno));
+						}
+					}
+				}
+			}
+
+			io_uring_buf_ring* pRing;
+			size_t ringSize;
+			unsigned int entries;
+			uint16_t tail;
+			uint8_t* pMemory;
+			size_t memorySize;
+			size_t bufferSize;
+
+			std::mutex mtx;
+			/// buffers owned by the kernel
+			std::atomic < unsigned int > provided;
+			/// operations are waiting for buffers
+			std::atomic < bool > starved;
+			/// of the owning Uring. -1 after the Uring is gone.
+			int eventFd;
+		};
+
+		Uring::Uring(sys::EventLoop& eventLoop, unsigned int entries, unsigned int bufferCount, size_t bufferSize)
+			: m_eventLoop(eventLoop)
+			, m_ringFd(-1)
+			, m_eventFd(-1)
+			, m_pSqRing(nullptr)
+			, m_sqRingSize(0)
+			, m_pCqRing(nullptr)
+			, m_cqRingSize(0)
+			, m_pSqes(nullptr)
+			, m_sqesSize(0)
+			, m_pSqHead(nullptr)
+			, m_pSqTail(nullptr)
+			, m_sqMask(0)
+			, m_sqEntries(0)
+			, m_pSqArray(nullptr)
+			, m_sqPending(0)
+			, m_pCqHead(nullptr)
+			, m_pCqTail(nullptr)
+			, m_cqMask(0)
+			, m_pCqes(nullptr)
+			, m_bufferRing(std::make_shared < BufferRing > ())
+			, m_nextId(1)
+			, m_operations()
+			, m_starved()
+		{
+			// a buffer id is 16 bit wide
+			if ((bufferCount==0) || (bufferCount>32768) || (bufferSize==0)) {
+				throw hbk::exception::exception("uring: Invalid buffer configuration");
+			}
+
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			params.flags = IORING_SETUP_CQSIZE;
+			// each multishot operation may post many completions for a single submission
+			params.cq_entries = std::max(entries*4, roundUpToPowerOf2(bufferCount));
+			m_ringFd = uringSetup(entries, &params);
+			if (m_ringFd<0) {
+				std::string message = std::string("uring: io_uring_setup failed '") + strerror(errno) + "'";
+				throw hbk::exception::exception(message);
+			}
+			if ((params.features & IORING_FEAT_SINGLE_MMAP)==0) {
+				release();
+				throw hbk::exception::exception("uring: Kernel too old");
+			}
+
+			m_sqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+			m_cqRingSize = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+			size_t ringSize = std::max(m_sqRingSize, m_cqRingSize);
+			m_pSqRing = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+			if (m_pSqRing==MAP_FAILED) {
+				m_pSqRing = nullptr;
+				release();
+				throw hbk::exception::exception("uring: Could not map rings");
+			}
+			// submission and completion ring share one mapping
+			m_sqRingSize = ringSize;
+			m_pCqRing = m_pSqRing;
+			m_cqRingSize = 0;
+
+			m_sqesSize = params.sq_entries*sizeof(io_uring_sqe);
+			void* pSqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+			if (pSqes==MAP_FAILED) {
+				release();
+				throw hbk::exception::exception("uring: Could not map submission queue entries");
+			}
+			m_pSqes = reinterpret_cast < io_uring_sqe* > (pSqes);
+
+			uint8_t* pSq = reinterpret_cast < uint8_t* > (m_pSqRing);
+			m_pSqHead = reinterpret_cast < unsigned int* > (pSq + params.sq_off.head);
+			m_pSqTail = reinterpret_cast < unsigned int* > (pSq + params.sq_off.tail);
+			m_sqMask = *reinterpret_cast < unsigned int* > (pSq + params.sq_off.ring_mask);
+			m_sqEntries = params.sq_entries;
+			m_pSqArray = reinterpret_cast < unsigned int* > (pSq + params.sq_off.array);
+
+			uint8_t* pCq = reinterpret_cast < uint8_t* > (m_pCqRing);
+			m_pCqHead = reinterpret_cast < unsigned int* > (pCq + params.cq_off.head);
+			m_pCqTail = reinterpret_cast < unsigned int* > (pCq + params.cq_off.tail);
+			m_cqMask = *reinterpret_cast < unsigned int* > (pCq + params.cq_off.ring_mask);
+			m_pCqes = pCq + params.cq_off.cqes;
+
+			m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (m_eventFd<0) {
+				release();
+				throw hbk::exception::exception("uring: Could not create eventfd");
+			}
+			if (uringRegister(m_ringFd, IORING_REGISTER_EVENTFD, &m_eventFd, 1)<0) {
+				release();
+				throw hbk::exception::exception("uring: Could not register eventfd");
+			}
+
+			BufferRing& bufferRing = *m_bufferRing;
+			bufferRing.entries = roundUpToPowerOf2(bufferCount);
+			bufferRing.bufferSize = bufferSize;
+			bufferRing.ringSize = bufferRing.entries*sizeof(io_uring_buf);
+			void* pRing = mmap(nullptr, bufferRing.ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (pRing==MAP_FAILED) {
+				release();
+				throw hbk::exception::exception("uring: Could not allocate buffer ring");
+			}
+			bufferRing.pRing = reinterpret_cast < io_uring_buf_ring* > (pRing);
+			bufferRing.memorySize = bufferRing.entries*bufferSize;
+			void* pMemory = mmap(nullptr, bufferRing.memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (pMemory==MAP_FAILED) {
+				release();
+				throw hbk::exception::exception("uring: Could not allocate receive buffers");
+			}
+			bufferRing.pMemory = reinterpret_cast < uint8_t* > (pMemory);
+
+			io_uring_buf_reg reg;
+			memset(&reg, 0, sizeof(reg));
+			reg.ring_addr = reinterpret_cast < uint64_t > (pRing);
+			reg.ring_entries = bufferRing.entries;
+			reg.bgid = BUFFER_GROUP;
+			if (uringRegister(m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1)<0) {
+				std::string message = std::string("uring: Could not register buffer ring '") + strerror(errno) + "'";
+				release();
+				throw hbk::exception::exception(message);
+			}
+			for (unsigned int bufferId = 0; bufferId<bufferRing.entries; ++bufferId) {
+				bufferRing.provide(static_cast < uint16_t > (bufferId));
+			}
+			bufferRing.eventFd = m_eventFd;
+
+			if (m_eventLoop.addEvent(m_eventFd, std::bind(&Uring::process, this))<0) {
+				release();
+				throw hbk::exception::exception("uring: Could not add eventfd to event loop");
+			}
+		}
+
+		Uring::~Uring()
+		{
+			if (m_eventFd!=-1) {
+				m_eventLoop.eraseEvent(m_eventFd);
+			}
+			release();
+		}
+
+		void Uring::release()
+		{
+			{
+				// slices still referencing receive buffers must not signal anymore
+				std::lock_guard < std::mutex > lock(m_bufferRing->mtx);
+				m_bufferRing->eventFd = -1;
+			}
+			// closing the ring cancels all pending operations
+			if (m_ringFd!=-1) {
+				::close(m_ringFd);
+				m_ringFd = -1;
+			}
+			if (m_eventFd!=-1) {
+				::close(m_eventFd);
+				m_eventFd = -1;
+			}
+			if (m_pSqes) {
+				munmap(m_pSqes, m_sqesSize);
+				m_pSqes = nullptr;
+			}
+			if (m_pSqRing) {
+				munmap(m_pSqRing, m_sqRingSize);
+				m_pSqRing = nullptr;
+				m_pCqRing = nullptr;
+			}
+			m_operations.clear();
+			m_starved.clear();
+		}
+
+		bool Uring::isSupported()
+		{
+			static const bool supported = []() {
+				// Setting up and registering might succeed while the kernel does not deliver into the buffer ring
+				// (i.e. older kernels or restricted environments). Receive one byte in order to be sure.
+				int fds[2];
+				if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds)<0) {
+					return false;
+				}
+				int received = -1;
+				try {
+					sys::EventLoop eventLoop;
+					Uring uring(eventLoop, 2, 1, 64);
+					if (uring.receiveMultishot(fds[0], [&received](int result, const BufferSlice&) { received = result; })!=0) {
+						if (::write(fds[1], "x", 1)==1) {
+							struct pollfd pfd;
+							pfd.fd = uring.m_eventFd;
+							pfd.events = POLLIN;
+							poll(&pfd, 1, 100);
+							uring.process();
+						}
+					}
+				} catch (const hbk::exception::exception&) {
+				}
+				::close(fds[0]);
+				::close(fds[1]);
+				return received==1;
+			}();
+			return supported;
+		}
+
+		uint64_t Uring::receiveMultishot(int fd, CompletionCb_t completionCb)
+		{
+			Operation operation;
+			operation.opcode = IORING_OP_RECV;
+			operation.fd = fd;
+			operation.completionCb = completionCb;
+			uint64_t id = m_nextId++;
+			if (arm(id, operation)<0) {
+				return 0;
+			}
+			m_operations[id] = operation;
+			if (submit()<0) {
+				m_operations.erase(id);
+				return 0;
+			}
+			return id;
+		}
+
+		uint64_t Uring::acceptMultishot(int fd, CompletionCb_t completionCb)
+		{
+			Operation operation;
+			operation.opcode = IORING_OP_ACCEPT;
+			operation.fd = fd;
+			operation.completionCb = completionCb;
+			uint64_t id = m_nextId++;
+			if (arm(id, operation)<0) {
+				return 0;
+			}
+			m_operations[id] = operation;
+			if (submit()<0) {
+				m_operations.erase(id);
+				return 0;
+			}
+			return id;
+		}
+
+		void Uring::cancel(uint64_t id)
+		{
+			if (m_operations.erase(id)==0) {
+				return;
+			}
+			m_starved.erase(std::remove(m_starved.begin(), m_starved.end(), id), m_starved.end());
+			io_uring_sqe* pSqe = getSqe();
+			if (pSqe==nullptr) {
+				syslog(LOG_ERR, "uring: Could not cancel operation, submission queue is full");
+				return;
+			}
+			pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+			pSqe->fd = -1;
+			pSqe->addr = id;
+			pSqe->user_data = IGNORED_ID;
+			submit();
+		}
+
+		int Uring::setCompletionCb(uint64_t id, CompletionCb_t completionCb)
+		{
+			auto iter = m_operations.find(id);
+			if (iter==m_operations.end()) {
+				return -1;
+			}
+			iter->second.completionCb = completionCb;
+			return 0;
+		}
+
+		size_t Uring::getBufferSize() const
+		{
+			return m_bufferRing->bufferSize;
+		}
+
+		unsigned int Uring::getProvidedBufferCount() const
+		{
+			return m_bufferRing->provided;
+		}
+
+		int Uring::arm(uint64_t id, const Operation& operation)
+		{
+			io_uring_sqe* pSqe = getSqe();
+			if (pSqe==nullptr) {
+				syslog(LOG_ERR, "uring: Submission queue is full");
+				return -1;
+			}
+			pSqe->opcode = operation.opcode;
+			pSqe->fd = operation.fd;
+			pSqe->user_data = id;
+			if (operation.opcode==IORING_OP_RECV) {
+				pSqe->ioprio = IORING_RECV_MULTISHOT;
+				pSqe->flags = IOSQE_BUFFER_SELECT;
+				pSqe->buf_group = BUFFER_GROUP;
+			} else {
+				pSqe->ioprio = IORING_ACCEPT_MULTISHOT;
+				pSqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+			}
+			return 0;
+		}
+
+		io_uring_sqe* Uring::getSqe()
+		{
+			unsigned int tail = *m_pSqTail + m_sqPending;
+			if (tail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+				submit();
+				tail = *m_pSqTail;
+				if (tail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+					return nullptr;
+				}
+			}
+			unsigned int index = tail & m_sqMask;
+			m_pSqArray[index] = index;
+			++m_sqPending;
+			io_uring_sqe* pSqe = &m_pSqes[index];
+			memset(pSqe, 0, sizeof(io_uring_sqe));
+			return pSqe;
+		}
+
+		int Uring::submit()
+		{
+			if (m_sqPending==0) {
+				return 0;
+			}
+			unsigned int count = m_sqPending;
+			m_sqPending = 0;
+			__atomic_store_n(m_pSqTail, *m_pSqTail + count, __ATOMIC_RELEASE);
+			int result = uringEnter(m_ringFd, count);
+			if (result<0) {
+				syslog(LOG_ERR, "uring: io_uring_enter failed '%s'", strerror(errno));
+			}
+			return result;
+		}
+
+		int Uring::process()
+		{
+			uint64_t value;
+			// reset the eventfd before draining. Completions arriving meanwhile signal again.
+			if (::read(m_eventFd, &value, sizeof(value))<0) {
+				if (errno!=EAGAIN) {
+					return -1;
+				}
+			}
+
+			io_uring_cqe* pCqes = reinterpret_cast < io_uring_cqe* > (m_pCqes);
+			std::shared_ptr < BufferRing > bufferRing = m_bufferRing;
+			unsigned int head = *m_pCqHead;
+			while (head!=__atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE)) {
+				const io_uring_cqe& cqe = pCqes[head & m_cqMask];
+				uint64_t id = cqe.user_data;
+				int result = cqe.res;
+				uint32_t flags = cqe.flags;
+				++head;
+				// the slot may be reused by the kernel from now on
+				__atomic_store_n(m_pCqHead, head, __ATOMIC_RELEASE);
+
+				BufferSlice data;
+				if (flags & IORING_CQE_F_BUFFER) {
+					--bufferRing->provided;
+					uint16_t bufferId = static_cast < uint16_t > (flags >> IORING_CQE_BUFFER_SHIFT);
+					const uint8_t* pBuffer = bufferRing->pMemory + bufferId*bufferRing->bufferSize;
+					std::shared_ptr < const uint8_t > buffer(pBuffer, [bufferRing, bufferId](const uint8_t*) { bufferRing->recycle(bufferId); });
+					data = BufferSlice(buffer, pBuffer, result>0 ? static_cast < size_t > (result) : 0);
+				}
+
+				auto iter = m_operations.find(id);
+				if (iter==m_operations.end()) {
+					// canceled or of no interest. A buffer goes back with the slice.
+					continue;
+				}
+				Operation& operation = iter->second;
+				bool more = (flags & IORING_CQE_F_MORE)!=0;
+				bool ended;
+				if (operation.opcode==IORING_OP_RECV) {
+					if (result==-ENOBUFS) {
+						// all buffers are held by the application. Restart when some come back.
+						bufferRing->starved = true;
+						m_starved.push_back(id);
+						continue;
+					}
+					ended = (result<=0);
+				} else {
+					ended = (result<0);
+				}
+
+				// callback might cancel the operation
+				CompletionCb_t completionCb = operation.completionCb;
+				if (ended) {
+					m_operations.erase(iter);
+				} else if (!more) {
+					// the kernel stopped the multishot operation although the socket is fine
+					arm(id, operation);
+				}
+				if (completionCb) {
+					completionCb(result, data);
+				}
+			}
+
+			if ((!m_starved.empty()) && (bufferRing->provided>0)) {
+				std::vector < uint64_t > starved;
+				starved.swap(m_starved);
+				for (auto &iter: starved) {
+					auto operationIter = m_operations.find(iter);
+					if (operationIter!=m_operations.end()) {
+						arm(iter, operationIter->second);
+					}
+				}
+			}
+			submit();
+			return 0;
+		}
+#else
+		struct Uring::BufferRing {
+		};
+
+		Uring::Uring(sys::EventLoop& eventLoop, unsigned int, unsigned int, size_t)
+			: m_eventLoop(eventLoop)
+			, m_ringFd(-1)
+			, m_eventFd(-1)
+			, m_pSqRing(nullptr)
+			, m_sqRingSize(0)
+			, m_pCqRing(nullptr)
+			, m_cqRingSize(0)
+			, m_pSqes(nullptr)
+			, m_sqesSize(0)
+			, m_pSqHead(nullptr)
+			, m_pSqTail(nullptr)
+			, m_sqMask(0)
+			, m_sqEntries(0)
+			, m_pSqArray(nullptr)
+			, m_sqPending(0)
+			, m_pCqHead(nullptr)
+			, m_pCqTail(nullptr)
+			, m_cqMask(0)
+			, m_pCqes(nullptr)
+			, m_bufferRing()
+			, m_nextId(1)
+			, m_operations()
+			, m_starved()
+		{
+			throw hbk::exception::exception("uring: Library was built without io_uring support");
+		}
+
+		Uring::~Uring()
+		{
+		}
+
+		void Uring::release()
+		{
+		}
+
+		bool Uring::isSupported()
+		{
+			return false;
+		}
+
+		uint64_t Uring::receiveMultishot(int, CompletionCb_t)
+		{
+			return 0;
+		}
+
+		uint64_t Uring::acceptMultishot(int, CompletionCb_t)
+		{
+			return 0;
+		}
+
+		void Uring::cancel(uint64_t)
+		{
+		}
+
+		int Uring::setCompletionCb(uint64_t, CompletionCb_t)
+		{
+			return -1;
+		}
+
+		size_t Uring::getBufferSize() const
+		{
+			return 0;
+		}
+
+		unsigned int Uring::getProvidedBufferCount() const
+		{
+			return 0;
+		}
+
+		int Uring::arm(uint64_t, const Operation&)
+		{
+			return -1;
+		}
+
+		io_uring_sqe* Uring::getSqe()
+		{
+			return nullptr;
+		}
+
+		int Uring::submit()
+		{
+			return -1;
+		}
+
+		int Uring::process()
+		{
+			return 0;
+		}
+#endif
+	}
+}
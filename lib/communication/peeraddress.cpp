@@ -0,0 +1,100 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "hbk/communication/socketnonblocking.h"
+
+/// reduce IPv4 mapped IPv6 addresses to IPv4
+static void normalizeAddress(const struct sockaddr* pAddress, socklen_t length, struct sockaddr_storage& normalized)
+{
+	memset(&normalized, 0, sizeof(normalized));
+	if (length>static_cast < socklen_t > (sizeof(normalized))) {
+		length = sizeof(normalized);
+	}
+	if ((pAddress->sa_family==AF_INET6) && (length>=static_cast < socklen_t > (sizeof(struct sockaddr_in6)))) {
+		const struct sockaddr_in6* pV6 = reinterpret_cast < const struct sockaddr_in6* > (pAddress);
+		if (IN6_IS_ADDR_V4MAPPED(&pV6->sin6_addr)) {
+			struct sockaddr_in* pV4 = reinterpret_cast < struct sockaddr_in* > (&normalized);
+			pV4->sin_family = AF_INET;
+			pV4->sin_port = pV6->sin6_port;
+			memcpy(&pV4->sin_addr, &pV6->sin6_addr.s6_addr[12], sizeof(pV4->sin_addr));
+			return;
+		}
+	}
+	memcpy(&normalized, pAddress, static_cast < size_t > (length));
+}
+
+/// binary comparison of address and port
+static bool isSameAddress(const struct sockaddr* pFirst, socklen_t firstLength, const struct sockaddr* pSecond, socklen_t secondLength)
+{
+	if ((pFirst==nullptr) || (pSecond==nullptr) || (firstLength<static_cast < socklen_t > (sizeof(pFirst->sa_family))) || (secondLength<static_cast < socklen_t > (sizeof(pSecond->sa_family)))) {
+		return false;
+	}
+	struct sockaddr_storage first;
+	struct sockaddr_storage second;
+	normalizeAddress(pFirst, firstLength, first);
+	normalizeAddress(pSecond, secondLength, second);
+	if (first.ss_family!=second.ss_family) {
+		return false;
+	}
+	switch (first.ss_family) {
+	case AF_INET:
+		{
+			const struct sockaddr_in* pFirstV4 = reinterpret_cast < const struct sockaddr_in* > (&first);
+			const struct sockaddr_in* pSecondV4 = reinterpret_cast < const struct sockaddr_in* > (&second);
+			return (pFirstV4->sin_port==pSecondV4->sin_port) && (pFirstV4->sin_addr.s_addr==pSecondV4->sin_addr.s_addr);
+		}
+	case AF_INET6:
+		{
+			const struct sockaddr_in6* pFirstV6 = reinterpret_cast < const struct sockaddr_in6* > (&first);
+			const struct sockaddr_in6* pSecondV6 = reinterpret_cast < const struct sockaddr_in6* > (&second);
+			if ((pFirstV6->sin6_port!=pSecondV6->sin6_port) || (memcmp(&pFirstV6->sin6_addr, &pSecondV6->sin6_addr, sizeof(pFirstV6->sin6_addr))!=0)) {
+				return false;
+			}
+			// the scope matters for link local addresses only
+			return (pFirstV6->sin6_scope_id==0) || (pSecondV6->sin6_scope_id==0) || (pFirstV6->sin6_scope_id==pSecondV6->sin6_scope_id);
+		}
+	default:
+		return (firstLength==secondLength) && (memcmp(pFirst, pSecond, static_cast < size_t > (firstLength))==0);
+	}
+}
+
+namespace hbk {
+	namespace communication {
+		bool SocketNonblocking::checkSockAddr(const struct ::sockaddr* pCheckSockAddr, socklen_t checkSockAddrLen) const
+		{
+			if (m_peerAddressLength==0) {
+				return false;
+			}
+			return isSameAddress(reinterpret_cast < const struct sockaddr* > (&m_peerAddress), m_peerAddressLength, pCheckSockAddr, checkSockAddrLen);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_RECEIVELOOP_H
+#define _HBK__COMMUNICATION_RECEIVELOOP_H
+
+/// Internal: The receive loop shared by the readers that split a byte stream (FramedReader, DelimitedReader, WebSocket).
+
+#include <utility>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
+#include "hbk/communication/socketnonblocking.h"
+
+namespace hbk {
+	namespace communication {
+		/// Receive until there is nothing left (we are working edge triggered) and feed each received chunk to process.
+		/// \param pool Microsoft Windows: Blocks to receive into. Linux: The socket receives into blocks of its own buffer pool.
+		/// \param process int (BufferChain&& data). Receiving stops if it returns a negative value.
+		/// \param processFailed Set to true if process stopped receiving
+		/// \return result of the last receive: 0 connection closed; -1 nothing left or error
+		template < typename Process_t >
+		ssize_t receiveLoop(SocketNonblocking& socket, BufferPool& pool, Process_t process, bool& processFailed)
+		{
+			processFailed = false;
+			ssize_t result;
+			do {
+				BufferChain received;
+#ifdef _WIN32
+				BufferPool::Buffer_t buffer = pool.get();
+				result = socket.receive(buffer.get(), pool.getBufferSize());
+				if (result>0) {
+					received.append(BufferSlice(buffer, buffer.get(), static_cast < size_t > (result)));
+				}
+#else
+				(void)pool;
+				result = socket.receive(received);
+#endif
+				if (result>0) {
+					if (process(std::move(received))<0) {
+						processFailed = true;
+						return -1;
+					}
+				}
+			} while (result>0);
+			return result;
+		}
+	}
+}
+#endif
@@ -0,0 +1,252 @@
+// This code is licenced under the MIT license:
+//
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "hbk/communication/resolver.h"
+#include "hbk/exception/exception.hpp"
+
+namespace hbk {
+	namespace communication {
+		Resolver::Resolver(sys::EventLoop& eventLoop, unsigned int workerCount, size_t maxCacheEntries, std::chrono::seconds positiveTtl, std::chrono::seconds negativeTtl)
+			: m_notifier(eventLoop)
+			, m_maxCacheEntries(maxCacheEntries)
+			, m_positiveTtl(positiveTtl)
+			, m_negativeTtl(negativeTtl)
+			, m_stop(false)
+		{
+			if (workerCount==0) {
+				throw hbk::exception::exception("resolver needs at least one worker");
+			}
+			m_notifier.set(std::bind(&Resolver::deliver, this));
+			for (unsigned int workerIndex = 0; workerIndex<workerCount; ++workerIndex) {
+				m_workers.emplace_back(std::thread(&Resolver::worker, this));
+			}
+		}
+
+		Resolver::~Resolver()
+		{
+			{
+				std::lock_guard < std::mutex > lock(m_jobsMtx);
+				m_stop = true;
+			}
+			m_jobsCondition.notify_all();
+			for (auto &iter: m_workers) {
+				iter.join();
+			}
+			m_notifier.set(nullptr);
+		}
+
+		int Resolver::getAddresses(const std::string& address, const std::string& port, int flags, ResolvedAddresses& addresses)
+		{
+			struct addrinfo hints;
+			struct addrinfo* pResult = nullptr;
+
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_protocol = IPPROTO_TCP;
+			hints.ai_flags = flags;
+
+			addresses.clear();
+			int err = getaddrinfo(address.c_str(), port.c_str(), &hints, &pResult);
+			if (err!=0) {
+				return err;
+			}
+			for (struct addrinfo* pIter = pResult; pIter!=nullptr; pIter = pIter->ai_next) {
+				ResolvedAddress resolvedAddress;
+				if (pIter->ai_addrlen>sizeof(resolvedAddress.address)) {
+					continue;
+				}
+				memset(&resolvedAddress.address, 0, sizeof(resolvedAddress.address));
+				memcpy(&resolvedAddress.address, pIter->ai_addr, pIter->ai_addrlen);
+				resolvedAddress.family = pIter->ai_family;
+				resolvedAddress.addressLength = static_cast < socklen_t > (pIter->ai_addrlen);
+				addresses.push_back(resolvedAddress);
+			}
+			freeaddrinfo(pResult);
+			return 0;
+		}
+
+		int Resolver::resolve(const std::string& address, const std::string& port, Cb_t resultCb)
+		{
+			if (!resultCb) {
+				return -1;
+			}
+
+			ResolvedAddresses addresses;
+			// numeric addresses do not need any name service. This never blocks.
+			int err = getAddresses(address, port, AI_NUMERICHOST, addresses);
+			if (err==0) {
+				resultCb(0, addresses);
+				return 0;
+			}
+
+			std::string key = address + '\n' + port;
+			{
+				std::unique_lock < std::mutex > lock(m_cacheMtx);
+				cache_t::iterator cacheIter = m_cache.find(key);
+				if (cacheIter!=m_cache.end()) {
+					if (cacheIter->second.expiry>clock_t::now()) {
+						CacheEntry entry = cacheIter->second;
+						lock.unlock();
+						resultCb(entry.error, entry.addresses);
+						return 0;
+					}
+					m_cache.erase(cacheIter);
+				}
+
+				pending_t::iterator pendingIter = m_pending.find(key);
+				if (pendingIter!=m_pending.end()) {
+					// resolution of this name is already in progress
+					pendingIter->second.push_back(resultCb);
+					return 1;
+				}
+				m_pending[key].push_back(resultCb);
+			}
+
+			{
+				std::lock_guard < std::mutex > lock(m_jobsMtx);
+				Job job;
+				job.key = key;
+				job.address = address;
+				job.port = port;
+				m_jobs.push_back(job);
+			}
+			m_jobsCondition.notify_one();
+			return 1;
+		}
+
+		void Resolver::clearCache()
+		{
+			std::lock_guard < std::mutex > lock(m_cacheMtx);
+			m_cache.clear();
+		}
+
+		size_t Resolver::getCacheSize() const
+		{
+			std::lock_guard < std::mutex > lock(m_cacheMtx);
+			return m_cache.size();
+		}
+
+		void Resolver::worker()
+		{
+			while (true) {
+				Job job;
+				{
+					std::unique_lock < std::mutex > lock(m_jobsMtx);
+					m_jobsCondition.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+					if (m_stop) {
+						return;
+					}
+					job = m_jobs.front();
+					m_jobs.pop_front();
+				}
+
+				Result result;
+				result.key = job.key;
+				result.error = getAddresses(job.address, job.port, 0, result.addresses);
+				{
+					std::lock_guard < std::mutex > lock(m_jobsMtx);
+					m_results.push_back(result);
+				}
+				m_notifier.notify();
+			}
+		}
+
+		void Resolver::deliver()
+		{
+			// the notifier calls us once for each notification. We might have processed all results already.
+			while (true) {
+				Result result;
+				{
+					std::lock_guard < std::mutex > lock(m_jobsMtx);
+					if (m_results.empty()) {
+						return;
+					}
+					result = m_results.front();
+					m_results.pop_front();
+				}
+
+				std::vector < Cb_t > callbacks;
+				{
+					std::lock_guard < std::mutex > lock(m_cacheMtx);
+					insertIntoCache(result.key, result.error, result.addresses);
+					pending_t::iterator pendingIter = m_pending.find(result.key);
+					if (pendingIter!=m_pending.end()) {
+						callbacks.swap(pendingIter->second);
+						m_pending.erase(pendingIter);
+					}
+				}
+
+				for (auto &iter: callbacks) {
+					iter(result.error, result.addresses);
+				}
+			}
+		}
+
+		void Resolver::insertIntoCache(const std::string& key, int error, const ResolvedAddresses& addresses)
+		{
+			if (m_maxCacheEntries==0) {
+				return;
+			}
+
+			clock_t::time_point now = clock_t::now();
+			if (m_cache.size()>=m_maxCacheEntries) {
+				// make room: remove expired entries first. If there are none, remove the one expiring first.
+				cache_t::iterator oldestIter = m_cache.end();
+				for (cache_t::iterator iter = m_cache.begin(); iter!=m_cache.end(); ) {
+					if (iter->second.expiry<=now) {
+						iter = m_cache.erase(iter);
+					} else {
+						if ((oldestIter==m_cache.end()) || (iter->second.expiry<oldestIter->second.expiry)) {
+							oldestIter = iter;
+						}
+						++iter;
+					}
+				}
+				if (m_cache.size()>=m_maxCacheEntries) {
+					m_cache.erase(oldestIter);
+				}
+			}
+
+			CacheEntry entry;
+			entry.error = error;
+			entry.addresses = addresses;
+			if (error==0) {
+				entry.expiry = now + m_positiveTtl;
+			} else {
+				entry.expiry = now + m_negativeTtl;
+			}
+			m_cache[key] = entry;
+		}
+	}
+}
@@ -0,0 +1,134 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_SIMD_H
+#define _HBK__COMMUNICATION_SIMD_H
+
+/// Internal: Instruction sets available at compile time and choosing the implementation the running CPU supports best.
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP>=2))
+#define HBK_SIMD_SSE2
+#include <emmintrin.h>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HBK_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#define HBK_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// nullptr for implementations that are not compiled in
+#ifdef HBK_SIMD_SSE2
+#define HBK_SIMD_SSE2_FUNCTION(function) function
+#else
+#define HBK_SIMD_SSE2_FUNCTION(function) nullptr
+#endif
+#ifdef HBK_SIMD_AVX2
+#define HBK_SIMD_AVX2_FUNCTION(function) function
+#else
+#define HBK_SIMD_AVX2_FUNCTION(function) nullptr
+#endif
+#ifdef HBK_SIMD_NEON
+#define HBK_SIMD_NEON_FUNCTION(function) function
+#else
+#define HBK_SIMD_NEON_FUNCTION(function) nullptr
+#endif
+
+namespace hbk {
+	namespace communication {
+		namespace simd {
+			/// \return index of the lowest bit set. value must not be 0.
+			inline unsigned countTrailingZeros(uint64_t value)
+			{
+#ifdef _MSC_VER
+				unsigned long index;
+#ifdef _M_X64
+				_BitScanForward64(&index, value);
+#else
+				if (static_cast < uint32_t > (value)) {
+					_BitScanForward(&index, static_cast < uint32_t > (value));
+				} else {
+					_BitScanForward(&index, static_cast < uint32_t > (value >> 32));
+					index += 32;
+				}
+#endif
+				return index;
+#else
+				return static_cast < unsigned > (__builtin_ctzll(value));
+#endif
+			}
+
+			/// Chooses the fastest implementation supported by the CPU when being constructed.
+			/// Meant to be a function local static, hence decided once on first use.
+			template < typename Function_t >
+			class Dispatch {
+			public:
+				/// \param sse2, avx2, neon nullptr if not compiled in (see HBK_SIMD_SSE2_FUNCTION() and friends)
+				Dispatch(Function_t scalar, Function_t sse2, Function_t avx2, Function_t neon)
+					: m_function(scalar)
+					, m_pName("scalar")
+				{
+					if (sse2) {
+						m_function = sse2;
+						m_pName = "sse2";
+					}
+#ifdef HBK_SIMD_AVX2
+					__builtin_cpu_init();
+					if ((avx2) && (__builtin_cpu_supports("avx2"))) {
+						m_function = avx2;
+						m_pName = "avx2";
+					}
+#else
+					(void)avx2;
+#endif
+					if (neon) {
+						m_function = neon;
+						m_pName = "neon";
+					}
+				}
+
+				Function_t get() const
+				{
+					return m_function;
+				}
+
+				/// \return "scalar", "sse2", "avx2" or "neon"
+				const char* getName() const
+				{
+					return m_pName;
+				}
+
+			private:
+				Function_t m_function;
+				const char* m_pName;
+			};
+		}
+	}
+}
+#endif
@@ -0,0 +1,84 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "hbk/communication/socketnonblocking.h"
+
+/// released objects kept for reuse
+static const size_t MAX_CACHED_OBJECTS = 1024;
+
+namespace hbk {
+	namespace communication {
+		struct SocketFreeList {
+			std::mutex mtx;
+			std::vector < void* > objects;
+		};
+
+		/// Never destroyed: Sockets might be released after static objects were destroyed.
+		static SocketFreeList& freeList()
+		{
+			static SocketFreeList* pFreeList = new SocketFreeList;
+			return *pFreeList;
+		}
+
+		void* SocketNonblocking::operator new(size_t size)
+		{
+			if (size==sizeof(SocketNonblocking)) {
+				SocketFreeList& list = freeList();
+				std::lock_guard < std::mutex > lock(list.mtx);
+				if (!list.objects.empty()) {
+					void* pObject = list.objects.back();
+					list.objects.pop_back();
+					return pObject;
+				}
+			}
+			// derived classes differ in size
+			return ::operator new(size);
+		}
+
+		void SocketNonblocking::operator delete(void* pObject, size_t size)
+		{
+			if (pObject==nullptr) {
+				return;
+			}
+			if (size==sizeof(SocketNonblocking)) {
+				SocketFreeList& list = freeList();
+				std::lock_guard < std::mutex > lock(list.mtx);
+				if (list.objects.size()<MAX_CACHED_OBJECTS) {
+					list.objects.push_back(pObject);
+					return;
+				}
+			}
+			::operator delete(pObject);
+		}
+
+		size_t SocketNonblocking::getCachedObjectCount()
+		{
+			SocketFreeList& list = freeList();
+			std::lock_guard < std::mutex > lock(list.mtx);
+			return list.objects.size();
+		}
+	}
+}
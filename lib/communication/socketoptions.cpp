@@ -0,0 +1,79 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "hbk/communication/socketoptions.h"
+
+namespace hbk {
+	namespace communication {
+		SocketOptions::SocketOptions()
+			: noDelay(true)
+			, keepAlive(true)
+#ifdef _WIN32
+			// from MSDN: on windows vista and later, the number of probes is set to 10 and can not be changed
+			, keepAliveIdle(1)
+			, keepAliveInterval(1)
+			, keepAliveProbes(10)
+#else
+			, keepAliveIdle(12)
+			, keepAliveInterval(3)
+			, keepAliveProbes(2)
+#endif
+			, sendBufferSize(0)
+			, receiveBufferSize(0)
+			, quickAck(false)
+			, notSentLowWatermark(0)
+			, priority(-1)
+			, dscp(-1)
+			, userTimeout(0)
+			, busyPoll(0)
+			, congestionControl()
+		{
+		}
+
+		SocketOptions SocketOptions::bulkStreaming()
+		{
+			SocketOptions options;
+			options.sendBufferSize = 4*1024*1024;
+			options.receiveBufferSize = 4*1024*1024;
+			// keeps the send buffer from growing huge while still being able to fill the pipe
+			options.notSentLowWatermark = 128*1024;
+			// AF11: high throughput data
+			options.dscp = 10;
+			options.congestionControl = "bbr";
+			return options;
+		}
+
+		SocketOptions SocketOptions::lowLatencyControl()
+		{
+			SocketOptions options;
+			options.quickAck = true;
+			options.notSentLowWatermark = 16*1024;
+			// TC_PRIO_INTERACTIVE
+			options.priority = 6;
+			// EF: expedited forwarding
+			options.dscp = 46;
+			options.userTimeout = std::chrono::milliseconds(5000);
+			options.busyPoll = std::chrono::microseconds(50);
+			return options;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/transportstats.h"
+
+namespace hbk {
+	namespace communication {
+		TransportStats::TransportStats()
+			: time()
+			, bytesReceived(0)
+			, bytesSent(0)
+			, partialWrites(0)
+			, coalescedWrites(0)
+			, blockedTime(0)
+			, sendQueueSize(0)
+			, receiveQueueSize(0)
+			, tcpInfoValid(false)
+			, rtt(0)
+			, rttVariance(0)
+			, retransmits(0)
+			, lost(0)
+			, congestionWindow(0)
+			, sendMss(0)
+			, notSentBytes(0)
+			, deliveryRate(0)
+			, pacingRate(0)
+			, busyTime(0)
+			, receiveWindowLimitedTime(0)
+			, sendBufferLimitedTime(0)
+		{
+		}
+
+		TransportStatsSampler::TransportStatsSampler(sys::EventLoop& eventLoop)
+			: m_timer(eventLoop)
+			, m_previous()
+		{
+		}
+
+		int TransportStatsSampler::start(SocketNonblocking& socket, std::chrono::milliseconds period, Cb_t cb)
+		{
+			if (!cb) {
+				return -1;
+			}
+			m_previous = TransportStats();
+			return m_timer.set(period, true, [this, &socket, cb](bool fired)
+			{
+				if (!fired) {
+					return;
+				}
+				TransportStats current = socket.transportStats();
+				cb(current, m_previous);
+				m_previous = current;
+			});
+		}
+
+		void TransportStatsSampler::stop()
+		{
+			m_timer.cancel();
+		}
+	}
+}
@@ -0,0 +1,821 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+
+#ifndef _WIN32
+#include <sys/random.h>
+#endif
+
+#include "hbk/communication/websocket.h"
+#include "hbk/string/split.h"
+#include "hbk/string/trim.h"
+
+#include "receiveloop.h"
+#include "simd.h"
+
+/// the opening handshake has to fit into this
+static const size_t MAX_HANDSHAKE_SIZE = 8192;
+/// payload of control frames is limited by the protocol
+static const size_t MAX_CONTROL_PAYLOAD = 125;
+
+static const char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+using Mask_t = void (*)(uint8_t* pDestination, const uint8_t* pSource, size_t size, const uint8_t* pKey);
+
+static void maskScalar(uint8_t* pDestination, const uint8_t* pSource, size_t size, const uint8_t* pKey)
+{
+	for (size_t index = 0; index<size; ++index) {
+		pDestination[index] = pSource[index] ^ pKey[index & 3];
+	}
+}
+
+#ifdef HBK_SIMD_SSE2
+static void maskSse2(uint8_t* pDestination, const uint8_t* pSource, size_t size, const uint8_t* pKey)
+{
+	uint32_t key;
+	memcpy(&key, pKey, sizeof(key));
+	const __m128i keys = _mm_set1_epi32(static_cast < int > (key));
+	size_t index = 0;
+	for (; index+16<=size; index += 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast < const __m128i* > (pSource+index));
+		_mm_storeu_si128(reinterpret_cast < __m128i* > (pDestination+index), _mm_xor_si128(chunk, keys));
+	}
+	// multiples of 4 keep the key in phase
+	maskScalar(pDestination+index, pSource+index, size-index, pKey);
+}
+#endif
+
+#ifdef HBK_SIMD_AVX2
+__attribute__((target("avx2")))
+static void maskAvx2(uint8_t* pDestination, const uint8_t* pSource, size_t size, const uint8_t* pKey)
+{
+	uint32_t key;
+	memcpy(&key, pKey, sizeof(key));
+	const __m256i keys = _mm256_set1_epi32(static_cast < int > (key));
+	size_t index = 0;
+	for (; index+32<=size; index += 32) {
+		__m256i chunk = _mm256_loadu_si256(reinterpret_cast < const __m256i* > (pSource+index));
+		_mm256_storeu_si256(reinterpret_cast < __m256i* > (pDestination+index), _mm256_xor_si256(chunk, keys));
+	}
+	maskSse2(pDestination+index, pSource+index, size-index, pKey);
+}
+#endif
+
+#ifdef HBK_SIMD_NEON
+static void maskNeon(uint8_t* pDestination, const uint8_t* pSource, size_t size, const uint8_t* pKey)
+{
+	uint32_t key;
+	memcpy(&key, pKey, sizeof(key));
+	const uint8x16_t keys = vreinterpretq_u8_u32(vdupq_n_u32(key));
+	size_t index = 0;
+	for (; index+16<=size; index += 16) {
+		vst1q_u8(pDestination+index, veorq_u8(vld1q_u8(pSource+index), keys));
+	}
+	maskScalar(pDestination+index, pSource+index, size-index, pKey);
+}
+#endif
+
+static const hbk::communication::simd::Dispatch < Mask_t >& getMask()
+{
+	static const hbk::communication::simd::Dispatch < Mask_t > mask(maskScalar, HBK_SIMD_SSE2_FUNCTION(maskSse2), HBK_SIMD_AVX2_FUNCTION(maskAvx2), HBK_SIMD_NEON_FUNCTION(maskNeon));
+	return mask;
+}
+
+/// masking keys and the handshake nonce must not be predictable
+static void getRandomBytes(uint8_t* pData, size_t size)
+{
+#ifndef _WIN32
+	while (size>0) {
+		ssize_t result = getrandom(pData, size, 0);
+		if (result<0) {
+			if (errno==EINTR) {
+				continue;
+			}
+			break;
+		}
+		pData += result;
+		size -= static_cast < size_t > (result);
+	}
+#endif
+	if (size>0) {
+		std::random_device device;
+		for (size_t index = 0; index<size; ++index) {
+			pData[index] = static_cast < uint8_t > (device());
+		}
+	}
+}
+
+static uint32_t rotateLeft(uint32_t value, unsigned int count)
+{
+	return (value << count) | (value >> (32-count));
+}
+
+/// only used for the opening handshake
+static void sha1(const uint8_t* pData, size_t size, uint8_t digest[20])
+{
+	uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+	std::vector < uint8_t > message(pData, pData+size);
+	message.push_back(0x80);
+	while (message.size()%64!=56) {
+		message.push_back(0);
+	}
+	uint64_t bitCount = static_cast < uint64_t > (size)*8;
+	for (int shift = 56; shift>=0; shift -= 8) {
+		message.push_back(static_cast < uint8_t > (bitCount >> shift));
+	}
+
+	for (size_t chunk = 0; chunk<message.size(); chunk += 64) {
+		uint32_t w[80];
+		for (unsigned int index = 0; index<16; ++index) {
+			const uint8_t* pWord = &message[chunk+index*4];
+			w[index] = (static_cast < uint32_t > (pWord[0]) << 24) | (static_cast < uint32_t > (pWord[1]) << 16) | (static_cast < uint32_t > (pWord[2]) << 8) | pWord[3];
+		}
+		for (unsigned int index = 16; index<80; ++index) {
+			w[index] = rotateLeft(w[index-3] ^ w[index-8] ^ w[index-14] ^ w[index-16], 1);
+		}
+
+		uint32_t a = h[0];
+		uint32_t b = h[1];
+		uint32_t c = h[2];
+		uint32_t d = h[3];
+		uint32_t e = h[4];
+		for (unsigned int index = 0; index<80; ++index) {
+			uint32_t f;
+			uint32_t k;
+			if (index<20) {
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			} else if (index<40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (index<60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+			uint32_t temp = rotateLeft(a, 5) + f + e + k + w[index];
+			e = d;
+			d = c;
+			c = rotateLeft(b, 30);
+			b = a;
+			a = temp;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	for (unsigned int index = 0; index<5; ++index) {
+		digest[index*4] = static_cast < uint8_t > (h[index] >> 24);
+		digest[index*4+1] = static_cast < uint8_t > (h[index] >> 16);
+		digest[index*4+2] = static_cast < uint8_t > (h[index] >> 8);
+		digest[index*4+3] = static_cast < uint8_t > (h[index]);
+	}
+}
+
+static std::string base64(const uint8_t* pData, size_t size)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string result;
+	result.reserve(((size+2)/3)*4);
+	for (size_t index = 0; index<size; index += 3) {
+		uint32_t group = static_cast < uint32_t > (pData[index]) << 16;
+		if (index+1<size) {
+			group |= static_cast < uint32_t > (pData[index+1]) << 8;
+		}
+		if (index+2<size) {
+			group |= pData[index+2];
+		}
+		result += alphabet[(group >> 18) & 0x3f];
+		result += alphabet[(group >> 12) & 0x3f];
+		result += (index+1<size) ? alphabet[(group >> 6) & 0x3f] : '=';
+		result += (index+2<size) ? alphabet[group & 0x3f] : '=';
+	}
+	return result;
+}
+
+static std::string toLower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char character) { return static_cast < char > (std::tolower(character)); });
+	return text;
+}
+
+/// \return value of the header field with the given lower case name. Empty if there is none.
+static std::string getField(const hbk::string::tokens& lines, const std::string& name)
+{
+	for (size_t index = 1; index<lines.size(); ++index) {
+		const std::string& line = lines[index];
+		size_t colon = line.find(':');
+		if (colon==std::string::npos) {
+			continue;
+		}
+		if (toLower(hbk::string::trim_copy(line.substr(0, colon)))==name) {
+			return hbk::string::trim_copy(line.substr(colon+1));
+		}
+	}
+	return "";
+}
+
+/// \return true if the comma separated field value contains token (case insensitive)
+static bool hasToken(const std::string& value, const std::string& token)
+{
+	hbk::string::tokens items = hbk::string::split(toLower(value), ',');
+	for (auto &iter: items) {
+		if (hbk::string::trim_copy(iter)==token) {
+			return true;
+		}
+	}
+	return false;
+}
+
+namespace hbk {
+	namespace communication {
+		const uint16_t WebSocket::CLOSE_NORMAL;
+		const uint16_t WebSocket::CLOSE_GOING_AWAY;
+		const uint16_t WebSocket::CLOSE_PROTOCOL_ERROR;
+		const uint16_t WebSocket::CLOSE_NO_STATUS;
+		const uint16_t WebSocket::CLOSE_ABNORMAL;
+		const uint16_t WebSocket::CLOSE_INVALID_PAYLOAD;
+		const uint16_t WebSocket::CLOSE_TOO_BIG;
+
+		WebSocket::WebSocket(clientSocket_t socket, BufferPool& pool)
+			: m_socket(std::move(socket))
+			, m_pool(pool)
+			, m_client(false)
+			, m_state(STATE_HANDSHAKE)
+			, m_maxMessageSize(16*1024*1024)
+			, m_messageCb()
+			, m_openCb()
+			, m_closeCb()
+			, m_pending()
+			, m_fragments()
+			, m_fragmentOpcode(OPCODE_CONTINUATION)
+			, m_key()
+			, m_sendBuffer()
+		{
+		}
+
+		WebSocket::WebSocket(sys::EventLoop& eventLoop, BufferPool& pool)
+			: m_socket(new SocketNonblocking(eventLoop))
+			, m_pool(pool)
+			, m_client(true)
+			, m_state(STATE_CLOSED)
+			, m_maxMessageSize(16*1024*1024)
+			, m_messageCb()
+			, m_openCb()
+			, m_closeCb()
+			, m_pending()
+			, m_fragments()
+			, m_fragmentOpcode(OPCODE_CONTINUATION)
+			, m_key()
+			, m_sendBuffer()
+		{
+		}
+
+		WebSocket::~WebSocket()
+		{
+		}
+
+		int WebSocket::start()
+		{
+			if ((m_client) || (m_state!=STATE_HANDSHAKE)) {
+				return -1;
+			}
+			m_socket->setDataCb(std::bind(&WebSocket::receive, this, std::placeholders::_1));
+			return 0;
+		}
+
+		int WebSocket::connect(const std::string& address, const std::string& port, const std::string& path, const std::string& host)
+		{
+			if (m_socket->connect(address, port)<0) {
+				return -1;
+			}
+
+			uint8_t nonce[16];
+			getRandomBytes(nonce, sizeof(nonce));
+			m_key = base64(nonce, sizeof(nonce));
+
+			std::string request =
+				"GET " + path + " HTTP/1.1\r\n"
+				"Host: " + (host.empty() ? address + ":" + port : host) + "\r\n"
+				"Upgrade: websocket\r\n"
+				"Connection: Upgrade\r\n"
+				"Sec-WebSocket-Key: " + m_key + "\r\n"
+				"Sec-WebSocket-Version: 13\r\n"
+				"\r\n";
+
+			m_state = STATE_HANDSHAKE;
+			m_pending.clear();
+			m_fragments.clear();
+			m_fragmentOpcode = OPCODE_CONTINUATION;
+			m_socket->setDataCb(std::bind(&WebSocket::receive, this, std::placeholders::_1));
+			if (m_socket->sendBlock(request.c_str(), request.length(), false)!=static_cast < ssize_t > (request.length())) {
+				m_socket->disconnect();
+				m_state = STATE_CLOSED;
+				return -1;
+			}
+			return 0;
+		}
+
+		void WebSocket::setMessageCb(MessageCb_t messageCb)
+		{
+			m_messageCb = messageCb;
+		}
+
+		void WebSocket::setOpenCb(OpenCb_t openCb)
+		{
+			m_openCb = openCb;
+		}
+
+		void WebSocket::setCloseCb(CloseCb_t closeCb)
+		{
+			m_closeCb = closeCb;
+		}
+
+		ssize_t WebSocket::send(Opcode opcode, const void* pData, size_t size, bool fin)
+		{
+			if (m_state!=STATE_OPEN) {
+				errno = ENOTCONN;
+				return -1;
+			}
+			if ((opcode & 0x8) && ((!fin) || (size>MAX_CONTROL_PAYLOAD))) {
+				errno = EINVAL;
+				return -1;
+			}
+			return sendFrame(static_cast < uint8_t > (opcode), pData, size, fin);
+		}
+
+		ssize_t WebSocket::sendText(const std::string& text)
+		{
+			return send(OPCODE_TEXT, text.c_str(), text.length());
+		}
+
+		ssize_t WebSocket::sendBinary(const void* pData, size_t size)
+		{
+			return send(OPCODE_BINARY, pData, size);
+		}
+
+		ssize_t WebSocket::ping(const void* pData, size_t size)
+		{
+			return send(OPCODE_PING, pData, size);
+		}
+
+		int WebSocket::close(uint16_t code, const std::string& reason)
+		{
+			if (m_state!=STATE_OPEN) {
+				return -1;
+			}
+			uint8_t payload[MAX_CONTROL_PAYLOAD];
+			payload[0] = static_cast < uint8_t > (code >> 8);
+			payload[1] = static_cast < uint8_t > (code);
+			size_t reasonLength = std::min(reason.length(), sizeof(payload)-2);
+			if (reasonLength<reason.length()) {
+				// do not cut a multi byte character
+				while ((reasonLength>0) && ((static_cast < uint8_t > (reason[reasonLength]) & 0xc0)==0x80)) {
+					--reasonLength;
+				}
+			}
+			memcpy(payload+2, reason.c_str(), reasonLength);
+			m_state = STATE_CLOSING;
+			if (sendFrame(OPCODE_CLOSE, payload, reasonLength+2, true)<0) {
+				return -1;
+			}
+			return 0;
+		}
+
+		void WebSocket::mask(uint8_t* pDestination, const uint8_t* pSource, size_t size, const uint8_t key[4])
+		{
+			getMask().get()(pDestination, pSource, size, key);
+		}
+
+		const char* WebSocket::getMaskerName()
+		{
+			return getMask().getName();
+		}
+
+		std::string WebSocket::acceptKey(const std::string& key)
+		{
+			std::string text = key + WEBSOCKET_GUID;
+			uint8_t digest[20];
+			sha1(reinterpret_cast < const uint8_t* > (text.c_str()), text.length(), digest);
+			return base64(digest, sizeof(digest));
+		}
+
+		bool WebSocket::isValidUtf8(const uint8_t* pData, size_t size)
+		{
+			size_t index = 0;
+			while (index<size) {
+				uint8_t lead = pData[index];
+				if (lead<0x80) {
+					++index;
+					continue;
+				}
+				size_t count;
+				// range of the first continuation byte excludes overlong forms, surrogates and code points above U+10FFFF
+				uint8_t lower = 0x80;
+				uint8_t upper = 0xbf;
+				if ((lead>=0xc2) && (lead<=0xdf)) {
+					count = 1;
+				} else if ((lead>=0xe0) && (lead<=0xef)) {
+					count = 2;
+					if (lead==0xe0) {
+						lower = 0xa0;
+					} else if (lead==0xed) {
+						upper = 0x9f;
+					}
+				} else if ((lead>=0xf0) && (lead<=0xf4)) {
+					count = 3;
+					if (lead==0xf0) {
+						lower = 0x90;
+					} else if (lead==0xf4) {
+						upper = 0x8f;
+					}
+				} else {
+					return false;
+				}
+				if (size-index<=count) {
+					return false;
+				}
+				if ((pData[index+1]<lower) || (pData[index+1]>upper)) {
+					return false;
+				}
+				for (size_t position = 2; position<=count; ++position) {
+					if ((pData[index+position] & 0xc0)!=0x80) {
+						return false;
+					}
+				}
+				index += count+1;
+			}
+			return true;
+		}
+
+		ssize_t WebSocket::sendFrame(uint8_t opcode, const void* pData, size_t size, bool fin)
+		{
+			uint8_t header[14];
+			size_t headerSize = 2;
+			header[0] = static_cast < uint8_t > ((fin ? 0x80 : 0x00) | opcode);
+			if (size<126) {
+				header[1] = static_cast < uint8_t > (size);
+			} else if (size<=0xffff) {
+				header[1] = 126;
+				header[2] = static_cast < uint8_t > (size >> 8);
+				header[3] = static_cast < uint8_t > (size);
+				headerSize = 4;
+			} else {
+				header[1] = 127;
+				uint64_t length = size;
+				for (unsigned int index = 0; index<8; ++index) {
+					header[2+index] = static_cast < uint8_t > (length >> (56-index*8));
+				}
+				headerSize = 10;
+			}
+
+			dataBlock_t blocks[2];
+			if (m_client) {
+				// frames sent by the client are masked with a new key each
+				uint8_t* pKey = header+headerSize;
+				getRandomBytes(pKey, 4);
+				header[1] |= 0x80;
+				headerSize += 4;
+				m_sendBuffer.resize(size);
+				if (size) {
+					mask(m_sendBuffer.data(), reinterpret_cast < const uint8_t* > (pData), size, pKey);
+				}
+				blocks[1] = dataBlock_t(m_sendBuffer.data(), size);
+			} else {
+				blocks[1] = dataBlock_t(pData, size);
+			}
+			blocks[0] = dataBlock_t(header, headerSize);
+
+			ssize_t result = m_socket->sendBlocks(blocks, size ? 2 : 1);
+			if (result!=static_cast < ssize_t > (headerSize+size)) {
+				return -1;
+			}
+			return static_cast < ssize_t > (size);
+		}
+
+		ssize_t WebSocket::receive(SocketNonblocking& socket)
+		{
+			bool processFailed;
+			ssize_t result = receiveLoop(socket, m_pool, [this](BufferChain&& data) {
+				return process(std::move(data));
+			}, processFailed);
+			if (processFailed) {
+				// closed, the close callback was called already
+				return 0;
+			}
+
+			if ((result==0) && (m_state!=STATE_CLOSED)) {
+				shutdown(CLOSE_ABNORMAL);
+			}
+			return result;
+		}
+
+		int WebSocket::process(BufferChain&& data)
+		{
+			m_pending.append(std::move(data));
+
+			if (m_state==STATE_HANDSHAKE) {
+				int result = processHandshake();
+				if (result<=0) {
+					return result;
+				}
+			}
+
+			while (m_pending.size()>=2) {
+				uint8_t header[14];
+				size_t available = m_pending.copyOut(0, header, sizeof(header));
+				bool fin = (header[0] & 0x80)!=0;
+				uint8_t opcode = header[0] & 0x0f;
+				bool masked = (header[1] & 0x80)!=0;
+				uint64_t length = header[1] & 0x7f;
+
+				size_t headerSize = 2;
+				if (length==126) {
+					headerSize += 2;
+				} else if (length==127) {
+					headerSize += 8;
+				}
+				if (masked) {
+					headerSize += 4;
+				}
+				if (available<headerSize) {
+					// wait for the rest
+					break;
+				}
+				if (length==126) {
+					length = (static_cast < uint64_t > (header[2]) << 8) | header[3];
+				} else if (length==127) {
+					length = 0;
+					for (unsigned int index = 2; index<10; ++index) {
+						length = (length << 8) | header[index];
+					}
+				}
+
+				if (header[0] & 0x70) {
+					// no extension negotiated
+					return fail(CLOSE_PROTOCOL_ERROR);
+				}
+				if (masked==m_client) {
+					// the client masks, the server does not
+					return fail(CLOSE_PROTOCOL_ERROR);
+				}
+				if (opcode & 0x8) {
+					if ((opcode>OPCODE_PONG) || (!fin) || (length>MAX_CONTROL_PAYLOAD)) {
+						return fail(CLOSE_PROTOCOL_ERROR);
+					}
+				} else if (opcode>OPCODE_BINARY) {
+					return fail(CLOSE_PROTOCOL_ERROR);
+				}
+				if (length>m_maxMessageSize) {
+					return fail(CLOSE_TOO_BIG);
+				}
+
+				size_t payloadSize = static_cast < size_t > (length);
+				if (m_pending.size()<headerSize+payloadSize) {
+					// wait for the rest
+					break;
+				}
+
+				m_pending.consume(headerSize);
+				BufferSlice payload;
+				if (payloadSize) {
+					const BufferSlice& front = m_pending.getSlices().front();
+					if (front.size>=payloadSize) {
+						// contiguous, unmask in place. Receive blocks are referenced by this object only.
+						payload = front.subSlice(0, payloadSize);
+						if (masked) {
+							uint8_t* pPayload = const_cast < uint8_t* > (payload.pData);
+							mask(pPayload, pPayload, payloadSize, header+headerSize-4);
+						}
+					} else {
+						// spread over several blocks
+						std::shared_ptr < uint8_t > buffer;
+						if (payloadSize<=m_pool.getBufferSize()) {
+							buffer = m_pool.get();
+						} else {
+							buffer = std::shared_ptr < uint8_t > (new uint8_t[payloadSize], std::default_delete < uint8_t[] > ());
+						}
+						m_pending.copyOut(0, buffer.get(), payloadSize);
+						if (masked) {
+							mask(buffer.get(), buffer.get(), payloadSize, header+headerSize-4);
+						}
+						payload = BufferSlice(buffer, buffer.get(), payloadSize);
+					}
+					m_pending.consume(payloadSize);
+				}
+
+				if (processFrame(fin, opcode, payload)<0) {
+					return -1;
+				}
+				if (m_state==STATE_CLOSED) {
+					// closed from within the message callback
+					return -1;
+				}
+			}
+			return 0;
+		}
+
+		int WebSocket::processHandshake()
+		{
+			std::string head(std::min(m_pending.size(), MAX_HANDSHAKE_SIZE), '\0');
+			m_pending.copyOut(0, &head[0], head.length());
+			size_t end = head.find("\r\n\r\n");
+			if (end==std::string::npos) {
+				if (head.length()>=MAX_HANDSHAKE_SIZE) {
+					shutdown(CLOSE_ABNORMAL);
+					return -1;
+				}
+				return 0;
+			}
+			head.resize(end);
+			m_pending.consume(end+4);
+
+			hbk::string::tokens lines = hbk::string::split(head, "\r\n");
+			if (m_client) {
+				if ((lines[0].compare(0, 13, "HTTP/1.1 101 ")!=0) ||
+					(!hasToken(getField(lines, "upgrade"), "websocket")) ||
+					(getField(lines, "sec-websocket-accept")!=acceptKey(m_key))) {
+					shutdown(CLOSE_ABNORMAL);
+					return -1;
+				}
+			} else {
+				std::string key = getField(lines, "sec-websocket-key");
+				if ((lines[0].compare(0, 4, "GET ")!=0) ||
+					(!hasToken(getField(lines, "upgrade"), "websocket")) ||
+					(!hasToken(getField(lines, "connection"), "upgrade")) ||
+					(getField(lines, "sec-websocket-version")!="13") ||
+					(key.empty())) {
+					static const char badRequest[] =
+						"HTTP/1.1 400 Bad Request\r\n"
+						"Sec-WebSocket-Version: 13\r\n"
+						"Content-Length: 0\r\n"
+						"\r\n";
+					m_socket->sendBlock(badRequest, sizeof(badRequest)-1, false);
+					shutdown(CLOSE_ABNORMAL);
+					return -1;
+				}
+				std::string response =
+					"HTTP/1.1 101 Switching Protocols\r\n"
+					"Upgrade: websocket\r\n"
+					"Connection: Upgrade\r\n"
+					"Sec-WebSocket-Accept: " + acceptKey(key) + "\r\n"
+					"\r\n";
+				if (m_socket->sendBlock(response.c_str(), response.length(), false)!=static_cast < ssize_t > (response.length())) {
+					shutdown(CLOSE_ABNORMAL);
+					return -1;
+				}
+			}
+
+			m_state = STATE_OPEN;
+			if (m_openCb) {
+				m_openCb(*this);
+			}
+			return 1;
+		}
+
+		int WebSocket::processFrame(bool fin, uint8_t opcode, const BufferSlice& payload)
+		{
+			switch (opcode) {
+			case OPCODE_PING:
+				if (m_state==STATE_OPEN) {
+					sendFrame(OPCODE_PONG, payload.pData, payload.size, true);
+				}
+				return 0;
+			case OPCODE_PONG:
+				if (m_messageCb) {
+					m_messageCb(*this, OPCODE_PONG, payload);
+				}
+				return 0;
+			case OPCODE_CLOSE:
+				{
+					if (payload.size==1) {
+						return fail(CLOSE_PROTOCOL_ERROR);
+					}
+					if ((payload.size>2) && (!isValidUtf8(payload.pData+2, payload.size-2))) {
+						return fail(CLOSE_INVALID_PAYLOAD);
+					}
+					uint16_t code = CLOSE_NO_STATUS;
+					if (payload.size>=2) {
+						code = static_cast < uint16_t > ((payload.pData[0] << 8) | payload.pData[1]);
+					}
+					if (m_state==STATE_OPEN) {
+						// answer with the status code received
+						sendFrame(OPCODE_CLOSE, payload.pData, std::min(payload.size, static_cast < size_t > (2)), true);
+					}
+					shutdown(code);
+					return -1;
+				}
+			case OPCODE_CONTINUATION:
+				if (m_fragmentOpcode==OPCODE_CONTINUATION) {
+					// nothing to continue
+					return fail(CLOSE_PROTOCOL_ERROR);
+				}
+				if (m_fragments.size()+payload.size>m_maxMessageSize) {
+					return fail(CLOSE_TOO_BIG);
+				}
+				m_fragments.append(payload);
+				if (fin) {
+					BufferSlice message;
+					if (m_fragments.getSlices().size()==1) {
+						message = m_fragments.getSlices().front();
+					} else if (!m_fragments.empty()) {
+						size_t messageSize = m_fragments.size();
+						std::shared_ptr < uint8_t > buffer;
+						if (messageSize<=m_pool.getBufferSize()) {
+							buffer = m_pool.get();
+						} else {
+							buffer = std::shared_ptr < uint8_t > (new uint8_t[messageSize], std::default_delete < uint8_t[] > ());
+						}
+						m_fragments.copyOut(0, buffer.get(), messageSize);
+						message = BufferSlice(buffer, buffer.get(), messageSize);
+					}
+					Opcode messageOpcode = static_cast < Opcode > (m_fragmentOpcode);
+					if ((messageOpcode==OPCODE_TEXT) && (!isValidUtf8(message.pData, message.size))) {
+						return fail(CLOSE_INVALID_PAYLOAD);
+					}
+					m_fragments.clear();
+					m_fragmentOpcode = OPCODE_CONTINUATION;
+					if (m_messageCb) {
+						m_messageCb(*this, messageOpcode, message);
+					}
+				}
+				return 0;
+			default:
+				if (m_fragmentOpcode!=OPCODE_CONTINUATION) {
+					// previous message is not complete
+					return fail(CLOSE_PROTOCOL_ERROR);
+				}
+				if (!fin) {
+					m_fragmentOpcode = opcode;
+					m_fragments.append(payload);
+					return 0;
+				}
+				if ((opcode==OPCODE_TEXT) && (!isValidUtf8(payload.pData, payload.size))) {
+					return fail(CLOSE_INVALID_PAYLOAD);
+				}
+				if (m_messageCb) {
+					m_messageCb(*this, static_cast < Opcode > (opcode), payload);
+				}
+				return 0;
+			}
+		}
+
+		int WebSocket::fail(uint16_t code)
+		{
+			if (m_state==STATE_OPEN) {
+				uint8_t payload[2];
+				payload[0] = static_cast < uint8_t > (code >> 8);
+				payload[1] = static_cast < uint8_t > (code);
+				sendFrame(OPCODE_CLOSE, payload, sizeof(payload), true);
+			}
+			shutdown(code);
+			return -1;
+		}
+
+		void WebSocket::shutdown(uint16_t code)
+		{
+			m_state = STATE_CLOSED;
+			m_pending.clear();
+			m_fragments.clear();
+			m_fragmentOpcode = OPCODE_CONTINUATION;
+			m_socket->disconnect();
+			// the callback might replace itself
+			CloseCb_t closeCb = m_closeCb;
+			if (closeCb) {
+				closeCb(*this, code);
+			}
+		}
+	}
+}
@@ -37,24 +37,98 @@ static WSABUF signalBuffer = { 0, nullptr };
 
 namespace hbk {
 	namespace communication {
-		BufferedReader::BufferedReader()
-			: m_fillLevel(0)
+		BufferedReader::BufferedReader(BufferPool& pool)
+			: m_pPool(&pool)
+			, m_pBufferOwner(nullptr)
+			, m_pBuffer(nullptr)
+			, m_bufferSize(0)
+			, m_fillLevel(0)
 			, m_alreadyRead(0)
 		{
 		}
 
+		BufferedReader::BufferedReader(BufferedReader&& op)
+			: m_pPool(op.m_pPool)
+			, m_pBufferOwner(op.m_pBufferOwner)
+			, m_pBuffer(op.m_pBuffer)
+			, m_bufferSize(op.m_bufferSize)
+			, m_fillLevel(op.m_fillLevel)
+			, m_alreadyRead(op.m_alreadyRead)
+		{
+			op.m_pBufferOwner = nullptr;
+			op.m_pBuffer = nullptr;
+			op.m_fillLevel = 0;
+			op.m_alreadyRead = 0;
+		}
+
+		BufferedReader& BufferedReader::operator=(BufferedReader&& op)
+		{
+			if (this==&op) {
+				return *this;
+			}
+			if (m_pBuffer) {
+				m_pBufferOwner->release(m_pBuffer);
+			}
+			m_pPool = op.m_pPool;
+			m_pBufferOwner = op.m_pBufferOwner;
+			m_pBuffer = op.m_pBuffer;
+			m_bufferSize = op.m_bufferSize;
+			m_fillLevel = op.m_fillLevel;
+			m_alreadyRead = op.m_alreadyRead;
+
+			op.m_pBufferOwner = nullptr;
+			op.m_pBuffer = nullptr;
+			op.m_fillLevel = 0;
+			op.m_alreadyRead = 0;
+			return *this;
+		}
+
+		BufferedReader::~BufferedReader()
+		{
+			if (m_pBuffer) {
+				m_pBufferOwner->release(m_pBuffer);
+			}
+		}
+
+		void BufferedReader::setBufferPool(BufferPool& pool)
+		{
+			m_pPool = &pool;
+		}
+
+		void BufferedReader::acquireBuffer()
+		{
+			if (m_pBuffer==nullptr) {
+				m_pBuffer = m_pPool->acquire();
+				m_bufferSize = m_pPool->getBufferSize();
+				m_pBufferOwner = m_pPool;
+			}
+		}
+
+		void BufferedReader::releaseBufferIfDrained()
+		{
+			if ((m_pBuffer) && (m_alreadyRead==m_fillLevel)) {
+				m_pBufferOwner->release(m_pBuffer);
+				m_pBuffer = nullptr;
+				m_pBufferOwner = nullptr;
+				m_bufferSize = 0;
+				m_fillLevel = 0;
+				m_alreadyRead = 0;
+			}
+		}
+
 		ssize_t BufferedReader::recv(hbk::sys::event& ev, void *buf, size_t desiredLen)
 		{
 			// check whether there is something left
 			size_t bytesLeft = m_fillLevel - m_alreadyRead;
 			if (bytesLeft >= desiredLen) {
-				memcpy(buf, m_buffer.data() + m_alreadyRead, desiredLen);
+				memcpy(buf, m_pBuffer + m_alreadyRead, desiredLen);
 				m_alreadyRead += desiredLen;
+				// the buffer is kept for the next read of this receive burst
 				return static_cast <ssize_t> (desiredLen);
 			}
 			else if (bytesLeft > 0) {
 				// return the rest which is less than desired (a short read)
-				memcpy(buf, m_buffer.data() + m_alreadyRead, bytesLeft);
+				memcpy(buf, m_pBuffer + m_alreadyRead, bytesLeft);
 				m_alreadyRead = m_fillLevel;
 				return static_cast <ssize_t> (bytesLeft);
 			}
@@ -65,13 +139,14 @@ namespace hbk {
 				return -1;
 			}
 
+			acquireBuffer();
 			WSABUF buffers[2];
 			DWORD Flags = 0;
 			DWORD numberOfBytesRecvd;
 			buffers[0].buf = reinterpret_cast <CHAR*> (buf);
 			buffers[0].len = static_cast <ULONG> (desiredLen);
-			buffers[1].buf = reinterpret_cast <CHAR*> (m_buffer.data());
-			buffers[1].len = sizeof(m_buffer);
+			buffers[1].buf = reinterpret_cast <CHAR*> (m_pBuffer);
+			buffers[1].len = static_cast <ULONG> (m_bufferSize);
 
 			int retVal = WSARecv(reinterpret_cast <SOCKET> (ev.fileHandle), buffers, 2, &numberOfBytesRecvd, &Flags, nullptr, nullptr);
 			m_alreadyRead = 0;
@@ -94,6 +169,8 @@ namespace hbk {
 				}
 
 				m_fillLevel = 0;
+				// nothing more to read, the receive burst is over
+				releaseBufferIfDrained();
 				return retVal;
 			}
 
@@ -103,6 +180,9 @@ namespace hbk {
 				return static_cast < ssize_t > (desiredLen);
 			}
 			m_fillLevel = 0;
+			if (numberOfBytesRecvd==0) {
+				releaseBufferIfDrained();
+			}
 			return numberOfBytesRecvd;
 		}
 	}
@@ -32,11 +32,14 @@
 #define ssize_t int
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 #ifndef snprintf
 	#define snprintf sprintf_s
 #endif
 
 
+#include "hbk/communication/resolver.h"
 #include "hbk/communication/socketnonblocking.h"
 
 
@@ -45,33 +48,26 @@ const time_t TIMEOUT_CONNECT_S = 5;
 
 static WSABUF signalBuffer = { 0, nullptr };
 
-hbk::communication::SocketNonblocking::SocketNonblocking(sys::EventLoop &eventLoop)
-	: m_bufferedReader()
-	, m_eventLoop(eventLoop)
-	, m_inDataHandler()
+hbk::communication::SocketNonblocking::SocketNonblocking(sys::EventLoop &eventLoop, const SocketOptions& options)
+	: m_options(options)
+	, m_pEventLoop(&eventLoop)
 {
 	WORD RequestedSockVersion = MAKEWORD(2, 2);
 	WSADATA wsaData;
 	WSAStartup(RequestedSockVersion, &wsaData);
-	m_event.completionPort = m_eventLoop.getCompletionPort();
+	m_event.completionPort = m_pEventLoop->getCompletionPort();
 	m_event.overlapped.hEvent = WSACreateEvent();
 }
 
-hbk::communication::SocketNonblocking::SocketNonblocking(int fd, sys::EventLoop &eventLoop)
-	: m_bufferedReader()
-	, m_eventLoop(eventLoop)
-	, m_inDataHandler()
+hbk::communication::SocketNonblocking::SocketNonblocking(int fd, sys::EventLoop &eventLoop, const SocketOptions& options)
+	: SocketNonblocking(eventLoop, options)
 {
-	WORD RequestedSockVersion = MAKEWORD(2, 2);
-	WSADATA wsaData;
-	WSAStartup(RequestedSockVersion, &wsaData);
-	m_event.completionPort = m_eventLoop.getCompletionPort();
-	m_event.overlapped.hEvent = WSACreateEvent();
 	m_event.fileHandle = reinterpret_cast < HANDLE > (fd);
 
 	if (setSocketOptions()<0) {
 		throw std::runtime_error("error setting socket options");
 	}
+	captureAddresses();
 }
 
 hbk::communication::SocketNonblocking::~SocketNonblocking()
@@ -85,7 +81,7 @@ void hbk::communication::SocketNonblocking::setDataCb(DataCb_t dataCb)
 	DWORD flags = 0;
 
 	m_inDataHandler = dataCb;
-	m_eventLoop.addEvent(m_event, std::bind(&SocketNonblocking::process, std::ref(*this)));
+	m_pEventLoop->addEvent(m_event, std::bind(&SocketNonblocking::process, std::ref(*this)));
 
 	// important: Makes io completion to be signalled by the first arriving byte
 	WSARecv(reinterpret_cast < SOCKET > (m_event.fileHandle), &signalBuffer, 1, nullptr, &flags, &m_event.overlapped, nullptr);
@@ -94,12 +90,12 @@ void hbk::communication::SocketNonblocking::setDataCb(DataCb_t dataCb)
 void hbk::communication::SocketNonblocking::clearDataCb()
 {
         m_inDataHandler = DataCb_t();
-        m_eventLoop.eraseEvent(m_event);
+        m_pEventLoop->eraseEvent(m_event);
 }
 
 int hbk::communication::SocketNonblocking::setSocketOptions()
 {
-	bool opt = true;
+	BOOL opt = m_options.noDelay ? TRUE : FALSE;
 	int result;
 
 	// switch to non blocking
@@ -119,18 +115,47 @@ int hbk::communication::SocketNonblocking::setSocketOptions()
 	// configure keep alive
 	DWORD len;
 	tcp_keepalive ka;
-	ka.keepaliveinterval = 1000; // probe interval in ms
-	ka.keepalivetime = 1000; // time of inactivity until first keep alive probe is being send in ms
+	ka.keepaliveinterval = static_cast < ULONG > (m_options.keepAliveInterval.count()*1000); // probe interval in ms
+	ka.keepalivetime = static_cast < ULONG > (m_options.keepAliveIdle.count()*1000); // time of inactivity until first keep alive probe is being send in ms
 	// from MSDN: on windows vista and later, the number of probes is set to 10 and can not be changed
 	// time until recognition: keepaliveinterval + (keepalivetime*number of probes)
-	ka.onoff = 1;
+	ka.onoff = m_options.keepAlive ? 1 : 0;
 	result = WSAIoctl(reinterpret_cast < SOCKET > (m_event.fileHandle), SIO_KEEPALIVE_VALS, &ka, sizeof(ka), nullptr, 0, &len, nullptr, nullptr);
 	if (result == SOCKET_ERROR) {
 		return -1;
 	}
+
+	// tuning options are applied on best effort basis
+	if (m_options.sendBufferSize > 0) {
+		setsockopt(reinterpret_cast < SOCKET > (m_event.fileHandle), SOL_SOCKET, SO_SNDBUF, reinterpret_cast < const char* > (&m_options.sendBufferSize), sizeof(m_options.sendBufferSize));
+	}
+	if (m_options.receiveBufferSize > 0) {
+		setsockopt(reinterpret_cast < SOCKET > (m_event.fileHandle), SOL_SOCKET, SO_RCVBUF, reinterpret_cast < const char* > (&m_options.receiveBufferSize), sizeof(m_options.receiveBufferSize));
+	}
 	return 0;
 }
 
+int hbk::communication::SocketNonblocking::setOptions(const SocketOptions& options)
+{
+	m_options = options;
+	if (m_event.fileHandle == INVALID_HANDLE_VALUE) {
+		// applied when connecting
+		return 0;
+	}
+	return setSocketOptions();
+}
+
+const hbk::communication::SocketOptions& hbk::communication::SocketNonblocking::getOptions() const
+{
+	return m_options;
+}
+
+int hbk::communication::SocketNonblocking::connect(const std::string &address, const std::string& port, const SocketOptions& options)
+{
+	m_options = options;
+	return connect(address, port);
+}
+
 int hbk::communication::SocketNonblocking::connect(const std::string &address, const std::string& port)
 {
 	struct addrinfo hints;
@@ -153,6 +178,33 @@ int hbk::communication::SocketNonblocking::connect(const std::string &address, c
 	return retVal;
 }
 
+int hbk::communication::SocketNonblocking::connect(Resolver& resolver, const std::string& address, const std::string& port, ConnectCb_t connectCb)
+{
+	if (!connectCb) {
+		return -1;
+	}
+
+	std::weak_ptr < int > lifeToken = m_lifeToken;
+	auto resultCb = [this, lifeToken, connectCb](int error, const ResolvedAddresses& addresses)
+	{
+		if (lifeToken.expired()) {
+			return;
+		}
+		int retVal = -1;
+		if (error==0) {
+			for (const auto &iter: addresses) {
+				retVal = connect(iter.family, reinterpret_cast < const struct sockaddr* > (&iter.address), iter.addressLength);
+				if (retVal==0) {
+					break;
+				}
+				disconnect();
+			}
+		}
+		connectCb(retVal);
+	};
+	return resolver.resolve(address, port, resultCb);
+}
+
 int hbk::communication::SocketNonblocking::connect(int domain, const struct sockaddr* pSockAddr, socklen_t len)
 {
 
@@ -196,10 +248,25 @@ int hbk::communication::SocketNonblocking::connect(int domain, const struct sock
 		}
 	}
 
+	captureAddresses();
 	setDataCb(m_inDataHandler);
 	return 0;
 }
 
+void hbk::communication::SocketNonblocking::captureAddresses()
+{
+	if (m_peerAddressLength==0) {
+		m_peerAddressLength = sizeof(m_peerAddress);
+		if (getpeername(reinterpret_cast < SOCKET > (m_event.fileHandle), reinterpret_cast < struct sockaddr* > (&m_peerAddress), &m_peerAddressLength)!=0) {
+			m_peerAddressLength = 0;
+		}
+	}
+	m_localAddressLength = sizeof(m_localAddress);
+	if (getsockname(reinterpret_cast < SOCKET > (m_event.fileHandle), reinterpret_cast < struct sockaddr* > (&m_localAddress), &m_localAddressLength)!=0) {
+		m_localAddressLength = 0;
+	}
+}
+
 int hbk::communication::SocketNonblocking::process()
 {
 	if (m_inDataHandler) {
@@ -211,7 +278,53 @@ int hbk::communication::SocketNonblocking::process()
 
 ssize_t hbk::communication::SocketNonblocking::receive(void* pBlock, size_t size)
 {
-  return m_bufferedReader.recv(m_event, pBlock, size);
+	ssize_t retVal = m_bufferedReader.recv(m_event, pBlock, size);
+	if (retVal>0) {
+		m_transportCounters.bytesReceived += static_cast < uint64_t > (retVal);
+	}
+	return retVal;
+}
+
+ssize_t hbk::communication::SocketNonblocking::receiveBlocks(const dataBlock_t* blocks, size_t blockCount)
+{
+	// no scatter read with the buffered reader. Stop on the first short read.
+	ssize_t received = 0;
+	for (size_t index = 0; index < blockCount; ++index) {
+		ssize_t retVal = receive(const_cast < void* > (blocks[index].pData), blocks[index].size);
+		if (retVal <= 0) {
+			if (received > 0) {
+				return received;
+			}
+			return retVal;
+		}
+		received += retVal;
+		if (static_cast < size_t > (retVal) < blocks[index].size) {
+			break;
+		}
+	}
+	return received;
+}
+
+ssize_t hbk::communication::SocketNonblocking::receiveBlocksComplete(const dataBlock_t* blocks, size_t blockCount, int msTimeout)
+{
+	ssize_t received = 0;
+	for (size_t index = 0; index < blockCount; ++index) {
+		ssize_t retVal = receiveComplete(const_cast < void* > (blocks[index].pData), blocks[index].size, msTimeout);
+		if (retVal < 0) {
+			return retVal;
+		}
+		received += retVal;
+		if (static_cast < size_t > (retVal) < blocks[index].size) {
+			// connection closed
+			break;
+		}
+	}
+	return received;
+}
+
+void hbk::communication::SocketNonblocking::setBufferPool(BufferPool& pool)
+{
+	m_bufferedReader.setBufferPool(pool);
 }
 
 ssize_t hbk::communication::SocketNonblocking::receiveComplete(void* pBlock, size_t len, int msTimeout)
@@ -243,6 +356,7 @@ ssize_t hbk::communication::SocketNonblocking::receiveComplete(void* pBlock, siz
   while (DataToGet > 0) {
     numBytes = m_bufferedReader.recv(m_event, reinterpret_cast<char*>(pDat), static_cast < int >(DataToGet));
     if(numBytes>0) {
+      m_transportCounters.bytesReceived += static_cast < uint64_t > (numBytes);
       pDat += numBytes;
       DataToGet -= numBytes;
     } else if(numBytes==0) {
@@ -277,6 +391,20 @@ ssize_t hbk::communication::SocketNonblocking::sendBlocks(dataBlock_t *blocks, s
 
 ssize_t hbk::communication::SocketNonblocking::sendBlocks(const dataBlocks_t &blocks, bool more)
 {
+	if (m_coalesceThreshold>0) {
+		std::vector < dataBlock_t > dataBlockVector(blocks.begin(), blocks.end());
+		int result = coalesce(dataBlockVector.data(), dataBlockVector.size());
+		if (result<0) {
+			return -1;
+		} else if (result>0) {
+			size_t totalLength = 0;
+			for (const auto &iter: blocks) {
+				totalLength += iter.size;
+			}
+			return static_cast < ssize_t > (totalLength);
+		}
+	}
+
 	std::vector < WSABUF > buffers;
 	buffers.reserve(blocks.size());
 
@@ -302,10 +430,12 @@ ssize_t hbk::communication::SocketNonblocking::sendBlocks(const dataBlocks_t &bl
 		}
 	}
 
+	m_transportCounters.bytesSent += bytesWritten;
 	if (bytesWritten == completeLength) {
 		// we are done!
 		return bytesWritten;
 	} else {
+		++m_transportCounters.partialWrites;
 		size_t blockSum = 0;
 
 		for (size_t index = 0; index < buffers.size(); ++index) {
@@ -330,6 +460,16 @@ ssize_t hbk::communication::SocketNonblocking::sendBlocks(const dataBlocks_t &bl
 
 ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, size_t size, bool more)
 {
+	if (m_coalesceThreshold>0) {
+		dataBlock_t block(pBlock, size);
+		int result = coalesce(&block, 1);
+		if (result<0) {
+			return -1;
+		} else if (result>0) {
+			return static_cast < ssize_t > (size);
+		}
+	}
+
 	const uint8_t* pDat = reinterpret_cast<const uint8_t*>(pBlock);
 	size_t BytesLeft = size;
 	int numBytes;
@@ -344,6 +484,10 @@ ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, siz
 	while (BytesLeft > 0) {
 		numBytes = ::send(reinterpret_cast < SOCKET > (m_event.fileHandle), reinterpret_cast < const char* >(pDat), static_cast < int >(BytesLeft), 0);
 		if (numBytes > 0) {
+			m_transportCounters.bytesSent += static_cast < uint64_t > (numBytes);
+			if (static_cast < size_t > (numBytes) < BytesLeft) {
+				++m_transportCounters.partialWrites;
+			}
 			pDat += numBytes;
 			BytesLeft -= numBytes;
 		} else if(numBytes==0){
@@ -354,7 +498,10 @@ ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, siz
 			// -1: error
 			int retVal = WSAGetLastError();
 			if ((retVal == WSAEWOULDBLOCK) || (retVal == ERROR_IO_PENDING) || (retVal == WSAEINPROGRESS)) {
+				++m_transportCounters.partialWrites;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 				err = select(0, nullptr, &recvFds, nullptr, nullptr);
+				m_transportCounters.blockedTime += static_cast < uint64_t > (std::chrono::duration_cast < std::chrono::microseconds > (std::chrono::steady_clock::now()-start).count());
 				if (err != 1) {
 					BytesLeft = 0;
 					retVal = -1;
@@ -370,44 +517,45 @@ ssize_t hbk::communication::SocketNonblocking::sendBlock(const void* pBlock, siz
 
 ssize_t hbk::communication::SocketNonblocking::send(const void* pBlock, size_t size, bool more)
 {
-	return ::send(reinterpret_cast < SOCKET > (m_event.fileHandle), reinterpret_cast < const char* >(pBlock), static_cast < int >(size), 0);
+	if (m_coalesceThreshold>0) {
+		dataBlock_t block(pBlock, size);
+		int result = coalesce(&block, 1);
+		if (result<0) {
+			return -1;
+		} else if (result>0) {
+			return static_cast < ssize_t > (size);
+		}
+	}
+
+	int retVal = ::send(reinterpret_cast < SOCKET > (m_event.fileHandle), reinterpret_cast < const char* >(pBlock), static_cast < int >(size), 0);
+	if (retVal >= 0) {
+		m_transportCounters.bytesSent += static_cast < uint64_t > (retVal);
+		if (static_cast < size_t > (retVal) < size) {
+			++m_transportCounters.partialWrites;
+		}
+	}
+	return retVal;
 }
 
 void hbk::communication::SocketNonblocking::disconnect()
 {
-	m_eventLoop.eraseEvent(m_event);
+	// collected data is sent before closing
+	flush();
+	m_coalesceBuffer.clear();
+	m_pEventLoop->eraseIterationEndHandler(this);
+	m_pEventLoop->eraseEvent(m_event);
 	// Windows: shutdown() before close in order to force gracefull shutdown.
 	// Windows: This has to be done after removing the event from the event loop to prevent a deadlock.
 	::shutdown(reinterpret_cast <SOCKET> (m_event.fileHandle), SD_BOTH);
 	::closesocket(reinterpret_cast < SOCKET > (m_event.fileHandle));
 	m_event.fileHandle = INVALID_HANDLE_VALUE;
+	memset(&m_peerAddress, 0, sizeof(m_peerAddress));
+	m_peerAddressLength = 0;
+	memset(&m_localAddress, 0, sizeof(m_localAddress));
+	m_localAddressLength = 0;
 }
 
 bool hbk::communication::SocketNonblocking::isFirewire() const
 {
 	return false;
 }
-
-bool hbk::communication::SocketNonblocking::checkSockAddr(const struct ::sockaddr* pCheckSockAddr, socklen_t checkSockAddrLen) const
-{
-	struct sockaddr sockAddr;
-	socklen_t addrLen = sizeof(sockaddr_in);
-	char checkHost[256];
-	char ckeckService[8];
-	char host[256];
-	char service[8];
-	int err = getnameinfo(pCheckSockAddr, checkSockAddrLen, checkHost, sizeof(checkHost), ckeckService, sizeof(ckeckService), NI_NUMERICHOST | NI_NUMERICSERV);
-	if (err != 0) {
-		return false;
-	}
-	getpeername(reinterpret_cast < SOCKET > (m_event.fileHandle), &sockAddr, &addrLen);
-	getnameinfo(&sockAddr, addrLen, host, sizeof(host), service, sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV);
-	if (
-		(strcmp(host, checkHost) == 0) &&
-		(strcmp(service, ckeckService) == 0)
-		)
-	{
-		return true;
-	}
-	return false;
-}
@@ -45,6 +45,8 @@ namespace hbk {
 			: m_acceptSocket(INVALID_SOCKET)
 			, m_eventLoop(eventLoop)
 			, m_acceptCb()
+			, m_pBufferPool(&BufferPool::defaultPool())
+			, m_options()
 		{
 			WORD RequestedSockVersion = MAKEWORD(2, 2);
 			WSADATA wsaData;
@@ -60,7 +62,7 @@ namespace hbk {
 			WSACloseEvent(m_listeningEvent.overlapped.hEvent);
 		}
 
-		int TcpServer::start(uint16_t port, int backlog, Cb_t acceptCb)
+		int TcpServer::start(uint16_t port, int backlog, Cb_t acceptCb, const SocketOptions& options)
 		{
 			m_listeningEvent.fileHandle = reinterpret_cast < HANDLE > (socket(AF_INET, SOCK_STREAM, 0));
 
@@ -91,6 +93,11 @@ namespace hbk {
 			}
 
 			m_acceptCb = acceptCb;
+			m_options = options;
+			if (options.receiveBufferSize > 0) {
+				// the window scale is negotiated during handshake, hence the receive buffer size has to be known before accepting
+				setsockopt(reinterpret_cast < SOCKET > (m_listeningEvent.fileHandle), SOL_SOCKET, SO_RCVBUF, reinterpret_cast < const char* > (&options.receiveBufferSize), sizeof(options.receiveBufferSize));
+			}
 
 			if (listen(reinterpret_cast < SOCKET > (m_listeningEvent.fileHandle), backlog) == -1) {
 				return -1;
@@ -111,7 +118,9 @@ namespace hbk {
 
 		clientSocket_t TcpServer::acceptClient()
 		{
-			return clientSocket_t(new SocketNonblocking(m_acceptSocket, m_eventLoop));
+			clientSocket_t worker(new SocketNonblocking(m_acceptSocket, m_eventLoop, m_options));
+			worker->setBufferPool(*m_pBufferPool);
+			return worker;
 		}
 
 
@@ -0,0 +1,44 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <WinSock2.h>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/transportstats.h"
+
+hbk::communication::TransportStats hbk::communication::SocketNonblocking::transportStats() const
+{
+	TransportStats stats;
+	stats.bytesReceived = m_transportCounters.bytesReceived;
+	stats.bytesSent = m_transportCounters.bytesSent;
+	stats.partialWrites = m_transportCounters.partialWrites;
+	stats.coalescedWrites = m_transportCounters.coalescedWrites;
+	stats.blockedTime = std::chrono::microseconds(m_transportCounters.blockedTime.load());
+	stats.time = std::chrono::steady_clock::now();
+
+	u_long queueSize;
+	if (ioctlsocket(reinterpret_cast < SOCKET > (m_event.fileHandle), FIONREAD, &queueSize) == 0) {
+		stats.receiveQueueSize = static_cast < uint32_t > (queueSize);
+	}
+	// TCP_INFO is not available. tcpInfoValid stays false.
+	return stats;
+}
@@ -0,0 +1,105 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include <vector>
+
+#include "hbk/communication/socketnonblocking.h"
+
+namespace hbk {
+	namespace communication {
+		void SocketNonblocking::setWriteCoalescing(size_t threshold)
+		{
+			if (threshold==0) {
+				flush();
+			}
+			m_coalesceThreshold = threshold;
+		}
+
+		int SocketNonblocking::flush()
+		{
+			if (m_coalesceBuffer.empty()) {
+				return 0;
+			}
+			m_pEventLoop->eraseIterationEndHandler(this);
+			std::vector < uint8_t > pending;
+			pending.swap(m_coalesceBuffer);
+
+			// the collected data is not to be collected again
+			size_t threshold = m_coalesceThreshold;
+			m_coalesceThreshold = 0;
+#ifdef _WIN32
+			ssize_t result = sendBlock(pending.data(), pending.size(), false);
+#else
+			// do not block the event loop
+			int result = sendAsync(pending.data(), pending.size());
+#endif
+			m_coalesceThreshold = threshold;
+
+			// keep the memory for the next round
+			pending.clear();
+			if (m_coalesceBuffer.empty()) {
+				m_coalesceBuffer.swap(pending);
+			}
+			if (result<0) {
+				return -1;
+			}
+			return 0;
+		}
+
+		int SocketNonblocking::coalesce(const dataBlock_t* blocks, size_t blockCount)
+		{
+			size_t totalLength = 0;
+			for (size_t blockIndex = 0; blockIndex<blockCount; ++blockIndex) {
+				totalLength += blocks[blockIndex].size;
+			}
+
+			if ((totalLength==0) || (totalLength>=m_coalesceThreshold)) {
+				// large writes go directly. Collected data has to go first to keep the order.
+				if (flush()<0) {
+					return -1;
+				}
+				return 0;
+			}
+
+			if (m_coalesceBuffer.empty()) {
+				if (m_pEventLoop->addIterationEndHandler(this, std::bind(&SocketNonblocking::flush, this))<0) {
+					// not within an event callback. Nobody would flush.
+					return 0;
+				}
+			}
+
+			for (size_t blockIndex = 0; blockIndex<blockCount; ++blockIndex) {
+				const uint8_t* pData = reinterpret_cast < const uint8_t* > (blocks[blockIndex].pData);
+				m_coalesceBuffer.insert(m_coalesceBuffer.end(), pData, pData+blocks[blockIndex].size);
+			}
+			++m_transportCounters.coalescedWrites;
+
+			if (m_coalesceBuffer.size()>=m_coalesceThreshold) {
+				if (flush()<0) {
+					return -1;
+				}
+			}
+			return 1;
+		}
+	}
+}
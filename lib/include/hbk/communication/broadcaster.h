@@ -0,0 +1,107 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_BROADCASTER_H
+#define _HBK__COMMUNICATION_BROADCASTER_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/socketnonblocking.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Sends the same data to many sockets without copying it for each of them.
+		/// The data is enqueued on the asynchronous send queue (SocketNonblocking::sendAsync()) of each subscriber.
+		/// All queues reference the same memory block. It is released when the last subscriber has sent it.
+		/// A subscriber is slow if it is above its high watermark (SocketNonblocking::setWatermarks()) or if more than maxQueuedBytes are queued.
+		/// \note thread safe. remove() may be called from within watermark callbacks.
+		class Broadcaster {
+		public:
+			/// what happens to slow subscribers
+			enum slowPolicy_t {
+				/// data is not enqueued until the subscriber caught up
+				SKIP,
+				/// the subscriber is removed and the drop callback is called
+				DROP
+			};
+
+			/// called for each subscriber removed because it was slow.
+			/// Executed by the thread calling broadcast() after all subscribers got the data. The socket may be disconnected or destroyed here.
+			using DropCb_t = std::function < void (SocketNonblocking& socket) >;
+
+			/// \param policy What happens to slow subscribers
+			/// \param maxQueuedBytes 0 relies on the watermarks of the subscribers only
+			/// \param dropCb Called for subscribers removed by policy DROP
+			Broadcaster(slowPolicy_t policy = SKIP, size_t maxQueuedBytes = 0, DropCb_t dropCb = DropCb_t());
+
+			Broadcaster(const Broadcaster& op) = delete;
+			Broadcaster& operator= (const Broadcaster& op) = delete;
+
+			/// \param socket Has to stay alive until removed
+			/// \return 0 success; -1 already subscribed
+			int add(SocketNonblocking& socket);
+
+			/// The socket may be destroyed afterwards
+			/// \return 0 success; -1 not subscribed
+			int remove(SocketNonblocking& socket);
+
+			/// Enqueue the slice on all subscribers that are not slow
+			/// \param slice Has to reference its memory block. The memory block must not be changed afterwards.
+			/// \return number of subscribers the data was enqueued for; -1 slice without memory block
+			ssize_t broadcast(const BufferSlice& slice);
+
+			/// The data is copied once into a memory block shared by all subscribers
+			/// \return number of subscribers the data was enqueued for
+			ssize_t broadcast(const void* pData, size_t size);
+
+			size_t getSubscriberCount() const;
+
+			/// \return number of times data was not enqueued for a slow or broken subscriber
+			uint64_t getSkippedCount() const;
+
+			/// \return number of subscribers removed by policy DROP
+			uint64_t getDroppedCount() const;
+
+		private:
+			bool isSlow(const SocketNonblocking& socket) const;
+
+			/// \warning m_mtx is to be locked by the caller
+			bool isSubscribed(const SocketNonblocking* pSocket) const;
+
+			/// recursive, remove() may be called from within watermark callbacks executed by broadcast()
+			mutable std::recursive_mutex m_mtx;
+			std::vector < SocketNonblocking* > m_subscribers;
+			/// incremented on each remove()
+			uint64_t m_removeCount;
+			slowPolicy_t m_policy;
+			size_t m_maxQueuedBytes;
+			DropCb_t m_dropCb;
+			uint64_t m_skippedCount;
+			uint64_t m_droppedCount;
+		};
+	}
+}
+#endif
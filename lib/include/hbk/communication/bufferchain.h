@@ -0,0 +1,114 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_BUFFERCHAIN_H
+#define _HBK__COMMUNICATION_BUFFERCHAIN_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace hbk {
+	namespace communication {
+		/// A view into a reference counted memory block.
+		/// The memory block stays valid as long as there is a slice referencing it.
+		struct BufferSlice {
+			BufferSlice()
+				: buffer()
+				, pData(nullptr)
+				, size(0)
+			{
+			}
+
+			/// All members are initialized on construction
+			BufferSlice(const std::shared_ptr < const uint8_t >& b, const uint8_t* pD, size_t s)
+				: buffer(b)
+				, pData(pD)
+				, size(s)
+			{
+			}
+
+			/// \return a slice of this slice referencing the same memory block
+			BufferSlice subSlice(size_t offset, size_t length) const
+			{
+				return BufferSlice(buffer, pData+offset, length);
+			}
+
+			/// keeps the memory block alive
+			std::shared_ptr < const uint8_t > buffer;
+			/// start of the data
+			const uint8_t* pData;
+			/// number of valid bytes starting at pData
+			size_t size;
+		};
+
+		/// A sequence of slices. Data is not copied when being appended, consumed or split.
+		class BufferChain {
+		public:
+			using Slices_t = std::deque < BufferSlice >;
+
+			BufferChain();
+
+			/// empty slices are ignored
+			void append(const BufferSlice& slice);
+
+			/// move all slices of other to the end of this chain
+			void append(BufferChain&& other);
+
+			/// \return total number of bytes in all slices
+			size_t size() const
+			{
+				return m_size;
+			}
+
+			bool empty() const
+			{
+				return m_size==0;
+			}
+
+			const Slices_t& getSlices() const
+			{
+				return m_slices;
+			}
+
+			/// remove length bytes from the front. Slices no longer referenced release their memory block.
+			void consume(size_t length);
+
+			/// remove length bytes from the front and return them as a new chain
+			BufferChain split(size_t length);
+
+			/// copy bytes out of the chain without consuming them
+			/// \return number of bytes copied
+			size_t copyOut(size_t offset, void* pDestination, size_t length) const;
+
+			/// \return the byte at offset. offset has to be less than size()
+			uint8_t at(size_t offset) const;
+
+			void clear();
+
+		private:
+			Slices_t m_slices;
+			size_t m_size;
+		};
+	}
+}
+#endif
@@ -33,35 +33,90 @@
 #include <sys/types.h>
 #endif
 
-#include <array>
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
 
 namespace hbk {
 	namespace communication {
+		struct dataBlock_t;
+
 		/// Try to receive a big chunk even if only a small amount of data is requested.
 		/// This reduces the number of system calls being made.
 		/// Return the requested amount of data and keep the remaining data.
+		/// The buffer for the remaining data is borrowed from a buffer pool on the first read of a receive burst.
+		/// It is given back when a read finds the socket drained (i.e. EAGAIN), hence idle sockets do not occupy a buffer.
 		/// \warning not reentrant
 		class BufferedReader
 		{
 		public:
-			BufferedReader();
+			/// \param pool Buffers are borrowed from this pool. It has to outlive this object.
+			BufferedReader(BufferPool& pool = BufferPool::defaultPool());
 
-			BufferedReader(BufferedReader&& op) = default;
-			BufferedReader& operator=(BufferedReader&& op) = default;
+			BufferedReader(BufferedReader&& op);
+			BufferedReader& operator=(BufferedReader&& op);
 
 			/// Not to be copied since we don't want to interfere with each other.
 			BufferedReader(const BufferedReader& op) = delete;
 			/// Not to be copied since we don't want to interfere with each other.
 			BufferedReader& operator=(const BufferedReader& op) = delete;
 
+			virtual ~BufferedReader();
+
 			/// behaves like standard recv
 			ssize_t recv(hbk::sys::event& ev, void *buf, size_t len);
 
+#ifndef _WIN32
+			/// Receive into memory blocks of the pool. Received data is appended to the chain as slices.
+			/// Data remaining from recv(ev, buf, len) is delivered first. This is the only case where data gets copied.
+			/// \return number of bytes appended to chain, 0 if connection closed, -1 on error
+			ssize_t recv(hbk::sys::event& ev, BufferChain& chain);
+
+			/// Scatter receive. Blocks are filled one after the other. Remaining data is delivered first, further data is read directly into the blocks.
+			/// \param blocks The memory of the blocks has to be writable
+			/// \return number of bytes received, 0 if connection closed, -1 on error
+			ssize_t recv(hbk::sys::event& ev, const dataBlock_t* blocks, size_t blockCount);
+
+			/// Data to be delivered before anything received from the socket, i.e. unread data of a connection taken over from another process.
+			/// Appended to what is buffered already.
+			/// \return 0 success; -1 does not fit into a memory block of the pool
+			int preload(const void* pData, size_t size);
+#endif
+
+			/// Buffers borrowed before are returned to the previous pool as soon as they are drained.
+			/// \param pool Buffers are borrowed from this pool. It has to outlive this object.
+			void setBufferPool(BufferPool& pool);
+
+			BufferPool& getBufferPool() const
+			{
+				return *m_pPool;
+			}
+
+			/// \return number of received bytes that were not yet delivered
+			size_t getBufferedCount() const
+			{
+				return m_fillLevel - m_alreadyRead;
+			}
+
 		private:
-			// std::array is movable
-			std::array < unsigned char, 65536> m_buffer;
+			/// borrow a buffer if we do not have one already
+			void acquireBuffer();
+			/// give back the buffer if there is nothing left in it. Called when there is nothing more to read, not per delivery.
+			void releaseBufferIfDrained();
+
+			BufferPool* m_pPool;
+			/// the pool m_pBuffer was borrowed from
+			BufferPool* m_pBufferOwner;
+			uint8_t* m_pBuffer;
+			size_t m_bufferSize;
 			size_t m_fillLevel;
 			size_t m_alreadyRead;
+#ifndef _WIN32
+			/// block currently being filled by recv(ev, chain). Slices handed out before keep on referencing its beginning.
+			/// Given back when the socket is drained and no slice references it anymore.
+			BufferPool::Buffer_t m_chainBuffer;
+			size_t m_chainBufferSize;
+			size_t m_chainBufferOffset;
+#endif
 		};
 	}
 }
@@ -0,0 +1,112 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_BUFFERPOOL_H
+#define _HBK__COMMUNICATION_BUFFERPOOL_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace hbk {
+	namespace communication {
+		/// Hands out memory blocks of fixed size. Released blocks are kept for reuse.
+		/// Blocks may outlive the pool. They are freed when released after the pool is gone.
+		/// \note thread safe
+		class BufferPool {
+		public:
+			/// reference counted block. The block returns to the pool when the last reference is gone.
+			using Buffer_t = std::shared_ptr < uint8_t >;
+
+			/// \param bufferSize Size of each block in bytes
+			/// \param maxCachedBuffers Maximum number of released blocks kept for reuse
+			/// \param useHugePages Blocks are carved from slabs backed by huge pages (Linux only).
+			/// Falls back to normal pages if no huge pages are available. Slab memory is kept until the pool and all of its blocks are gone.
+			BufferPool(size_t bufferSize = 65536, size_t maxCachedBuffers = 64, bool useHugePages = false);
+
+			BufferPool(const BufferPool& op) = delete;
+			BufferPool& operator= (const BufferPool& op) = delete;
+
+			virtual ~BufferPool();
+
+			/// \return a reference counted block of getBufferSize() bytes
+			Buffer_t get();
+
+			/// \return a block of getBufferSize() bytes. Has to be given back using release()
+			uint8_t* acquire();
+
+			/// give back a block retrieved by acquire()
+			void release(uint8_t* pBuffer);
+
+			size_t getBufferSize() const;
+
+			/// \return number of released blocks that are waiting for reuse
+			size_t getCachedCount() const;
+
+			/// \return true if blocks are carved from slabs
+			bool usesSlabs() const;
+
+			/// The pool used by all objects that were not told to use a specific one.
+			/// Sockets borrow a block on the first read of a receive burst and give it back when a read finds the socket drained (EAGAIN),
+			/// hence idle sockets do not occupy any receive buffer.
+			/// The lock is held for a push or pop on the free list only, and a socket takes it twice per receive burst, not per read.
+			/// Create one pool per event loop (see TcpServer::setBufferPool()) if several busy loops still contend for it.
+			static BufferPool& defaultPool();
+
+		private:
+			/// shared with the blocks handed out by get()
+			struct Storage {
+				struct Slab {
+					void* pMemory;
+					size_t size;
+				};
+
+				~Storage();
+
+				uint8_t* acquire();
+				void release(uint8_t* pBuffer);
+
+				/// map the memory of a slab. Does not touch any member but bufferSize, hence needs no lock.
+				/// \return false if no memory could be mapped
+				bool mapSlab(Slab& slab) const;
+
+				/// remember the slab and put its blocks into the free list
+				/// \warning mtx is to be locked by the caller
+				void addSlab(const Slab& slab);
+
+				bool isFromSlab(const uint8_t* pBuffer) const;
+
+				size_t bufferSize;
+				size_t maxCachedBuffers;
+				bool useSlabs;
+				std::mutex mtx;
+				std::vector < uint8_t* > freeList;
+
+				std::vector < Slab > slabs;
+			};
+
+			std::shared_ptr < Storage > m_storage;
+		};
+	}
+}
+#endif
@@ -0,0 +1,130 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_CONNECTIONPOOL_H
+#define _HBK__COMMUNICATION_CONNECTIONPOOL_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/socketoptions.h"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Keeps connections to endpoints warm for reuse, avoiding a connect handshake per request/response exchange.
+		/// Connections are keyed by address and port or by unix domain socket path.
+		/// All connections are bound to the event loop of the pool. Create one pool per event loop. The pool has to outlive the connections handed out.
+		/// \note thread safe
+		class ConnectionPool {
+		public:
+			/// \param eventLoop Connections handed out are bound to this event loop. It also executes the eviction of idle connections.
+			/// \param maxPerEndpoint Maximum number of connections per endpoint, idle and checked out together
+			/// \param idleTimeout Idle connections are closed after this time
+			/// \param options Applied to all connections
+			ConnectionPool(sys::EventLoop& eventLoop, size_t maxPerEndpoint = 8, std::chrono::milliseconds idleTimeout = std::chrono::seconds(30), const SocketOptions& options = SocketOptions());
+			virtual ~ConnectionPool();
+
+			ConnectionPool(const ConnectionPool& op) = delete;
+			ConnectionPool& operator= (const ConnectionPool& op) = delete;
+
+			/// Hand out an idle connection to the endpoint. Connects (blocking) if there is none that is still alive.
+			/// \return empty on error or if maxPerEndpoint connections are checked out (errno is EBUSY then)
+			clientSocket_t checkout(const std::string& address, const std::string& port);
+
+			/// Unix domain socket variant of checkout()
+			clientSocket_t checkout(const std::string& path, bool useAbstractNamespace);
+
+			/// Give back a connection handed out by checkout(). Callbacks are removed.
+			/// The connection is closed instead of being kept if it is disconnected, not reusable or still has queued data.
+			/// \param reusable false after a protocol error or if the response was not read completely
+			/// \return 0 kept for reuse; -1 closed
+			int checkin(clientSocket_t socket, bool reusable = true);
+
+			/// close all idle connections
+			void clear();
+
+			/// \return number of idle connections of all endpoints
+			size_t getIdleCount() const;
+
+			/// \return number of connections established
+			uint64_t getConnectCount() const;
+
+			/// \return number of times an idle connection was handed out
+			uint64_t getReuseCount() const;
+
+			/// \return number of idle connections closed because they timed out or the peer closed them
+			uint64_t getEvictedCount() const;
+
+		private:
+			struct IdleConnection {
+				clientSocket_t socket;
+				std::chrono::steady_clock::time_point lastUsed;
+			};
+
+			struct Endpoint {
+				Endpoint()
+					: idle()
+					, checkedOutCount(0)
+				{
+				}
+
+				/// the most recently used connection is at the back
+				std::vector < IdleConnection > idle;
+				size_t checkedOutCount;
+			};
+
+			using ConnectCb_t = std::function < int (SocketNonblocking& socket) >;
+
+			clientSocket_t checkout(const std::string& key, ConnectCb_t connectCb);
+
+			/// \return true if the peer did not close the connection and did not send anything unexpected
+			static bool isAlive(const SocketNonblocking& socket);
+
+			/// called by the timer
+			void evictIdle();
+
+			sys::EventLoop& m_eventLoop;
+			size_t m_maxPerEndpoint;
+			std::chrono::milliseconds m_idleTimeout;
+			SocketOptions m_options;
+
+			mutable std::mutex m_mtx;
+			std::map < std::string, Endpoint > m_endpoints;
+			/// key of each connection handed out
+			std::unordered_map < const SocketNonblocking*, std::string > m_checkedOut;
+			uint64_t m_connectCount;
+			uint64_t m_reuseCount;
+			uint64_t m_evictedCount;
+
+			sys::Timer m_evictionTimer;
+		};
+	}
+}
+#endif
@@ -0,0 +1,104 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_DELIMITEDREADER_H
+#define _HBK__COMMUNICATION_DELIMITEDREADER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#ifdef _WIN32
+#ifndef ssize_t
+#define ssize_t int
+#endif
+#else
+#include <sys/types.h>
+#endif
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
+
+namespace hbk {
+	namespace communication {
+		class SocketNonblocking;
+
+		/// Splits a received byte stream into records terminated by a delimiter (i.e. "\n" for newline framed JSON-RPC or SCPI).
+		/// Received data is scanned using SIMD instructions (AVX2, SSE2 or NEON) if supported by the CPU.
+		/// Partial records are kept until the rest arrives, hence it never blocks.
+		/// \warning not reentrant
+		class DelimitedReader {
+		public:
+			/// \param record complete record without the delimiter. The slice may be kept, it keeps the memory alive.
+			using RecordCb_t = std::function < void (const BufferSlice& record) >;
+
+			/// \param delimiter One or more bytes terminating each record
+			/// \param recordCb Called for each complete record
+			/// \param maxRecordSize Longer records are treated as protocol error
+			/// \param pool Records spread over several receive blocks are assembled in blocks of this pool. It has to outlive this object.
+			/// \throw std::invalid_argument on empty delimiter
+			DelimitedReader(const std::string& delimiter, RecordCb_t recordCb, size_t maxRecordSize = 16*1024*1024, BufferPool& pool = BufferPool::defaultPool());
+
+			DelimitedReader(const DelimitedReader& op) = delete;
+			DelimitedReader& operator= (const DelimitedReader& op) = delete;
+
+			/// Receive all available data from socket and deliver all complete records.
+			/// To be called from the data callback of the socket:
+			/// socket.setDataCb(std::bind(&DelimitedReader::receive, &delimitedReader, std::placeholders::_1));
+			/// \return 0 connection closed; -1 error (errno is EAGAIN or EWOULDBLOCK if everything was read, EMSGSIZE if record is too long)
+			ssize_t receive(SocketNonblocking& socket);
+
+			/// Feed received data. All complete records are delivered.
+			/// Records that are contiguous in memory are delivered without copying.
+			/// \return number of delivered records, -1 if record is too long
+			int process(BufferChain&& data);
+
+			/// \return number of bytes of an incomplete record waiting for the rest
+			size_t getPendingCount() const
+			{
+				return m_pending.size();
+			}
+
+			/// drop incomplete data. To be called after the connection was reestablished.
+			void reset();
+
+			/// \return position of the first occurence of value or size if there is none
+			static size_t find(const uint8_t* pData, size_t size, uint8_t value);
+
+			/// \return name of the instruction set used by find(): "avx2", "sse2", "neon" or "scalar"
+			static const char* getScannerName();
+
+		private:
+			/// \return position of the next occurence of the last delimiter byte starting at offset or std::string::npos
+			size_t findInPending(size_t offset) const;
+
+			std::string m_delimiter;
+			RecordCb_t m_recordCb;
+			size_t m_maxRecordSize;
+			BufferPool& m_pool;
+			BufferChain m_pending;
+			/// pending data up to here has already been scanned without success
+			size_t m_scanned;
+		};
+	}
+}
+#endif
@@ -0,0 +1,113 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_FRAMEDREADER_H
+#define _HBK__COMMUNICATION_FRAMEDREADER_H
+
+#include <cstdint>
+#include <functional>
+
+#ifdef _WIN32
+#ifndef ssize_t
+#define ssize_t int
+#endif
+#else
+#include <sys/types.h>
+#endif
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
+
+namespace hbk {
+	namespace communication {
+		class SocketNonblocking;
+
+		/// Splits a received byte stream into length prefixed frames. Each frame consists of a header of fixed size followed by the payload.
+		/// The length field is located somewhere inside the header.
+		/// Partial frames are kept until the rest arrives, hence it never blocks.
+		/// \warning not reentrant
+		class FramedReader {
+		public:
+			/// Describes the header of a frame
+			struct Format {
+				/// 4 byte big endian length of the payload at the start of a 4 byte header
+				Format();
+
+				/// offset of the length field inside the header
+				size_t lengthOffset;
+				/// size of the length field in bytes: 1, 2, 4 or 8
+				size_t lengthSize;
+				/// byte order of the length field
+				bool bigEndian;
+				/// complete header size. At least lengthOffset+lengthSize
+				size_t headerSize;
+				/// true if the length field counts the header too. Otherwise it counts the payload only.
+				bool lengthIncludesHeader;
+				/// larger frames are treated as protocol error
+				size_t maxFrameSize;
+			};
+
+			/// \param frame complete frame including the header. The payload starts at frame.pData+headerSize.
+			/// The slice may be kept, it keeps the memory alive.
+			using FrameCb_t = std::function < void (const BufferSlice& frame) >;
+
+			/// \param format Description of the header
+			/// \param frameCb Called for each complete frame
+			/// \param pool Frames spread over several receive blocks are assembled in blocks of this pool. It has to outlive this object.
+			/// \throw std::invalid_argument on invalid format
+			FramedReader(const Format& format, FrameCb_t frameCb, BufferPool& pool = BufferPool::defaultPool());
+
+			FramedReader(const FramedReader& op) = delete;
+			FramedReader& operator= (const FramedReader& op) = delete;
+
+			/// Receive all available data from socket and deliver all complete frames.
+			/// To be called from the data callback of the socket:
+			/// socket.setDataCb(std::bind(&FramedReader::receive, &framedReader, std::placeholders::_1));
+			/// \return 0 connection closed; -1 error (errno is EAGAIN or EWOULDBLOCK if everything was read, EMSGSIZE on invalid frame length)
+			ssize_t receive(SocketNonblocking& socket);
+
+			/// Feed received data. All complete frames are delivered.
+			/// Frames that are contiguous in memory are delivered without copying.
+			/// \return number of delivered frames, -1 on invalid frame length
+			int process(BufferChain&& data);
+
+			/// \return number of bytes of an incomplete frame waiting for the rest
+			size_t getPendingCount() const
+			{
+				return m_pending.size();
+			}
+
+			/// drop incomplete data. To be called after the connection was reestablished.
+			void reset();
+
+		private:
+			/// \return length field of the header at the front of the pending data
+			uint64_t readLength() const;
+
+			Format m_format;
+			FrameCb_t m_frameCb;
+			BufferPool& m_pool;
+			BufferChain m_pending;
+		};
+	}
+}
+#endif
@@ -0,0 +1,92 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_HANDOFF_H
+#define _HBK__COMMUNICATION_HANDOFF_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/socketoptions.h"
+#include "hbk/communication/tcpserver.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Hand over listening sockets and live connections to another process (i.e. the successor when upgrading)
+		/// over a unix domain socket using SCM_RIGHTS. Clients stay connected, no reconnect storm after deployment.
+		/// Unread received data and data not yet sent go along with each connection.
+		/// The sending side calls sendServer() and sendConnection() for everything to hand over and finishes with sendEnd().
+		/// The receiving side calls receive().
+		/// \note works blocking
+		class Handoff {
+		public:
+			/// \param listeningFd Pass to TcpServer::start(int listeningFd, ...) in order to continue accepting
+			/// \param tag As given to sendServer()
+			using ServerCb_t = std::function < void (int listeningFd, uint32_t tag) >;
+			/// \param socket The connection. Unread data of the other process is delivered first, unsent data is queued by sendAsync().
+			/// \param tag As given to sendConnection()
+			using ConnectionCb_t = std::function < void (clientSocket_t socket, uint32_t tag) >;
+
+			/// \param fd Connected unix domain socket (SOCK_STREAM) to the other process. Not owned by this object.
+			Handoff(int fd);
+
+			Handoff(const Handoff& op) = delete;
+			Handoff& operator= (const Handoff& op) = delete;
+
+			/// The server stops accepting and gives up the listening socket. A unix domain socket path is not unlinked.
+			/// \param tag Tells the receiving side what this is about
+			/// \return 0 success; -1 error
+			int sendServer(TcpServer& server, uint32_t tag = 0);
+
+			/// The socket gives up the connection (see SocketNonblocking::release()) and is disconnected afterwards.
+			/// \warning The connection is given up on error as well. It is closed then, the socket does not get it back.
+			/// \param tag Tells the receiving side what this is about
+			/// \return 0 success; -1 error
+			int sendConnection(SocketNonblocking& socket, uint32_t tag = 0);
+
+			/// Tell the receiving side that everything was handed over
+			/// \return 0 success; -1 error
+			int sendEnd();
+
+			/// Take over everything until the sending side called sendEnd()
+			/// Items that can not be taken over (i.e. unread data too large for the receive buffer) are closed and skipped.
+			/// \param eventLoop Taken over connections are registered here
+			/// \param serverCb Called for each listening socket
+			/// \param connectionCb Called for each connection
+			/// \param options Applied to the taken over connections
+			/// \param msTimeout Maximum time to wait for the sending side, -1 for infinite
+			/// \return number of listening sockets and connections taken over; -1 error, timeout or item too large to be received
+			int receive(sys::EventLoop& eventLoop, ServerCb_t serverCb, ConnectionCb_t connectionCb, const SocketOptions& options = SocketOptions(), int msTimeout = 5000);
+
+		private:
+			/// \param fd Passed using SCM_RIGHTS, -1 for none
+			int sendItem(uint32_t type, uint32_t tag, int fd, const std::vector < uint8_t >& unreadData, const BufferChain& unsentData);
+
+			int m_fd;
+		};
+	}
+}
+#endif
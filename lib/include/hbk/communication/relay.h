@@ -0,0 +1,146 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_RELAY_H
+#define _HBK__COMMUNICATION_RELAY_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Forwards the byte streams of two connections to each other without copying them through user space.
+		/// Each direction moves data from the source socket into a pipe and from the pipe into the destination socket using splice().
+		/// Backpressure: While the pipe of a direction is full, its source is not read anymore and the tcp receive window of the source closes.
+		/// The end of a stream is forwarded by shutting down the sending direction of the destination.
+		/// SIGPIPE is blocked for the thread executing the event loop, splice() can not be told not to raise it.
+		/// \warning not thread safe. Not to be destroyed from within its callbacks.
+		class Relay {
+		public:
+			enum Direction {
+				FIRST_TO_SECOND = 0,
+				SECOND_TO_FIRST = 1
+			};
+
+			/// Sees the start of a stream before anything of it is forwarded
+			/// \param pHeader First headerSize bytes of the stream, less if the stream ended before
+			/// \return false to close both connections
+			using InspectCb_t = std::function < bool (Relay& relay, Direction direction, const uint8_t* pHeader, size_t size) >;
+			/// called when both connections were closed
+			/// \param error 0 if both streams ended, ECONNABORTED if closed by the inspection callback, errno of the failed operation otherwise
+			using CloseCb_t = std::function < void (Relay& relay, int error) >;
+
+			/// \param eventLoop Executes the forwarding
+			/// \param pipeSize Capacity of each pipe, the amount of data in flight per direction. Limited by /proc/sys/fs/pipe-max-size.
+			/// \throw std::runtime_error if the pipes could not be created
+			Relay(sys::EventLoop& eventLoop, size_t pipeSize = 65536);
+
+			Relay(const Relay& op) = delete;
+			Relay& operator= (const Relay& op) = delete;
+
+			/// closes both connections
+			virtual ~Relay();
+
+			/// \param headerSize Number of bytes at the start of each stream given to inspectCb. 0 switches inspection off.
+			/// Has to fit into the socket receive buffer, the header is peeked before anything is forwarded.
+			/// \warning to be set before start()
+			void setInspectCb(size_t headerSize, InspectCb_t inspectCb);
+
+			void setCloseCb(CloseCb_t closeCb);
+
+			/// Take over both connections (see SocketNonblocking::release()) and start forwarding.
+			/// Unread data of a connection is forwarded first, unsent data of a connection is sent before anything forwarded to it.
+			/// \return 0 success; -1 already running or a socket is not connected
+			int start(SocketNonblocking& first, SocketNonblocking& second);
+
+			/// Close both connections without calling the close callback
+			void stop();
+
+			bool isRunning() const
+			{
+				return m_running;
+			}
+
+			/// \return number of bytes handed over to the destination of a direction
+			uint64_t getRelayedCount(Direction direction) const
+			{
+				return m_streams[direction].relayedCount;
+			}
+
+			/// \return capacity of each pipe
+			size_t getPipeSize() const
+			{
+				return m_pipeSize;
+			}
+
+		private:
+			/// one direction
+			struct Stream {
+				int source;
+				int destination;
+				int pipe[2];
+				/// bytes inside the pipe
+				size_t fill;
+				/// unread and unsent data of the released sockets. Goes into the pipe before anything from source.
+				std::vector < uint8_t > backlog;
+				/// leading bytes of the backlog that were unsent data of the destination, they are not inspected
+				size_t unsentCount;
+				bool inspected;
+				bool sourceEnded;
+				/// the end of the stream was forwarded to the destination
+				bool finished;
+				uint64_t relayedCount;
+			};
+
+			/// move as much as possible from source over the pipe to destination
+			/// \return -1 if the relay was closed, the close callback was called already
+			int pump(Direction direction);
+
+			/// \return 1 source would block or ended, 0 pipe (might be) full, -1 error
+			int fill(Stream& stream);
+
+			/// \return 1 pipe empty, 0 destination would block, -1 error
+			int drain(Stream& stream);
+
+			/// collect the header of the stream and give it to the inspection callback
+			/// \return 1 accepted; 0 waiting for the rest of the header; -1 the relay was closed
+			int inspect(Direction direction);
+
+			/// close both connections and call the close callback. Has to be the last thing to do.
+			/// \return -1
+			int close(int error);
+
+			sys::EventLoop& m_eventLoop;
+			size_t m_pipeSize;
+			size_t m_headerSize;
+			InspectCb_t m_inspectCb;
+			CloseCb_t m_closeCb;
+			bool m_running;
+			Stream m_streams[2];
+		};
+	}
+}
+#endif
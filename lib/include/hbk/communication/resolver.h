@@ -0,0 +1,161 @@
+// This code is licenced under the MIT license:
+//
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_RESOLVER_H
+#define _HBK__COMMUNICATION_RESOLVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/notifier.h"
+
+namespace hbk {
+	namespace communication {
+		/// One address delivered by the resolver. Can be used directly with connect().
+		struct ResolvedAddress {
+			/// address family (AF_INET or AF_INET6)
+			int family;
+			/// large enough for ipv4 and ipv6
+			struct sockaddr_storage address;
+			/// the length of the valid part of address
+			socklen_t addressLength;
+		};
+
+		using ResolvedAddresses = std::vector < ResolvedAddress >;
+
+		/// Resolves host names without blocking the event loop.
+		///
+		/// Numeric addresses are converted immediately. All other names are resolved by helper threads using getaddrinfo.
+		/// Results are delivered in the context of the event loop. Successful and failed resolutions are kept in a bounded cache
+		/// for a limited time. Concurrent requests for the same name are resolved only once.
+		class Resolver {
+		public:
+			/// \param error 0 on success, otherwise the getaddrinfo() error code (EAI_...)
+			/// \param addresses all addresses found. Empty on error.
+			using Cb_t = std::function < void (int error, const ResolvedAddresses& addresses) >;
+
+			/// \param eventLoop Results of resolutions done by the helper threads are delivered in the context of this event loop
+			/// \param workerCount Number of helper threads doing the blocking getaddrinfo()
+			/// \param maxCacheEntries Maximum number of cached results. 0 disables the cache
+			/// \param positiveTtl Time to keep successful resolutions
+			/// \param negativeTtl Time to keep failed resolutions
+			/// \throws hbk::exception
+			Resolver(sys::EventLoop& eventLoop,
+				unsigned int workerCount = 1,
+				size_t maxCacheEntries = 256,
+				std::chrono::seconds positiveTtl = std::chrono::seconds(60),
+				std::chrono::seconds negativeTtl = std::chrono::seconds(5));
+
+			Resolver(const Resolver& op) = delete;
+			Resolver& operator= (const Resolver& op) = delete;
+
+			/// Waits for running resolutions to finish. Pending callbacks won't be called.
+			virtual ~Resolver();
+
+			/// If the result is known already (numeric address or cached entry) the callback is executed before returning.
+			/// Otherwise it will be executed in the context of the event loop.
+			/// \param address host name or numeric ipv4/ipv6 address
+			/// \param port tcp port or service name
+			/// \param resultCb called with the result
+			/// \return 0 result was delivered, 1 resolution is pending, -1 error
+			int resolve(const std::string& address, const std::string& port, Cb_t resultCb);
+
+			/// Remove all cached entries
+			void clearCache();
+
+			/// \return number of cached entries including expired ones that were not yet removed
+			size_t getCacheSize() const;
+
+		private:
+			using clock_t = std::chrono::steady_clock;
+
+			struct CacheEntry {
+				int error;
+				ResolvedAddresses addresses;
+				clock_t::time_point expiry;
+			};
+
+			struct Job {
+				std::string key;
+				std::string address;
+				std::string port;
+			};
+
+			struct Result {
+				std::string key;
+				int error;
+				ResolvedAddresses addresses;
+			};
+
+			using cache_t = std::unordered_map < std::string, CacheEntry >;
+			using pending_t = std::unordered_map < std::string, std::vector < Cb_t > >;
+
+			/// \return getaddrinfo() error code
+			static int getAddresses(const std::string& address, const std::string& port, int flags, ResolvedAddresses& addresses);
+
+			void worker();
+
+			/// executed by the notifier in the context of the event loop
+			void deliver();
+
+			/// \warning m_cacheMtx is to be locked by the caller
+			void insertIntoCache(const std::string& key, int error, const ResolvedAddresses& addresses);
+
+			sys::Notifier m_notifier;
+
+			size_t m_maxCacheEntries;
+			std::chrono::seconds m_positiveTtl;
+			std::chrono::seconds m_negativeTtl;
+
+			/// protects m_cache and m_pending
+			mutable std::mutex m_cacheMtx;
+			cache_t m_cache;
+			/// callbacks waiting for a resolution that is in progress
+			pending_t m_pending;
+
+			/// protects m_jobs, m_results and m_stop
+			std::mutex m_jobsMtx;
+			std::condition_variable m_jobsCondition;
+			std::deque < Job > m_jobs;
+			std::deque < Result > m_results;
+			bool m_stop;
+
+			std::vector < std::thread > m_workers;
+		};
+	}
+}
+#endif
@@ -0,0 +1,72 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_SEQPACKETSERVER_H
+#define _HBK__COMMUNICATION_SEQPACKETSERVER_H
+
+#include <functional>
+#include <string>
+
+#include "hbk/communication/seqpacketsocket.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Listens for and accepts message oriented unix domain socket connections (SOCK_SEQPACKET).
+		/// Counterpart of TcpServer::start(path, ...) for SeqPacketSocket.
+		class SeqPacketServer {
+		public:
+			/// deliveres the worker socket for an accepted client
+			using Cb_t = std::function < void (seqPacketSocket_t) >;
+
+			/// @param eventLoop Event loop the object will be registered in
+			SeqPacketServer(sys::EventLoop& eventLoop);
+			virtual ~SeqPacketServer();
+
+			SeqPacketServer(const SeqPacketServer& op) = delete;
+			SeqPacketServer& operator= (const SeqPacketServer& op) = delete;
+
+			/// @param path path of unix domain socket to listen to
+			/// \param useAbstractNamespace true unix domain socket is in abstract namespace
+			/// @param backlog Maximum length of the queue of pending connections
+			/// @param acceptCb called when accepting a new client
+			/// \return -1 on error
+			int start(const std::string& path, bool useAbstractNamespace, int backlog, Cb_t acceptCb);
+
+			/// Remove this object from the event loop and close the server socket
+			void stop();
+
+		private:
+			/// called by eventloop
+			int process();
+
+			sys::event m_listeningEvent;
+			sys::EventLoop& m_eventLoop;
+			Cb_t m_acceptCb;
+
+			/// unix domain socket path.
+			/// Not relevant when using abstract namespace
+			std::string m_unixDomainSocketPath;
+		};
+	}
+}
+#endif
@@ -0,0 +1,135 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_SEQPACKETSOCKET_H
+#define _HBK__COMMUNICATION_SEQPACKETSOCKET_H
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <sys/socket.h>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Message oriented unix domain socket (SOCK_SEQPACKET). Message boundaries are kept by the kernel.
+		/// Each send() is one message, each receive() yields exactly one message. There is no framing and no buffering of partial messages.
+		/// Use SeqPacketServer for the accepting side.
+		/// Empty messages are not supported, they can not be told apart from the end of the connection.
+		class SeqPacketSocket {
+		public:
+			/// called on the arrival of messages
+			using DataCb_t = std::function < ssize_t (SeqPacketSocket& socket) >;
+
+			/// used by receiveMessages()
+			struct Message {
+				/// receive buffer
+				void* pData;
+				size_t capacity;
+				/// size of the received message
+				size_t size;
+				/// the message was larger than capacity, the rest is lost
+				bool truncated;
+			};
+
+			/// Maximum number of messages received by one call of receiveMessages()
+			static const unsigned int MAX_BATCH = 64;
+
+			/// \param eventLoop Callbacks are executed in this context
+			SeqPacketSocket(sys::EventLoop& eventLoop);
+
+			/// used when accepting connection via SeqPacketServer.
+			/// \throw std::runtime_error on error
+			SeqPacketSocket(int fd, sys::EventLoop& eventLoop);
+
+			virtual ~SeqPacketSocket();
+
+			SeqPacketSocket(const SeqPacketSocket& op) = delete;
+			SeqPacketSocket& operator= (const SeqPacketSocket& op) = delete;
+
+			/// this method does work blocking
+			/// \param path path to unix domain socket
+			/// \param useAbstractNamespace true unix domain socket is in abstract namespace
+			/// \return 0: success; -1: error
+			int connect(const std::string& path, bool useAbstractNamespace = true);
+
+			/// Remove event from event loop and close socket
+			void disconnect();
+
+			/// \param dataCb callback to be called if messages are available or the connection was closed
+			void setDataCb(DataCb_t dataCb);
+
+			/// \param dataCb callback to be called if the socket gets writable
+			void setOutDataCb(DataCb_t dataCb);
+
+			void clearDataCb();
+			void clearOutDataCb();
+
+			/// Send one message without blocking. The message is sent completely or not at all.
+			/// \return size of the message; -1 error (errno is EAGAIN if the socket buffer is full)
+			ssize_t send(const void* pData, size_t size);
+
+			/// Gather several memory areas into one message without blocking
+			/// \return size of the message; -1 error (errno is EAGAIN if the socket buffer is full)
+			ssize_t sendBlocks(const dataBlock_t* blocks, size_t blockCount);
+
+			/// Send one message
+			/// \warning waits until the message is taken by the kernel, hence it might block the eventloop if called from within a callback function
+			/// \return size of the message; -1 error
+			ssize_t sendBlock(const void* pData, size_t size);
+
+			/// Receive exactly one message
+			/// \return size of the message; 0 connection closed; -1 error (errno is EAGAIN if there is nothing to receive,
+			/// EMSGSIZE if the message was larger than size. The message is lost then.)
+			ssize_t receive(void* pData, size_t size);
+
+			/// Receive up to messageCount messages with one system call. Each message goes into its own buffer.
+			/// \param messageCount Not more than MAX_BATCH are received
+			/// \return number of messages received; 0 connection closed; -1 error (errno is EAGAIN if there is nothing to receive)
+			int receiveMessages(Message* pMessages, unsigned int messageCount);
+
+			/// Wait for and receive exactly one message
+			/// \warning might block the eventloop if called from within a callback function
+			/// \param msTimeout -1 for infinite
+			/// \return size of the message; 0 connection closed; -1 error or timeout
+			ssize_t receiveComplete(void* pData, size_t size, int msTimeout = -1);
+
+			/// \return the file descriptor
+			sys::event getEvent() const
+			{
+				return m_event;
+			}
+
+		private:
+			sys::EventLoop& m_eventLoop;
+			sys::event m_event;
+			DataCb_t m_inDataHandler;
+			DataCb_t m_outDataHandler;
+		};
+
+		using seqPacketSocket_t = std::unique_ptr < SeqPacketSocket >;
+	}
+}
+#endif
@@ -0,0 +1,154 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_SHAREDMEMORYSOCKET_H
+#define _HBK__COMMUNICATION_SHAREDMEMORYSOCKET_H
+
+#include <functional>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Byte stream between two processes on the same host through shared memory.
+		/// There is one single producer single consumer ring buffer per direction inside a memfd.
+		/// Data is copied into the ring by the sender and out of the ring by the receiver, there are no system calls for the transfer itself.
+		/// Eventfds wake up the peer if it waits for data or space. They are processed by the event loop.
+		/// The rings are negotiated over a connected unix domain socket (i.e. one from TcpServer::start(path, ...) and SocketNonblocking::connect(path)).
+		/// That socket is also used to detect the termination of the peer and must not be used for anything else afterwards.
+		/// The API mirrors SocketNonblocking.
+		class SharedMemorySocket {
+		public:
+			/// called on the arrival of data or when the peer closed the connection
+			using DataCb_t = std::function < ssize_t (SharedMemorySocket& socket) >;
+
+			/// \param eventLoop Handles the wake ups
+			SharedMemorySocket(sys::EventLoop& eventLoop);
+			virtual ~SharedMemorySocket();
+
+			SharedMemorySocket(const SharedMemorySocket& op) = delete;
+			SharedMemorySocket& operator= (const SharedMemorySocket& op) = delete;
+
+			/// Client side: Create the rings and offer them to the peer. Does not wait for the peer.
+			/// \param unixSocket Connected unix domain socket. It may be destroyed afterwards.
+			/// \param ringSize Capacity of each direction in bytes. Rounded up to a power of 2, at least 4096.
+			/// \return 0 success; -1 error
+			int connect(const SocketNonblocking& unixSocket, size_t ringSize = 1024*1024);
+
+			/// Server side: Take over the rings offered by the client.
+			/// \param unixSocket Connected unix domain socket. It may be destroyed afterwards.
+			/// \param msTimeout Time to wait for the offer of the client. -1 for infinite
+			/// \return 0 success; -1 error
+			int accept(const SocketNonblocking& unixSocket, int msTimeout = 5000);
+
+			/// Tell the peer and release the rings
+			void disconnect();
+
+			bool isConnected() const
+			{
+				return m_pTx!=nullptr;
+			}
+
+			/// \param dataCb Called if data is available or the peer closed the connection. Read until receive() returns -1 with errno EAGAIN.
+			void setDataCb(DataCb_t dataCb);
+			void clearDataCb();
+
+			/// \param dataCb Called if the peer made space after send() returned -1 with errno EAGAIN
+			void setOutDataCb(DataCb_t dataCb);
+			void clearOutDataCb();
+
+			/// Copy as much as fits into the ring
+			/// \return number of bytes sent; -1 error (errno is EAGAIN if the ring is full, EPROTO if the peer corrupted the ring)
+			ssize_t send(const void* pBlock, size_t len);
+
+			/// send everything or until the connection closes
+			/// \warning waits until requested amount of data is processed or an error happened, hence it might block the eventloop if called from within a callback function
+			ssize_t sendBlock(const void* pBlock, size_t len);
+
+			/// send everything or until the connection closes
+			/// \warning waits until requested amount of data is processed or an error happened, hence it might block the eventloop if called from within a callback function
+			ssize_t sendBlocks(const dataBlocks_t& blocks);
+
+			/// might return with less bytes the requested
+			/// \return number of bytes received; 0 connection closed; -1 error (errno is EAGAIN if there is nothing to receive, EPROTO if the peer corrupted the ring)
+			ssize_t receive(void* pBlock, size_t len);
+
+			/// might return with less bytes then requested if connection is being closed before completion
+			/// \warning waits until requested amount of data is processed or an error happened, hence it might block the eventloop if called from within a callback function
+			/// \param msTimeout -1 for infinite
+			/// \return number of bytes received; -1 error or timeout
+			ssize_t receiveComplete(void* pBlock, size_t len, int msTimeout = -1);
+
+			/// \return capacity of each direction in bytes, 0 if not connected
+			size_t getRingSize() const
+			{
+				return m_ringSize;
+			}
+
+		private:
+			/// control block and data of one direction
+			struct Ring;
+
+			/// map the rings and register the events
+			/// All file descriptors but unixSocketFd are owned by this object afterwards, even on error.
+			int setup(int memFd, bool isClient, int ownDataEventFd, int ownSpaceEventFd, int peerDataEventFd, int peerSpaceEventFd, int unixSocketFd);
+
+			/// \return true if the peer closed its side or terminated
+			bool isPeerClosed() const;
+
+			/// The positions are in memory the peer can write to. Distances beyond the ring size would make us access memory outside the mapping.
+			/// Disconnects and sets errno to EPROTO
+			/// \return -1
+			ssize_t protocolError();
+
+			/// wait for one of the own eventfds
+			/// \return 1 signaled; 0 timeout; -1 error
+			int waitFor(int eventFd, int msTimeout);
+
+			int dataEvent();
+			int spaceEvent();
+			int controlEvent();
+
+			sys::EventLoop& m_eventLoop;
+			void* m_pMemory;
+			size_t m_memorySize;
+			size_t m_ringSize;
+			Ring* m_pTx;
+			Ring* m_pRx;
+
+			/// signaled by the peer if there is new data
+			int m_ownDataEventFd;
+			/// signaled by the peer if it made space
+			int m_ownSpaceEventFd;
+			int m_peerDataEventFd;
+			int m_peerSpaceEventFd;
+			/// duplicate of the unix domain socket, becomes readable if the peer terminates
+			int m_controlFd;
+			bool m_peerGone;
+
+			DataCb_t m_inDataHandler;
+			DataCb_t m_outDataHandler;
+		};
+	}
+}
+#endif
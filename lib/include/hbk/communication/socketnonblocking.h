@@ -23,8 +23,10 @@
 #ifndef __HBK__SOCKETNONBLOCKING_H
 #define __HBK__SOCKETNONBLOCKING_H
 
+#include <atomic>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -39,7 +41,12 @@ typedef int ssize_t;
 #endif
 
 #include "hbk/communication/bufferedreader.h"
+#include "hbk/communication/resolver.h"
+#include "hbk/communication/socketoptions.h"
+#include "hbk/communication/transportstats.h"
 #include "hbk/sys/eventloop.h"
+#include "hbk/sys/notifier.h"
+#include "hbk/sys/timer.h"
 
 namespace hbk
 {
@@ -67,6 +74,8 @@ namespace hbk
 
 		using dataBlocks_t = std::list < dataBlock_t >;
 
+		class Uring;
+
 		/// A tcp client connection to a tcpserver. Ipv4 and ipv6 are supported.
 		/// the socket uses keep-alive in order to detect broken connection.
 		class SocketNonblocking
@@ -74,15 +83,41 @@ namespace hbk
 		public:
 			/// called on the arrival of data
 			using DataCb_t = std::function < ssize_t (SocketNonblocking& socket) >;
+			/// called when an asynchronous connect finished
+			/// \param result 0: success; -1: error
+			using ConnectCb_t = std::function < void (int result) >;
+#ifndef _WIN32
+			/// called when the number of bytes queued by sendAsync() crosses a watermark
+			/// \param aboveHighWatermark true: high watermark was reached; false: queue drained down to the low watermark
+			using WatermarkCb_t = std::function < void (SocketNonblocking& socket, bool aboveHighWatermark) >;
+
+			/// called when sending data queued by sendAsync() failed
+			/// \param error errno of the failed send
+			using SendErrorCb_t = std::function < void (SocketNonblocking& socket, int error) >;
+			/// called with data received by io_uring
+			/// \param data Received data. An empty slice tells that the connection was closed (errno 0) or an error happened (errno set).
+			using SliceDataCb_t = std::function < void (SocketNonblocking& socket, const BufferSlice& data) >;
+#endif
 			/// @param eventLoop Event loop the object will be registered in. A running eventloop is necessary to handle input/output events.
 			/// A running eventloop is not necessary if you are just using methods for receiving or sending data.
-			SocketNonblocking(sys::EventLoop &eventLoop);
+			/// @param options Applied when connecting
+			SocketNonblocking(sys::EventLoop &eventLoop, const SocketOptions& options = SocketOptions());
 
 
-			/// not movable
+#ifdef _WIN32
+			/// not movable, pending overlapped operations refer to the object
 			SocketNonblocking(SocketNonblocking&& op) = delete;
-			/// not movable
+			/// not movable, pending overlapped operations refer to the object
 			SocketNonblocking& operator= (SocketNonblocking&& op) = delete;
+#else
+			/// Takes over the connection of op including callbacks, queued data and settings.
+			/// Callbacks get this object as parameter afterwards. A pending name resolution stays with op, a connection attempt in progress moves to this object.
+			/// \warning Not to be called from within a callback of op
+			SocketNonblocking(SocketNonblocking&& op);
+			/// disconnects and takes over the connection of op
+			/// \warning Not to be called from within a callback of op
+			SocketNonblocking& operator= (SocketNonblocking&& op);
+#endif
 
 			/// should not be copied
 			SocketNonblocking(const SocketNonblocking& op) = delete;
@@ -92,15 +127,53 @@ namespace hbk
 
 			/// used when accepting connection via tcp server.
 			/// \throw std::runtime_error on error
-			SocketNonblocking(int fd, sys::EventLoop &eventLoop);
+			SocketNonblocking(int fd, sys::EventLoop &eventLoop, const SocketOptions& options = SocketOptions());
+
+#ifndef _WIN32
+			/// used when accepting connection via tcp server. The peer address delivered by accept() is kept instead of being queried.
+			/// \param inheritedOptions true if fd was accepted non-blocking from a listening socket prepared by applyListenerOptions() with the same options.
+			/// Only the options the kernel does not inherit (priority, quick ack) are applied then.
+			/// \throw std::runtime_error on error
+			SocketNonblocking(int fd, sys::EventLoop &eventLoop, const SocketOptions& options, const struct sockaddr* pPeerAddress, socklen_t peerAddressLength, bool inheritedOptions = false);
+
+			/// Apply options to a listening tcp socket. Sockets accepted from it inherit them, which saves the system calls per connection.
+			/// \return -1 if fd is not a tcp socket or a mandatory option could not be set
+			static int applyListenerOptions(int listeningFd, const SocketOptions& options);
+#endif
 			virtual ~SocketNonblocking();
 
+			/// Objects are allocated from a free list. Memory of destroyed objects is kept for reuse,
+			/// hence connection churn (accept, close) does not hit the heap allocator.
+			static void* operator new(size_t size);
+			static void operator delete(void* pObject, size_t size);
+
+			/// \return number of released objects waiting for reuse
+			static size_t getCachedObjectCount();
+
 			/// this method does work blocking
 			/// \param address address of tcp server or path od unix domain socket
 			/// \param port tcp port to connect to
 			/// \return 0: success; -1: error
 			int connect(const std::string& address, const std::string& port);
 
+			/// this method does work blocking
+			/// \param address address of tcp server
+			/// \param port tcp port to connect to
+			/// \param options replace the options given on construction
+			/// \return 0: success; -1: error
+			int connect(const std::string& address, const std::string& port, const SocketOptions& options);
+
+			/// Name resolution does not block the event loop.
+			/// Linux: Neither does connecting. It is finished by the event loop, each resolved address is tried for up to 5s.
+			/// Microsoft Windows: Connecting works blocking like connect(address, port).
+			/// \param resolver Resolves the address. Resolved addresses are cached by the resolver.
+			/// \param address address of tcp server
+			/// \param port tcp port to connect to
+			/// \param connectCb called with the result after the address was resolved and connecting was tried.
+			/// Won't be called if this object is destroyed or disconnected before.
+			/// \return 0: connectCb was executed before returning; 1: resolution or connecting is pending; -1: error
+			int connect(Resolver& resolver, const std::string& address, const std::string& port, ConnectCb_t connectCb);
+
 #ifndef _WIN32
 			/// this method does work blocking
 			/// \param path path to unix domain socket
@@ -113,13 +186,31 @@ namespace hbk
 			int connect(int domain, const struct sockaddr* pSockAddr, socklen_t len);
 
 			/// Remove event from event loop and close socket
+			/// Collected data (see setWriteCoalescing()) is sent before closing.
+			/// Linux: So is data queued by sendAsync(). Waits up to 1s for the peer to take it, what is left then is discarded.
 			void disconnect();
 
+			/// Options are applied immediately if connected. Otherwise they are applied when connecting.
+			/// \return 0: success; -1: error
+			int setOptions(const SocketOptions& options);
+
+			const SocketOptions& getOptions() const;
+
 			/// if setting a callback function, data receiption is done via event loop.
 			/// if setting an empty callback function DataCb_t(), the event is taken out of the eventloop.
 			/// \param dataCb callback to be called if fd gets readable (data is available)
 			void setDataCb(DataCb_t dataCb);
 
+#ifndef _WIN32
+			/// Receive by multishot receive of io_uring instead of readiness notification and receive calls.
+			/// The kernel puts received data into buffers provided by uring. They are handed to dataCb without copying.
+			/// Data that was already buffered by this object is delivered first.
+			/// Has to be called while connected. clearDataCb() or setDataCb(DataCb_t) switch back.
+			/// \param uring Has to outlive this object. Has to work with the event loop of this object.
+			/// \return 0 success; -1 error
+			int setDataCb(Uring& uring, SliceDataCb_t dataCb);
+#endif
+
 			/// \param dataCb callback to be called if fd gets writable
 			void setOutDataCb(DataCb_t dataCb);
 
@@ -145,9 +236,114 @@ namespace hbk
 			/// works as posix send
 			ssize_t send(const void* pBlock, size_t len, bool more);
 
+			/// Collect small writes and hand them over to the kernel together. Reduces the number of system calls and tcp segments
+			/// if several small messages are being sent while processing events.
+			/// Collected data is sent when the threshold is reached, at the end of the current event loop iteration or on flush().
+			/// Writes that are not called from within an event callback are sent immediately.
+			/// Send methods return the number of bytes collected. Errors happening when sending collected data at the end of the iteration are not reported,
+			/// a broken connection is to be detected by receiving.
+			/// \param threshold Writes smaller than threshold are collected. 0 switches coalescing off (default)
+			void setWriteCoalescing(size_t threshold);
+
+			size_t getWriteCoalescing() const
+			{
+				return m_coalesceThreshold;
+			}
+
+			/// send all collected data
+			/// \warning Microsoft Windows: waits until all collected data is processed or an error happened.
+			/// Linux: Whatever the kernel does not take immediately is handed over to sendAsync().
+			/// \return 0 success; -1 error
+			int flush();
+
+#ifndef _WIN32
+			/// Send without blocking. Whatever the kernel does not take immediately is queued and sent by the event loop when the socket becomes writable.
+			/// Data not taken immediately is copied into memory blocks of the buffer pool.
+			/// While data is queued, the blocking send methods queue as well in order to keep the order.
+			/// May be called from other threads than the one executing the event loop.
+			/// Queued data is sent by the thread executing the event loop only.
+			/// \return 0 success (sent or queued); -1 error (also if sending queued data failed before, see setSendErrorCb())
+			int sendAsync(const void* pBlock, size_t len);
+
+			/// Zero copy variant of sendAsync(). The slice keeps its memory block alive until it was sent.
+			/// Slices without memory block are copied.
+			/// \return 0 success (sent or queued); -1 error
+			int sendAsync(const BufferSlice& slice);
+
+			/// \return number of bytes queued by sendAsync() that were not yet handed over to the kernel
+			size_t getQueuedBytes() const;
+
+			/// Get told when the event loop fails to send data queued by sendAsync().
+			/// The data stays queued (see getQueuedBytes() and release()). Sending fails with the same errno afterwards, until disconnect().
+			/// \param sendErrorCb Executed by the thread executing the event loop
+			void setSendErrorCb(SendErrorCb_t sendErrorCb);
+
+			/// Backpressure: Get told when the queue of sendAsync() grows above highWatermark and when it drained down to lowWatermark again.
+			/// Producers may throttle or drop data in between.
+			/// \param lowWatermark Has to be less than highWatermark
+			/// \param highWatermark 0 switches watermark notification off
+			/// \param watermarkCb Executed by the thread that caused the crossing
+			/// \param useNotSentLowWatermark Also set TCP_NOTSENT_LOWAT to lowWatermark. The kernel keeps less unsent data,
+			/// hence the queue reflects the real backlog and the socket becomes writable when the kernel runs low.
+			/// \return 0 success; -1 invalid watermarks
+			int setWatermarks(size_t lowWatermark, size_t highWatermark, WatermarkCb_t watermarkCb, bool useNotSentLowWatermark = false);
+
+			/// \return true after reaching the high watermark until the queue drained down to the low watermark
+			bool isAboveHighWatermark() const;
+
+			/// Limit the send rate of the current connection without blocking the event loop.
+			/// Tcp connections are paced by the kernel using SO_MAX_PACING_RATE (fq qdisc or tcp internal pacing).
+			/// Otherwise a token bucket drains the queue of sendAsync(). The blocking send methods queue as well then.
+			/// Has to be called after connecting, from the thread executing the event loop or while the event loop is not running.
+			/// \param bytesPerSecond 0 removes the limit
+			/// \param burstSize Token bucket only: Maximum number of bytes sent at once. 0 for 10ms worth of data
+			/// \param useKernel false forces the token bucket
+			/// \return 0 paced by the kernel or limit removed; 1 paced by the token bucket; -1 error
+			int setPacingRate(uint64_t bytesPerSecond, size_t burstSize = 0, bool useKernel = true);
+
+			/// \return bytes per second, 0 if not limited
+			uint64_t getPacingRate() const;
+
+			/// Give up the connection without closing it, i.e. for handing it over to another process (see Handoff).
+			/// Collected data is flushed. Events, timers and io_uring operations are removed. This object is disconnected afterwards.
+			/// \warning Data already received by io_uring but not yet processed by the event loop is lost.
+			/// \param unreadData Receives data that was received but not yet delivered
+			/// \param unsentData Receives data queued by sendAsync() that was not yet handed over to the kernel
+			/// \return the file descriptor, -1 if not connected
+			int release(std::vector < uint8_t >& unreadData, BufferChain& unsentData);
+
+			/// Deliver data before anything received from the socket, i.e. unread data of a connection taken over from another process
+			/// \return 0 success; -1 more than fits into a memory block of the buffer pool
+			int preload(const void* pData, size_t size);
+#endif
+
 			/// might return with less bytes the requested
 			ssize_t receive(void* pBlock, size_t len);
 
+#ifndef _WIN32
+			/// Receive without copying into reference counted memory blocks of the buffer pool.
+			/// Received data is appended to the chain. Slices may be kept as long as needed, the memory blocks return to the pool afterwards.
+			/// \return number of bytes received; 0 connection closed; -1 error (errno is EAGAIN or EWOULDBLOCK if there is nothing to receive)
+			ssize_t receive(BufferChain& chain);
+#endif
+
+			/// Receive buffers are borrowed from this pool only while received data is pending.
+			/// \param pool Memory blocks are taken from this pool. It has to outlive this object.
+			void setBufferPool(BufferPool& pool);
+
+			/// Scatter receive: Fill several memory areas with one system call. Blocks are filled one after the other.
+			/// Data already buffered is delivered first.
+			/// \param blocks Memory areas to receive into. pData has to point to writable memory.
+			/// \return number of bytes received (might be less than requested); 0 connection closed; -1 error
+			ssize_t receiveBlocks(const dataBlock_t* blocks, size_t blockCount);
+
+			/// Scatter receive until all blocks are filled
+			/// \warning waits until requested amount of data is processed or an error happened, hence it might block the eventloop if called from within a callback function
+			/// \param blocks Memory areas to receive into. pData has to point to writable memory.
+			/// \param msTimeout -1 for infinite
+			/// \return number of bytes received. Less than requested if connection is being closed before completion; -1 error or timeout
+			ssize_t receiveBlocksComplete(const dataBlock_t* blocks, size_t blockCount, int msTimeout = -1);
+
 			/// might return with less bytes then requested if connection is being closed before completion
 			/// \warning waits until requested amount of data is processed or an error happened, hence it might block the eventloop if called from within a callback function
 			/// @param pBlock Receive buffer
@@ -158,11 +354,40 @@ namespace hbk
 			/// \return true if socket uses firewire connection
 			bool isFirewire() const;
 
+			/// Compares binary with the peer address captured when connecting or accepting. There are no system calls.
+			/// An IPv4 mapped IPv6 address equals the IPv4 address.
 			/// @param pCheckSockAddr The structure to compare the socket of this object with
 			/// @param checkSockAddrLen Length of the structure depends on the type of socket (ipv4, ipv6)
 			/// \return true if the socket of this object corresponds to the given sockaddr structure
 			bool checkSockAddr(const struct sockaddr* pCheckSockAddr, socklen_t checkSockAddrLen) const;
 
+			/// \return address of the peer, captured once when connecting or accepting. ss_family is AF_UNSPEC if not connected.
+			const struct sockaddr_storage& peerAddress() const
+			{
+				return m_peerAddress;
+			}
+
+			socklen_t peerAddressLength() const
+			{
+				return m_peerAddressLength;
+			}
+
+			/// \return local address of the connection, captured once when connecting or accepting. ss_family is AF_UNSPEC if not connected.
+			const struct sockaddr_storage& localAddress() const
+			{
+				return m_localAddress;
+			}
+
+			socklen_t localAddressLength() const
+			{
+				return m_localAddressLength;
+			}
+
+			/// Counters of this library and, for tcp connections, the kernel's view on the connection (TCP_INFO).
+			/// Tells whether a slow connection is caused by the network, the peer or the application.
+			/// Use TransportStatsSampler to sample periodically.
+			TransportStats transportStats() const;
+
 			/// \return the file descriptor (Linux) or handle (Microsoft Windows)
 			sys::event getEvent() const
 			{
@@ -170,22 +395,164 @@ namespace hbk
 			}
 
 private:
+			// Members have default initializers. Constructors only initialize what depends on their parameters.
 
 			int setSocketOptions();
 
+			/// query the local address and the peer address if it is not known yet
+			void captureAddresses();
+
+			/// collect the blocks if coalescing is active and they are small enough. Otherwise collected data is sent first.
+			/// \return 1 blocks were collected; 0 blocks are to be sent by the caller; -1 error sending collected data
+			int coalesce(const dataBlock_t* blocks, size_t blockCount);
+
 #ifdef _WIN32
 			int process();
+#else
+			/// waits for the socket to become writable and counts the time spent
+			int waitForWritableCounted();
+
+			/// reenable TCP_QUICKACK if requested by the options
+			void rearmQuickAck();
+
+			/// move the connection and everything belonging to it from op to this object
+			/// \warning this object is to be disconnected
+			void takeOver(SocketNonblocking& op);
+
+			/// output event of the event loop: sends queued data, then calls the output callback
+			int outEvent();
+
+			/// executed by the thread executing the event loop after sendAsync() started queueing
+			void registerOutEvent();
+
+			/// asynchronous connect: try the next resolved address, report failure if there is none left
+			void connectNext();
+
+			/// asynchronous connect: arm the time limit and wait for the out event
+			void waitForConnect();
+
+			/// out event while an asynchronous connect is pending
+			int connectEvent();
+
+			/// asynchronous connect: register the event handlers and report success
+			void connected();
+
+			/// asynchronous connect: close the socket of a failed attempt
+			void closeConnectAttempt();
+
+			/// \return false if the connect callback destroyed this object
+			bool finishConnect(int result);
+
+			/// send queued data blocking with a time limit
+			void sendQueuedBeforeClosing();
+
+			/// send queued data and report reaching the low watermark
+			/// \return true if data is left in the queue
+			bool sendQueued();
+
+			/// send as much queued data as the kernel (and the pacing rate) takes
+			/// \return 0 queue empty; 1 kernel does not take more or paced; -1 error, m_sendError is set and the data stays queued
+			/// \warning m_sendQueueMtx is to be locked by the caller
+			int drainSendQueue();
+
+			/// add tokens for the time elapsed since the last refill
+			/// \warning m_sendQueueMtx is to be locked by the caller
+			void refillPacingTokens();
+
+			/// queue the blocks if data queued by sendAsync() is pending
+			/// \return 1 blocks were queued; 0 blocks are to be sent by the caller; -1 error
+			int queueIfPending(const dataBlock_t* blocks, size_t blockCount);
+
+			/// append to the queue. Slices without memory block are copied into memory blocks of the buffer pool.
+			/// \warning m_sendQueueMtx is to be locked by the caller
+			void appendToSendQueue(const BufferSlice& slice);
+
+			/// \return true if the high watermark was reached just now
+			/// \warning m_sendQueueMtx is to be locked by the caller
+			bool reachedHighWatermark();
+
+			/// completion of the multishot receive operation
+			void uringReceived(int result, const BufferSlice& data);
+
+			/// stop multishot receive
+			void cancelUringReceive();
 #endif
 
 			sys::event m_event;
 
+			/// Counters of TransportStats. sendAsync() might be called by other threads, transportStats() takes a snapshot.
+			struct TransportCounters {
+				std::atomic < uint64_t > bytesReceived{0};
+				std::atomic < uint64_t > bytesSent{0};
+				std::atomic < uint64_t > partialWrites{0};
+				std::atomic < uint64_t > coalescedWrites{0};
+				/// microseconds
+				std::atomic < uint64_t > blockedTime{0};
+			};
+
 			BufferedReader m_bufferedReader;
+			TransportCounters m_transportCounters;
+			SocketOptions m_options;
+
+			size_t m_coalesceThreshold = 0;
+			std::vector < uint8_t > m_coalesceBuffer;
+
+			struct sockaddr_storage m_peerAddress = {};
+			socklen_t m_peerAddressLength = 0;
+			struct sockaddr_storage m_localAddress = {};
+			socklen_t m_localAddressLength = 0;
+
+#ifndef _WIN32
+			/// protects the send queue and the watermark state
+			mutable std::mutex m_sendQueueMtx;
+			BufferChain m_sendQueue;
+			bool m_outEventRegistered = false;
+			size_t m_lowWatermark = 0;
+			size_t m_highWatermark = 0;
+			bool m_aboveHighWatermark = false;
+			WatermarkCb_t m_watermarkCb;
+			/// errno of sending queued data, 0 if there was no error
+			int m_sendError = 0;
+			SendErrorCb_t m_sendErrorCb;
+
+			/// bytes per second
+			uint64_t m_pacingRate = 0;
+			bool m_userSpacePacing = false;
+			size_t m_pacingBurst = 0;
+			uint64_t m_pacingTokens = 0;
+			std::chrono::steady_clock::time_point m_pacingRefillTime;
+			bool m_pacingTimerArmed = false;
+			/// wakes the token bucket when there is new data
+			std::unique_ptr < sys::Notifier > m_pPacingNotifier;
+			/// registers the out event from the thread executing the event loop
+			std::unique_ptr < sys::Notifier > m_pOutEventNotifier;
+			/// wakes the token bucket when there are enough tokens
+			std::unique_ptr < sys::Timer > m_pPacingTimer;
+
+			/// addresses of the asynchronous connect, m_connectAddressIndex is the next one to try
+			ResolvedAddresses m_connectAddresses;
+			size_t m_connectAddressIndex = 0;
+			/// address and port for error messages
+			std::string m_connectName;
+			ConnectCb_t m_connectCb;
+			/// true while an attempt waits for the out event. Claimed by whoever finishes the attempt.
+			std::atomic < bool > m_connecting { false };
+			/// limits each attempt of the asynchronous connect
+			std::unique_ptr < sys::Timer > m_pConnectTimer;
+
+			Uring* m_pUring = nullptr;
+			/// id of the multishot receive operation, 0 if none
+			uint64_t m_uringOperation = 0;
+			SliceDataCb_t m_sliceDataHandler;
+#endif
 
-			sys::EventLoop& m_eventLoop;
+			sys::EventLoop* m_pEventLoop;
 			DataCb_t m_inDataHandler;
 #ifndef _WIN32
 			DataCb_t m_outDataHandler;
 #endif
+			/// pending asynchronous operations hold a weak reference in order to detect destruction of this object
+			std::shared_ptr < int > m_lifeToken = std::make_shared < int > (0);
 		};
 		
 #ifdef _MSC_VER
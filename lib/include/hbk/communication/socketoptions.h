@@ -0,0 +1,78 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_SOCKETOPTIONS_H
+#define _HBK__COMMUNICATION_SOCKETOPTIONS_H
+
+#include <chrono>
+#include <string>
+
+namespace hbk {
+	namespace communication {
+		/// Options applied to each socket. Different kinds of traffic need different options.
+		/// Tuning options (all but nagle and keep alive) are applied on best effort basis. If the system refuses one, a warning is logged and the socket is used anyway.
+		/// Options marked as Linux only are ignored under Windows.
+		struct SocketOptions {
+			/// Nagle algorithm off, keep alive on, system defaults for everything else
+			SocketOptions();
+
+			/// For high data rates: Big buffers, limited amount of unsent data in the kernel and congestion control optimized for throughput.
+			static SocketOptions bulkStreaming();
+
+			/// For small request/response messages: Immediate acknowledges, high priority, expedited forwarding DSCP, busy polling and fast detection of dead peers.
+			static SocketOptions lowLatencyControl();
+
+			/// TCP_NODELAY: turn off nagle algorithm
+			bool noDelay;
+
+			/// SO_KEEPALIVE
+			bool keepAlive;
+			/// TCP_KEEPIDLE: the interval between the last data packet sent and the first keep alive probe
+			std::chrono::seconds keepAliveIdle;
+			/// TCP_KEEPINTVL: the interval between subsequential keep alive probes
+			std::chrono::seconds keepAliveInterval;
+			/// TCP_KEEPCNT: the number of unacknowledged probes to send before considering the connection dead (Linux only)
+			int keepAliveProbes;
+
+			/// SO_SNDBUF in bytes. 0 for system default
+			int sendBufferSize;
+			/// SO_RCVBUF in bytes. 0 for system default. Also applied to the listening socket of TcpServer in order to get a matching window scale.
+			int receiveBufferSize;
+
+			/// TCP_QUICKACK: acknowledge immediately instead of delaying. Rearmed after each receive since the kernel turns it off from time to time (Linux only)
+			bool quickAck;
+			/// TCP_NOTSENT_LOWAT: Socket is reported writable only if less bytes are not yet sent. 0 for system default (Linux only)
+			int notSentLowWatermark;
+			/// SO_PRIORITY: 0 to 6 for queuing inside the host. -1 for system default (Linux only)
+			int priority;
+			/// differentiated services code point 0 to 63 (IP_TOS, IPV6_TCLASS). -1 for system default (Linux only)
+			int dscp;
+			/// TCP_USER_TIMEOUT: maximum time transmitted data may remain unacknowledged before the connection is closed. 0 for system default (Linux only)
+			std::chrono::milliseconds userTimeout;
+			/// SO_BUSY_POLL: time to busy poll the device queue on blocking receive. 0 for off (Linux only)
+			std::chrono::microseconds busyPoll;
+			/// TCP_CONGESTION: name of the congestion control algorithm (i.e. "cubic", "bbr"). Empty for system default (Linux only)
+			std::string congestionControl;
+		};
+	}
+}
+#endif
@@ -24,7 +24,9 @@
 #define __HBK__COMMUNICATION_TCPACCEPTOR_H
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 #include <WinSock2.h>
@@ -37,9 +39,12 @@
 
 #include "hbk/communication/socketnonblocking.h"
 #include "hbk/sys/eventloop.h"
+#include "hbk/sys/notifier.h"
 
 namespace hbk {
 	namespace communication {
+		class Uring;
+
 		/// Listens for and accepts incoming connections from clients. A callback function will be called with the worker socket for the accepted client.
 		/// Under Linux ipv4 and ipv6 are supported. Under Windows ipv4 is supported.
 		class TcpServer {
@@ -47,6 +52,22 @@ namespace hbk {
 			/// deliveres the worker socket for an accepted client
 			using Cb_t = std::function < void (clientSocket_t) >;
 
+#ifndef _WIN32
+			/// Counters of accepting connections
+			struct AcceptStats {
+				AcceptStats();
+
+				/// number of times the listening socket was processed. accepted/wakeups is the average number of connections accepted per wakeup.
+				uint64_t wakeups;
+				uint64_t accepted;
+				/// largest number of connections accepted in one wakeup
+				uint64_t maxAcceptedPerWakeup;
+				/// accept failed because the process (EMFILE) or the system (ENFILE) ran out of file descriptors.
+				/// Such connections are accepted and closed right away in order to keep on processing the backlog.
+				uint64_t fileLimitCount;
+			};
+#endif
+
 			/// @param eventLoop Event loop the object will be registered in 
 			TcpServer(sys::EventLoop &eventLoop);
 			virtual ~TcpServer();
@@ -55,20 +76,80 @@ namespace hbk {
 			/// @param port TCP port to listen to
 			/// @param backlog Maximum length of the queue of pending connections
 			/// @param acceptCb called when accepting a new tcp client
+			/// @param options applied to each accepted worker socket
 			/// \return -1 on error
-			int start(uint16_t port, int backlog, Cb_t acceptCb);
+			int start(uint16_t port, int backlog, Cb_t acceptCb, const SocketOptions& options = SocketOptions());
 
 			/// Start as unix domain socket server
 			/// @param path path of unix domain socket to listen to
 			/// \param useAbstractNamespace true unix domain socket is in abstract namespace
 			/// @param backlog Maximum length of the queue of pending connections
 			/// @param acceptCb called when accepting a new tcp client
+			/// @param options applied to each accepted worker socket
+			/// \return -1 on error
+			int start(const std::string& path, bool useAbstractNamespace, int backlog, Cb_t acceptCb, const SocketOptions& options = SocketOptions());
+
+#ifndef _WIN32
+			/// Take over a listening socket, i.e. one handed over by another process (see Handoff)
+			/// @param listeningFd Listening socket. Owned by this object afterwards.
+			/// @param acceptCb called when accepting a new tcp client
+			/// @param options applied to each accepted worker socket
 			/// \return -1 on error
-			int start(const std::string& path, bool useAbstractNamespace, int backlog, Cb_t acceptCb);
+			int start(int listeningFd, Cb_t acceptCb, const SocketOptions& options = SocketOptions());
+
+			/// Stop accepting and give up the listening socket without closing it. A unix domain socket path is not unlinked.
+			/// \return the listening socket, -1 if not started
+			int release();
+#endif
 
 			/// Remove this object from the event loop and close the server socket
 			void stop();
 
+			/// Worker sockets created afterwards borrow their receive buffers from this pool.
+			/// Connections handed to the event loop of another CPU (see setCpuEventLoops()) use the pool set when start() was called.
+			/// \param pool Has to outlive all worker sockets
+			void setBufferPool(BufferPool& pool)
+			{
+				m_pBufferPool = &pool;
+			}
+
+#ifndef _WIN32
+			/// Accept by multishot accept of io_uring instead of readiness notification and accept calls.
+			/// Falls back to the event loop if the operation can not be started or ends with an error.
+			/// To be called before start().
+			/// \param uring Has to outlive this object. Has to work with the event loop of this object.
+			void setUring(Uring& uring)
+			{
+				m_pUring = &uring;
+			}
+
+			/// Hand each accepted connection to the event loop of the CPU that processed its packets (SO_INCOMING_CPU).
+			/// With the thread executing eventLoops[n] pinned to CPU n and the NIC queue interrupts spread accordingly,
+			/// each connection is processed on the core its packets arrive on.
+			/// acceptCb is executed by the thread of the chosen event loop then.
+			/// Connections with unknown CPU or a CPU without event loop stay with the event loop of this object.
+			/// To be called before start().
+			/// \param eventLoops Index is the CPU number. May contain nullptr. All event loops have to outlive this object.
+			/// \throws hbk::exception::exception if notifying an event loop is not possible
+			void setCpuEventLoops(const std::vector < sys::EventLoop* >& eventLoops);
+
+			/// \return number of connections handed to an event loop other than the one of this object
+			uint64_t getRedirectedCount() const
+			{
+				return m_redirectedCount;
+			}
+
+			const AcceptStats& getAcceptStats() const
+			{
+				return m_acceptStats;
+			}
+
+			/// Connections dropped because the accept queue of a listening socket was full (ListenOverflows of /proc/net/netstat).
+			/// The kernel counts for all listening sockets of the network namespace.
+			/// \return -1 if not available
+			static int64_t getListenOverflowCount();
+#endif
+
 		private:
 
 			/// should not be copied
@@ -77,8 +158,59 @@ namespace hbk {
 			/// should not be assigned
 			TcpServer& operator= (const TcpServer& op);
 
+#ifndef _WIN32
+			/// apply what is relevant for the listening socket and remember options for the worker sockets
+			void setListenerOptions(const SocketOptions& options);
+
+			/// register the listening socket with uring or the event loop
+			void startAccepting(Cb_t acceptCb);
+
+			/// create the worker socket for an accepted client and call acceptCb
+			/// \param pPeerAddress nullptr if not known, the worker socket queries it then
+			void addWorker(int clientFd, const struct sockaddr* pPeerAddress = nullptr, socklen_t peerAddressLength = 0);
+
+			/// Out of file descriptors: accept one pending connection using the reserve file descriptor and close it.
+			/// Working edge triggered, the backlog would not be processed anymore otherwise.
+			/// \return 0 a connection was closed; -1 nothing accepted
+			int shedConnection();
+
+			/// an accepted connection waiting to be picked up
+			struct PendingClient {
+				int fd;
+				struct sockaddr_storage peerAddress;
+				socklen_t peerAddressLength;
+			};
+
+			/// Accepted connections waiting to be picked up by the event loop of another CPU.
+			/// Holds copies of everything needed for creating the workers, the thread of the target does not access the TcpServer.
+			/// All but eventLoop and notifier are protected by mtx.
+			struct CpuTarget {
+				CpuTarget(sys::EventLoop& eventLoop);
+
+				/// create the workers and call acceptCb. Executed by the event loop of the target.
+				void addWorkers();
+
+				sys::EventLoop& eventLoop;
+				std::mutex mtx;
+				std::vector < PendingClient > clients;
+				/// empty while the server is stopped
+				Cb_t acceptCb;
+				SocketOptions options;
+				bool optionsInherited;
+				BufferPool* pBufferPool;
+				/// Declared last, hence destroyed first. Its destruction waits for a running addWorkers().
+				sys::Notifier notifier;
+			};
+
+			/// hand the current accept callback, options and buffer pool to the targets
+			void updateCpuTargets();
+
+			/// close connections not yet picked up and forget the accept callback
+			void clearCpuTargets();
+#endif
+
 			/// called by eventloop
-			/// accepts a new connection creates new worker socket anf calls acceptCb
+			/// accepts a limited number of new connections, creates new worker sockets and calls acceptCb for each
 			int process();
 
 #ifdef _WIN32
@@ -100,6 +232,21 @@ namespace hbk {
 #endif
 			sys::EventLoop& m_eventLoop;
 			Cb_t m_acceptCb;
+			BufferPool* m_pBufferPool;
+			SocketOptions m_options;
+#ifndef _WIN32
+			Uring* m_pUring;
+			/// id of the multishot accept operation, 0 if none
+			uint64_t m_uringOperation;
+			/// index is the CPU number, nullptr for the event loop of this object. CPUs with the same event loop share the target.
+			std::vector < std::shared_ptr < CpuTarget > > m_cpuTargets;
+			uint64_t m_redirectedCount;
+			/// accepted sockets inherit the options from the listening socket
+			bool m_optionsInherited;
+			AcceptStats m_acceptStats;
+			/// kept open while accepting. Given up for accepting and closing a connection when running out of file descriptors.
+			int m_reserveFd;
+#endif
 
 			/// unix domain socket path.
 			/// Not relevant when using abstract namespace
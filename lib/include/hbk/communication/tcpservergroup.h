@@ -0,0 +1,101 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_TCPSERVERGROUP_H
+#define _HBK__COMMUNICATION_TCPSERVERGROUP_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <linux/filter.h>
+
+#include "hbk/communication/socketoptions.h"
+#include "hbk/communication/tcpserver.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Several listening sockets on the same port (SO_REUSEPORT), one TcpServer per event loop.
+		/// The kernel distributes incoming connections among the listeners, hence connection setup scales with the number of event loops.
+		/// By default the kernel chooses by hash of the connection. A classic BPF program may steer deterministically instead.
+		/// \warning start() and stop() are to be called while the event loops are not executed.
+		class TcpServerGroup {
+		public:
+			/// \param eventLoops One listener per event loop. All have to outlive this object.
+			/// \throw std::invalid_argument if there is no event loop or one is nullptr
+			TcpServerGroup(const std::vector < sys::EventLoop* >& eventLoops);
+
+			TcpServerGroup(const TcpServerGroup& op) = delete;
+			TcpServerGroup& operator= (const TcpServerGroup& op) = delete;
+
+			virtual ~TcpServerGroup();
+
+			/// Start all listeners
+			/// @param port TCP port to listen to. 0 for any free port, see getPort()
+			/// @param backlog Maximum length of the queue of pending connections of each listener
+			/// @param acceptCb Executed by the thread of the event loop whose listener accepted the client
+			/// @param options applied to each accepted worker socket
+			/// \return -1 on error
+			int start(uint16_t port, int backlog, TcpServer::Cb_t acceptCb, const SocketOptions& options = SocketOptions());
+
+			/// Steer each connection to the listener with the index of the CPU that received it.
+			/// Connections received by CPUs without listener are distributed by hash.
+			/// \return 0 success; -1 not started or not supported by the kernel
+			int setCpuSteering();
+
+			/// Attach a classic BPF program (SO_ATTACH_REUSEPORT_CBPF). It returns the index of the listener. Out of range results are distributed by hash.
+			/// \return 0 success; -1 not started or invalid program
+			int setSteeringProgram(const std::vector < struct sock_filter >& program);
+
+			/// stop all listeners
+			void stop();
+
+			/// \return the port listened to, 0 if not started
+			uint16_t getPort() const
+			{
+				return m_port;
+			}
+
+			size_t getListenerCount() const
+			{
+				return m_servers.size();
+			}
+
+			/// i.e. for setting a buffer pool per event loop before start()
+			TcpServer& getServer(size_t index)
+			{
+				return *m_servers[index];
+			}
+
+		private:
+			/// \return the listening socket bound to port with SO_REUSEPORT, -1 on error
+			static int createListener(uint16_t port, int backlog);
+
+			std::vector < std::unique_ptr < TcpServer > > m_servers;
+			/// listening sockets in the order they joined the reuseport group, owned by the servers
+			std::vector < int > m_listeningFds;
+			uint16_t m_port;
+		};
+	}
+}
+#endif
@@ -0,0 +1,118 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_TRANSPORTSTATS_H
+#define _HBK__COMMUNICATION_TRANSPORTSTATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		class SocketNonblocking;
+
+		/// Statistics of a connection.
+		/// Counters of this library tell about the application side, TCP_INFO tells about the network and the peer.
+		struct TransportStats {
+			TransportStats();
+
+			/// when the sample was taken
+			std::chrono::steady_clock::time_point time;
+
+			/// \name counted by this library since the socket was created
+			/// @{
+			uint64_t bytesReceived;
+			uint64_t bytesSent;
+			/// send operations that could not hand over everything to the kernel at once
+			uint64_t partialWrites;
+			/// small writes that were collected and handed over to the kernel together (see SocketNonblocking::setWriteCoalescing())
+			uint64_t coalescedWrites;
+			/// time spent waiting for the socket to become writable while sending blocking
+			std::chrono::microseconds blockedTime;
+			/// @}
+
+			/// bytes not yet acknowledged by the peer plus bytes not yet sent (SIOCOUTQ)
+			uint32_t sendQueueSize;
+			/// bytes received by the kernel not yet read by the application (SIOCINQ)
+			uint32_t receiveQueueSize;
+
+			/// \name from TCP_INFO. Only valid if tcpInfoValid is true. Fields not supported by the running kernel stay 0.
+			/// @{
+			bool tcpInfoValid;
+			/// smoothed round trip time
+			std::chrono::microseconds rtt;
+			std::chrono::microseconds rttVariance;
+			/// total number of retransmitted segments
+			uint32_t retransmits;
+			/// segments considered lost
+			uint32_t lost;
+			/// congestion window in segments
+			uint32_t congestionWindow;
+			/// maximum segment size for sending
+			uint32_t sendMss;
+			/// bytes in the send queue not yet sent
+			uint32_t notSentBytes;
+			/// bytes per second
+			uint64_t deliveryRate;
+			/// bytes per second
+			uint64_t pacingRate;
+			/// time spent sending data
+			std::chrono::microseconds busyTime;
+			/// time the peer did not read fast enough (receive window of the peer was exhausted)
+			std::chrono::microseconds receiveWindowLimitedTime;
+			/// time the local send buffer was exhausted
+			std::chrono::microseconds sendBufferLimitedTime;
+			/// @}
+		};
+
+		/// Periodically samples the transport statistics of a socket using the event loop
+		class TransportStatsSampler {
+		public:
+			/// \param current most recent sample
+			/// \param previous sample before. All values are 0 on the first call.
+			using Cb_t = std::function < void (const TransportStats& current, const TransportStats& previous) >;
+
+			/// \throws hbk::exception
+			TransportStatsSampler(sys::EventLoop& eventLoop);
+
+			TransportStatsSampler(const TransportStatsSampler& op) = delete;
+			TransportStatsSampler& operator= (const TransportStatsSampler& op) = delete;
+
+			/// \param socket Socket to sample. Has to outlive sampling.
+			/// \param period sampling interval
+			/// \param cb called with each sample
+			/// \return -1 on error
+			int start(SocketNonblocking& socket, std::chrono::milliseconds period, Cb_t cb);
+
+			void stop();
+
+		private:
+			sys::Timer m_timer;
+			TransportStats m_previous;
+		};
+	}
+}
+#endif
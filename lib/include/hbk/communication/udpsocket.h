@@ -0,0 +1,143 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_UDPSOCKET_H
+#define _HBK__COMMUNICATION_UDPSOCKET_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: Unicast UDP socket receiving and sending batches of datagrams with one system call (recvmmsg/sendmmsg).
+		/// All message headers, receive buffers and address storage are allocated on construction, receiving and sending do not allocate.
+		class UdpSocket {
+		public:
+			/// called by the event loop on arrival of datagrams. Return the result of receive() in order to be called again while there is more.
+			using DataCb_t = std::function < ssize_t (UdpSocket& socket) >;
+
+			/// A received datagram. Valid until the next call of receive()
+			struct Datagram {
+				/// start of the payload inside the receive buffer of the socket
+				const uint8_t* pData;
+				size_t size;
+				/// the datagram was larger than maxDatagramSize, the rest is lost
+				bool truncated;
+				/// source of the datagram
+				const struct sockaddr* pAddress;
+				socklen_t addressLength;
+			};
+
+			/// \param eventLoop Executes the data callback
+			/// \param batchSize Maximum number of datagrams received or sent with one system call
+			/// \param maxDatagramSize Size of the receive buffer of each datagram
+			/// \throws std::runtime_error on invalid parameters
+			UdpSocket(sys::EventLoop& eventLoop, unsigned int batchSize = 64, size_t maxDatagramSize = 2048);
+			virtual ~UdpSocket();
+
+			UdpSocket(const UdpSocket& op) = delete;
+			UdpSocket& operator= (const UdpSocket& op) = delete;
+
+			/// \param address Local IPv4 or IPv6 address. Empty for all IPv4 interfaces
+			/// \param port 0 for an ephemeral port, i.e. for sending only
+			/// \return 0 success; -1 error
+			int bind(const std::string& address, unsigned int port);
+
+			/// unregister from the event loop and close the socket
+			void close();
+
+			/// \return the local port; 0 if not bound
+			unsigned int getPort() const;
+
+			/// \return the file descriptor; -1 if not bound
+			int getEvent() const
+			{
+				return m_event;
+			}
+
+			void setDataCb(DataCb_t dataCb);
+			void clearDataCb();
+
+			/// Receive up to batchSize datagrams
+			/// \return number of datagrams received, retrieve them with getDatagram(); -1 error (errno is EAGAIN if there is nothing to receive)
+			int receive();
+
+			/// \param index Less than the value returned by the last receive()
+			const Datagram& getDatagram(unsigned int index) const
+			{
+				return m_datagrams[index];
+			}
+
+			/// Add a datagram to the send batch. Nothing is copied, the data and the address have to stay valid until flush() has sent it.
+			/// \return number of datagrams waiting to be sent; -1 the batch is full, call flush() first
+			int queue(const void* pData, size_t size, const struct sockaddr* pAddress, socklen_t addressLength);
+
+			/// Send the queued datagrams. Datagrams not sent because the socket buffer is full stay queued.
+			/// Datagrams that can not be sent at all (i.e. too large) are dropped.
+			/// \return number of datagrams sent; -1 error (errno is EAGAIN if the socket buffer is full)
+			int flush();
+
+			/// \return number of datagrams waiting to be sent
+			unsigned int getQueuedCount() const
+			{
+				return m_queuedCount;
+			}
+
+			/// Send a single datagram immediately
+			/// \return number of bytes sent; -1 error
+			ssize_t sendTo(const void* pData, size_t size, const struct sockaddr* pAddress, socklen_t addressLength);
+
+			/// Fill a socket address to be used as destination
+			/// \param address IPv4 or IPv6 address
+			/// \return 0 success; -1 not a valid address
+			static int makeAddress(const std::string& address, unsigned int port, struct sockaddr_storage& socketAddress, socklen_t& addressLength);
+
+		private:
+			int process();
+
+			sys::EventLoop& m_eventLoop;
+			int m_event;
+			unsigned int m_batchSize;
+			size_t m_maxDatagramSize;
+			DataCb_t m_dataHandler;
+
+			/// one block holding the receive buffers of all datagrams of a batch
+			std::vector < uint8_t > m_receiveBuffer;
+			std::vector < struct sockaddr_storage > m_sourceAddresses;
+			std::vector < struct iovec > m_receiveIovs;
+			std::vector < struct mmsghdr > m_receiveMessages;
+			std::vector < Datagram > m_datagrams;
+
+			std::vector < struct iovec > m_sendIovs;
+			std::vector < struct mmsghdr > m_sendMessages;
+			unsigned int m_queuedCount;
+		};
+	}
+}
+#endif
@@ -0,0 +1,147 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_URING_H
+#define _HBK__COMMUNICATION_URING_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/sys/defines.h"
+#include "hbk/sys/eventloop.h"
+
+struct io_uring_sqe;
+
+namespace hbk {
+	namespace communication {
+		/// Linux only: io_uring instance for multishot receive and multishot accept.
+		/// Received data lands in buffers that were provided to the kernel beforehand (buffer ring).
+		/// There is no readiness notification followed by a system call for each read.
+		/// Completions are signaled by an eventfd that is processed by the event loop.
+		/// Multishot operations stay armed. They are restarted if the kernel ends them while the socket is fine (i.e. no buffer was available).
+		/// \note Requires Linux 6.0 or newer and a library built with HBK_IO_URING. Check isSupported() before.
+		/// Not thread safe, to be used from the thread executing the event loop. Received slices may be released by any thread.
+		class Uring {
+		public:
+			/// \param result Number of bytes received or accepted socket; 0 connection closed (receive); negative errno on error.
+			/// The operation ended if result <= 0 (receive) or result < 0 (accept).
+			/// \param data Received data. The buffer goes back to the kernel when the last slice referencing it is gone.
+			using CompletionCb_t = std::function < void (int result, const BufferSlice& data) >;
+
+			/// \param eventLoop Completions are processed by this event loop
+			/// \param entries Size of the submission queue
+			/// \param bufferCount Number of receive buffers handed to the kernel. Rounded up to the next power of 2.
+			/// \param bufferSize Size of each receive buffer
+			/// \throws hbk::exception
+			Uring(sys::EventLoop& eventLoop, unsigned int entries = 64, unsigned int bufferCount = 256, size_t bufferSize = 16384);
+			virtual ~Uring();
+
+			Uring(const Uring& op) = delete;
+			Uring& operator= (const Uring& op) = delete;
+
+			/// Probes by receiving through a buffer ring once, the result is cached.
+			/// \return true if io_uring with multishot receive and buffer rings is available
+			static bool isSupported();
+
+			/// receive until the connection closes or cancel() is called
+			/// \return id of the operation; 0 on error
+			uint64_t receiveMultishot(int fd, CompletionCb_t completionCb);
+
+			/// accept until an error happens or cancel() is called. result of completionCb is the accepted socket. It is non-blocking and close-on-exec.
+			/// \return id of the operation; 0 on error
+			uint64_t acceptMultishot(int fd, CompletionCb_t completionCb);
+
+			/// The completion callback won't be called anymore.
+			void cancel(uint64_t id);
+
+			/// Replace the completion callback of a pending operation. Completions not yet processed go to the new callback.
+			/// \return 0 success; -1 no such operation
+			int setCompletionCb(uint64_t id, CompletionCb_t completionCb);
+
+			size_t getBufferSize() const;
+
+			/// \return number of buffers currently owned by the kernel
+			unsigned int getProvidedBufferCount() const;
+
+		private:
+			/// buffer memory and buffer ring. Shared with the slices handed out.
+			struct BufferRing;
+
+			struct Operation {
+				uint8_t opcode;
+				int fd;
+				CompletionCb_t completionCb;
+			};
+
+			/// called by the event loop when completions are available
+			int process();
+
+			/// submit the sqe for the operation
+			int arm(uint64_t id, const Operation& operation);
+
+			/// \return nullptr if the submission queue is full even after submitting
+			io_uring_sqe* getSqe();
+
+			/// hand prepared sqes to the kernel
+			int submit();
+
+			/// unmap and close everything, used on destruction and on failing construction
+			void release();
+
+			sys::EventLoop& m_eventLoop;
+			int m_ringFd;
+			int m_eventFd;
+
+			void* m_pSqRing;
+			size_t m_sqRingSize;
+			void* m_pCqRing;
+			size_t m_cqRingSize;
+			io_uring_sqe* m_pSqes;
+			size_t m_sqesSize;
+
+			unsigned int* m_pSqHead;
+			unsigned int* m_pSqTail;
+			unsigned int m_sqMask;
+			unsigned int m_sqEntries;
+			unsigned int* m_pSqArray;
+			/// sqes prepared but not yet submitted
+			unsigned int m_sqPending;
+
+			unsigned int* m_pCqHead;
+			unsigned int* m_pCqTail;
+			unsigned int m_cqMask;
+			void* m_pCqes;
+
+			std::shared_ptr < BufferRing > m_bufferRing;
+
+			uint64_t m_nextId;
+			std::unordered_map < uint64_t, Operation > m_operations;
+			/// receive operations waiting for buffers
+			std::vector < uint64_t > m_starved;
+		};
+	}
+}
+#endif
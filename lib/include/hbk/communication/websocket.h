@@ -0,0 +1,215 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _HBK__COMMUNICATION_WEBSOCKET_H
+#define _HBK__COMMUNICATION_WEBSOCKET_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef ssize_t
+#define ssize_t int
+#endif
+#else
+#include <sys/types.h>
+#endif
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		/// WebSocket (RFC 6455) on top of SocketNonblocking. Does the opening handshake, fragmentation, ping/pong and the closing handshake.
+		/// Server side: Construct with a connection accepted by TcpServer and start(). Client side: Construct with an event loop and connect().
+		/// Payload is (un)masked using SIMD instructions (AVX2, SSE2 or NEON) if supported by the CPU.
+		/// Received frames are unmasked in place and delivered as slices of the receive blocks. Fragmented messages are reassembled.
+		/// Text messages and close reasons that are not valid UTF-8 are answered by closing with CLOSE_INVALID_PAYLOAD.
+		/// Masking keys and Sec-WebSocket-Key are taken from the random source of the system. Extensions and subprotocols are not supported.
+		/// \warning not thread safe. Not to be destroyed from within its callbacks.
+		class WebSocket {
+		public:
+			enum Opcode {
+				OPCODE_CONTINUATION = 0x0,
+				OPCODE_TEXT = 0x1,
+				OPCODE_BINARY = 0x2,
+				OPCODE_CLOSE = 0x8,
+				OPCODE_PING = 0x9,
+				OPCODE_PONG = 0xa
+			};
+
+			/// some status codes of the closing handshake
+			static const uint16_t CLOSE_NORMAL = 1000;
+			static const uint16_t CLOSE_GOING_AWAY = 1001;
+			static const uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+			/// not sent, reported if the close frame of the peer carried no status code
+			static const uint16_t CLOSE_NO_STATUS = 1005;
+			/// not sent, reported if the connection was lost without closing handshake
+			static const uint16_t CLOSE_ABNORMAL = 1006;
+			/// text message or close reason is not valid UTF-8
+			static const uint16_t CLOSE_INVALID_PAYLOAD = 1007;
+			static const uint16_t CLOSE_TOO_BIG = 1009;
+
+			/// \param opcode OPCODE_TEXT, OPCODE_BINARY or OPCODE_PONG
+			/// \param payload Complete message. The slice may be kept, it keeps the memory alive.
+			using MessageCb_t = std::function < void (WebSocket& webSocket, Opcode opcode, const BufferSlice& payload) >;
+			/// called when the opening handshake succeeded
+			using OpenCb_t = std::function < void (WebSocket& webSocket) >;
+			/// called when the connection is closed. The socket is disconnected already.
+			/// \param code status code sent by the peer or CLOSE_ABNORMAL
+			using CloseCb_t = std::function < void (WebSocket& webSocket, uint16_t code) >;
+
+			/// Server side: Takes over a connection accepted by TcpServer. Set the callbacks and call start() afterwards.
+			/// \param pool Receive blocks and reassembled messages are taken from this pool. It has to outlive this object.
+			WebSocket(clientSocket_t socket, BufferPool& pool = BufferPool::defaultPool());
+
+			/// Client side: Use connect() afterwards.
+			WebSocket(sys::EventLoop& eventLoop, BufferPool& pool = BufferPool::defaultPool());
+
+			WebSocket(const WebSocket& op) = delete;
+			WebSocket& operator= (const WebSocket& op) = delete;
+
+			virtual ~WebSocket();
+
+			/// Server side: Process the opening handshake of the client. Data that arrived before is processed immediately.
+			/// \return 0 success; -1 not a server side object that is waiting for the handshake
+			int start();
+
+			/// Client side: Connect (blocking) and send the opening handshake. The open callback is called when the server accepted.
+			/// \param path Resource requested
+			/// \param host Value of the host header field, address is used if empty
+			/// \return 0 handshake sent; -1 error
+			int connect(const std::string& address, const std::string& port, const std::string& path = "/", const std::string& host = "");
+
+			void setMessageCb(MessageCb_t messageCb);
+			void setOpenCb(OpenCb_t openCb);
+			void setCloseCb(CloseCb_t closeCb);
+
+			/// Send one frame. A message may be sent in several fragments: The first one carries the opcode and fin=false,
+			/// further ones OPCODE_CONTINUATION. The last one fin=true. Control frames may be sent in between.
+			/// Frames sent by the client side are masked, the payload is copied for this.
+			/// \warning waits until the frame is processed or an error happened, hence it might block the eventloop if called from within a callback function
+			/// \return size of the payload or -1 on error (errno is ENOTCONN if the connection is not open)
+			ssize_t send(Opcode opcode, const void* pData, size_t size, bool fin = true);
+
+			/// send a complete text message (i.e. a JSON-RPC request)
+			ssize_t sendText(const std::string& text);
+
+			/// send a complete binary message
+			ssize_t sendBinary(const void* pData, size_t size);
+
+			/// the peer answers with a pong carrying the same payload. Not more than 125 bytes.
+			ssize_t ping(const void* pData = nullptr, size_t size = 0);
+
+			/// Start the closing handshake. The connection is closed when the peer answers.
+			/// \return 0 success; -1 not open
+			int close(uint16_t code = CLOSE_NORMAL, const std::string& reason = "");
+
+			/// \return true after the opening handshake and before the closing handshake was started
+			bool isOpen() const
+			{
+				return m_state==STATE_OPEN;
+			}
+
+			/// Larger messages are answered by closing with CLOSE_TOO_BIG. Default is 16MiB.
+			void setMaxMessageSize(size_t maxMessageSize)
+			{
+				m_maxMessageSize = maxMessageSize;
+			}
+
+			SocketNonblocking& getSocket()
+			{
+				return *m_socket;
+			}
+
+			/// XOR size bytes from pSource with the masking key. pSource may be pDestination.
+			/// \param key the 4 byte masking key, rotated to fit the position of pSource inside the payload
+			static void mask(uint8_t* pDestination, const uint8_t* pSource, size_t size, const uint8_t key[4]);
+
+			/// \return name of the instruction set used by mask(): "avx2", "sse2", "neon" or "scalar"
+			static const char* getMaskerName();
+
+			/// \return value of Sec-WebSocket-Accept answering to Sec-WebSocket-Key
+			static std::string acceptKey(const std::string& key);
+
+			/// \return true if the data is valid UTF-8 (no overlong forms, no surrogates, nothing above U+10FFFF)
+			static bool isValidUtf8(const uint8_t* pData, size_t size);
+
+		private:
+			enum State {
+				STATE_HANDSHAKE,
+				STATE_OPEN,
+				STATE_CLOSING,
+				STATE_CLOSED
+			};
+
+			/// data callback of the socket
+			ssize_t receive(SocketNonblocking& socket);
+
+			/// Feed received data. Handshake and all complete frames are processed.
+			/// \return -1 if the connection was closed, the close callback was called already
+			int process(BufferChain&& data);
+
+			/// \return 1 handshake complete; 0 waiting for more; -1 failed, the connection was closed
+			int processHandshake();
+
+			/// \return -1 if the connection was closed
+			int processFrame(bool fin, uint8_t opcode, const BufferSlice& payload);
+
+			ssize_t sendFrame(uint8_t opcode, const void* pData, size_t size, bool fin);
+
+			/// send a close frame, if possible, and close the connection
+			/// \return -1, the close callback was called
+			int fail(uint16_t code);
+
+			/// disconnect and call the close callback. Has to be the last thing to do.
+			void shutdown(uint16_t code);
+
+			clientSocket_t m_socket;
+			BufferPool& m_pool;
+			bool m_client;
+			State m_state;
+			size_t m_maxMessageSize;
+
+			MessageCb_t m_messageCb;
+			OpenCb_t m_openCb;
+			CloseCb_t m_closeCb;
+
+			/// received data not processed yet
+			BufferChain m_pending;
+			/// fragments of an incomplete message
+			BufferChain m_fragments;
+			/// opcode of the incomplete message
+			uint8_t m_fragmentOpcode;
+
+			/// client side: Sec-WebSocket-Key sent with the opening handshake
+			std::string m_key;
+			/// client side: masked copy of the payload
+			std::vector < uint8_t > m_sendBuffer;
+		};
+	}
+}
+#endif
@@ -33,6 +33,8 @@
 #endif
 #include <functional>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 #include "hbk/exception/exception.hpp"
 #include "hbk/sys/defines.h"
@@ -42,6 +44,9 @@ namespace hbk {
 		/// The event loop is not responsible for handling errors returned by any callback routine. Error handling is to be done by the callback routine itself.
 		class EventLoop {
 		public:
+			/// called once after all events of the current iteration were processed
+			using IterationEndHandler_t = std::function < void () >;
+
 			/// \throws hbk::exception
 			EventLoop();
 
@@ -72,6 +77,15 @@ namespace hbk {
 			int eraseOutEvent(event fd);
 #endif
 
+			/// Defer work until all events of the current iteration were processed. Used to combine work triggered by several events (i.e. sending).
+			/// A handler registered before for the same key is replaced.
+			/// \param pKey identifies the handler
+			/// \return 0 success; -1 not called from within an event callback of this event loop. In this case the caller should do the work immediately.
+			int addIterationEndHandler(const void* pKey, const IterationEndHandler_t& handler);
+
+			/// remove a pending handler
+			void eraseIterationEndHandler(const void* pKey);
+
 			/// \return 0 stopped; -1 error
 			int execute();
 
@@ -109,9 +123,16 @@ namespace hbk {
 			int m_epollfd;
 			event m_stopFd;
 #endif
+			/// call all handlers registered with addIterationEndHandler()
+			/// \warning m_eventInfosMtx is to be locked by the caller
+			void processIterationEnd();
+
 			/// protects access on events structures
 			std::recursive_mutex m_eventInfosMtx;
 			eventInfos_t m_eventInfos;
+			/// true while event callbacks are being executed
+			bool m_dispatching;
+			std::vector < std::pair < const void*, IterationEndHandler_t > > m_iterationEndHandlers;
 		};
 	}
 }
@@ -22,6 +22,7 @@ namespace hbk {
 			: m_eventCount(0)
 			, m_epollfd(epoll_create(1)) // parameter is ignored but must be greater than 0
 			, m_stopFd(eventfd(0, EFD_NONBLOCK))
+			, m_dispatching(false)
 		{
 			if (m_epollfd==-1) {
 				throw hbk::exception::exception(std::string("epoll_create failed ") + strerror(errno));
@@ -230,6 +231,51 @@ namespace hbk {
 			return ret;
 		}
 		
+		int EventLoop::addIterationEndHandler(const void* pKey, const IterationEndHandler_t& handler)
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_eventInfosMtx);
+			if (!m_dispatching) {
+				return -1;
+			}
+			for (auto &iter: m_iterationEndHandlers) {
+				if (iter.first==pKey) {
+					iter.second = handler;
+					return 0;
+				}
+			}
+			m_iterationEndHandlers.emplace_back(pKey, handler);
+			return 0;
+		}
+
+		void EventLoop::eraseIterationEndHandler(const void* pKey)
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_eventInfosMtx);
+			for (auto iter = m_iterationEndHandlers.begin(); iter!=m_iterationEndHandlers.end(); ++iter) {
+				if (iter->first==pKey) {
+					m_iterationEndHandlers.erase(iter);
+					return;
+				}
+			}
+		}
+
+		void EventLoop::processIterationEnd()
+		{
+			// handlers adding handlers are told to do the work immediately
+			m_dispatching = false;
+			while (!m_iterationEndHandlers.empty()) {
+				std::pair < const void*, IterationEndHandler_t > item = std::move(m_iterationEndHandlers.front());
+				// erase before calling. The handler may remove other handlers.
+				m_iterationEndHandlers.erase(m_iterationEndHandlers.begin());
+				try {
+					item.second();
+				} catch (const std::exception& e) {
+					syslog(LOG_ERR, "Event loop caught exception from iteration end callback method: '%s'", e.what());
+				} catch (...) {
+					syslog(LOG_ERR, "Event loop caught exception from iteration end callback method");
+				}
+			}
+		}
+
 		int EventLoop::execute()
 		{
 			ssize_t result;
@@ -248,6 +294,7 @@ namespace hbk {
 
 				{
 					std::lock_guard < std::recursive_mutex > lock(m_eventInfosMtx);
+					m_dispatching = true;
 					// We are working edge triggered, hence we need to process everything that is available for each event.
 					// To be fair, the callback of each signaled event is called only once.
 					// After all the callbacks of all signaled events were called, we start from the beginning until no signaled event is left.
@@ -294,10 +341,13 @@ namespace hbk {
 							} else {
 								// We are working edge triggered. Reading away the event is not necessary.
 								// Stop eventloop notification!
+								// Work deferred by the events processed so far is not to be lost
+								processIterationEnd();
 								return 0;
 							}
 						}
 					} while (eventsLeft);
+					processIterationEnd();
 				}
 			}
 		}
@@ -25,7 +25,9 @@
 #include <Windows.h>
 #define ssize_t int
 #include <chrono>
+#include <exception>
 #include <mutex>
+#include <string>
 
 #include "hbk/sys/eventloop.h"
 
@@ -39,6 +41,7 @@ namespace hbk {
 		EventLoop::EventLoop()
 			: m_completionPort(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1))
 			, m_hEventLog(RegisterEventSource(nullptr, reinterpret_cast < LPSTRINGTYPE > ("Application")))
+			, m_dispatching(false)
 		{
 		}
 
@@ -94,6 +97,54 @@ namespace hbk {
 			return 0;
 		}
 
+		int EventLoop::addIterationEndHandler(const void* pKey, const IterationEndHandler_t& handler)
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_eventInfosMtx);
+			if (!m_dispatching) {
+				return -1;
+			}
+			for (auto &iter: m_iterationEndHandlers) {
+				if (iter.first==pKey) {
+					iter.second = handler;
+					return 0;
+				}
+			}
+			m_iterationEndHandlers.emplace_back(pKey, handler);
+			return 0;
+		}
+
+		void EventLoop::eraseIterationEndHandler(const void* pKey)
+		{
+			std::lock_guard < std::recursive_mutex > lock(m_eventInfosMtx);
+			for (auto iter = m_iterationEndHandlers.begin(); iter!=m_iterationEndHandlers.end(); ++iter) {
+				if (iter->first==pKey) {
+					m_iterationEndHandlers.erase(iter);
+					return;
+				}
+			}
+		}
+
+		void EventLoop::processIterationEnd()
+		{
+			// handlers adding handlers are told to do the work immediately
+			m_dispatching = false;
+			while (!m_iterationEndHandlers.empty()) {
+				std::pair < const void*, IterationEndHandler_t > item = std::move(m_iterationEndHandlers.front());
+				// erase before calling. The handler may remove other handlers.
+				m_iterationEndHandlers.erase(m_iterationEndHandlers.begin());
+				try {
+					item.second();
+				} catch (const std::exception& e) {
+					std::string message = std::string("Event loop caught exception from iteration end callback method: '") + e.what() + "'";
+					LPCSTR messages = message.c_str();
+					ReportEvent(m_hEventLog, EVENTLOG_ERROR_TYPE, 0, 0, nullptr, 1, 0, reinterpret_cast < LPSTRINGTYPE* > (&messages), nullptr);
+				} catch (...) {
+					LPCSTR messages = "Event loop caught exception from iteration end callback method";
+					ReportEvent(m_hEventLog, EVENTLOG_ERROR_TYPE, 0, 0, nullptr, 1, 0, reinterpret_cast < LPSTRINGTYPE* > (&messages), nullptr);
+				}
+			}
+		}
+
 		int EventLoop::execute()
 		{
 			BOOL result;
@@ -158,13 +209,15 @@ namespace hbk {
 						return 0;
 					}
 
+					std::lock_guard < std::recursive_mutex > lock(m_eventInfosMtx);
+					m_dispatching = true;
 					do {
-						std::lock_guard < std::recursive_mutex > lock(m_eventInfosMtx);
 						eventInfos_t::iterator iter = m_eventInfos.find(event);
 						if (iter != m_eventInfos.end()) {
 							retval = iter->second();
 						}
 					} while (retval > 0);
+					processIterationEnd();
 //					}
 				}
 			} while (true);
@@ -0,0 +1,156 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/broadcaster.h"
+#include "hbk/communication/bufferpool.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			/// subscriber sockets connected to peers that are read by the test
+			struct Subscribers {
+				Subscribers(sys::EventLoop& eventLoop, size_t count)
+				{
+					for (size_t i = 0; i<count; ++i) {
+						int fds[2];
+						if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)<0) {
+							throw std::runtime_error("socketpair failed");
+						}
+						sockets.emplace_back(new SocketNonblocking(fds[0], eventLoop));
+						peers.push_back(fds[1]);
+					}
+				}
+
+				~Subscribers()
+				{
+					for (auto &iter: peers) {
+						::close(iter);
+					}
+				}
+
+				std::vector < std::unique_ptr < SocketNonblocking > > sockets;
+				std::vector < int > peers;
+			};
+
+			TEST(broadcaster, fan_out)
+			{
+				static const char message[] = "measurement block";
+				static const size_t subscriberCount = 5;
+				sys::EventLoop eventLoop;
+				Subscribers subscribers(eventLoop, subscriberCount);
+				Broadcaster broadcaster;
+				for (auto &iter: subscribers.sockets) {
+					ASSERT_EQ(broadcaster.add(*iter), 0);
+				}
+				ASSERT_EQ(broadcaster.add(*subscribers.sockets.front()), -1);
+				ASSERT_EQ(broadcaster.getSubscriberCount(), subscriberCount);
+
+				BufferPool pool(64, 1);
+				{
+					BufferPool::Buffer_t buffer = pool.get();
+					memcpy(buffer.get(), message, sizeof(message));
+					ssize_t result = broadcaster.broadcast(BufferSlice(buffer, buffer.get(), sizeof(message)));
+					ASSERT_EQ(result, static_cast < ssize_t > (subscriberCount));
+				}
+				// everything was sent, nobody references the block anymore
+				ASSERT_EQ(pool.getCachedCount(), 1u);
+
+				ASSERT_EQ(broadcaster.broadcast(BufferSlice()), -1);
+
+				for (auto &iter: subscribers.peers) {
+					char buffer[sizeof(message)];
+					ASSERT_EQ(::recv(iter, buffer, sizeof(buffer), 0), static_cast < ssize_t > (sizeof(message)));
+					ASSERT_STREQ(buffer, message);
+				}
+
+				ASSERT_EQ(broadcaster.remove(*subscribers.sockets.back()), 0);
+				ASSERT_EQ(broadcaster.remove(*subscribers.sockets.back()), -1);
+				ASSERT_EQ(broadcaster.broadcast(message, sizeof(message)), static_cast < ssize_t > (subscriberCount-1));
+				ASSERT_EQ(broadcaster.getSkippedCount(), 0u);
+			}
+
+			TEST(broadcaster, skip_slow)
+			{
+				static const size_t blockSize = 65536;
+				static const size_t maxQueuedBytes = 4*blockSize;
+				sys::EventLoop eventLoop;
+				Subscribers subscribers(eventLoop, 2);
+				Broadcaster broadcaster(Broadcaster::SKIP, maxQueuedBytes);
+				for (auto &iter: subscribers.sockets) {
+					broadcaster.add(*iter);
+				}
+
+				// peers do not read
+				std::vector < uint8_t > block(blockSize);
+				for (unsigned int i = 0; i<100; ++i) {
+					broadcaster.broadcast(block.data(), block.size());
+				}
+				ASSERT_GT(broadcaster.getSkippedCount(), 0u);
+				ASSERT_EQ(broadcaster.getSubscriberCount(), 2u);
+				for (auto &iter: subscribers.sockets) {
+					ASSERT_GT(iter->getQueuedBytes(), 0u);
+					ASSERT_LT(iter->getQueuedBytes(), maxQueuedBytes+blockSize);
+				}
+			}
+
+			TEST(broadcaster, drop_slow)
+			{
+				static const size_t blockSize = 65536;
+				sys::EventLoop eventLoop;
+				Subscribers subscribers(eventLoop, 2);
+				std::vector < SocketNonblocking* > dropped;
+				Broadcaster broadcaster(Broadcaster::DROP, 0, [&dropped](SocketNonblocking& socket)
+				{
+					dropped.push_back(&socket);
+					socket.disconnect();
+				});
+				for (auto &iter: subscribers.sockets) {
+					// slow is decided by the watermarks of the subscriber
+					ASSERT_EQ(iter->setWatermarks(blockSize, 4*blockSize, SocketNonblocking::WatermarkCb_t()), 0);
+					broadcaster.add(*iter);
+				}
+
+				std::vector < uint8_t > block(blockSize);
+				for (unsigned int i = 0; i<100; ++i) {
+					broadcaster.broadcast(block.data(), block.size());
+				}
+				ASSERT_EQ(broadcaster.getSubscriberCount(), 0u);
+				ASSERT_EQ(broadcaster.getDroppedCount(), 2u);
+				ASSERT_EQ(dropped.size(), 2u);
+				ASSERT_EQ(broadcaster.broadcast(block.data(), block.size()), 0);
+			}
+		}
+	}
+}
@@ -0,0 +1,229 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferedreader.h"
+#include "hbk/communication/bufferpool.h"
+
+#include "bufferchain_test.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			TEST(bufferpool, reuse)
+			{
+				static const size_t bufferSize = 128;
+				static const size_t maxCached = 2;
+				BufferPool pool(bufferSize, maxCached);
+				ASSERT_EQ(pool.getBufferSize(), bufferSize);
+				ASSERT_EQ(pool.getCachedCount(), 0u);
+
+				uint8_t* pFirst;
+				{
+					BufferPool::Buffer_t buffer = pool.get();
+					pFirst = buffer.get();
+				}
+				// released block is kept for reuse
+				ASSERT_EQ(pool.getCachedCount(), 1u);
+				BufferPool::Buffer_t buffer = pool.get();
+				ASSERT_EQ(buffer.get(), pFirst);
+				ASSERT_EQ(pool.getCachedCount(), 0u);
+
+				uint8_t* pBlocks[4];
+				for (auto &iter: pBlocks) {
+					iter = pool.acquire();
+				}
+				for (auto &iter: pBlocks) {
+					pool.release(iter);
+				}
+				// not more than maxCached are kept
+				ASSERT_EQ(pool.getCachedCount(), maxCached);
+			}
+
+			TEST(bufferpool, block_outlives_pool)
+			{
+				BufferPool::Buffer_t buffer;
+				{
+					BufferPool pool(16);
+					buffer = pool.get();
+				}
+				buffer.get()[0] = 42;
+				ASSERT_EQ(buffer.get()[0], 42);
+			}
+
+			TEST(bufferpool, slabs)
+			{
+				static const size_t bufferSize = 4096;
+				BufferPool pool(bufferSize, 0, true);
+				ASSERT_TRUE(pool.usesSlabs());
+
+				uint8_t* pFirst = pool.acquire();
+				ASSERT_NE(pFirst, nullptr);
+				pFirst[bufferSize-1] = 42;
+				// the rest of the slab is waiting for reuse
+				size_t cachedCount = pool.getCachedCount();
+				ASSERT_GT(cachedCount, 0u);
+
+				// slab blocks always go back to the free list
+				pool.release(pFirst);
+				ASSERT_EQ(pool.getCachedCount(), cachedCount+1);
+			}
+
+#ifndef _WIN32
+			TEST(bufferedreader, borrow_while_pending)
+			{
+				static const char message[] = "0123456789";
+				BufferPool pool(64, 4);
+				BufferedReader reader(pool);
+				int fds[2];
+				ASSERT_EQ(pipe2(fds, O_NONBLOCK), 0);
+				sys::event readEvent = fds[0];
+
+				char buffer[sizeof(message)] = "";
+				ssize_t result = reader.recv(readEvent, buffer, 4);
+				ASSERT_EQ(result, -1);
+				// nothing pending, nothing borrowed
+				ASSERT_EQ(pool.getCachedCount(), 1u);
+
+				ASSERT_EQ(write(fds[1], message, 10), 10);
+				result = reader.recv(readEvent, buffer, 4);
+				ASSERT_EQ(result, 4);
+				ASSERT_EQ(reader.getBufferedCount(), 6u);
+				// buffer is borrowed while data is pending
+				ASSERT_EQ(pool.getCachedCount(), 0u);
+
+				// rest is delivered even if there is nothing more to read
+				result = reader.recv(readEvent, buffer+4, 8);
+				ASSERT_EQ(result, 6);
+				ASSERT_EQ(std::string(buffer, 10), message);
+				ASSERT_EQ(reader.getBufferedCount(), 0u);
+				ASSERT_EQ(pool.getCachedCount(), 1u);
+
+				// buffer is kept until a read finds nothing more to read, not given back per delivery
+				ASSERT_EQ(write(fds[1], message, 10), 10);
+				result = reader.recv(readEvent, buffer, 4);
+				ASSERT_EQ(result, 4);
+				result = reader.recv(readEvent, buffer+4, 6);
+				ASSERT_EQ(result, 6);
+				ASSERT_EQ(reader.getBufferedCount(), 0u);
+				ASSERT_EQ(pool.getCachedCount(), 0u);
+				result = reader.recv(readEvent, buffer, 4);
+				ASSERT_EQ(result, -1);
+				ASSERT_EQ(pool.getCachedCount(), 1u);
+
+				// moved reader takes the borrowed buffer with it
+				ASSERT_EQ(write(fds[1], message, 10), 10);
+				result = reader.recv(readEvent, buffer, 2);
+				ASSERT_EQ(result, 2);
+				BufferedReader other(std::move(reader));
+				ASSERT_EQ(reader.getBufferedCount(), 0u);
+				ASSERT_EQ(other.getBufferedCount(), 8u);
+				result = other.recv(readEvent, buffer, sizeof(buffer));
+				ASSERT_EQ(result, 8);
+				ASSERT_EQ(std::string(buffer, 8), "23456789");
+				ASSERT_EQ(pool.getCachedCount(), 1u);
+
+				close(fds[0]);
+				close(fds[1]);
+			}
+
+			TEST(bufferedreader, chain_block_given_back_when_idle)
+			{
+				static const char message[] = "0123456789";
+				BufferPool pool(64, 4);
+				BufferedReader reader(pool);
+				int fds[2];
+				ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+				sys::event readEvent = fds[0];
+
+				BufferChain chain;
+				ASSERT_EQ(write(fds[1], message, 10), 10);
+				ASSERT_EQ(reader.recv(readEvent, chain), 10);
+				ASSERT_EQ(reader.recv(readEvent, chain), -1);
+				// the slice still references the block
+				ASSERT_EQ(pool.getCachedCount(), 0u);
+
+				chain.clear();
+				ASSERT_EQ(reader.recv(readEvent, chain), -1);
+				// nothing references the block, the drained socket does not keep it
+				ASSERT_EQ(pool.getCachedCount(), 1u);
+
+				close(fds[0]);
+				close(fds[1]);
+			}
+#endif
+
+			TEST(bufferchain, consume_and_split)
+			{
+				BufferPool pool(64);
+				BufferChain chain;
+				ASSERT_TRUE(chain.empty());
+
+				chain.append(makeSlice(pool, "hello "));
+				chain.append(makeSlice(pool, "world"));
+				chain.append(BufferSlice());
+				ASSERT_EQ(chain.size(), 11u);
+				ASSERT_EQ(chain.getSlices().size(), 2u);
+				ASSERT_EQ(chain.at(6), 'w');
+
+				char text[32] = "";
+				size_t copied = chain.copyOut(4, text, 4);
+				ASSERT_EQ(copied, 4u);
+				ASSERT_EQ(std::string(text, copied), "o wo");
+
+				BufferChain head = chain.split(8);
+				ASSERT_EQ(head.size(), 8u);
+				ASSERT_EQ(head.getSlices().size(), 2u);
+				ASSERT_EQ(chain.size(), 3u);
+				copied = chain.copyOut(0, text, sizeof(text));
+				ASSERT_EQ(std::string(text, copied), "rld");
+
+				// split does not copy: the second slice of head and the remaining slice share the block
+				ASSERT_EQ(head.getSlices().back().buffer, chain.getSlices().front().buffer);
+
+				head.consume(7);
+				ASSERT_EQ(head.size(), 1u);
+				ASSERT_EQ(head.at(0), 'o');
+
+				chain.append(std::move(head));
+				ASSERT_EQ(chain.size(), 4u);
+				ASSERT_TRUE(head.empty());
+
+				chain.clear();
+				ASSERT_TRUE(chain.empty());
+				// all blocks went back to the pool
+				ASSERT_EQ(pool.getCachedCount(), 2u);
+			}
+		}
+	}
+}
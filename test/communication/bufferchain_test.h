@@ -0,0 +1,54 @@
+// This code is licenced under the MIT license:
+//
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __HBK__COMMUNICATION_BUFFERCHAINTEST_H
+#define __HBK__COMMUNICATION_BUFFERCHAINTEST_H
+
+#include <cstring>
+#include <string>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
+
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			/// \return a block of the pool holding content
+			inline BufferSlice makeSlice(BufferPool& pool, const std::string& content)
+			{
+				BufferPool::Buffer_t buffer = pool.get();
+				memcpy(buffer.get(), content.c_str(), content.length());
+				return BufferSlice(buffer, buffer.get(), content.length());
+			}
+
+			/// \return a chain with a single block holding content
+			inline BufferChain makeChain(BufferPool& pool, const std::string& content)
+			{
+				BufferChain chain;
+				chain.append(makeSlice(pool, content));
+				return chain;
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,209 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/connectionpool.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/tcpserver.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			static const std::string port = "22228";
+
+			/// echo server running its own event loop
+			class EchoServer {
+			public:
+				EchoServer()
+					: m_eventLoop()
+					, m_server(m_eventLoop)
+				{
+					if (m_server.start(static_cast < uint16_t > (std::stoi(port)), 8, std::bind(&EchoServer::acceptCb, this, std::placeholders::_1))<0) {
+						throw std::runtime_error("could not start tcp server");
+					}
+					m_thread = std::thread(std::bind(&sys::EventLoop::execute, std::ref(m_eventLoop)));
+				}
+
+				~EchoServer()
+				{
+					m_eventLoop.stop();
+					m_thread.join();
+				}
+
+				/// close all worker sockets from within the event loop
+				void closeAll()
+				{
+					std::lock_guard < std::mutex > lock(m_mtx);
+					m_workers.clear();
+				}
+
+				size_t getWorkerCount() const
+				{
+					std::lock_guard < std::mutex > lock(m_mtx);
+					return m_workers.size();
+				}
+
+			private:
+				void acceptCb(clientSocket_t worker)
+				{
+					std::lock_guard < std::mutex > lock(m_mtx);
+					SocketNonblocking* pWorker = worker.get();
+					m_workers[pWorker] = std::move(worker);
+					pWorker->setDataCb([this](SocketNonblocking& socket) -> ssize_t {
+						char buffer[256];
+						ssize_t result = socket.receive(buffer, sizeof(buffer));
+						if (result>0) {
+							socket.sendBlock(buffer, static_cast < size_t > (result), false);
+						}
+						return result;
+					});
+				}
+
+				sys::EventLoop m_eventLoop;
+				TcpServer m_server;
+				std::thread m_thread;
+				mutable std::mutex m_mtx;
+				std::map < SocketNonblocking*, clientSocket_t > m_workers;
+			};
+
+			static void exchange(SocketNonblocking& socket)
+			{
+				char buffer[5];
+				ASSERT_EQ(socket.sendBlock("hello", 5, false), 5);
+				ASSERT_EQ(socket.receiveComplete(buffer, sizeof(buffer), 1000), 5);
+				ASSERT_EQ(std::string(buffer, 5), "hello");
+			}
+
+			TEST(connectionpool, reuse)
+			{
+				EchoServer server;
+				sys::EventLoop eventLoop;
+				ConnectionPool pool(eventLoop, 2);
+
+				clientSocket_t socket = pool.checkout("127.0.0.1", port);
+				ASSERT_TRUE(socket);
+				exchange(*socket);
+				ASSERT_EQ(pool.checkin(std::move(socket)), 0);
+				ASSERT_EQ(pool.getIdleCount(), 1u);
+
+				// the warm connection is handed out again
+				socket = pool.checkout("127.0.0.1", port);
+				ASSERT_TRUE(socket);
+				exchange(*socket);
+				ASSERT_EQ(pool.getConnectCount(), 1u);
+				ASSERT_EQ(pool.getReuseCount(), 1u);
+				ASSERT_EQ(pool.getIdleCount(), 0u);
+
+				// per endpoint limit
+				clientSocket_t second = pool.checkout("127.0.0.1", port);
+				ASSERT_TRUE(second);
+				clientSocket_t third = pool.checkout("127.0.0.1", port);
+				ASSERT_FALSE(third);
+				ASSERT_EQ(errno, EBUSY);
+
+				// not reusable, frees the slot
+				ASSERT_EQ(pool.checkin(std::move(second), false), -1);
+				third = pool.checkout("127.0.0.1", port);
+				ASSERT_TRUE(third);
+				ASSERT_EQ(pool.getConnectCount(), 3u);
+
+				ASSERT_EQ(pool.checkin(std::move(socket)), 0);
+				ASSERT_EQ(pool.checkin(std::move(third)), 0);
+				ASSERT_EQ(pool.getIdleCount(), 2u);
+				pool.clear();
+				ASSERT_EQ(pool.getIdleCount(), 0u);
+
+				// not from this pool
+				clientSocket_t foreign(new SocketNonblocking(eventLoop));
+				ASSERT_EQ(pool.checkin(std::move(foreign)), -1);
+			}
+
+			TEST(connectionpool, closed_by_peer)
+			{
+				EchoServer server;
+				sys::EventLoop eventLoop;
+				ConnectionPool pool(eventLoop);
+
+				clientSocket_t socket = pool.checkout("127.0.0.1", port);
+				ASSERT_TRUE(socket);
+				exchange(*socket);
+				ASSERT_EQ(pool.checkin(std::move(socket)), 0);
+
+				for (unsigned int i = 0; (i<100) && (server.getWorkerCount()==0); ++i) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				}
+				server.closeAll();
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+				// the dead connection is detected on checkout and replaced
+				socket = pool.checkout("127.0.0.1", port);
+				ASSERT_TRUE(socket);
+				exchange(*socket);
+				ASSERT_EQ(pool.getEvictedCount(), 1u);
+				ASSERT_EQ(pool.getReuseCount(), 0u);
+				ASSERT_EQ(pool.getConnectCount(), 2u);
+			}
+
+			TEST(connectionpool, idle_timeout)
+			{
+				EchoServer server;
+				sys::EventLoop eventLoop;
+				ConnectionPool pool(eventLoop, 8, std::chrono::milliseconds(20));
+
+				clientSocket_t socket = pool.checkout("127.0.0.1", port);
+				ASSERT_TRUE(socket);
+				ASSERT_EQ(pool.checkin(std::move(socket)), 0);
+				ASSERT_EQ(pool.getIdleCount(), 1u);
+
+				sys::Timer stopTimer(eventLoop);
+				stopTimer.set(100, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+				ASSERT_EQ(pool.getIdleCount(), 0u);
+				ASSERT_EQ(pool.getEvictedCount(), 1u);
+			}
+
+			TEST(connectionpool, connect_error)
+			{
+				sys::EventLoop eventLoop;
+				ConnectionPool pool(eventLoop, 1);
+				clientSocket_t socket = pool.checkout("hbk_connectionpool_nobody_listens", true);
+				ASSERT_FALSE(socket);
+				// the slot is free again
+				socket = pool.checkout("hbk_connectionpool_nobody_listens", true);
+				ASSERT_FALSE(socket);
+				ASSERT_NE(errno, EBUSY);
+			}
+		}
+	}
+}
@@ -0,0 +1,111 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
+#include "hbk/communication/delimitedreader.h"
+
+#include "bufferchain_test.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			static std::string toString(const BufferSlice& slice)
+			{
+				return std::string(reinterpret_cast < const char* > (slice.pData), slice.size);
+			}
+
+			TEST(delimitedreader, find)
+			{
+				std::cout << "scanner: " << DelimitedReader::getScannerName() << std::endl;
+				std::vector < uint8_t > data(300, 'a');
+				ASSERT_EQ(DelimitedReader::find(data.data(), data.size(), '\n'), data.size());
+				ASSERT_EQ(DelimitedReader::find(data.data(), 0, 'a'), 0u);
+
+				// every position and misalignment, covering vector and scalar tails
+				for (size_t start = 0; start<4; ++start) {
+					for (size_t position = start; position<data.size(); ++position) {
+						data[position] = '\n';
+						ASSERT_EQ(DelimitedReader::find(data.data()+start, data.size()-start, '\n'), position-start);
+						data[position] = 'a';
+					}
+				}
+			}
+
+			TEST(delimitedreader, records)
+			{
+				BufferPool pool(256);
+				std::vector < BufferSlice > records;
+				DelimitedReader reader("\n", [&records](const BufferSlice& record) { records.push_back(record); });
+
+				BufferChain data = makeChain(pool, "{\"id\":1}\n\n{\"id\":2}\n{\"id");
+				const uint8_t* pReceived = data.getSlices().front().pData;
+				ASSERT_EQ(reader.process(std::move(data)), 3);
+				ASSERT_EQ(records.size(), 3u);
+				ASSERT_EQ(toString(records[0]), "{\"id\":1}");
+				// contiguous records point into the received block
+				ASSERT_EQ(records[0].pData, pReceived);
+				ASSERT_EQ(records[1].size, 0u);
+				ASSERT_EQ(toString(records[2]), "{\"id\":2}");
+				ASSERT_EQ(reader.getPendingCount(), 4u);
+
+				// record spread over two blocks
+				ASSERT_EQ(reader.process(makeChain(pool, "\":3}\n")), 1);
+				ASSERT_EQ(toString(records[3]), "{\"id\":3}");
+				ASSERT_EQ(reader.getPendingCount(), 0u);
+			}
+
+			TEST(delimitedreader, multibyte_delimiter)
+			{
+				BufferPool pool(256);
+				std::vector < std::string > records;
+				DelimitedReader reader("\r\n", [&records](const BufferSlice& record) { records.push_back(toString(record)); });
+
+				ASSERT_EQ(reader.process(makeChain(pool, "\n*IDN?\n\r")), 0);
+				ASSERT_EQ(reader.process(makeChain(pool, "\nMEAS:VOLT?\r\n")), 2);
+				ASSERT_EQ(records.size(), 2u);
+				ASSERT_EQ(records[0], "\n*IDN?\n");
+				ASSERT_EQ(records[1], "MEAS:VOLT?");
+			}
+
+			TEST(delimitedreader, invalid)
+			{
+				ASSERT_THROW(DelimitedReader("", DelimitedReader::RecordCb_t()), std::invalid_argument);
+
+				BufferPool pool(256);
+				DelimitedReader reader("\n", [](const BufferSlice&) {}, 8);
+				ASSERT_EQ(reader.process(makeChain(pool, "12345678\n")), 1);
+				ASSERT_EQ(reader.process(makeChain(pool, "123456789\n")), -1);
+				reader.reset();
+				ASSERT_EQ(reader.process(makeChain(pool, "123456789")), -1);
+			}
+		}
+	}
+}
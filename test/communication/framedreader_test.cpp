@@ -0,0 +1,157 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/bufferpool.h"
+#include "hbk/communication/framedreader.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+
+#include "bufferchain_test.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			TEST(framedreader, contiguous_without_copy)
+			{
+				BufferPool pool(256);
+				std::vector < BufferSlice > frames;
+				FramedReader reader(FramedReader::Format(), [&frames](const BufferSlice& frame) { frames.push_back(frame); });
+
+				BufferChain data = makeChain(pool, std::string("\0\0\0\x03" "abc" "\0\0\0\x01" "d", 12));
+				const uint8_t* pReceived = data.getSlices().front().pData;
+				ASSERT_EQ(reader.process(std::move(data)), 2);
+				ASSERT_EQ(frames.size(), 2u);
+				ASSERT_EQ(frames[0].size, 7u);
+				ASSERT_EQ(frames[1].size, 5u);
+				// frames point into the received block
+				ASSERT_EQ(frames[0].pData, pReceived);
+				ASSERT_EQ(frames[1].pData, pReceived+7);
+				ASSERT_EQ(std::string(reinterpret_cast < const char* > (frames[0].pData)+4, 3), "abc");
+				ASSERT_EQ(reader.getPendingCount(), 0u);
+			}
+
+			TEST(framedreader, partial_frames)
+			{
+				BufferPool pool(256);
+				std::vector < std::string > payloads;
+				FramedReader::Format format;
+				// 2 byte little endian length after a 1 byte type, length counts the whole frame
+				format.lengthOffset = 1;
+				format.lengthSize = 2;
+				format.bigEndian = false;
+				format.headerSize = 3;
+				format.lengthIncludesHeader = true;
+				FramedReader reader(format, [&payloads](const BufferSlice& frame)
+				{
+					payloads.push_back(std::string(reinterpret_cast < const char* > (frame.pData)+3, frame.size-3));
+				});
+
+				ASSERT_EQ(reader.process(makeChain(pool, std::string("T\x08", 2))), 0);
+				ASSERT_EQ(reader.process(makeChain(pool, std::string("\0he", 3))), 0);
+				ASSERT_EQ(reader.getPendingCount(), 5u);
+				ASSERT_EQ(reader.process(makeChain(pool, std::string("llo", 3))), 1);
+				ASSERT_EQ(payloads.size(), 1u);
+				ASSERT_EQ(payloads[0], "hello");
+				ASSERT_EQ(reader.getPendingCount(), 0u);
+			}
+
+			TEST(framedreader, invalid)
+			{
+				FramedReader::Format format;
+				format.lengthSize = 3;
+				ASSERT_THROW(FramedReader(format, FramedReader::FrameCb_t()), std::invalid_argument);
+
+				format.lengthSize = 8;
+				ASSERT_THROW(FramedReader(format, FramedReader::FrameCb_t()), std::invalid_argument);
+
+				BufferPool pool(256);
+				format = FramedReader::Format();
+				format.maxFrameSize = 16;
+				FramedReader reader(format, [](const BufferSlice&) {});
+				ASSERT_EQ(reader.process(makeChain(pool, std::string("\0\0\0\x20", 4))), -1);
+			}
+
+#ifndef _WIN32
+			TEST(framedreader, receive_from_socket)
+			{
+				static const size_t payloadSize = 100000;
+				sys::EventLoop eventLoop;
+				int fds[2];
+				ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+				SocketNonblocking socket(fds[0], eventLoop);
+
+				std::string payload(payloadSize, 'x');
+				size_t frameCount = 0;
+				FramedReader::Format format;
+				format.lengthSize = 8;
+				format.headerSize = 8;
+				FramedReader reader(format, [&](const BufferSlice& frame)
+				{
+					EXPECT_EQ(frame.size, payloadSize+8);
+					EXPECT_EQ(memcmp(frame.pData+8, payload.c_str(), payloadSize), 0);
+					if (++frameCount==2) {
+						eventLoop.stop();
+					}
+				});
+				socket.setDataCb(std::bind(&FramedReader::receive, &reader, std::placeholders::_1));
+
+				std::string frame(8, '\0');
+				frame[5] = static_cast < char > ((payloadSize >> 16) & 0xff);
+				frame[6] = static_cast < char > ((payloadSize >> 8) & 0xff);
+				frame[7] = static_cast < char > (payloadSize & 0xff);
+				frame += payload;
+				frame += frame;
+				std::thread writer([&]()
+				{
+					size_t offset = 0;
+					while (offset<frame.size()) {
+						ssize_t result = ::send(fds[1], frame.c_str()+offset, frame.size()-offset, 0);
+						if (result<=0) {
+							break;
+						}
+						offset += static_cast < size_t > (result);
+					}
+				});
+				eventLoop.execute();
+				writer.join();
+				ASSERT_EQ(frameCount, 2u);
+				::close(fds[1]);
+			}
+#endif
+		}
+	}
+}
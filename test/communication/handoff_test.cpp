@@ -0,0 +1,222 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/handoff.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/tcpserver.h"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			static const uint16_t PORT = 22225;
+			static const uint32_t SERVER_TAG = 7;
+			static const uint32_t CONNECTION_TAG = 8;
+
+			TEST(handoff, server_and_connection)
+			{
+				static const char request[] = "hello world";
+				static const char reply[] = "reply";
+				char buffer[64];
+
+				// the predecessor
+				sys::EventLoop oldEventLoop;
+				clientSocket_t oldWorker;
+				TcpServer oldServer(oldEventLoop);
+				ASSERT_EQ(oldServer.start(PORT, 8, [&](clientSocket_t worker)
+				{
+					oldWorker = std::move(worker);
+					oldEventLoop.stop();
+				}), 0);
+
+				SocketNonblocking client(oldEventLoop);
+				ASSERT_EQ(client.connect("127.0.0.1", std::to_string(PORT)), 0);
+				sys::Timer timeout(oldEventLoop);
+				timeout.set(std::chrono::milliseconds(1000), false, [&](bool fired)
+				{
+					if (fired) {
+						oldEventLoop.stop();
+					}
+				});
+				oldEventLoop.execute();
+				ASSERT_TRUE(oldWorker);
+
+				ASSERT_EQ(client.sendBlock(request, sizeof(request)-1, false), static_cast < ssize_t > (sizeof(request)-1));
+				// " world" stays unread
+				ASSERT_EQ(oldWorker->receiveComplete(buffer, 5, 1000), 5);
+				ASSERT_EQ(std::string(buffer, 5), "hello");
+				// the token bucket keeps the reply in the queue, it is not sent yet
+				ASSERT_EQ(oldWorker->setPacingRate(1000, 1500, false), 1);
+				ASSERT_EQ(oldWorker->sendAsync(reply, sizeof(reply)-1), 0);
+				ASSERT_EQ(oldWorker->getQueuedBytes(), sizeof(reply)-1);
+
+				// waiting in the backlog during handoff
+				SocketNonblocking lateClient(oldEventLoop);
+				ASSERT_EQ(lateClient.connect("127.0.0.1", std::to_string(PORT)), 0);
+
+				int channel[2];
+				ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, channel), 0);
+				Handoff sender(channel[0]);
+				ASSERT_EQ(sender.sendServer(oldServer, SERVER_TAG), 0);
+				ASSERT_EQ(sender.sendConnection(*oldWorker, CONNECTION_TAG), 0);
+				ASSERT_EQ(oldWorker->getEvent(), -1);
+				ASSERT_EQ(sender.sendEnd(), 0);
+				// nothing to hand over anymore
+				ASSERT_EQ(sender.sendServer(oldServer), -1);
+				ASSERT_EQ(sender.sendConnection(*oldWorker), -1);
+
+				// the successor
+				sys::EventLoop eventLoop;
+				TcpServer server(eventLoop);
+				std::vector < clientSocket_t > accepted;
+				clientSocket_t worker;
+				Handoff receiver(channel[1]);
+				int result = receiver.receive(eventLoop, [&](int listeningFd, uint32_t tag)
+				{
+					ASSERT_EQ(tag, SERVER_TAG);
+					ASSERT_EQ(server.start(listeningFd, [&](clientSocket_t socket)
+					{
+						accepted.push_back(std::move(socket));
+					}), 0);
+				}, [&](clientSocket_t socket, uint32_t tag)
+				{
+					ASSERT_EQ(tag, CONNECTION_TAG);
+					worker = std::move(socket);
+				});
+				ASSERT_EQ(result, 2);
+				::close(channel[0]);
+				::close(channel[1]);
+
+				// the connection waiting in the backlog was accepted by the successor
+				ASSERT_EQ(accepted.size(), 1u);
+				ASSERT_TRUE(worker);
+
+				// unread data is delivered first
+				ASSERT_EQ(worker->receiveComplete(buffer, 6, 1000), 6);
+				ASSERT_EQ(std::string(buffer, 6), " world");
+				// unsent data was sent by the successor
+				ASSERT_EQ(client.receiveComplete(buffer, sizeof(reply)-1, 1000), static_cast < ssize_t > (sizeof(reply)-1));
+				ASSERT_EQ(std::string(buffer, sizeof(reply)-1), reply);
+
+				// the connection goes on
+				ASSERT_EQ(client.sendBlock(request, sizeof(request)-1, false), static_cast < ssize_t > (sizeof(request)-1));
+				ASSERT_EQ(worker->receiveComplete(buffer, sizeof(request)-1, 1000), static_cast < ssize_t > (sizeof(request)-1));
+				ASSERT_EQ(std::string(buffer, sizeof(request)-1), request);
+
+				server.stop();
+			}
+
+			TEST(handoff, oversized_item)
+			{
+				int channel[2];
+				ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, channel), 0);
+
+				// same layout as the item header of the handoff protocol
+				struct {
+					uint32_t magic;
+					uint32_t type;
+					uint32_t tag;
+					uint32_t unreadSize;
+					uint64_t unsentSize;
+				} header;
+				header.magic = 0x484b4248;
+				header.type = 2;
+				header.tag = CONNECTION_TAG;
+				header.unreadSize = 0;
+				header.unsentSize = 0xffffffffffffull;
+				ASSERT_EQ(::send(channel[0], &header, sizeof(header), 0), static_cast < ssize_t > (sizeof(header)));
+
+				sys::EventLoop eventLoop;
+				Handoff receiver(channel[1]);
+				ASSERT_EQ(receiver.receive(eventLoop, nullptr, nullptr, SocketOptions(), 100), -1);
+				::close(channel[0]);
+				::close(channel[1]);
+			}
+
+			TEST(handoff, bad_items_are_skipped)
+			{
+				int channel[2];
+				ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, channel), 0);
+
+				// same layout as the item header of the handoff protocol
+				struct {
+					uint32_t magic;
+					uint32_t type;
+					uint32_t tag;
+					uint32_t unreadSize;
+					uint64_t unsentSize;
+				} header;
+				header.magic = 0x484b4248;
+				header.tag = CONNECTION_TAG;
+				header.unreadSize = 4;
+				header.unsentSize = 0;
+				// connection without file descriptor
+				header.type = 2;
+				ASSERT_EQ(::send(channel[0], &header, sizeof(header), 0), static_cast < ssize_t > (sizeof(header)));
+				ASSERT_EQ(::send(channel[0], "data", 4, 0), 4);
+				// unknown item type
+				header.type = 42;
+				ASSERT_EQ(::send(channel[0], &header, sizeof(header), 0), static_cast < ssize_t > (sizeof(header)));
+				ASSERT_EQ(::send(channel[0], "data", 4, 0), 4);
+
+				Handoff sender(channel[0]);
+				ASSERT_EQ(sender.sendEnd(), 0);
+
+				// the items following a bad one are still processed
+				sys::EventLoop eventLoop;
+				Handoff receiver(channel[1]);
+				ASSERT_EQ(receiver.receive(eventLoop, nullptr, nullptr, SocketOptions(), 100), 0);
+				::close(channel[0]);
+				::close(channel[1]);
+			}
+
+			TEST(handoff, receive_timeout)
+			{
+				static const int TIMEOUT = 100;
+				int channel[2];
+				ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, channel), 0);
+
+				// the sending side never sends anything
+				sys::EventLoop eventLoop;
+				Handoff receiver(channel[1]);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				ASSERT_EQ(receiver.receive(eventLoop, nullptr, nullptr, SocketOptions(), TIMEOUT), -1);
+				std::chrono::milliseconds elapsed = std::chrono::duration_cast < std::chrono::milliseconds > (std::chrono::steady_clock::now()-start);
+				ASSERT_GE(elapsed.count(), TIMEOUT);
+				ASSERT_LT(elapsed.count(), 10*TIMEOUT);
+				::close(channel[0]);
+				::close(channel[1]);
+			}
+		}
+	}
+}
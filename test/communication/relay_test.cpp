@@ -0,0 +1,180 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/relay.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			/// client <-> first ... relay ... second <-> device
+			struct Endpoints {
+				Endpoints()
+				{
+					int fds[2];
+					if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)==-1) {
+						throw std::runtime_error("socketpair failed");
+					}
+					client = fds[0];
+					first = fds[1];
+					if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)==-1) {
+						throw std::runtime_error("socketpair failed");
+					}
+					device = fds[0];
+					second = fds[1];
+				}
+
+				~Endpoints()
+				{
+					::close(client);
+					::close(device);
+				}
+
+				int client;
+				int first;
+				int second;
+				int device;
+			};
+
+			static std::string readAll(int fd)
+			{
+				std::string result;
+				char buffer[4096];
+				ssize_t count;
+				while ((count = ::read(fd, buffer, sizeof(buffer)))>0) {
+					result.append(buffer, static_cast < size_t > (count));
+				}
+				return result;
+			}
+
+			TEST(relay, forward_with_backpressure)
+			{
+				static const size_t dataSize = 1024*1024;
+				sys::EventLoop eventLoop;
+				Endpoints endpoints;
+				SocketNonblocking first(endpoints.first, eventLoop);
+				SocketNonblocking second(endpoints.second, eventLoop);
+				// received before the relay took over
+				ASSERT_EQ(first.preload("pre", 3), 0);
+
+				std::string data(dataSize, '\0');
+				for (size_t index = 0; index<data.size(); ++index) {
+					data[index] = static_cast < char > (index*13);
+				}
+
+				// small pipes in order to have the destination block
+				Relay relay(eventLoop, 4096);
+				std::string header;
+				int closeError = -1;
+				relay.setInspectCb(8, [&](Relay&, Relay::Direction direction, const uint8_t* pHeader, size_t size) {
+					if (direction==Relay::FIRST_TO_SECOND) {
+						header = std::string(reinterpret_cast < const char* > (pHeader), size);
+					}
+					return true;
+				});
+				relay.setCloseCb([&](Relay&, int error) {
+					closeError = error;
+					eventLoop.stop();
+				});
+				ASSERT_EQ(relay.start(first, second), 0);
+				ASSERT_TRUE(relay.isRunning());
+				ASSERT_EQ(first.getEvent(), -1);
+
+				std::thread clientThread([&]() {
+					ASSERT_EQ(::write(endpoints.client, data.c_str(), data.size()), static_cast < ssize_t > (data.size()));
+					::shutdown(endpoints.client, SHUT_WR);
+				});
+				std::string received;
+				std::thread deviceThread([&]() {
+					// slow consumer
+					std::this_thread::sleep_for(std::chrono::milliseconds(50));
+					received = readAll(endpoints.device);
+					ASSERT_EQ(::write(endpoints.device, "bye", 3), 3);
+					::shutdown(endpoints.device, SHUT_WR);
+				});
+
+				sys::Timer timer(eventLoop);
+				timer.set(10000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+				clientThread.join();
+				deviceThread.join();
+
+				ASSERT_EQ(closeError, 0);
+				ASSERT_FALSE(relay.isRunning());
+				ASSERT_EQ(header, "pre" + data.substr(0, 5));
+				ASSERT_EQ(received.size(), dataSize+3);
+				ASSERT_TRUE(received=="pre" + data);
+				ASSERT_EQ(readAll(endpoints.client), "bye");
+				ASSERT_EQ(relay.getRelayedCount(Relay::FIRST_TO_SECOND), dataSize+3);
+				ASSERT_EQ(relay.getRelayedCount(Relay::SECOND_TO_FIRST), 3u);
+			}
+
+			TEST(relay, rejected_by_inspection)
+			{
+				sys::EventLoop eventLoop;
+				Endpoints endpoints;
+				SocketNonblocking first(endpoints.first, eventLoop);
+				SocketNonblocking second(endpoints.second, eventLoop);
+
+				Relay relay(eventLoop);
+				int closeError = -1;
+				relay.setInspectCb(4, [&](Relay&, Relay::Direction, const uint8_t* pHeader, size_t size) {
+					return (size==4) && (memcmp(pHeader, "HBK1", 4)==0);
+				});
+				relay.setCloseCb([&](Relay&, int error) {
+					closeError = error;
+					eventLoop.stop();
+				});
+				ASSERT_EQ(::write(endpoints.client, "EVIL request", 12), 12);
+				ASSERT_EQ(relay.start(first, second), 0);
+
+				sys::Timer timer(eventLoop);
+				timer.set(5000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+
+				ASSERT_EQ(closeError, ECONNABORTED);
+				// nothing was forwarded
+				ASSERT_EQ(readAll(endpoints.device), "");
+				ASSERT_EQ(relay.getRelayedCount(Relay::FIRST_TO_SECOND), 0u);
+				// not connected anymore
+				ASSERT_EQ(relay.start(first, second), -1);
+			}
+		}
+	}
+}
@@ -0,0 +1,161 @@
+// This code is licenced under the MIT license:
+//
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <chrono>
+#include <future>
+#include <functional>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/resolver.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			TEST(resolver, numeric_address)
+			{
+				hbk::sys::EventLoop eventloop;
+				hbk::communication::Resolver resolver(eventloop);
+
+				int error = -1;
+				hbk::communication::ResolvedAddresses result;
+				auto resultCb = [&error, &result](int err, const hbk::communication::ResolvedAddresses& addresses)
+				{
+					error = err;
+					result = addresses;
+				};
+
+				// numeric addresses are delivered immediately without running the event loop
+				int retVal = resolver.resolve("127.0.0.1", "22222", resultCb);
+				ASSERT_EQ(retVal, 0);
+				ASSERT_EQ(error, 0);
+				ASSERT_EQ(result.size(), 1u);
+				ASSERT_EQ(result.front().family, AF_INET);
+
+				retVal = resolver.resolve("::1", "22222", resultCb);
+				ASSERT_EQ(retVal, 0);
+				ASSERT_EQ(error, 0);
+				ASSERT_FALSE(result.empty());
+				ASSERT_EQ(result.front().family, AF_INET6);
+
+				// numeric addresses are not cached
+				ASSERT_EQ(resolver.getCacheSize(), 0u);
+
+				retVal = resolver.resolve("127.0.0.1", "22222", hbk::communication::Resolver::Cb_t());
+				ASSERT_EQ(retVal, -1);
+			}
+
+			TEST(resolver, name_is_cached)
+			{
+				static const std::chrono::milliseconds waitDuration(5000);
+				hbk::sys::EventLoop eventloop;
+				hbk::communication::Resolver resolver(eventloop);
+				std::future < int > worker = std::async(std::launch::async, std::bind(&hbk::sys::EventLoop::execute, std::ref(eventloop)));
+
+				std::promise < int > resultPromise;
+				auto resultCb = [&resultPromise](int err, const hbk::communication::ResolvedAddresses&)
+				{
+					resultPromise.set_value(err);
+				};
+
+				int retVal = resolver.resolve("localhost", "22222", resultCb);
+				ASSERT_EQ(retVal, 1);
+				std::future < int > resultFuture = resultPromise.get_future();
+				ASSERT_EQ(resultFuture.wait_for(waitDuration), std::future_status::ready);
+				ASSERT_EQ(resultFuture.get(), 0);
+				ASSERT_EQ(resolver.getCacheSize(), 1u);
+
+				// second request is answered from the cache
+				int error = -1;
+				retVal = resolver.resolve("localhost", "22222", [&error](int err, const hbk::communication::ResolvedAddresses&) { error = err; });
+				ASSERT_EQ(retVal, 0);
+				ASSERT_EQ(error, 0);
+
+				resolver.clearCache();
+				ASSERT_EQ(resolver.getCacheSize(), 0u);
+
+				eventloop.stop();
+				worker.wait();
+			}
+
+			TEST(resolver, negative_result_is_cached)
+			{
+				static const std::chrono::milliseconds waitDuration(5000);
+				hbk::sys::EventLoop eventloop;
+				hbk::communication::Resolver resolver(eventloop);
+				std::future < int > worker = std::async(std::launch::async, std::bind(&hbk::sys::EventLoop::execute, std::ref(eventloop)));
+
+				std::promise < int > resultPromise;
+				auto resultCb = [&resultPromise](int err, const hbk::communication::ResolvedAddresses& addresses)
+				{
+					if (!addresses.empty()) {
+						resultPromise.set_value(0);
+					} else {
+						resultPromise.set_value(err);
+					}
+				};
+
+				// unknown service name
+				int retVal = resolver.resolve("localhost", "no_such_service_hbk", resultCb);
+				ASSERT_EQ(retVal, 1);
+				std::future < int > resultFuture = resultPromise.get_future();
+				ASSERT_EQ(resultFuture.wait_for(waitDuration), std::future_status::ready);
+				ASSERT_NE(resultFuture.get(), 0);
+
+				int error = 0;
+				retVal = resolver.resolve("localhost", "no_such_service_hbk", [&error](int err, const hbk::communication::ResolvedAddresses&) { error = err; });
+				ASSERT_EQ(retVal, 0);
+				ASSERT_NE(error, 0);
+
+				eventloop.stop();
+				worker.wait();
+			}
+
+			TEST(resolver, cache_is_bounded)
+			{
+				static const std::chrono::milliseconds waitDuration(5000);
+				static const size_t maxCacheEntries = 2;
+				static const unsigned int requestCount = 4;
+				hbk::sys::EventLoop eventloop;
+				hbk::communication::Resolver resolver(eventloop, 2, maxCacheEntries);
+				std::future < int > worker = std::async(std::launch::async, std::bind(&hbk::sys::EventLoop::execute, std::ref(eventloop)));
+
+				for (unsigned int requestIndex = 0; requestIndex<requestCount; ++requestIndex) {
+					std::promise < void > resultPromise;
+					auto resultCb = [&resultPromise](int, const hbk::communication::ResolvedAddresses&)
+					{
+						resultPromise.set_value();
+					};
+					resolver.resolve("localhost", std::to_string(22222+requestIndex), resultCb);
+					std::future < void > resultFuture = resultPromise.get_future();
+					ASSERT_EQ(resultFuture.wait_for(waitDuration), std::future_status::ready);
+					ASSERT_LE(resolver.getCacheSize(), maxCacheEntries);
+				}
+
+				eventloop.stop();
+				worker.wait();
+			}
+		}
+	}
+}
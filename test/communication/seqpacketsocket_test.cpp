@@ -0,0 +1,150 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/seqpacketserver.h"
+#include "hbk/communication/seqpacketsocket.h"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			static const char path[] = "hbk_seqpacket_test";
+
+			TEST(seqpacketsocket, message_boundaries)
+			{
+				sys::EventLoop eventLoop;
+				SeqPacketServer server(eventLoop);
+				seqPacketSocket_t worker;
+				ASSERT_EQ(server.start(path, true, 4, [&](seqPacketSocket_t socket) {
+					worker = std::move(socket);
+					eventLoop.stop();
+				}), 0);
+
+				SeqPacketSocket client(eventLoop);
+				ASSERT_EQ(client.connect(path, true), 0);
+				sys::Timer timeout(eventLoop);
+				timeout.set(1000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+				ASSERT_TRUE(worker);
+
+				ASSERT_EQ(client.send("first", 5), 5);
+				dataBlock_t blocks[2] = { dataBlock_t("sec", 3), dataBlock_t("ond", 3) };
+				ASSERT_EQ(client.sendBlocks(blocks, 2), 6);
+				ASSERT_EQ(client.sendBlock("third message", 13), 13);
+
+				// each receive yields exactly one message even if the buffer could take more
+				char buffer[64];
+				ASSERT_EQ(worker->receiveComplete(buffer, sizeof(buffer), 1000), 5);
+				ASSERT_EQ(std::string(buffer, 5), "first");
+				ASSERT_EQ(worker->receive(buffer, sizeof(buffer)), 6);
+				ASSERT_EQ(std::string(buffer, 6), "second");
+				// too small for the message, the message is lost
+				ASSERT_EQ(worker->receive(buffer, 4), -1);
+				ASSERT_EQ(errno, EMSGSIZE);
+				ASSERT_EQ(worker->receive(buffer, sizeof(buffer)), -1);
+				ASSERT_EQ(errno, EAGAIN);
+
+				client.disconnect();
+				ASSERT_EQ(worker->receiveComplete(buffer, sizeof(buffer), 1000), 0);
+			}
+
+			TEST(seqpacketsocket, batch_receive)
+			{
+				static const unsigned int messageCount = 10;
+				sys::EventLoop eventLoop;
+				SeqPacketServer server(eventLoop);
+				std::vector < std::string > received;
+				bool closed = false;
+				seqPacketSocket_t worker;
+				ASSERT_EQ(server.start(path, true, 4, [&](seqPacketSocket_t socket) {
+					worker = std::move(socket);
+					worker->setDataCb([&](SeqPacketSocket& s) -> ssize_t {
+						char buffers[4][32];
+						SeqPacketSocket::Message messages[4];
+						for (unsigned int i = 0; i<4; ++i) {
+							messages[i].pData = buffers[i];
+							messages[i].capacity = sizeof(buffers[i]);
+						}
+						int count = s.receiveMessages(messages, 4);
+						for (int i = 0; i<count; ++i) {
+							EXPECT_FALSE(messages[i].truncated);
+							received.push_back(std::string(buffers[i], messages[i].size));
+						}
+						if (count==0) {
+							closed = true;
+							eventLoop.stop();
+						}
+						return count;
+					});
+				}), 0);
+
+				SeqPacketSocket client(eventLoop);
+				ASSERT_EQ(client.connect(path, true), 0);
+				std::vector < std::string > messages;
+				for (unsigned int i = 0; i<messageCount; ++i) {
+					messages.push_back("message " + std::to_string(i));
+					ASSERT_EQ(client.send(messages.back().c_str(), messages.back().length()), static_cast < ssize_t > (messages.back().length()));
+				}
+				client.disconnect();
+
+				sys::Timer timeout(eventLoop);
+				timeout.set(2000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+				ASSERT_EQ(received, messages);
+				ASSERT_TRUE(closed);
+			}
+
+			TEST(seqpacketsocket, invalid)
+			{
+				sys::EventLoop eventLoop;
+				SeqPacketSocket client(eventLoop);
+				ASSERT_EQ(client.connect("hbk_seqpacket_nobody_listens", true), -1);
+				ASSERT_EQ(client.getEvent(), -1);
+
+				int fds[2];
+				ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+				ASSERT_THROW(SeqPacketSocket(fds[0], eventLoop), std::runtime_error);
+				close(fds[0]);
+				close(fds[1]);
+
+				SeqPacketServer server(eventLoop);
+				ASSERT_EQ(server.start(path, true, 4, SeqPacketServer::Cb_t()), -1);
+			}
+		}
+	}
+}
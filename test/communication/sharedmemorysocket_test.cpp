@@ -0,0 +1,333 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/sharedmemorysocket.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			/// both ends of a connected unix domain socket
+			struct UnixPair {
+				UnixPair(sys::EventLoop& eventLoop)
+				{
+					int fds[2];
+					if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)<0) {
+						throw std::runtime_error("socketpair failed");
+					}
+					client.reset(new SocketNonblocking(fds[0], eventLoop));
+					server.reset(new SocketNonblocking(fds[1], eventLoop));
+				}
+
+				std::unique_ptr < SocketNonblocking > client;
+				std::unique_ptr < SocketNonblocking > server;
+			};
+
+			static const size_t RING_SIZE = 4096;
+			/// control block in front of the data of each ring
+			static const size_t CONTROL_SIZE = 128;
+			/// offset of the read position inside the control block
+			static const size_t READ_POSITION_OFFSET = 64;
+
+			/// \return memfd holding both rings, as a misbehaving client might create it
+			static int createMemFd(bool seal)
+			{
+				int memFd = memfd_create("test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+				if (memFd==-1) {
+					return -1;
+				}
+				if (ftruncate(memFd, 2*(CONTROL_SIZE+RING_SIZE))==-1) {
+					::close(memFd);
+					return -1;
+				}
+				if (seal) {
+					fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+				}
+				return memFd;
+			}
+
+			/// send an offer with our own memfd the way SharedMemorySocket::connect() does
+			static bool offerRings(SocketNonblocking& unixSocket, int memFd)
+			{
+				struct {
+					uint32_t magic;
+					uint32_t reserved;
+					uint64_t ringSize;
+				} offer = { 0x534b4248, 0, RING_SIZE };
+				int fds[5] = { memFd, -1, -1, -1, -1 };
+				for (unsigned int i = 1; i<5; ++i) {
+					fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				}
+				union {
+					char buffer[CMSG_SPACE(sizeof(fds))];
+					struct cmsghdr align;
+				} control;
+				memset(&control, 0, sizeof(control));
+				struct iovec iov;
+				iov.iov_base = &offer;
+				iov.iov_len = sizeof(offer);
+				struct msghdr msg;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_iov = &iov;
+				msg.msg_iovlen = 1;
+				msg.msg_control = control.buffer;
+				msg.msg_controllen = sizeof(control.buffer);
+				struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+				pCmsg->cmsg_level = SOL_SOCKET;
+				pCmsg->cmsg_type = SCM_RIGHTS;
+				pCmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+				memcpy(CMSG_DATA(pCmsg), fds, sizeof(fds));
+				bool success = (::sendmsg(unixSocket.getEvent(), &msg, 0)==static_cast < ssize_t > (sizeof(offer)));
+				// the receiver got duplicates
+				for (unsigned int i = 1; i<5; ++i) {
+					::close(fds[i]);
+				}
+				return success;
+			}
+
+			TEST(sharedmemorysocket, send_receive)
+			{
+				static const char message[] = "hello shared memory";
+				sys::EventLoop eventLoop;
+				UnixPair unixPair(eventLoop);
+				SharedMemorySocket client(eventLoop);
+				SharedMemorySocket server(eventLoop);
+
+				ASSERT_EQ(client.connect(*unixPair.client, 1000), 0);
+				ASSERT_EQ(client.getRingSize(), 4096u);
+				// data written before the peer accepted waits in the ring
+				ASSERT_EQ(client.send(message, sizeof(message)), static_cast < ssize_t > (sizeof(message)));
+				ASSERT_EQ(server.accept(*unixPair.server), 0);
+				ASSERT_EQ(server.getRingSize(), 4096u);
+
+				char buffer[64];
+				ASSERT_EQ(server.receive(buffer, sizeof(buffer)), static_cast < ssize_t > (sizeof(message)));
+				ASSERT_STREQ(buffer, message);
+				ASSERT_EQ(server.receive(buffer, sizeof(buffer)), -1);
+				ASSERT_EQ(errno, EAGAIN);
+
+				ASSERT_EQ(server.send(message, 5), 5);
+				ASSERT_EQ(client.receiveComplete(buffer, 5, 1000), 5);
+				ASSERT_EQ(std::string(buffer, 5), "hello");
+
+				client.disconnect();
+				ASSERT_FALSE(client.isConnected());
+				ASSERT_EQ(server.receive(buffer, sizeof(buffer)), 0);
+				ASSERT_EQ(server.send(message, 5), -1);
+			}
+
+			TEST(sharedmemorysocket, wrap_around_with_backpressure)
+			{
+				static const size_t transferSize = 1024*1024;
+				sys::EventLoop eventLoop;
+				UnixPair unixPair(eventLoop);
+				SharedMemorySocket client(eventLoop);
+				SharedMemorySocket server(eventLoop);
+				ASSERT_EQ(client.connect(*unixPair.client, 4096), 0);
+				ASSERT_EQ(server.accept(*unixPair.server), 0);
+
+				std::vector < uint8_t > data(transferSize);
+				for (size_t i = 0; i<data.size(); ++i) {
+					data[i] = static_cast < uint8_t > (i*7);
+				}
+
+				// the ring is much smaller than the transfer, the sender has to wait for the receiver
+				ssize_t sent = 0;
+				std::thread sender([&]() {
+					sent = client.sendBlock(data.data(), data.size());
+				});
+
+				std::vector < uint8_t > received(transferSize);
+				size_t position = 0;
+				while (position<transferSize) {
+					// odd chunk size in order to hit the end of the ring at varying positions
+					size_t chunk = 1000;
+					if (chunk>transferSize-position) {
+						chunk = transferSize-position;
+					}
+					ssize_t result = server.receiveComplete(received.data()+position, chunk, 5000);
+					ASSERT_EQ(result, static_cast < ssize_t > (chunk));
+					position += chunk;
+				}
+				sender.join();
+				ASSERT_EQ(sent, static_cast < ssize_t > (transferSize));
+				ASSERT_EQ(received, data);
+			}
+
+			TEST(sharedmemorysocket, data_callback)
+			{
+				static const char message[] = "event driven";
+				sys::EventLoop eventLoop;
+				UnixPair unixPair(eventLoop);
+				SharedMemorySocket client(eventLoop);
+				SharedMemorySocket server(eventLoop);
+				ASSERT_EQ(client.connect(*unixPair.client), 0);
+				ASSERT_EQ(server.accept(*unixPair.server), 0);
+
+				std::string received;
+				bool closed = false;
+				server.setDataCb([&](SharedMemorySocket& socket) -> ssize_t {
+					char buffer[8];
+					ssize_t result;
+					do {
+						result = socket.receive(buffer, sizeof(buffer));
+						if (result>0) {
+							received.append(buffer, static_cast < size_t > (result));
+						} else if (result==0) {
+							closed = true;
+							eventLoop.stop();
+						}
+					} while (result>0);
+					return 0;
+				});
+
+				sys::Timer timer(eventLoop);
+				timer.set(10, false, [&](bool) {
+					client.send(message, sizeof(message)-1);
+					client.disconnect();
+				});
+				sys::Timer timeout(eventLoop);
+				timeout.set(2000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+				ASSERT_EQ(received, message);
+				ASSERT_TRUE(closed);
+			}
+
+			TEST(sharedmemorysocket, peer_terminates)
+			{
+				sys::EventLoop eventLoop;
+				UnixPair unixPair(eventLoop);
+				SharedMemorySocket client(eventLoop);
+				ASSERT_EQ(client.connect(*unixPair.client), 0);
+
+				// the server process vanishes without disconnecting. Only the unix domain socket tells.
+				pid_t pid = fork();
+				ASSERT_NE(pid, -1);
+				if (pid==0) {
+					sys::EventLoop childEventLoop;
+					SharedMemorySocket server(childEventLoop);
+					_exit(server.accept(*unixPair.server));
+				}
+				unixPair.server.reset();
+				int status;
+				ASSERT_EQ(waitpid(pid, &status, 0), pid);
+				ASSERT_EQ(WEXITSTATUS(status), 0);
+
+				char buffer[8];
+				ASSERT_EQ(client.receiveComplete(buffer, sizeof(buffer), 2000), 0);
+				ASSERT_EQ(client.send(buffer, sizeof(buffer)), -1);
+			}
+
+			TEST(sharedmemorysocket, invalid_offer)
+			{
+				sys::EventLoop eventLoop;
+				UnixPair unixPair(eventLoop);
+				SharedMemorySocket server(eventLoop);
+				ASSERT_EQ(unixPair.client->sendBlock("garbage garbage", 16, false), 16);
+				ASSERT_EQ(server.accept(*unixPair.server, 100), -1);
+				ASSERT_FALSE(server.isConnected());
+				ASSERT_EQ(server.accept(*unixPair.server, 10), -1);
+			}
+
+			TEST(sharedmemorysocket, unsealed_memfd)
+			{
+				sys::EventLoop eventLoop;
+				UnixPair unixPair(eventLoop);
+				SharedMemorySocket server(eventLoop);
+				int memFd = createMemFd(false);
+				ASSERT_NE(memFd, -1);
+				ASSERT_TRUE(offerRings(*unixPair.client, memFd));
+				// the client could shrink the memfd later on
+				ASSERT_EQ(server.accept(*unixPair.server, 100), -1);
+				ASSERT_FALSE(server.isConnected());
+				::close(memFd);
+			}
+
+			TEST(sharedmemorysocket, corrupted_positions)
+			{
+				sys::EventLoop eventLoop;
+				char buffer[16] = "";
+
+				{
+					UnixPair unixPair(eventLoop);
+					SharedMemorySocket server(eventLoop);
+					int memFd = createMemFd(true);
+					ASSERT_NE(memFd, -1);
+					ASSERT_TRUE(offerRings(*unixPair.client, memFd));
+					ASSERT_EQ(server.accept(*unixPair.server, 100), 0);
+					void* pMemory = mmap(nullptr, 2*(CONTROL_SIZE+RING_SIZE), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+					ASSERT_NE(pMemory, MAP_FAILED);
+
+					// write position of the client to server ring claims more than the ring holds
+					*reinterpret_cast < uint64_t* > (pMemory) = 1ULL << 40;
+					errno = 0;
+					ASSERT_EQ(server.receive(buffer, sizeof(buffer)), -1);
+					ASSERT_EQ(errno, EPROTO);
+					ASSERT_FALSE(server.isConnected());
+					munmap(pMemory, 2*(CONTROL_SIZE+RING_SIZE));
+					::close(memFd);
+				}
+
+				{
+					UnixPair unixPair(eventLoop);
+					SharedMemorySocket server(eventLoop);
+					int memFd = createMemFd(true);
+					ASSERT_NE(memFd, -1);
+					ASSERT_TRUE(offerRings(*unixPair.client, memFd));
+					ASSERT_EQ(server.accept(*unixPair.server, 100), 0);
+					uint8_t* pMemory = reinterpret_cast < uint8_t* > (mmap(nullptr, 2*(CONTROL_SIZE+RING_SIZE), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0));
+					ASSERT_NE(pMemory, MAP_FAILED);
+
+					// read position of the server to client ring is ahead of the write position
+					*reinterpret_cast < uint64_t* > (pMemory+CONTROL_SIZE+RING_SIZE+READ_POSITION_OFFSET) = 100;
+					errno = 0;
+					ASSERT_EQ(server.send(buffer, sizeof(buffer)), -1);
+					ASSERT_EQ(errno, EPROTO);
+					ASSERT_FALSE(server.isConnected());
+					munmap(pMemory, 2*(CONTROL_SIZE+RING_SIZE));
+					::close(memFd);
+				}
+			}
+		}
+	}
+}
@@ -20,13 +20,28 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <atomic>
+#include <cstring>
 #include <string>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #include <gtest/gtest.h>
 
+#include "hbk/communication/resolver.h"
 #include "hbk/communication/socketnonblocking.h"
 #include "hbk/communication/tcpserver.h"
 #include "socketnonblocking_test.h"
@@ -276,6 +291,41 @@ namespace hbk {
 			ASSERT_TRUE(result == -1) <<  strerror(errno);
 		}
 
+		TEST_F(serverFixture, connect_resolver_test)
+		{
+			static const std::chrono::milliseconds waitDuration(5000);
+			int result;
+			start();
+			hbk::communication::Resolver resolver(m_eventloop);
+			hbk::communication::SocketNonblocking client(m_eventloop);
+
+			// numeric address: no need to resolve, connecting is finished by the event loop
+			std::promise < int > numericPromise;
+			result = client.connect(resolver, server, std::to_string(PORT), [&numericPromise](int value) { numericPromise.set_value(value); });
+			ASSERT_NE(result, -1);
+			std::future < int > numericFuture = numericPromise.get_future();
+			ASSERT_EQ(numericFuture.wait_for(waitDuration), std::future_status::ready);
+			ASSERT_EQ(numericFuture.get(), 0);
+			ASSERT_NE(client.peerAddressLength(), 0u);
+			client.disconnect();
+
+			std::promise < int > connectPromise;
+			result = client.connect(resolver, "localhost", std::to_string(PORT), [&connectPromise](int value) { connectPromise.set_value(value); });
+			ASSERT_NE(result, -1);
+			std::future < int > connectFuture = connectPromise.get_future();
+			ASSERT_EQ(connectFuture.wait_for(waitDuration), std::future_status::ready);
+			ASSERT_EQ(connectFuture.get(), 0);
+			client.disconnect();
+
+			// wrong port! Should fail
+			std::promise < int > failPromise;
+			result = client.connect(resolver, server, std::to_string(PORT + 1), [&failPromise](int value) { failPromise.set_value(value); });
+			ASSERT_NE(result, -1);
+			std::future < int > failFuture = failPromise.get_future();
+			ASSERT_EQ(failFuture.wait_for(waitDuration), std::future_status::ready);
+			ASSERT_EQ(failFuture.get(), -1);
+		}
+
 		TEST_F(serverFixture, connect_multiple_test)
 		{
 			static const unsigned int CLIENT_COUNT = 32;
@@ -334,6 +384,750 @@ namespace hbk {
 
 		}
 
+#ifndef _WIN32
+		TEST_F(serverFixture, receive_chain_test)
+		{
+			ssize_t result;
+			static const char msg[] = "hallo";
+			char response[1024];
+
+			start();
+
+			hbk::communication::BufferPool pool(1024);
+			hbk::communication::SocketNonblocking client(m_eventloop);
+			client.setBufferPool(pool);
+			result = client.connect(server, std::to_string(PORT));
+			ASSERT_EQ(result, 0) << strerror(errno);
+
+			result = client.sendBlock(msg, sizeof(msg), false);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)));
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+			// mix both kinds of receiving. What is buffered by the buffered reader is delivered first.
+			result = client.receive(response, 1);
+			ASSERT_EQ(result, 1);
+			ASSERT_EQ(response[0], msg[0]);
+
+			hbk::communication::BufferChain chain;
+			result = client.receive(chain);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)-1));
+			result = client.receive(chain);
+			ASSERT_EQ(result, -1);
+
+			result = client.sendBlock(msg, sizeof(msg), false);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)));
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			result = client.receive(chain);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)));
+
+			ASSERT_EQ(chain.size(), 2*sizeof(msg)-1);
+			size_t copied = chain.copyOut(sizeof(msg)-1, response, sizeof(msg));
+			ASSERT_EQ(copied, sizeof(msg));
+			ASSERT_EQ(strcmp(response, msg), 0);
+
+			client.disconnect();
+		}
+
+		TEST_F(serverFixture, receive_blocks_test)
+		{
+			ssize_t result;
+			static const char msg[] = "0123456789abcdefghij";
+			char first;
+			char header[4];
+			char payload[15];
+			char tail[4];
+
+			start();
+
+			hbk::communication::SocketNonblocking client(m_eventloop);
+			result = client.connect(server, std::to_string(PORT));
+			ASSERT_EQ(result, 0) << strerror(errno);
+
+			result = client.sendBlock(msg, sizeof(msg)-1, false);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)-1));
+
+			// leaves the rest in the buffered reader
+			result = client.receiveComplete(&first, 1, 1000);
+			ASSERT_EQ(result, 1);
+
+			hbk::communication::dataBlock_t blocks[] = {
+				hbk::communication::dataBlock_t(header, sizeof(header)),
+				hbk::communication::dataBlock_t(payload, sizeof(payload)),
+			};
+			result = client.receiveBlocksComplete(blocks, 2, 1000);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(header)+sizeof(payload)));
+			ASSERT_EQ(std::string(header, sizeof(header)), "1234");
+			ASSERT_EQ(std::string(payload, sizeof(payload)), "56789abcdefghij");
+			// the blocks of the caller are not changed
+			ASSERT_EQ(blocks[1].size, sizeof(payload));
+
+			result = client.sendBlock(msg, 4, false);
+			ASSERT_EQ(result, 4);
+			hbk::communication::dataBlock_t tailBlock(tail, sizeof(tail));
+			result = client.receiveBlocksComplete(&tailBlock, 1, 1000);
+			ASSERT_EQ(result, 4);
+			ASSERT_EQ(std::string(tail, sizeof(tail)), "0123");
+
+			// nothing left
+			result = client.receiveBlocks(&tailBlock, 1);
+			ASSERT_EQ(result, -1);
+			client.disconnect();
+		}
+
+		TEST_F(serverFixture, socket_options_test)
+		{
+			int result;
+			int value;
+			socklen_t len = sizeof(value);
+
+			start();
+
+			hbk::communication::SocketNonblocking client(m_eventloop, hbk::communication::SocketOptions::lowLatencyControl());
+			result = client.connect(server, std::to_string(PORT));
+			ASSERT_EQ(result, 0) << strerror(errno);
+
+			getsockopt(client.getEvent(), IPPROTO_TCP, TCP_NODELAY, &value, &len);
+			ASSERT_NE(value, 0);
+			getsockopt(client.getEvent(), IPPROTO_TCP, TCP_USER_TIMEOUT, &value, &len);
+			ASSERT_EQ(value, 5000);
+			getsockopt(client.getEvent(), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &value, &len);
+			ASSERT_EQ(value, 16*1024);
+
+			// applied immediately on a connected socket
+			hbk::communication::SocketOptions options;
+			options.keepAliveIdle = std::chrono::seconds(42);
+			result = client.setOptions(options);
+			ASSERT_EQ(result, 0);
+			getsockopt(client.getEvent(), SOL_TCP, TCP_KEEPIDLE, &value, &len);
+			ASSERT_EQ(value, 42);
+			client.disconnect();
+
+			// options given to connect replace those of the constructor
+			result = client.connect(server, std::to_string(PORT), hbk::communication::SocketOptions::bulkStreaming());
+			ASSERT_EQ(result, 0) << strerror(errno);
+			getsockopt(client.getEvent(), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &value, &len);
+			ASSERT_EQ(value, 128*1024);
+			getsockopt(client.getEvent(), IPPROTO_TCP, TCP_USER_TIMEOUT, &value, &len);
+			ASSERT_EQ(value, 0);
+			client.disconnect();
+		}
+
+		TEST_F(serverFixture, transport_stats_test)
+		{
+			ssize_t result;
+			static const char msg[] = "hallo";
+			char response[1024];
+
+			start();
+
+			hbk::communication::SocketNonblocking client(m_eventloop);
+			result = client.connect(server, std::to_string(PORT));
+			ASSERT_EQ(result, 0) << strerror(errno);
+
+			hbk::communication::TransportStats stats = client.transportStats();
+			ASSERT_TRUE(stats.tcpInfoValid);
+			ASSERT_EQ(stats.bytesSent, 0u);
+			ASSERT_GT(stats.sendMss, 0u);
+
+			std::promise < void > sampled;
+			unsigned int sampleCount = 0;
+			hbk::communication::TransportStatsSampler sampler(m_eventloop);
+			result = sampler.start(client, std::chrono::milliseconds(10), [&](const hbk::communication::TransportStats& current, const hbk::communication::TransportStats& previous)
+			{
+				if (++sampleCount==2) {
+					EXPECT_GT(current.time, previous.time);
+					sampled.set_value();
+				}
+			});
+			ASSERT_EQ(result, 0);
+
+			result = client.sendBlock(msg, sizeof(msg), false);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)));
+			result = client.receiveComplete(response, sizeof(msg), 1000);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)));
+
+			stats = client.transportStats();
+			ASSERT_EQ(stats.bytesSent, sizeof(msg));
+			ASSERT_EQ(stats.bytesReceived, sizeof(msg));
+			ASSERT_EQ(stats.partialWrites, 0u);
+			ASSERT_EQ(stats.receiveQueueSize, 0u);
+
+			ASSERT_EQ(sampled.get_future().wait_for(std::chrono::seconds(1)), std::future_status::ready);
+			sampler.stop();
+			client.disconnect();
+		}
+
+		/// listening socket on an ephemeral port. The peer does not read anything until told so.
+		static int createSilentListener(std::string& port)
+		{
+			int listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+			if (listenFd==-1) {
+				return -1;
+			}
+			sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t addressLength = sizeof(address);
+			if ((::bind(listenFd, reinterpret_cast < sockaddr* > (&address), addressLength)!=0) ||
+				(::listen(listenFd, 1)!=0) ||
+				(::getsockname(listenFd, reinterpret_cast < sockaddr* > (&address), &addressLength)!=0)) {
+				::close(listenFd);
+				return -1;
+			}
+			port = std::to_string(ntohs(address.sin_port));
+			return listenFd;
+		}
+
+		TEST_F(serverFixture, backpressure_test)
+		{
+			static const size_t chunkSize = 65536;
+			static const size_t lowWatermark = 2*chunkSize;
+			static const size_t highWatermark = 8*chunkSize;
+			static const size_t maxChunkCount = 4096;
+
+			start();
+
+			std::string port;
+			int listenFd = createSilentListener(port);
+			ASSERT_NE(listenFd, -1) << strerror(errno);
+
+			hbk::communication::SocketOptions options;
+			options.sendBufferSize = chunkSize;
+			hbk::communication::SocketNonblocking client(m_eventloop, options);
+			int result = client.connect(server, port);
+			ASSERT_EQ(result, 0) << strerror(errno);
+			int peerFd = ::accept(listenFd, nullptr, nullptr);
+			ASSERT_NE(peerFd, -1) << strerror(errno);
+			::close(listenFd);
+
+			ASSERT_EQ(client.setWatermarks(highWatermark, lowWatermark, nullptr), -1);
+
+			std::atomic < unsigned int > highCount(0);
+			std::promise < void > lowReached;
+			result = client.setWatermarks(lowWatermark, highWatermark, [&](hbk::communication::SocketNonblocking&, bool aboveHighWatermark)
+			{
+				if (aboveHighWatermark) {
+					++highCount;
+				} else {
+					lowReached.set_value();
+				}
+			});
+			ASSERT_EQ(result, 0);
+
+			// sendAsync never blocks. The peer does not read, hence the queue grows until the producer stops at the high watermark
+			std::vector < uint8_t > chunk(chunkSize);
+			size_t totalSent = 0;
+			for (size_t chunkIndex = 0; chunkIndex<maxChunkCount; ++chunkIndex) {
+				for (size_t index = 0; index<chunkSize; ++index) {
+					chunk[index] = static_cast < uint8_t > ((totalSent+index) % 251);
+				}
+				ASSERT_EQ(client.sendAsync(chunk.data(), chunk.size()), 0);
+				totalSent += chunkSize;
+				if (client.isAboveHighWatermark()) {
+					break;
+				}
+			}
+			ASSERT_TRUE(client.isAboveHighWatermark());
+			ASSERT_EQ(highCount, 1u);
+			ASSERT_GE(client.getQueuedBytes(), highWatermark);
+
+			// blocking send methods queue as well while data is pending
+			uint8_t tail = static_cast < uint8_t > (totalSent % 251);
+			ASSERT_EQ(client.sendBlock(&tail, 1, false), 1);
+			++totalSent;
+
+			// peer reads everything in the order it was sent
+			std::vector < uint8_t > received(chunkSize);
+			size_t totalReceived = 0;
+			bool inOrder = true;
+			while (totalReceived<totalSent) {
+				ssize_t count = ::recv(peerFd, received.data(), received.size(), 0);
+				ASSERT_GT(count, 0) << strerror(errno);
+				for (ssize_t index = 0; index<count; ++index) {
+					if (received[static_cast < size_t > (index)]!=static_cast < uint8_t > ((totalReceived+static_cast < size_t > (index)) % 251)) {
+						inOrder = false;
+					}
+				}
+				totalReceived += static_cast < size_t > (count);
+			}
+			ASSERT_TRUE(inOrder);
+			ASSERT_EQ(lowReached.get_future().wait_for(std::chrono::seconds(1)), std::future_status::ready);
+			ASSERT_FALSE(client.isAboveHighWatermark());
+			ASSERT_EQ(client.getQueuedBytes(), 0u);
+
+			client.disconnect();
+			::close(peerFd);
+		}
+
+		TEST(communication, send_async_error_test)
+		{
+			static const size_t chunkSize = 65536;
+			static const size_t maxChunkCount = 64;
+			hbk::sys::EventLoop eventLoop;
+			int fds[2];
+			ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+			hbk::communication::SocketNonblocking socket(fds[0], eventLoop);
+
+			std::promise < int > errorReported;
+			std::thread::id errorThreadId;
+			socket.setSendErrorCb([&](hbk::communication::SocketNonblocking&, int error)
+			{
+				errorThreadId = std::this_thread::get_id();
+				errorReported.set_value(error);
+			});
+
+			// the peer does not read, hence data gets queued
+			std::vector < uint8_t > chunk(chunkSize, 'x');
+			for (size_t chunkIndex = 0; chunkIndex<maxChunkCount; ++chunkIndex) {
+				ASSERT_EQ(socket.sendAsync(chunk.data(), chunk.size()), 0);
+				if (socket.getQueuedBytes()>0) {
+					break;
+				}
+			}
+			size_t queuedBytes = socket.getQueuedBytes();
+			ASSERT_GT(queuedBytes, 0u);
+
+			// the event loop fails sending the queued data
+			::close(fds[1]);
+			std::thread eventLoopThread(std::bind(&hbk::sys::EventLoop::execute, std::ref(eventLoop)));
+			std::future < int > errorFuture = errorReported.get_future();
+			ASSERT_EQ(errorFuture.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+			ASSERT_EQ(errorFuture.get(), EPIPE);
+			// queued data is sent by the event loop, never by the thread calling sendAsync()
+			ASSERT_EQ(errorThreadId, eventLoopThread.get_id());
+			eventLoop.stop();
+			eventLoopThread.join();
+
+			// nothing was dropped silently
+			ASSERT_EQ(socket.getQueuedBytes(), queuedBytes);
+			ASSERT_EQ(socket.sendAsync(chunk.data(), chunk.size()), -1);
+			ASSERT_EQ(errno, EPIPE);
+		}
+
+		TEST(communication, disconnect_sends_queued_test)
+		{
+			static const size_t chunkSize = 65536;
+			static const size_t maxChunkCount = 64;
+			hbk::sys::EventLoop eventLoop;
+			int fds[2];
+			ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+			hbk::communication::SocketNonblocking socket(fds[0], eventLoop);
+
+			// the peer does not read yet, hence data gets queued
+			std::vector < uint8_t > chunk(chunkSize, 'x');
+			size_t totalSent = 0;
+			for (size_t chunkIndex = 0; chunkIndex<maxChunkCount; ++chunkIndex) {
+				ASSERT_EQ(socket.sendAsync(chunk.data(), chunk.size()), 0);
+				totalSent += chunkSize;
+				if (socket.getQueuedBytes()>0) {
+					break;
+				}
+			}
+			ASSERT_GT(socket.getQueuedBytes(), 0u);
+
+			size_t totalReceived = 0;
+			std::thread peerThread([&]()
+			{
+				std::vector < uint8_t > buffer(chunkSize);
+				ssize_t count;
+				while ((count = ::recv(fds[1], buffer.data(), buffer.size(), 0))>0) {
+					totalReceived += static_cast < size_t > (count);
+				}
+			});
+			// waits for the peer to take the queued data
+			socket.disconnect();
+			peerThread.join();
+			::close(fds[1]);
+			ASSERT_EQ(totalReceived, totalSent);
+		}
+
+		TEST_F(serverFixture, pacing_test)
+		{
+			static const uint64_t pacingRate = 1000000;
+			static const size_t burstSize = 16384;
+			static const size_t dataSize = 262144;
+			ssize_t result;
+
+			start();
+
+			hbk::communication::SocketNonblocking client(m_eventloop);
+			ASSERT_EQ(client.setPacingRate(pacingRate), -1);
+			result = client.connect(server, std::to_string(PORT));
+			ASSERT_EQ(result, 0) << strerror(errno);
+
+			// tcp is paced by the kernel
+			ASSERT_EQ(client.setPacingRate(pacingRate), 0);
+			ASSERT_EQ(client.getPacingRate(), pacingRate);
+
+			ASSERT_EQ(client.setPacingRate(pacingRate, burstSize, false), 1);
+			std::vector < uint8_t > data(dataSize, 'x');
+			std::vector < uint8_t > response(dataSize);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			ASSERT_EQ(client.sendAsync(data.data(), data.size()), 0);
+			// nothing leaves without tokens
+			ASSERT_GE(client.getQueuedBytes(), dataSize-burstSize);
+			result = client.receiveComplete(response.data(), response.size(), 5000);
+			std::chrono::milliseconds elapsed = std::chrono::duration_cast < std::chrono::milliseconds > (std::chrono::steady_clock::now()-start);
+			ASSERT_EQ(result, static_cast < ssize_t > (dataSize));
+			// the first burst leaves immediately
+			ASSERT_GE(elapsed.count(), static_cast < int64_t > ((dataSize-burstSize)*1000/pacingRate));
+			ASSERT_EQ(client.getQueuedBytes(), 0u);
+
+			// limit removed
+			ASSERT_EQ(client.setPacingRate(0), 0);
+			ASSERT_EQ(client.getPacingRate(), 0u);
+			client.disconnect();
+		}
+
+		TEST_F(serverFixture, move_test)
+		{
+			static const char msg[] = "hallo";
+			ssize_t result;
+
+			start();
+
+			hbk::communication::SocketNonblocking client(m_eventloop);
+			result = client.connect(server, std::to_string(PORT));
+			ASSERT_EQ(result, 0) << strerror(errno);
+			client.setWriteCoalescing(64);
+
+			std::mutex mtx;
+			std::string answer;
+			hbk::communication::SocketNonblocking* pReceiver = nullptr;
+			std::promise < void > received;
+			client.setDataCb([&](hbk::communication::SocketNonblocking& socket)
+			{
+				char buffer[1024];
+				ssize_t count = socket.receive(buffer, sizeof(buffer));
+				if (count>0) {
+					std::lock_guard < std::mutex > lock(mtx);
+					pReceiver = &socket;
+					answer.append(buffer, static_cast < size_t > (count));
+					if (answer.length()==sizeof(msg)) {
+						received.set_value();
+					}
+				}
+				return count;
+			});
+
+			hbk::communication::SocketNonblocking moved(std::move(client));
+			ASSERT_EQ(client.getEvent(), -1);
+			ASSERT_EQ(client.send(msg, sizeof(msg), false), -1);
+			ASSERT_EQ(moved.getWriteCoalescing(), 64u);
+
+			result = moved.sendBlock(msg, sizeof(msg), false);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)));
+			ASSERT_EQ(received.get_future().wait_for(std::chrono::seconds(1)), std::future_status::ready);
+			{
+				std::lock_guard < std::mutex > lock(mtx);
+				// callbacks get the new owner
+				ASSERT_EQ(pReceiver, &moved);
+				ASSERT_EQ(answer, std::string(msg, sizeof(msg)));
+			}
+
+			// move assignment
+			hbk::communication::SocketNonblocking other(m_eventloop);
+			other = std::move(moved);
+			ASSERT_EQ(moved.getEvent(), -1);
+			ASSERT_NE(other.getEvent(), -1);
+			other.disconnect();
+		}
+#endif
+
+		TEST(communication, pooled_allocation_test)
+		{
+			hbk::sys::EventLoop eventLoop;
+			std::unique_ptr < hbk::communication::SocketNonblocking > socket(new hbk::communication::SocketNonblocking(eventLoop));
+			hbk::communication::SocketNonblocking* pFirst = socket.get();
+			size_t cachedCount = hbk::communication::SocketNonblocking::getCachedObjectCount();
+			socket.reset();
+			ASSERT_EQ(hbk::communication::SocketNonblocking::getCachedObjectCount(), cachedCount+1);
+
+			// memory of the released object is being reused
+			socket.reset(new hbk::communication::SocketNonblocking(eventLoop));
+			ASSERT_EQ(socket.get(), pFirst);
+			ASSERT_EQ(hbk::communication::SocketNonblocking::getCachedObjectCount(), cachedCount);
+		}
+
+#ifndef _WIN32
+		TEST(communication, cpu_event_loops_test)
+		{
+			static const unsigned int port = 22226;
+			hbk::sys::EventLoop serverEventLoop;
+			hbk::sys::EventLoop workerEventLoop;
+			hbk::communication::TcpServer tcpServer(serverEventLoop);
+			// whatever CPU receives the connection, it goes to the worker event loop
+			long cpuCount = sysconf(_SC_NPROCESSORS_CONF);
+			tcpServer.setCpuEventLoops(std::vector < hbk::sys::EventLoop* > (static_cast < size_t > (cpuCount), &workerEventLoop));
+
+			clientSocket_t worker;
+			std::promise < std::thread::id > acceptPromise;
+			int result = tcpServer.start(port, 3, [&](clientSocket_t clientSocket) {
+				worker = std::move(clientSocket);
+				acceptPromise.set_value(std::this_thread::get_id());
+			});
+			ASSERT_EQ(result, 0);
+
+			std::thread serverThread(std::bind(&hbk::sys::EventLoop::execute, std::ref(serverEventLoop)));
+			std::thread workerThread(std::bind(&hbk::sys::EventLoop::execute, std::ref(workerEventLoop)));
+
+			hbk::communication::SocketNonblocking client(serverEventLoop);
+			result = client.connect(server, std::to_string(port));
+			ASSERT_EQ(result, 0);
+			std::future < std::thread::id > acceptFuture = acceptPromise.get_future();
+			ASSERT_EQ(acceptFuture.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+			ASSERT_EQ(acceptFuture.get(), workerThread.get_id());
+			ASSERT_EQ(tcpServer.getRedirectedCount(), 1u);
+			// the peer address delivered by accept() travels along
+			ASSERT_GT(worker->peerAddressLength(), 0u);
+			ASSERT_TRUE(worker->checkSockAddr(reinterpret_cast < const struct sockaddr* > (&client.localAddress()), client.localAddressLength()));
+
+			serverEventLoop.stop();
+			workerEventLoop.stop();
+			serverThread.join();
+			workerThread.join();
+		}
+#endif
+
+		TEST(communication, peer_address_test)
+		{
+			static const unsigned int port = 22227;
+			hbk::sys::EventLoop eventLoop;
+			hbk::communication::TcpServer tcpServer(eventLoop);
+			clientSocket_t worker;
+			std::promise < void > acceptPromise;
+			int result = tcpServer.start(port, 3, [&](clientSocket_t clientSocket) {
+				worker = std::move(clientSocket);
+				acceptPromise.set_value();
+			});
+			ASSERT_EQ(result, 0);
+			std::thread serverThread(std::bind(&hbk::sys::EventLoop::execute, std::ref(eventLoop)));
+
+			hbk::communication::SocketNonblocking client(eventLoop);
+			ASSERT_EQ(client.peerAddress().ss_family, AF_UNSPEC);
+			ASSERT_EQ(client.peerAddressLength(), 0u);
+			result = client.connect(server, std::to_string(port));
+			ASSERT_EQ(result, 0);
+			ASSERT_EQ(acceptPromise.get_future().wait_for(std::chrono::seconds(2)), std::future_status::ready);
+
+			ASSERT_EQ(client.peerAddress().ss_family, AF_INET);
+			const struct sockaddr_in* pPeer = reinterpret_cast < const struct sockaddr_in* > (&client.peerAddress());
+			ASSERT_EQ(ntohs(pPeer->sin_port), port);
+
+			// the peer of the worker is the local end of the client. The dual stack server sees it as IPv4 mapped IPv6 address.
+			ASSERT_TRUE(worker->checkSockAddr(reinterpret_cast < const struct sockaddr* > (&client.localAddress()), client.localAddressLength()));
+			ASSERT_FALSE(worker->checkSockAddr(reinterpret_cast < const struct sockaddr* > (&client.peerAddress()), client.peerAddressLength()));
+			ASSERT_TRUE(client.checkSockAddr(reinterpret_cast < const struct sockaddr* > (&worker->localAddress()), worker->localAddressLength()));
+
+			// an IPv4 mapped IPv6 address equals the IPv4 address
+			const struct sockaddr_in* pClientLocal = reinterpret_cast < const struct sockaddr_in* > (&client.localAddress());
+			struct sockaddr_in6 mapped;
+			memset(&mapped, 0, sizeof(mapped));
+			mapped.sin6_family = AF_INET6;
+			mapped.sin6_port = pClientLocal->sin_port;
+			mapped.sin6_addr.s6_addr[10] = 0xff;
+			mapped.sin6_addr.s6_addr[11] = 0xff;
+			memcpy(&mapped.sin6_addr.s6_addr[12], &pClientLocal->sin_addr, 4);
+			ASSERT_TRUE(worker->checkSockAddr(reinterpret_cast < const struct sockaddr* > (&mapped), sizeof(mapped)));
+
+			client.disconnect();
+			ASSERT_EQ(client.peerAddressLength(), 0u);
+			ASSERT_FALSE(client.checkSockAddr(reinterpret_cast < const struct sockaddr* > (&worker->localAddress()), worker->localAddressLength()));
+
+			eventLoop.stop();
+			serverThread.join();
+		}
+
+#ifndef _WIN32
+		static int getIntSocketOption(int fd, int level, int name)
+		{
+			int value = -1;
+			socklen_t len = sizeof(value);
+			getsockopt(fd, level, name, &value, &len);
+			return value;
+		}
+
+		TEST(communication, inherited_options_test)
+		{
+			static const unsigned int port = 22231;
+			static const size_t clientCount = 3;
+			hbk::communication::SocketOptions options;
+			options.keepAliveIdle = std::chrono::seconds(7);
+			options.userTimeout = std::chrono::milliseconds(3000);
+			options.priority = 2;
+
+			hbk::sys::EventLoop eventLoop;
+			hbk::communication::TcpServer tcpServer(eventLoop);
+			std::mutex mtx;
+			std::vector < clientSocket_t > workers;
+			std::promise < void > acceptPromise;
+			int result = tcpServer.start(port, 8, [&](clientSocket_t clientSocket) {
+				std::lock_guard < std::mutex > lock(mtx);
+				workers.push_back(std::move(clientSocket));
+				if (workers.size()==clientCount) {
+					acceptPromise.set_value();
+				}
+			}, options);
+			ASSERT_EQ(result, 0);
+
+			// connections are waiting in the accept queue before the event loop runs, they are accepted in one go
+			hbk::sys::EventLoop clientEventLoop;
+			std::vector < std::unique_ptr < hbk::communication::SocketNonblocking > > clients;
+			for (size_t count = 0; count<clientCount; ++count) {
+				std::unique_ptr < hbk::communication::SocketNonblocking > client(new hbk::communication::SocketNonblocking(clientEventLoop));
+				ASSERT_EQ(client->connect(server, std::to_string(port)), 0);
+				clients.push_back(std::move(client));
+			}
+			std::thread serverThread(std::bind(&hbk::sys::EventLoop::execute, std::ref(eventLoop)));
+			ASSERT_EQ(acceptPromise.get_future().wait_for(std::chrono::seconds(2)), std::future_status::ready);
+			eventLoop.stop();
+			serverThread.join();
+
+			// taken over from the listening socket instead of being set for each worker
+			for (const auto &iter: workers) {
+				int fd = iter->getEvent();
+				ASSERT_TRUE(fcntl(fd, F_GETFL) & O_NONBLOCK);
+				ASSERT_TRUE(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+				ASSERT_EQ(getIntSocketOption(fd, IPPROTO_TCP, TCP_NODELAY), 1);
+				ASSERT_EQ(getIntSocketOption(fd, SOL_SOCKET, SO_KEEPALIVE), 1);
+				ASSERT_EQ(getIntSocketOption(fd, IPPROTO_TCP, TCP_KEEPIDLE), 7);
+				ASSERT_EQ(getIntSocketOption(fd, IPPROTO_TCP, TCP_USER_TIMEOUT), 3000);
+				ASSERT_EQ(getIntSocketOption(fd, SOL_SOCKET, SO_PRIORITY), 2);
+			}
+
+			const hbk::communication::TcpServer::AcceptStats& stats = tcpServer.getAcceptStats();
+			ASSERT_EQ(stats.accepted, clientCount);
+			ASSERT_GE(stats.wakeups, 1u);
+			ASSERT_EQ(stats.maxAcceptedPerWakeup, clientCount);
+			ASSERT_EQ(stats.fileLimitCount, 0u);
+			ASSERT_GE(hbk::communication::TcpServer::getListenOverflowCount(), 0);
+		}
+
+		TEST(communication, file_limit_test)
+		{
+			static const unsigned int port = 22232;
+			hbk::sys::EventLoop eventLoop;
+			hbk::communication::TcpServer tcpServer(eventLoop);
+			int result = tcpServer.start(port, 8, [](clientSocket_t) {});
+			ASSERT_EQ(result, 0);
+
+			struct sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_port = htons(port);
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			int clientFd = ::socket(AF_INET, SOCK_STREAM, 0);
+			ASSERT_NE(clientFd, -1);
+			struct timeval timeout = { 2, 0 };
+			setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			ASSERT_EQ(::connect(clientFd, reinterpret_cast < struct sockaddr* > (&address), sizeof(address)), 0);
+
+			// no file descriptor left for accepting
+			struct rlimit limit;
+			ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &limit), 0);
+			struct rlimit lowLimit = limit;
+			int lowestFreeFd = dup(clientFd);
+			ASSERT_NE(lowestFreeFd, -1);
+			::close(lowestFreeFd);
+			lowLimit.rlim_cur = static_cast < rlim_t > (lowestFreeFd);
+			ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &lowLimit), 0);
+
+			std::thread serverThread(std::bind(&hbk::sys::EventLoop::execute, std::ref(eventLoop)));
+			// the connection is accepted and closed instead of waiting forever in the backlog
+			char byte;
+			ssize_t received = ::recv(clientFd, &byte, sizeof(byte), 0);
+			eventLoop.stop();
+			serverThread.join();
+			setrlimit(RLIMIT_NOFILE, &limit);
+			::close(clientFd);
+
+			ASSERT_EQ(received, 0);
+			const hbk::communication::TcpServer::AcceptStats& stats = tcpServer.getAcceptStats();
+			ASSERT_GE(stats.fileLimitCount, 1u);
+			ASSERT_EQ(stats.accepted, 0u);
+		}
+
+		TEST(communication, stop_from_accept_callback_test)
+		{
+			static const unsigned int port = 22233;
+			static const size_t clientCount = 3;
+			hbk::sys::EventLoop eventLoop;
+			hbk::communication::TcpServer tcpServer(eventLoop);
+			std::promise < void > acceptPromise;
+			int result = tcpServer.start(port, 8, [&](clientSocket_t) {
+				tcpServer.stop();
+				acceptPromise.set_value();
+			});
+			ASSERT_EQ(result, 0);
+
+			hbk::sys::EventLoop clientEventLoop;
+			std::vector < std::unique_ptr < hbk::communication::SocketNonblocking > > clients;
+			for (size_t count = 0; count<clientCount; ++count) {
+				std::unique_ptr < hbk::communication::SocketNonblocking > client(new hbk::communication::SocketNonblocking(clientEventLoop));
+				ASSERT_EQ(client->connect(server, std::to_string(port)), 0);
+				clients.push_back(std::move(client));
+			}
+			std::thread serverThread(std::bind(&hbk::sys::EventLoop::execute, std::ref(eventLoop)));
+			ASSERT_EQ(acceptPromise.get_future().wait_for(std::chrono::seconds(2)), std::future_status::ready);
+			eventLoop.stop();
+			serverThread.join();
+
+			// no further accept on the closed listening socket
+			ASSERT_EQ(tcpServer.getAcceptStats().accepted, 1u);
+		}
+#endif
+
+		TEST_F(serverFixture, write_coalescing_test)
+		{
+			ssize_t result;
+			static const char msg[] = "0123456789";
+			static const size_t messageCount = 10;
+			char response[1024];
+
+			start();
+
+			hbk::communication::SocketNonblocking client(m_eventloop);
+			result = client.connect(server, std::to_string(PORT));
+			ASSERT_EQ(result, 0) << strerror(errno);
+			client.setWriteCoalescing(1024);
+			ASSERT_EQ(client.getWriteCoalescing(), 1024u);
+
+			// not within an event callback: sent immediately
+			result = client.sendBlock(msg, sizeof(msg)-1, false);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)-1));
+			ASSERT_EQ(client.transportStats().coalescedWrites, 0u);
+			result = client.receiveComplete(response, sizeof(msg)-1, 1000);
+			ASSERT_EQ(result, static_cast < ssize_t > (sizeof(msg)-1));
+
+			// within an event callback: collected and sent at the end of the event loop iteration
+			std::promise < uint64_t > collected;
+			hbk::sys::Timer timer(m_eventloop);
+			timer.set(std::chrono::milliseconds(1), false, [&](bool fired)
+			{
+				if (fired) {
+					for (size_t index = 0; index<messageCount; ++index) {
+						client.send(msg, sizeof(msg)-1, false);
+					}
+					collected.set_value(client.transportStats().bytesSent);
+				}
+			});
+			std::future < uint64_t > collectedFuture = collected.get_future();
+			ASSERT_EQ(collectedFuture.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+			// nothing was sent by the send calls themselves
+			ASSERT_EQ(collectedFuture.get(), sizeof(msg)-1);
+
+			result = client.receiveComplete(response, messageCount*(sizeof(msg)-1), 1000);
+			ASSERT_EQ(result, static_cast < ssize_t > (messageCount*(sizeof(msg)-1)));
+			ASSERT_EQ(std::string(response, sizeof(msg)-1), std::string(msg));
+			ASSERT_EQ(client.transportStats().coalescedWrites, messageCount);
+
+			// nothing left to send
+			result = client.flush();
+			ASSERT_EQ(result, 0);
+			client.disconnect();
+		}
+
 		TEST_F(serverFixture, sendblock_recvblock_test)
 			{
 				ssize_t result;
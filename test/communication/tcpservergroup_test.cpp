@@ -0,0 +1,307 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/tcpservergroup.h"
+#include "hbk/sys/eventloop.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			static const uint16_t port = 22230;
+			static const size_t loopCount = 2;
+
+			TEST(tcpservergroup, invalid_event_loops)
+			{
+				std::vector < sys::EventLoop* > eventLoops;
+				ASSERT_THROW(TcpServerGroup group(eventLoops), std::invalid_argument);
+				eventLoops.push_back(nullptr);
+				ASSERT_THROW(TcpServerGroup group(eventLoops), std::invalid_argument);
+			}
+
+			/// Executes each event loop in a thread of its own. The thread ids are known before any loop executes.
+			class LoopThreads {
+			public:
+				LoopThreads(sys::EventLoop* pEventLoops, size_t count)
+					: m_pEventLoops(pEventLoops)
+					, m_go()
+					, m_threads()
+					, m_threadIds()
+					, m_running(false)
+				{
+					std::shared_future < void > go = m_go.get_future().share();
+					for (size_t index = 0; index<count; ++index) {
+						sys::EventLoop* pEventLoop = &m_pEventLoops[index];
+						m_threads.push_back(std::thread([go, pEventLoop]() {
+							go.wait();
+							pEventLoop->execute();
+						}));
+						m_threadIds.push_back(m_threads.back().get_id());
+					}
+				}
+
+				~LoopThreads()
+				{
+					stop();
+				}
+
+				/// let the event loops execute
+				void run()
+				{
+					if (!m_running) {
+						m_running = true;
+						m_go.set_value();
+					}
+				}
+
+				void stop()
+				{
+					run();
+					for (size_t index = 0; index<m_threads.size(); ++index) {
+						if (m_threads[index].joinable()) {
+							m_pEventLoops[index].stop();
+							m_threads[index].join();
+						}
+					}
+				}
+
+				/// \return index of the event loop executed by the calling thread, the number of loops if there is none
+				size_t getIndex() const
+				{
+					for (size_t index = 0; index<m_threadIds.size(); ++index) {
+						if (std::this_thread::get_id()==m_threadIds[index]) {
+							return index;
+						}
+					}
+					return m_threadIds.size();
+				}
+
+			private:
+				sys::EventLoop* m_pEventLoops;
+				std::promise < void > m_go;
+				std::vector < std::thread > m_threads;
+				/// not changed after construction, hence read without lock
+				std::vector < std::thread::id > m_threadIds;
+				bool m_running;
+			};
+
+			/// accepted workers and the number accepted by each event loop
+			struct AcceptCounter {
+				AcceptCounter()
+					: mtx()
+					, workers()
+					, counts(loopCount+1, 0)
+				{
+				}
+
+				/// \return number of accepted workers after all expected arrived or the time is up
+				size_t waitFor(size_t expected)
+				{
+					for (unsigned int retry = 0; retry<100; ++retry) {
+						{
+							std::lock_guard < std::mutex > lock(mtx);
+							if (workers.size()>=expected) {
+								break;
+							}
+						}
+						std::this_thread::sleep_for(std::chrono::milliseconds(10));
+					}
+					std::lock_guard < std::mutex > lock(mtx);
+					return workers.size();
+				}
+
+				std::mutex mtx;
+				std::vector < clientSocket_t > workers;
+				/// the last one counts accepts by threads that execute none of the event loops
+				std::vector < size_t > counts;
+			};
+
+			TEST(tcpservergroup, distribute)
+			{
+				static const size_t clientCount = 32;
+
+				sys::EventLoop eventLoops[loopCount];
+				std::vector < sys::EventLoop* > pEventLoops;
+				for (auto &iter: eventLoops) {
+					pEventLoops.push_back(&iter);
+				}
+
+				LoopThreads threads(eventLoops, loopCount);
+				AcceptCounter counter;
+
+				TcpServerGroup group(pEventLoops);
+				ASSERT_EQ(group.getListenerCount(), loopCount);
+				ASSERT_EQ(group.getPort(), 0);
+				// nothing to attach to yet
+				ASSERT_EQ(group.setCpuSteering(), -1);
+
+				int result = group.start(port, 64, [&](clientSocket_t worker) {
+					std::lock_guard < std::mutex > lock(counter.mtx);
+					++counter.counts[threads.getIndex()];
+					counter.workers.push_back(std::move(worker));
+				});
+				ASSERT_EQ(result, 0);
+				ASSERT_EQ(group.getPort(), port);
+				// already started
+				ASSERT_EQ(group.start(port, 64, [](clientSocket_t) {}), -1);
+
+				// A = random number
+				// A = A % number of listeners
+				// return A
+				std::vector < struct sock_filter > program = {
+					{ BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast < uint32_t > (SKF_AD_OFF + SKF_AD_RANDOM) },
+					{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast < uint32_t > (loopCount) },
+					{ BPF_RET | BPF_A, 0, 0, 0 }
+				};
+				ASSERT_EQ(group.setSteeringProgram(program), 0);
+				threads.run();
+
+				sys::EventLoop clientEventLoop;
+				std::vector < std::unique_ptr < SocketNonblocking > > clients;
+				for (size_t count = 0; count<clientCount; ++count) {
+					std::unique_ptr < SocketNonblocking > client(new SocketNonblocking(clientEventLoop));
+					ASSERT_EQ(client->connect("127.0.0.1", std::to_string(port)), 0);
+					clients.push_back(std::move(client));
+				}
+
+				size_t acceptedCount = counter.waitFor(clientCount);
+				threads.stop();
+
+				// every client was accepted by exactly one of the listeners, each by the thread of its event loop
+				ASSERT_EQ(acceptedCount, clientCount);
+				ASSERT_EQ(counter.counts[loopCount], 0u);
+				// all loops got some. Failing by chance is as likely as 32 coin tosses alike.
+				size_t sum = 0;
+				for (size_t index = 0; index<loopCount; ++index) {
+					ASSERT_GT(counter.counts[index], 0u) << "event loop " << index;
+					sum += counter.counts[index];
+				}
+				ASSERT_EQ(sum, clientCount);
+
+				group.stop();
+				ASSERT_EQ(group.getPort(), 0);
+				counter.workers.clear();
+			}
+
+			TEST(tcpservergroup, cpu_steering)
+			{
+				static const size_t clientsPerCpu = 8;
+
+				cpu_set_t originalCpus;
+				ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(originalCpus), &originalCpus), 0);
+				std::vector < size_t > cpus;
+				for (size_t cpu = 0; cpu<loopCount; ++cpu) {
+					if (CPU_ISSET(cpu, &originalCpus)) {
+						cpus.push_back(cpu);
+					}
+				}
+				if (cpus.empty()) {
+					GTEST_SKIP() << "none of the first " << loopCount << " CPUs is available";
+				}
+
+				sys::EventLoop eventLoops[loopCount];
+				std::vector < sys::EventLoop* > pEventLoops;
+				for (auto &iter: eventLoops) {
+					pEventLoops.push_back(&iter);
+				}
+
+				LoopThreads threads(eventLoops, loopCount);
+				AcceptCounter counter;
+
+				TcpServerGroup group(pEventLoops);
+				ASSERT_EQ(group.start(0, 64, [&](clientSocket_t worker) {
+					std::lock_guard < std::mutex > lock(counter.mtx);
+					++counter.counts[threads.getIndex()];
+					counter.workers.push_back(std::move(worker));
+				}), 0);
+				ASSERT_EQ(group.setCpuSteering(), 0);
+				threads.run();
+
+				// on loopback, the connection request is processed by the CPU of the connecting thread
+				sys::EventLoop clientEventLoop;
+				std::vector < std::unique_ptr < SocketNonblocking > > clients;
+				for (auto cpu: cpus) {
+					cpu_set_t cpuSet;
+					CPU_ZERO(&cpuSet);
+					CPU_SET(cpu, &cpuSet);
+					ASSERT_EQ(pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet), 0);
+					for (size_t count = 0; count<clientsPerCpu; ++count) {
+						std::unique_ptr < SocketNonblocking > client(new SocketNonblocking(clientEventLoop));
+						ASSERT_EQ(client->connect("127.0.0.1", std::to_string(group.getPort())), 0);
+						clients.push_back(std::move(client));
+					}
+				}
+				pthread_setaffinity_np(pthread_self(), sizeof(originalCpus), &originalCpus);
+
+				size_t acceptedCount = counter.waitFor(cpus.size()*clientsPerCpu);
+				threads.stop();
+
+				ASSERT_EQ(acceptedCount, cpus.size()*clientsPerCpu);
+				// each CPU steered all of its connections to the listener of the same index
+				for (size_t index = 0; index<loopCount; ++index) {
+					size_t expected = 0;
+					for (auto cpu: cpus) {
+						if (cpu==index) {
+							expected = clientsPerCpu;
+						}
+					}
+					ASSERT_EQ(counter.counts[index], expected) << "event loop " << index;
+				}
+				group.stop();
+				counter.workers.clear();
+			}
+
+			TEST(tcpservergroup, any_port)
+			{
+				sys::EventLoop eventLoops[loopCount];
+				std::vector < sys::EventLoop* > pEventLoops;
+				for (auto &iter: eventLoops) {
+					pEventLoops.push_back(&iter);
+				}
+				TcpServerGroup group(pEventLoops);
+				ASSERT_EQ(group.start(0, 8, [](clientSocket_t) {}), 0);
+				uint16_t chosenPort = group.getPort();
+				ASSERT_NE(chosenPort, 0);
+
+				// connection is established by the kernel, even if the event loops are not running
+				sys::EventLoop clientEventLoop;
+				SocketNonblocking client(clientEventLoop);
+				ASSERT_EQ(client.connect("127.0.0.1", std::to_string(chosenPort)), 0);
+			}
+		}
+	}
+}
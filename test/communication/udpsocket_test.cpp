@@ -0,0 +1,148 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/udpsocket.h"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			TEST(udpsocket, batch_send_receive)
+			{
+				static const unsigned int datagramCount = 20;
+				sys::EventLoop eventLoop;
+				UdpSocket receiver(eventLoop, 8);
+				UdpSocket sender(eventLoop, 8);
+				ASSERT_EQ(receiver.bind("127.0.0.1", 0), 0);
+				ASSERT_EQ(sender.bind("127.0.0.1", 0), 0);
+				ASSERT_NE(receiver.getPort(), 0u);
+
+				struct sockaddr_storage destination;
+				socklen_t destinationLength;
+				ASSERT_EQ(UdpSocket::makeAddress("127.0.0.1", receiver.getPort(), destination, destinationLength), 0);
+
+				std::vector < std::string > messages;
+				for (unsigned int i = 0; i<datagramCount; ++i) {
+					messages.push_back("datagram " + std::to_string(i));
+				}
+
+				unsigned int sentCount = 0;
+				while (sentCount<datagramCount) {
+					while ((sentCount+sender.getQueuedCount()<datagramCount) && (sender.getQueuedCount()<8)) {
+						const std::string& message = messages[sentCount+sender.getQueuedCount()];
+						ASSERT_GT(sender.queue(message.c_str(), message.length(), reinterpret_cast < struct sockaddr* > (&destination), destinationLength), 0);
+					}
+					// batch is full
+					if (sender.getQueuedCount()==8) {
+						ASSERT_EQ(sender.queue("x", 1, reinterpret_cast < struct sockaddr* > (&destination), destinationLength), -1);
+					}
+					int result = sender.flush();
+					ASSERT_GT(result, 0);
+					sentCount += static_cast < unsigned int > (result);
+				}
+				ASSERT_EQ(sender.getQueuedCount(), 0u);
+
+				std::vector < std::string > received;
+				receiver.setDataCb([&](UdpSocket& socket) -> ssize_t {
+					int count = socket.receive();
+					for (int i = 0; i<count; ++i) {
+						const UdpSocket::Datagram& datagram = socket.getDatagram(static_cast < unsigned int > (i));
+						EXPECT_FALSE(datagram.truncated);
+						EXPECT_EQ(datagram.addressLength, sizeof(struct sockaddr_in));
+						const struct sockaddr_in* pSource = reinterpret_cast < const struct sockaddr_in* > (datagram.pAddress);
+						EXPECT_EQ(ntohs(pSource->sin_port), sender.getPort());
+						received.push_back(std::string(reinterpret_cast < const char* > (datagram.pData), datagram.size));
+					}
+					if (received.size()==datagramCount) {
+						eventLoop.stop();
+					}
+					return count;
+				});
+
+				sys::Timer timeout(eventLoop);
+				timeout.set(2000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+				ASSERT_EQ(received, messages);
+			}
+
+			TEST(udpsocket, truncated_and_reply)
+			{
+				sys::EventLoop eventLoop;
+				UdpSocket receiver(eventLoop, 4, 4);
+				UdpSocket sender(eventLoop);
+				ASSERT_EQ(receiver.bind("127.0.0.1", 0), 0);
+				ASSERT_EQ(sender.bind("127.0.0.1", 0), 0);
+
+				ASSERT_EQ(receiver.receive(), -1);
+				ASSERT_EQ(errno, EAGAIN);
+
+				struct sockaddr_storage destination;
+				socklen_t destinationLength;
+				ASSERT_EQ(UdpSocket::makeAddress("127.0.0.1", receiver.getPort(), destination, destinationLength), 0);
+				ASSERT_EQ(sender.sendTo("0123456789", 10, reinterpret_cast < struct sockaddr* > (&destination), destinationLength), 10);
+
+				int count;
+				do {
+					count = receiver.receive();
+				} while ((count==-1) && (errno==EAGAIN));
+				ASSERT_EQ(count, 1);
+				const UdpSocket::Datagram& datagram = receiver.getDatagram(0);
+				ASSERT_TRUE(datagram.truncated);
+				ASSERT_EQ(std::string(reinterpret_cast < const char* > (datagram.pData), datagram.size), "0123");
+
+				// answer to the source of the datagram
+				ASSERT_EQ(receiver.sendTo("ok", 2, datagram.pAddress, datagram.addressLength), 2);
+				do {
+					count = sender.receive();
+				} while ((count==-1) && (errno==EAGAIN));
+				ASSERT_EQ(count, 1);
+				ASSERT_EQ(sender.getDatagram(0).size, 2u);
+			}
+
+			TEST(udpsocket, invalid)
+			{
+				sys::EventLoop eventLoop;
+				ASSERT_THROW(UdpSocket(eventLoop, 0), std::runtime_error);
+				UdpSocket socket(eventLoop);
+				ASSERT_EQ(socket.bind("no address", 0), -1);
+				ASSERT_EQ(socket.getPort(), 0u);
+				ASSERT_EQ(socket.bind("::1", 0), 0);
+				ASSERT_NE(socket.getPort(), 0u);
+				ASSERT_EQ(socket.bind("::1", 0), -1);
+				socket.close();
+				ASSERT_EQ(socket.getEvent(), -1);
+			}
+		}
+	}
+}
@@ -0,0 +1,216 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/bufferchain.h"
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/tcpserver.h"
+#include "hbk/communication/uring.h"
+#include "hbk/exception/exception.hpp"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			static const uint16_t PORT = 22224;
+
+			/// \return true if the running kernel is expected to support multishot receive into a buffer ring
+			static bool isUringExpected()
+			{
+#ifdef HBK_HAVE_IO_URING
+				struct utsname name;
+				if (uname(&name)!=0) {
+					return false;
+				}
+				unsigned int major = 0;
+				unsigned int minor = 0;
+				if (sscanf(name.release, "%u.%u", &major, &minor)!=2) {
+					return false;
+				}
+				if (major<6) {
+					return false;
+				}
+				// io_uring might be turned off by the administrator
+				FILE* pFile = fopen("/proc/sys/kernel/io_uring_disabled", "r");
+				if (pFile) {
+					int disabled = 0;
+					if (fscanf(pFile, "%d", &disabled)!=1) {
+						disabled = 0;
+					}
+					fclose(pFile);
+					if (disabled!=0) {
+						return false;
+					}
+				}
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			TEST(uring, multishot_receive)
+			{
+				if (isUringExpected()) {
+					ASSERT_TRUE(Uring::isSupported());
+				} else if (!Uring::isSupported()) {
+					GTEST_SKIP() << "io_uring with multishot receive is not available";
+				}
+				static const unsigned int bufferCount = 4;
+				static const size_t bufferSize = 64;
+				sys::EventLoop eventLoop;
+				Uring uring(eventLoop, 8, bufferCount, bufferSize);
+				ASSERT_EQ(uring.getBufferSize(), bufferSize);
+				ASSERT_EQ(uring.getProvidedBufferCount(), bufferCount);
+
+				int fds[2];
+				ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+				SocketNonblocking socket(fds[0], eventLoop);
+
+				// more than all buffers together
+				std::string message;
+				for (unsigned int i = 0; i<100; ++i) {
+					message += std::to_string(i) + ",";
+				}
+				ASSERT_GT(message.length(), bufferCount*bufferSize);
+				ASSERT_EQ(::write(fds[1], message.c_str(), message.length()), static_cast < ssize_t > (message.length()));
+				::close(fds[1]);
+
+				std::string received;
+				BufferChain held;
+				bool closed = false;
+				sys::Timer releaseTimer(eventLoop);
+				int result = socket.setDataCb(uring, [&](SocketNonblocking&, const BufferSlice& data)
+				{
+					if (data.size==0) {
+						closed = true;
+						eventLoop.stop();
+						return;
+					}
+					held.append(data);
+					if (held.getSlices().size()==bufferCount) {
+						// all buffers are held by us. Receiving continues after giving them back.
+						ASSERT_EQ(uring.getProvidedBufferCount(), 0u);
+						releaseTimer.set(std::chrono::milliseconds(10), false, [&](bool)
+						{
+							std::vector < char > text(held.size());
+							held.copyOut(0, text.data(), text.size());
+							received.append(text.data(), text.size());
+							held.clear();
+						});
+					}
+				});
+				ASSERT_EQ(result, 0);
+
+				sys::Timer timeout(eventLoop);
+				timeout.set(std::chrono::milliseconds(2000), false, [&](bool fired)
+				{
+					if (fired) {
+						eventLoop.stop();
+					}
+				});
+				eventLoop.execute();
+
+				ASSERT_TRUE(closed);
+				std::vector < char > text(held.size());
+				held.copyOut(0, text.data(), text.size());
+				received.append(text.data(), text.size());
+				held.clear();
+				ASSERT_EQ(received, message);
+				ASSERT_EQ(socket.transportStats().bytesReceived, message.length());
+				ASSERT_EQ(uring.getProvidedBufferCount(), bufferCount);
+			}
+
+			TEST(uring, multishot_accept)
+			{
+				static const char message[] = "hello";
+				static const size_t clientCount = 3;
+				sys::EventLoop eventLoop;
+				// accepting does not depend on receive buffers, hence isSupported() is not required here
+				std::unique_ptr < Uring > uring;
+				try {
+					uring.reset(new Uring(eventLoop));
+				} catch (const hbk::exception::exception& e) {
+					GTEST_SKIP() << e.what();
+				}
+
+				std::vector < clientSocket_t > workers;
+				std::string received;
+				TcpServer server(eventLoop);
+				server.setUring(*uring);
+				int result = server.start(PORT, 8, [&](clientSocket_t worker)
+				{
+					worker->setDataCb([&](SocketNonblocking& socket)
+					{
+						char buffer[64];
+						ssize_t result;
+						do {
+							result = socket.receive(buffer, sizeof(buffer));
+							if (result>0) {
+								received.append(buffer, static_cast < size_t > (result));
+							}
+						} while (result>0);
+						if (received.length()==clientCount*(sizeof(message)-1)) {
+							eventLoop.stop();
+						}
+						return result;
+					});
+					workers.push_back(std::move(worker));
+				});
+				ASSERT_EQ(result, 0);
+
+				std::vector < std::unique_ptr < SocketNonblocking > > clients;
+				for (size_t i = 0; i<clientCount; ++i) {
+					clients.emplace_back(new SocketNonblocking(eventLoop));
+					ASSERT_EQ(clients.back()->connect("127.0.0.1", std::to_string(PORT)), 0);
+					ASSERT_EQ(clients.back()->sendBlock(message, sizeof(message)-1, false), static_cast < ssize_t > (sizeof(message)-1));
+				}
+
+				sys::Timer timeout(eventLoop);
+				timeout.set(std::chrono::milliseconds(2000), false, [&](bool fired)
+				{
+					if (fired) {
+						eventLoop.stop();
+					}
+				});
+				eventLoop.execute();
+
+				ASSERT_EQ(workers.size(), clientCount);
+				ASSERT_EQ(received, "hellohellohello");
+				workers.clear();
+				server.stop();
+			}
+		}
+	}
+}
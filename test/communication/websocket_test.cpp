@@ -0,0 +1,349 @@
+// This code is licenced under the MIT license:
+// 
+// Copyright (c) 2024 Hottinger Brüel & Kjær
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "hbk/communication/socketnonblocking.h"
+#include "hbk/communication/tcpserver.h"
+#include "hbk/communication/websocket.h"
+#include "hbk/sys/eventloop.h"
+#include "hbk/sys/timer.h"
+
+namespace hbk {
+	namespace communication {
+		namespace test {
+			static const uint16_t PORT = 22229;
+
+			/// echoes text and binary messages
+			class EchoServer {
+			public:
+				EchoServer(sys::EventLoop& eventLoop)
+					: m_server(eventLoop)
+					, m_webSockets()
+					, m_closeCode(0)
+				{
+					if (m_server.start(PORT, 8, std::bind(&EchoServer::acceptCb, this, std::placeholders::_1))<0) {
+						throw std::runtime_error("could not start tcp server");
+					}
+				}
+
+				uint16_t getCloseCode() const
+				{
+					return m_closeCode;
+				}
+
+			private:
+				void acceptCb(clientSocket_t worker)
+				{
+					std::unique_ptr < WebSocket > webSocket(new WebSocket(std::move(worker)));
+					webSocket->setMessageCb([](WebSocket& ws, WebSocket::Opcode opcode, const BufferSlice& payload) {
+						ws.send(opcode, payload.pData, payload.size);
+					});
+					webSocket->setCloseCb([this](WebSocket&, uint16_t code) {
+						m_closeCode = code;
+					});
+					webSocket->start();
+					m_webSockets.push_back(std::move(webSocket));
+				}
+
+				TcpServer m_server;
+				std::vector < std::unique_ptr < WebSocket > > m_webSockets;
+				uint16_t m_closeCode;
+			};
+
+			TEST(websocket, mask)
+			{
+				static const uint8_t key[4] = { 0x12, 0x34, 0x56, 0x78 };
+				std::cout << "masking with " << WebSocket::getMaskerName() << std::endl;
+
+				uint8_t source[300];
+				for (size_t index = 0; index<sizeof(source); ++index) {
+					source[index] = static_cast < uint8_t > (index*7);
+				}
+				// all remainders and unaligned start positions
+				for (size_t offset = 0; offset<4; ++offset) {
+					for (size_t size = 0; size<sizeof(source)-offset; size += 7) {
+						uint8_t masked[sizeof(source)];
+						WebSocket::mask(masked, source+offset, size, key);
+						for (size_t index = 0; index<size; ++index) {
+							ASSERT_EQ(masked[index], source[offset+index] ^ key[index & 3]);
+						}
+						// in place, masking twice restores
+						WebSocket::mask(masked, masked, size, key);
+						ASSERT_EQ(memcmp(masked, source+offset, size), 0);
+					}
+				}
+			}
+
+			TEST(websocket, accept_key)
+			{
+				// example from RFC 6455
+				ASSERT_EQ(WebSocket::acceptKey("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+			}
+
+			TEST(websocket, utf8)
+			{
+				static const char* valid[] = {
+					"",
+					"plain ascii",
+					"\xc3\xa4\xc3\xb6\xc3\xbc",
+					"\xe2\x82\xac",
+					"\xed\x9f\xbf",
+					"\xf0\x9f\x98\x80",
+					"\xf4\x8f\xbf\xbf"
+				};
+				static const char* invalid[] = {
+					// lonely continuation byte
+					"\x80",
+					// overlong forms
+					"\xc0\xaf",
+					"\xe0\x80\xaf",
+					"\xf0\x80\x80\xaf",
+					// surrogate
+					"\xed\xa0\x80",
+					// above U+10FFFF
+					"\xf4\x90\x80\x80",
+					"\xff",
+					// truncated
+					"\xe2\x82",
+					"\xc3\x28"
+				};
+				for (const char* pText: valid) {
+					ASSERT_TRUE(WebSocket::isValidUtf8(reinterpret_cast < const uint8_t* > (pText), strlen(pText))) << pText;
+				}
+				for (const char* pText: invalid) {
+					ASSERT_FALSE(WebSocket::isValidUtf8(reinterpret_cast < const uint8_t* > (pText), strlen(pText))) << pText;
+				}
+			}
+
+			TEST(websocket, echo)
+			{
+				sys::EventLoop eventLoop;
+				EchoServer server(eventLoop);
+
+				std::string text = "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [42, 23], \"id\": 1}";
+				// larger than a receive block, hence spread over several blocks
+				std::vector < uint8_t > binary(100000);
+				for (size_t index = 0; index<binary.size(); ++index) {
+					binary[index] = static_cast < uint8_t > (index);
+				}
+
+				std::vector < std::string > received;
+				std::vector < WebSocket::Opcode > opcodes;
+				uint16_t closeCode = 0;
+				bool opened = false;
+
+				WebSocket client(eventLoop);
+				client.setOpenCb([&](WebSocket& ws) {
+					opened = true;
+					ws.sendText(text);
+					ws.sendBinary(binary.data(), binary.size());
+					// fragmented message with a ping in between
+					ws.send(WebSocket::OPCODE_TEXT, "frag", 4, false);
+					ws.ping("ping", 4);
+					ws.send(WebSocket::OPCODE_CONTINUATION, "men", 3, false);
+					ws.send(WebSocket::OPCODE_CONTINUATION, "ted", 3, true);
+				});
+				client.setMessageCb([&](WebSocket& ws, WebSocket::Opcode opcode, const BufferSlice& payload) {
+					opcodes.push_back(opcode);
+					received.push_back(std::string(reinterpret_cast < const char* > (payload.pData), payload.size));
+					if (received.size()==4) {
+						ws.close(WebSocket::CLOSE_NORMAL, "done");
+					}
+				});
+				client.setCloseCb([&](WebSocket&, uint16_t code) {
+					closeCode = code;
+					eventLoop.stop();
+				});
+				ASSERT_EQ(client.connect("127.0.0.1", std::to_string(PORT), "/rpc"), 0);
+
+				sys::Timer timer(eventLoop);
+				timer.set(5000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+
+				ASSERT_TRUE(opened);
+				ASSERT_EQ(received.size(), 4u);
+				ASSERT_EQ(opcodes[0], WebSocket::OPCODE_TEXT);
+				ASSERT_EQ(received[0], text);
+				ASSERT_EQ(opcodes[1], WebSocket::OPCODE_BINARY);
+				ASSERT_EQ(received[1].size(), binary.size());
+				ASSERT_EQ(memcmp(received[1].c_str(), binary.data(), binary.size()), 0);
+				ASSERT_EQ(opcodes[2], WebSocket::OPCODE_PONG);
+				ASSERT_EQ(received[2], "ping");
+				ASSERT_EQ(opcodes[3], WebSocket::OPCODE_TEXT);
+				ASSERT_EQ(received[3], "fragmented");
+				ASSERT_EQ(closeCode, WebSocket::CLOSE_NORMAL);
+				ASSERT_EQ(server.getCloseCode(), WebSocket::CLOSE_NORMAL);
+				ASSERT_FALSE(client.isOpen());
+				ASSERT_EQ(client.sendText(text), -1);
+			}
+
+			TEST(websocket, invalid_text)
+			{
+				sys::EventLoop eventLoop;
+				EchoServer server(eventLoop);
+
+				std::vector < std::string > received;
+				uint16_t closeCode = 0;
+
+				WebSocket client(eventLoop);
+				client.setOpenCb([&](WebSocket& ws) {
+					// the euro sign split over two fragments is fine
+					ws.send(WebSocket::OPCODE_TEXT, "\xe2\x82", 2, false);
+					ws.send(WebSocket::OPCODE_CONTINUATION, "\xac", 1, true);
+				});
+				client.setMessageCb([&](WebSocket& ws, WebSocket::Opcode, const BufferSlice& payload) {
+					received.push_back(std::string(reinterpret_cast < const char* > (payload.pData), payload.size));
+					ws.sendText("\xc3\x28");
+				});
+				client.setCloseCb([&](WebSocket&, uint16_t code) {
+					closeCode = code;
+					eventLoop.stop();
+				});
+				ASSERT_EQ(client.connect("127.0.0.1", std::to_string(PORT)), 0);
+
+				sys::Timer timer(eventLoop);
+				timer.set(5000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+
+				ASSERT_EQ(received.size(), 1u);
+				ASSERT_EQ(received[0], "\xe2\x82\xac");
+				ASSERT_EQ(closeCode, WebSocket::CLOSE_INVALID_PAYLOAD);
+				ASSERT_EQ(server.getCloseCode(), WebSocket::CLOSE_INVALID_PAYLOAD);
+			}
+
+			TEST(websocket, invalid_close_reason)
+			{
+				sys::EventLoop eventLoop;
+				EchoServer server(eventLoop);
+
+				uint16_t closeCode = 0;
+
+				WebSocket client(eventLoop);
+				client.setOpenCb([&](WebSocket& ws) {
+					ws.close(WebSocket::CLOSE_NORMAL, "\xff");
+				});
+				client.setCloseCb([&](WebSocket&, uint16_t code) {
+					closeCode = code;
+					eventLoop.stop();
+				});
+				ASSERT_EQ(client.connect("127.0.0.1", std::to_string(PORT)), 0);
+
+				sys::Timer timer(eventLoop);
+				timer.set(5000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+
+				ASSERT_EQ(closeCode, WebSocket::CLOSE_INVALID_PAYLOAD);
+				ASSERT_EQ(server.getCloseCode(), WebSocket::CLOSE_INVALID_PAYLOAD);
+			}
+
+			TEST(websocket, bad_handshake)
+			{
+				sys::EventLoop eventLoop;
+				EchoServer server(eventLoop);
+
+				SocketNonblocking client(eventLoop);
+				ASSERT_EQ(client.connect("127.0.0.1", std::to_string(PORT)), 0);
+				static const char request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+				ASSERT_EQ(client.sendBlock(request, sizeof(request)-1, false), static_cast < ssize_t > (sizeof(request)-1));
+
+				std::string response;
+				client.setDataCb([&](SocketNonblocking& socket) -> ssize_t {
+					char buffer[256];
+					ssize_t result = socket.receive(buffer, sizeof(buffer));
+					if (result>0) {
+						response.append(buffer, static_cast < size_t > (result));
+					} else if (result==0) {
+						eventLoop.stop();
+					}
+					return result;
+				});
+
+				sys::Timer timer(eventLoop);
+				timer.set(5000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+				ASSERT_EQ(response.compare(0, 13, "HTTP/1.1 400 "), 0);
+			}
+
+			TEST(websocket, unmasked_from_client)
+			{
+				sys::EventLoop eventLoop;
+				EchoServer server(eventLoop);
+
+				SocketNonblocking client(eventLoop);
+				ASSERT_EQ(client.connect("127.0.0.1", std::to_string(PORT)), 0);
+				static const char request[] =
+					"GET / HTTP/1.1\r\n"
+					"Host: localhost\r\n"
+					"Upgrade: websocket\r\n"
+					"Connection: keep-alive, Upgrade\r\n"
+					"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+					"Sec-WebSocket-Version: 13\r\n"
+					"\r\n";
+				// clients have to mask
+				static const uint8_t unmaskedFrame[] = { 0x81, 0x02, 'h', 'i' };
+				ASSERT_EQ(client.sendBlock(request, sizeof(request)-1, false), static_cast < ssize_t > (sizeof(request)-1));
+				ASSERT_EQ(client.sendBlock(unmaskedFrame, sizeof(unmaskedFrame), false), static_cast < ssize_t > (sizeof(unmaskedFrame)));
+
+				std::string response;
+				client.setDataCb([&](SocketNonblocking& socket) -> ssize_t {
+					char buffer[256];
+					ssize_t result = socket.receive(buffer, sizeof(buffer));
+					if (result>0) {
+						response.append(buffer, static_cast < size_t > (result));
+					} else if (result==0) {
+						eventLoop.stop();
+					}
+					return result;
+				});
+
+				sys::Timer timer(eventLoop);
+				timer.set(5000, false, [&](bool) {
+					eventLoop.stop();
+				});
+				eventLoop.execute();
+
+				size_t headEnd = response.find("\r\n\r\n");
+				ASSERT_NE(headEnd, std::string::npos);
+				ASSERT_NE(response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"), std::string::npos);
+				// close frame with protocol error 1002
+				std::string frame = response.substr(headEnd+4);
+				ASSERT_EQ(frame, std::string("\x88\x02\x03\xea", 4));
+				ASSERT_EQ(server.getCloseCode(), WebSocket::CLOSE_PROTOCOL_ERROR);
+			}
+		}
+	}
+}
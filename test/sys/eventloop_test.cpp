@@ -320,6 +320,53 @@ TEST(eventloop, multiple_event_test)
 	ASSERT_EQ(notificationCount, NOTIFIER_COUNT);
 }
 
+TEST(eventloop, iteration_end_handler_test)
+{
+	static const unsigned int NOTIFIER_COUNT = 10;
+	unsigned int notificationCount = 0;
+	unsigned int iterationEndCount = 0;
+	unsigned int notificationCountAtIterationEnd = 0;
+	hbk::sys::EventLoop eventLoop;
+
+	// not within an event callback
+	int result = eventLoop.addIterationEndHandler(&eventLoop, [&iterationEndCount]() { ++iterationEndCount; });
+	ASSERT_EQ(result, -1);
+
+	auto iterationEndCb = [&]()
+	{
+		++iterationEndCount;
+		notificationCountAtIterationEnd = notificationCount;
+	};
+
+	auto notificationCb = [&]()
+	{
+		++notificationCount;
+		// same key: replaces the handler registered before
+		eventLoop.addIterationEndHandler(&eventLoop, iterationEndCb);
+	};
+
+	std::vector < std::unique_ptr < hbk::sys::Notifier > > notifiers;
+	for (unsigned int i=0; i<NOTIFIER_COUNT; ++i) {
+		auto notifier = std::make_unique < hbk::sys::Notifier > (eventLoop);
+		notifier->set(notificationCb);
+		notifier->notify();
+		notifiers.emplace_back(std::move(notifier));
+	}
+
+	std::thread worker(std::bind(&hbk::sys::EventLoop::execute, &eventLoop));
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	eventLoop.stop();
+	worker.join();
+
+	ASSERT_EQ(notificationCount, NOTIFIER_COUNT);
+	ASSERT_GE(iterationEndCount, 1u);
+	ASSERT_EQ(notificationCountAtIterationEnd, NOTIFIER_COUNT);
+#ifndef _WIN32
+	// all pending events are processed in one iteration
+	ASSERT_EQ(iterationEndCount, 1u);
+#endif
+}
+
 TEST(eventloop, oneshottimer_test)
 {
 	static const std::chrono::milliseconds timerCycle(100);